@@ -38,15 +38,8 @@ static std::shared_ptr<VksCompute<> > prepareCompute()
 {
     auto computeShader = std::make_shared<VksShaderProgram>( std::string( "shaders/edgedetect.comp.spv" ) );
     
-    std::vector<VksShaderProgram::DescriptorPoolInfo> descPools;
-    std::vector<VksShaderProgram::UniformLayoutBinding> layoutBindings;
-    
-    descPools.push_back( VksShaderProgram::DescriptorPoolInfo( VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2 ));
-    
-    layoutBindings.push_back( VksShaderProgram::UniformLayoutBinding(0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT) );
-    layoutBindings.push_back( VksShaderProgram::UniformLayoutBinding(1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT) );
-    
-    computeShader->initialize(layoutBindings, descPools, 1);
+    // layouts and pool come from the shader's own SPIR-V
+    computeShader->initialize( 1 );
     
     auto inputTexture = VksTexture::createFromFile("texture1.jpg", VK_IMAGE_USAGE_STORAGE_BIT);
     auto outputTexture = VksTexture::createEmptyTexture(inputTexture->getWidth(), inputTexture->getHeight(), inputTexture->getFormat(), VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
@@ -57,7 +50,7 @@ static std::shared_ptr<VksCompute<> > prepareCompute()
     auto compute = std::make_shared<VksCompute<> >( computeShader );
     
     compute->setComputeInputOutput(inputTexture, outputTexture);
-    compute->prepareCompute(inputTexture->getWidth(), 16, inputTexture->getHeight(), 16);
+    compute->prepareCompute(inputTexture->getWidth(), inputTexture->getHeight());
     
     return compute;
 }
@@ -0,0 +1,106 @@
+#include "VksShaderProgram.hpp"
+#include "VksCompute.hpp"
+#include "VksReadback.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+
+// Runs the edge detect compute shader over both demo images without a window and writes
+// each result, and a crop of its center, to PPM files.
+
+static const char* images[] = { "texture.jpg", "texture1.jpg" };
+
+// rgba rows of rowPitch bytes to a binary PPM, alpha dropped
+static void writePPM( const std::string& path, const std::vector<uint8_t>& rgba, VkExtent2D extent, VkDeviceSize rowPitch )
+{
+    std::ofstream file( path, std::ios::binary );
+    file << "P6\n" << extent.width << " " << extent.height << "\n255\n";
+    std::vector<char> row( extent.width * 3 );
+    for( uint32_t y = 0; y < extent.height; y++ )
+    {
+        const uint8_t* src = rgba.data() + y * rowPitch;
+        for( uint32_t x = 0; x < extent.width; x++ )
+        {
+            row[ x * 3 + 0 ] = src[ x * 4 + 0 ];
+            row[ x * 3 + 1 ] = src[ x * 4 + 1 ];
+            row[ x * 3 + 2 ] = src[ x * 4 + 2 ];
+        }
+        file.write( row.data(), row.size() );
+    }
+}
+
+int headlessDemo()
+{
+    try{
+        auto computeShader = std::make_shared<VksShaderProgram>( std::string( "shaders/edgedetect.comp.spv" ) );
+        computeShader->initialize( 1 );
+
+        auto inputTexture = VksTexture::createFromFile( images[0], VK_IMAGE_USAGE_STORAGE_BIT );
+        auto outputTexture = VksTexture::createEmptyTexture( inputTexture->getWidth(), inputTexture->getHeight(), inputTexture->getFormat(), VK_IMAGE_LAYOUT_GENERAL,
+                                                             VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT );
+
+        computeShader->updateSampler( 0, 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, *inputTexture );
+        computeShader->updateSampler( 0, 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, *outputTexture );
+
+        auto compute = std::make_shared<VksCompute<> >( computeShader );
+        compute->setComputeInputOutput( inputTexture, outputTexture );
+        compute->prepareCompute( inputTexture->getWidth(), inputTexture->getHeight() );
+
+        auto readback = VksReadback::createReadback();
+
+        uint32_t width = outputTexture->getWidth();
+        uint32_t height = outputTexture->getHeight();
+        VkRect2D center = { { static_cast<int32_t>( width / 4 ), static_cast<int32_t>( height / 4 ) }, { width / 2, height / 2 } };
+        // rows padded to 256 bytes, the layout an encoder or another API may ask for
+        VkDeviceSize cropPitch = ( center.extent.width * 4 + 255 ) / 256 * 256;
+
+        // the compute runs on the graphics queue, so readbacks recorded after each submit
+        // are ordered behind it and nothing waits until the results are written out
+        std::vector<std::shared_ptr<VksReadback::Download>> downloads;
+        std::vector<VkSemaphore> waitSemaphores, signalSemaphores;
+        for( int i = 0; i < 2; i++ )
+        {
+            if( i > 0 )
+                inputTexture->updateTexture( images[i] );
+
+            if( compute->getTimeline() )
+            {
+                compute->submitWork();
+            }
+            else
+            {
+                // each submit waits on the semaphore the previous one signaled
+                compute->submitWork( waitSemaphores, signalSemaphores );
+                waitSemaphores = signalSemaphores;
+            }
+
+            downloads.push_back( readback->readTexture( outputTexture ) );
+            downloads.push_back( readback->readTexture( outputTexture, center, cropPitch ) );
+            readback->flush();
+        }
+
+        for( int i = 0; i < 2; i++ )
+        {
+            auto& full = downloads[ i * 2 ];
+            auto& crop = downloads[ i * 2 + 1 ];
+            writePPM( "edges" + std::to_string( i ) + ".ppm", full->wait(), full->getExtent(), full->getRowPitch() );
+            writePPM( "edges" + std::to_string( i ) + "_center.ppm", crop->wait(), crop->getExtent(), crop->getRowPitch() );
+        }
+
+        VksReadback::Statistics stats = readback->getStatistics();
+        std::cout << "read back " << stats.readbacks << " images, " << stats.bytesRead << " bytes, "
+                  << stats.stalls << " stalls" << std::endl;
+    }catch( const std::exception& e )
+    {
+        std::cout << " exception = " << e.what();
+    }
+    return 0;
+}
+
+int main()
+{
+    VkEngine::setHeadless( true );
+    return headlessDemo();
+}
@@ -7,6 +7,7 @@
 #include "VksDepthStencil.hpp"
 #include "VksCommand.hpp"
 #include "VksCompute.hpp"
+#include "VksFrameCapture.hpp"
 #include <memory>
 #include <string>
 #include <glm/glm.hpp>
@@ -114,7 +115,7 @@ static std::shared_ptr<OffScreen> offscreenRender( int width, int height, VkForm
                                         height,
                                         format,
                                         VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                                        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+                                        VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
                                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
                                         VK_IMAGE_ASPECT_COLOR_BIT );
 
@@ -162,6 +163,11 @@ int textureDemo( VksSwapChain& swapChain )
     {
         auto offscreen = offscreenRender( swapChain.getRenderAreaSize().width, swapChain.getRenderAreaSize().height,
                     VK_FORMAT_R8G8B8A8_UNORM );
+
+        // the offscreen pass is already submitted, its PNG is written on a worker thread
+        auto frameCapture = VksFrameCapture::createFrameCapture( VksFrameCapture::Options() );
+        frameCapture->capture( offscreen->offscreenBuffer, "offscreen.png" );
+
         std::shared_ptr<VksShaderProgram> shaderProgram( new VksShaderProgram(
             std::string( "shaders/textureVert.spv" ), std::string( "shaders/textureFrag.spv" ) ) );
 
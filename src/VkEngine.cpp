@@ -2,6 +2,12 @@
 #include <iostream>
 #include <set>
 #include "VksCommand.hpp"
+#include "VksAllocator.hpp"
+#include "VksPipelineCache.hpp"
+#include "VksTimeline.hpp"
+#include "VksSyncPool.hpp"
+#include "VksStagingPool.hpp"
+#include "VksSamplerCache.hpp"
 
 static bool enableValidationLayers = true;
 VkInstance VkEngine::m_instance = VK_NULL_HANDLE;
@@ -10,11 +16,32 @@ VkDevice VkEngine::m_logicDevice = VK_NULL_HANDLE;
 VkSurfaceKHR VkEngine::m_surface = VK_NULL_HANDLE;
 GLFWwindow* VkEngine::m_window = nullptr;
 std::atomic_uint VkEngine::m_subCount = 0;
+uint32_t VkEngine::m_ownedCount = 0;
 VkQueue VkEngine::m_graphicsQueue = VK_NULL_HANDLE;
 VkQueue VkEngine::m_presentQueue = VK_NULL_HANDLE;
+VkQueue VkEngine::m_transferQueue = VK_NULL_HANDLE;
+VkQueue VkEngine::m_computeQueue = VK_NULL_HANDLE;
 QueueFamilyIndices VkEngine::m_familyIndices;
+VkPhysicalDeviceFeatures VkEngine::m_enabledFeatures = {};
 std::shared_ptr<VksCommand> VkEngine::m_graphicCommand = nullptr;
+std::shared_ptr<VksCommand> VkEngine::m_transferCommand = nullptr;
+std::shared_ptr<VksCommand> VkEngine::m_computeCommand = nullptr;
+std::shared_ptr<VksAllocator> VkEngine::m_allocator = nullptr;
+std::shared_ptr<VksSyncPool> VkEngine::m_syncPool = nullptr;
+std::shared_ptr<VksStagingPool> VkEngine::m_stagingPool = nullptr;
+std::shared_ptr<VksSamplerCache> VkEngine::m_samplerCache = nullptr;
+std::shared_ptr<VksPipelineCache> VkEngine::m_pipelineCache = nullptr;
+std::string VkEngine::m_pipelineCacheDirectory;
+uint32_t VkEngine::m_instanceVersion = VK_API_VERSION_1_0;
+bool VkEngine::m_timelineSubmission = true;
+std::mutex VkEngine::m_queueMutexes[4];
+bool VkEngine::m_timelineSemaphore = false;
+bool VkEngine::m_synchronization2 = false;
+std::shared_ptr<VksTimeline> VkEngine::m_graphicsTimeline = nullptr;
+std::shared_ptr<VksTimeline> VkEngine::m_transferTimeline = nullptr;
+std::shared_ptr<VksTimeline> VkEngine::m_computeTimeline = nullptr;
 VkDebugUtilsMessengerEXT VkEngine::m_debugMessenger = VK_NULL_HANDLE;
+bool VkEngine::m_headless = false;
 
 const std::vector<const char*> validationLayers = { "VK_LAYER_LUNARG_standard_validation" };
 
@@ -25,6 +52,15 @@ static void DestroyDebugUtilsMessengerEXT(VkInstance instance, VkDebugUtilsMesse
     }
 }
 
+static bool hasDeviceExtension(const std::vector<VkExtensionProperties>& extensions, const char* name) {
+    for( auto& extension : extensions )
+    {
+        if( strcmp(extension.extensionName, name) == 0 )
+            return true;
+    }
+    return false;
+}
+
 static VkResult CreateDebugUtilsMessengerEXT(VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT* pCreateInfo, const VkAllocationCallbacks* pAllocator, VkDebugUtilsMessengerEXT* pDebugMessenger) {
     auto func = (PFN_vkCreateDebugUtilsMessengerEXT) vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT");
     if (func != nullptr) {
@@ -39,9 +75,11 @@ VkEngine::VkEngine()
     m_subCount.fetch_add(1);
     if( m_instance == VK_NULL_HANDLE )
     {
-        __initWindow();
+        if( !m_headless )
+            __initWindow();
         __createInstance();
-        __createSurface();
+        if( !m_headless )
+            __createSurface();
         __pickPhysicalDevice();
         __createLogicDevice();
     }
@@ -50,20 +88,82 @@ VkEngine::VkEngine()
 VkEngine::~VkEngine()
 {
     m_subCount.fetch_sub(1);
-    if( m_subCount.load() == 1 )
+    if( m_ownedCount > 0 && m_subCount.load() == m_ownedCount )
     {
-        m_graphicCommand.reset();
+        // only the objects the engine owns itself are left
+        __releaseEngineObjects();
     }
     else if( m_subCount.load() == 0 )
     {
         if( m_debugMessenger )
             DestroyDebugUtilsMessengerEXT(m_instance, m_debugMessenger, nullptr);
         vkDestroyDevice( m_logicDevice, nullptr );
-        vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
+        if( m_surface )
+            vkDestroySurfaceKHR(m_instance, m_surface, nullptr);
         vkDestroyInstance( m_instance, nullptr );
-        glfwDestroyWindow(m_window);
-        glfwTerminate();
+        if( m_window )
+        {
+            glfwDestroyWindow(m_window);
+            glfwTerminate();
+        }
+    }
+}
+
+void VkEngine::setHeadless( bool headless )
+{
+    if( m_instance != VK_NULL_HANDLE )
+    {
+        throw std::runtime_error("setHeadless must be called before the engine is created");
+    }
+    m_headless = headless;
+}
+
+bool VkEngine::isHeadless()
+{
+    return m_headless;
+}
+
+void VkEngine::setPipelineCacheDirectory( const std::string& directory )
+{
+    if( m_instance != VK_NULL_HANDLE )
+    {
+        throw std::runtime_error("setPipelineCacheDirectory must be called before the engine is created");
     }
+    m_pipelineCacheDirectory = directory;
+}
+
+void VkEngine::setTimelineSubmission( bool enabled )
+{
+    if( m_instance != VK_NULL_HANDLE )
+    {
+        throw std::runtime_error("setTimelineSubmission must be called before the engine is created");
+    }
+    m_timelineSubmission = enabled;
+}
+
+const VkPhysicalDeviceFeatures& VkEngine::getEnabledFeatures()
+{
+    return m_enabledFeatures;
+}
+
+bool VkEngine::hasTimelineSemaphore()
+{
+    return m_timelineSemaphore;
+}
+
+bool VkEngine::hasSynchronization2()
+{
+    return m_synchronization2;
+}
+
+VksTimeline* VkEngine::getGraphicsTimeline()
+{
+    return m_graphicsTimeline.get();
+}
+
+VkPipelineCache VkEngine::getVkPipelineCache()
+{
+    return m_pipelineCache ? m_pipelineCache->getVkPipelineCache() : VK_NULL_HANDLE;
 }
 
 void VkEngine::__initWindow()
@@ -79,9 +179,13 @@ void VkEngine::__createInstance()
     VkInstanceCreateInfo insInfo = {};
     insInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
 
-    uint32_t glfwExtensionCount = 0;
-    const char**  glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-    std::vector<const char*> extensions(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    std::vector<const char*> extensions;
+    if( !m_headless )
+    {
+        uint32_t glfwExtensionCount = 0;
+        const char**  glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        extensions.assign(glfwExtensions, glfwExtensions + glfwExtensionCount);
+    }
 
     std::vector<const char*> debugExtenstions( extensions.begin(), extensions.end() );
     if( enableValidationLayers )
@@ -95,7 +199,16 @@ void VkEngine::__createInstance()
 
     VkApplicationInfo appInfo = {};
     appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-    appInfo.apiVersion = VK_API_VERSION_1_0;
+    // 1.1 brings vkGetPhysicalDeviceFeatures2, which the timeline and synchronization2
+    // features are queried with; a 1.0 loader has no vkEnumerateInstanceVersion
+    auto enumerateInstanceVersion = (PFN_vkEnumerateInstanceVersion) vkGetInstanceProcAddr(nullptr, "vkEnumerateInstanceVersion");
+    uint32_t loaderVersion = VK_API_VERSION_1_0;
+    if( enumerateInstanceVersion != nullptr )
+    {
+        enumerateInstanceVersion(&loaderVersion);
+    }
+    m_instanceVersion = loaderVersion >= VK_API_VERSION_1_1 ? VK_API_VERSION_1_1 : VK_API_VERSION_1_0;
+    appInfo.apiVersion = m_instanceVersion;
     appInfo.pApplicationName = "VkEngin App";
     appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
     appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0);
@@ -177,6 +290,10 @@ void VkEngine::__pickPhysicalDevice()
 bool VkEngine::__isDeviceSuitable(VkPhysicalDevice device)
 {
     QueueFamilyIndices indices = _findQueueFamily(device);
+    if( m_headless )
+    {
+        return indices.isComplete( false );
+    }
     bool extensionSupport = _checkDeviceExtensionSupport(device);
 
     return indices.isComplete() && extensionSupport;
@@ -218,6 +335,12 @@ QueueFamilyIndices VkEngine::_findQueueFamily(VkPhysicalDevice device)
         {
             indices.graphicsFamily = i;
         }
+        if( m_headless )
+        {
+            if( indices.isComplete( false ) )
+                break;
+            continue;
+        }
         VkBool32 presentSupported = false;
         vkGetPhysicalDeviceSurfaceSupportKHR(device, i, m_surface, &presentSupported);
         if( queueFamily.queueCount > 0 && presentSupported )
@@ -229,6 +352,28 @@ QueueFamilyIndices VkEngine::_findQueueFamily(VkPhysicalDevice device)
             break;
         }
     }
+
+    // dedicated families let uploads and compute overlap with rendering
+    for(i = 0; i < queueFamilyCount; i++)
+    {
+        auto queueFamily = queueFamilies[i];
+        if( queueFamily.queueCount == 0 || queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT )
+            continue;
+
+        if( queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT )
+        {
+            if( !indices.computeFamily.has_value() )
+                indices.computeFamily = i;
+        }
+        else if( queueFamily.queueFlags & VK_QUEUE_TRANSFER_BIT
+                && queueFamily.minImageTransferGranularity.width == 1
+                && queueFamily.minImageTransferGranularity.height == 1 )
+        {
+            // coarser granularities cannot copy arbitrary mip tails and sub-rects
+            if( !indices.transferFamily.has_value() )
+                indices.transferFamily = i;
+        }
+    }
     return indices;
 }
 
@@ -237,21 +382,92 @@ void VkEngine::__createLogicDevice()
     VkDeviceCreateInfo deviceInfo = {};
     deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 
-    deviceInfo.enabledExtensionCount = static_cast<uint32_t>( deviceExtensions.size() );
-    deviceInfo.ppEnabledExtensionNames = deviceExtensions.data();
+    std::vector<const char*> extensions;
+    if( !m_headless )
+    {
+        extensions = deviceExtensions;
+    }
+
+    uint32_t extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties(m_physicalDevice, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(m_physicalDevice, nullptr, &extensionCount, availableExtensions.data());
+
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(m_physicalDevice, &deviceProperties);
+
+    VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineFeatures = {};
+    timelineFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR;
+    VkPhysicalDeviceSynchronization2FeaturesKHR synchronization2Features = {};
+    synchronization2Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_SYNCHRONIZATION_2_FEATURES_KHR;
+
+    m_timelineSemaphore = false;
+    m_synchronization2 = false;
+    if( m_timelineSubmission && m_instanceVersion >= VK_API_VERSION_1_1 && deviceProperties.apiVersion >= VK_API_VERSION_1_1
+        && hasDeviceExtension(availableExtensions, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME) )
+    {
+        bool synchronization2Extension = hasDeviceExtension(availableExtensions, VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME);
+        VkPhysicalDeviceFeatures2 features2 = {};
+        features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+        features2.pNext = &timelineFeatures;
+        if( synchronization2Extension )
+            timelineFeatures.pNext = &synchronization2Features;
+        vkGetPhysicalDeviceFeatures2(m_physicalDevice, &features2);
+
+        // synchronization2 is only used on top of the timeline path
+        m_timelineSemaphore = timelineFeatures.timelineSemaphore == VK_TRUE;
+        m_synchronization2 = m_timelineSemaphore && synchronization2Extension && synchronization2Features.synchronization2 == VK_TRUE;
+    }
+
+    timelineFeatures.pNext = nullptr;
+    if( m_timelineSemaphore )
+    {
+        extensions.push_back( VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME );
+        deviceInfo.pNext = &timelineFeatures;
+    }
+    if( m_synchronization2 )
+    {
+        extensions.push_back( VK_KHR_SYNCHRONIZATION_2_EXTENSION_NAME );
+        synchronization2Features.pNext = nullptr;
+        timelineFeatures.pNext = &synchronization2Features;
+    }
+    deviceInfo.enabledExtensionCount = static_cast<uint32_t>( extensions.size() );
+    deviceInfo.ppEnabledExtensionNames = extensions.empty() ? nullptr : extensions.data();
 
     deviceInfo.enabledLayerCount = static_cast<uint32_t>( validationLayers.size() );
     deviceInfo.ppEnabledLayerNames = validationLayers.data();
 
-    VkPhysicalDeviceFeatures features = {};
-    deviceInfo.pEnabledFeatures = &features;
+    VkPhysicalDeviceFeatures supportedFeatures = {};
+    vkGetPhysicalDeviceFeatures(m_physicalDevice, &supportedFeatures);
+    m_enabledFeatures = {};
+    m_enabledFeatures.pipelineStatisticsQuery = supportedFeatures.pipelineStatisticsQuery;
+    // format-less storage images, used by the compute mipmap downsample
+    m_enabledFeatures.shaderStorageImageReadWithoutFormat = supportedFeatures.shaderStorageImageReadWithoutFormat;
+    m_enabledFeatures.shaderStorageImageWriteWithoutFormat = supportedFeatures.shaderStorageImageWriteWithoutFormat;
+    // BC textures from VksTexture::createFromFile
+    m_enabledFeatures.textureCompressionBC = supportedFeatures.textureCompressionBC;
+    // VksTexture::SamplerOptions::maxAnisotropy
+    m_enabledFeatures.samplerAnisotropy = supportedFeatures.samplerAnisotropy;
+    // sparse residency of VksTiledTexture, which falls back to an atlas without it
+    m_enabledFeatures.sparseBinding = supportedFeatures.sparseBinding;
+    m_enabledFeatures.sparseResidencyImage2D = supportedFeatures.sparseResidencyImage2D;
+    deviceInfo.pEnabledFeatures = &m_enabledFeatures;
 
     m_familyIndices = _findQueueFamily(m_physicalDevice);
 
-    std::set<int> uniqueQueueFamilies = {
-        m_familyIndices.graphicsFamily.value(),
-        m_familyIndices.presentFamily.value()
-    };
+    std::set<int> uniqueQueueFamilies = { m_familyIndices.graphicsFamily.value() };
+    if( m_familyIndices.presentFamily.has_value() )
+    {
+        uniqueQueueFamilies.insert( m_familyIndices.presentFamily.value() );
+    }
+    if( m_familyIndices.transferFamily.has_value() )
+    {
+        uniqueQueueFamilies.insert( m_familyIndices.transferFamily.value() );
+    }
+    if( m_familyIndices.computeFamily.has_value() )
+    {
+        uniqueQueueFamilies.insert( m_familyIndices.computeFamily.value() );
+    }
     std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
 
     float queuePriority = 1.0f;
@@ -270,9 +486,30 @@ void VkEngine::__createLogicDevice()
     VK_CHECK( vkCreateDevice(m_physicalDevice, &deviceInfo, nullptr, &m_logicDevice) )
 
     vkGetDeviceQueue(m_logicDevice, m_familyIndices.graphicsFamily.value(), 0, &m_graphicsQueue);
-    vkGetDeviceQueue(m_logicDevice, m_familyIndices.presentFamily.value(), 0, &m_presentQueue);
+    if( m_familyIndices.presentFamily.has_value() )
+    {
+        vkGetDeviceQueue(m_logicDevice, m_familyIndices.presentFamily.value(), 0, &m_presentQueue);
+    }
+    
+    m_transferQueue = m_graphicsQueue;
+    if( m_familyIndices.transferFamily.has_value() )
+    {
+        vkGetDeviceQueue(m_logicDevice, m_familyIndices.transferFamily.value(), 0, &m_transferQueue);
+    }
+    m_computeQueue = m_graphicsQueue;
+    if( m_familyIndices.computeFamily.has_value() )
+    {
+        vkGetDeviceQueue(m_logicDevice, m_familyIndices.computeFamily.value(), 0, &m_computeQueue);
+    }
     
     __createGraphicCommand(m_familyIndices);
+    __createQueueCommands(m_familyIndices);
+    __createAllocator();
+    __createSyncPool();
+    __createStagingPool();
+    __createSamplerCache();
+    __createPipelineCache();
+    __createTimelines();
 }
 
 static VKAPI_ATTR VkBool32 VKAPI_CALL debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity, VkDebugUtilsMessageTypeFlagsEXT messageType, const VkDebugUtilsMessengerCallbackDataEXT* pCallbackData, void* pUserData) {
@@ -292,7 +529,90 @@ void VkEngine::__populateDebugMessengerCreateInfo(VkDebugUtilsMessengerCreateInf
 
 void VkEngine::__createGraphicCommand( const QueueFamilyIndices& indices )
 {
-    m_graphicCommand = VksCommand::createCommandPool(indices.graphicsFamily.value());
+    // framebuffers re-record their primary buffer in bind()
+    m_graphicCommand = VksCommand::createCommandPool(indices.graphicsFamily.value(), VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT);
+    m_ownedCount++;
+}
+
+void VkEngine::__createQueueCommands( const QueueFamilyIndices& indices )
+{
+    if( indices.transferFamily.has_value() )
+    {
+        m_transferCommand = VksCommand::createCommandPool(indices.transferFamily.value());
+        m_ownedCount++;
+    }
+    if( indices.computeFamily.has_value() )
+    {
+        m_computeCommand = VksCommand::createCommandPool(indices.computeFamily.value());
+        m_ownedCount++;
+    }
+}
+
+void VkEngine::__createAllocator()
+{
+    m_allocator = VksAllocator::createAllocator();
+    m_ownedCount++;
+}
+
+void VkEngine::__createSyncPool()
+{
+    m_syncPool = VksSyncPool::createSyncPool();
+    m_ownedCount++;
+}
+
+void VkEngine::__createStagingPool()
+{
+    m_stagingPool = VksStagingPool::createStagingPool();
+    m_ownedCount++;
+}
+
+void VkEngine::__createSamplerCache()
+{
+    m_samplerCache = VksSamplerCache::createSamplerCache();
+    m_ownedCount++;
+}
+
+void VkEngine::__createPipelineCache()
+{
+    m_pipelineCache = VksPipelineCache::createPipelineCache( m_pipelineCacheDirectory );
+    m_ownedCount++;
+}
+
+void VkEngine::__createTimelines()
+{
+    if( !m_timelineSemaphore ) return;
+
+    m_graphicsTimeline = VksTimeline::createTimeline(m_graphicsQueue, m_familyIndices.graphicsFamily.value());
+    m_ownedCount++;
+    m_transferTimeline = m_graphicsTimeline;
+    if( m_familyIndices.transferFamily.has_value() )
+    {
+        m_transferTimeline = VksTimeline::createTimeline(m_transferQueue, m_familyIndices.transferFamily.value());
+        m_ownedCount++;
+    }
+    m_computeTimeline = m_graphicsTimeline;
+    if( m_familyIndices.computeFamily.has_value() )
+    {
+        m_computeTimeline = VksTimeline::createTimeline(m_computeQueue, m_familyIndices.computeFamily.value());
+        m_ownedCount++;
+    }
+}
+
+void VkEngine::__releaseEngineObjects()
+{
+    // every reset below re-enters ~VkEngine; the last one destroys the device
+    m_ownedCount = 0;
+    m_computeTimeline.reset();
+    m_transferTimeline.reset();
+    m_graphicsTimeline.reset();
+    m_pipelineCache.reset();
+    m_samplerCache.reset();
+    m_stagingPool.reset();
+    m_syncPool.reset();
+    m_allocator.reset();
+    m_computeCommand.reset();
+    m_transferCommand.reset();
+    m_graphicCommand.reset();
 }
 
 std::optional<uint32_t> VkEngine::__findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
@@ -308,7 +628,52 @@ std::optional<uint32_t> VkEngine::__findMemoryType(uint32_t typeFilter, VkMemory
     return std::nullopt;
 }
 
+std::mutex& VkEngine::_queueMutex( VkQueue queue )
+{
+    if( queue == m_graphicsQueue ) return m_queueMutexes[0];
+    if( queue == m_presentQueue ) return m_queueMutexes[1];
+    if( queue == m_transferQueue ) return m_queueMutexes[2];
+    if( queue == m_computeQueue ) return m_queueMutexes[3];
+    throw std::runtime_error("the queue does not belong to the engine");
+}
+
+void VkEngine::_deviceWaitIdle()
+{
+    std::scoped_lock lock( m_queueMutexes[0], m_queueMutexes[1], m_queueMutexes[2], m_queueMutexes[3] );
+    vkDeviceWaitIdle(m_logicDevice);
+}
+
 VksCommand* VkEngine::getGraphicVksCommand()
 {
     return m_graphicCommand.get();
 }
+
+VksAllocator* VkEngine::getAllocator()
+{
+    return m_allocator.get();
+}
+
+VksSyncPool* VkEngine::getSyncPool()
+{
+    return m_syncPool.get();
+}
+
+VksStagingPool* VkEngine::getStagingPool()
+{
+    return m_stagingPool.get();
+}
+
+VksSamplerCache* VkEngine::getSamplerCache()
+{
+    return m_samplerCache.get();
+}
+
+bool VkEngine::hasDedicatedTransferQueue()
+{
+    return m_transferCommand != nullptr;
+}
+
+bool VkEngine::hasDedicatedComputeQueue()
+{
+    return m_computeCommand != nullptr;
+}
@@ -7,6 +7,9 @@
 #include <atomic>
 #include <exception>
 #include <optional>
+#include <memory>
+#include <mutex>
+#include <string>
 
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
@@ -22,17 +25,32 @@
     struct QueueFamilyIndices {
         std::optional<int> graphicsFamily;
         std::optional<int> presentFamily;
-        bool isComplete(){
-            return graphicsFamily.has_value() && presentFamily.has_value();
+        // only set when the device exposes a family without graphics for that work
+        std::optional<int> transferFamily;
+        std::optional<int> computeFamily;
+        bool isComplete( bool requirePresent = true ){
+            return graphicsFamily.has_value() && ( presentFamily.has_value() || !requirePresent );
         }
     };
 
 class VksCommand;
+class VksAllocator;
+class VksPipelineCache;
+class VksTimeline;
+class VksSyncPool;
+class VksStagingPool;
+class VksSamplerCache;
 class VkEngine{
 private:
     static VkInstance m_instance;
     static std::atomic_uint m_subCount;
+    static uint32_t m_ownedCount;
     static VkDebugUtilsMessengerEXT m_debugMessenger;
+    static std::string m_pipelineCacheDirectory;
+    static uint32_t m_instanceVersion;
+    static bool m_timelineSubmission;
+    // graphics, present, transfer, compute
+    static std::mutex m_queueMutexes[4];
     
     void __initWindow();
     void __createInstance( );
@@ -42,8 +60,17 @@ private:
     bool __isDeviceSuitable(VkPhysicalDevice device);
     void __createLogicDevice();
     void __createGraphicCommand( const QueueFamilyIndices& indices );
+    void __createQueueCommands( const QueueFamilyIndices& indices );
+    void __createAllocator();
+    void __createSyncPool();
+    void __createStagingPool();
+    void __createSamplerCache();
+    void __createPipelineCache();
+    void __createTimelines();
+    void __releaseEngineObjects();
 
 protected:
+    static bool m_headless;
     static GLFWwindow* m_window;
     static VkSurfaceKHR m_surface;
     static VkPhysicalDevice m_physicalDevice;
@@ -51,10 +78,37 @@ protected:
 
     static VkQueue m_graphicsQueue;
     static VkQueue m_presentQueue;
+    // fall back to m_graphicsQueue when there is no dedicated family
+    static VkQueue m_transferQueue;
+    static VkQueue m_computeQueue;
+    
+    // VkQueue needs external synchronization: every submit, present, sparse bind and
+    // wait idle holds the lock of its queue while it runs. Roles that fall back to the
+    // same queue share its lock.
+    static std::mutex& _queueMutex( VkQueue queue );
+    // vkDeviceWaitIdle with every queue lock held
+    static void _deviceWaitIdle();
     
     static QueueFamilyIndices m_familyIndices;
+    // optional features are enabled whenever the device supports them
+    static VkPhysicalDeviceFeatures m_enabledFeatures;
+    static bool m_timelineSemaphore;
+    static bool m_synchronization2;
     
     static std::shared_ptr<VksCommand> m_graphicCommand;
+    // nullptr when there is no dedicated family
+    static std::shared_ptr<VksCommand> m_transferCommand;
+    static std::shared_ptr<VksCommand> m_computeCommand;
+    static std::shared_ptr<VksAllocator> m_allocator;
+    static std::shared_ptr<VksSyncPool> m_syncPool;
+    static std::shared_ptr<VksStagingPool> m_stagingPool;
+    static std::shared_ptr<VksSamplerCache> m_samplerCache;
+    static std::shared_ptr<VksPipelineCache> m_pipelineCache;
+    // one per queue, so they are shared when a family falls back to the graphics queue;
+    // nullptr without VK_KHR_timeline_semaphore
+    static std::shared_ptr<VksTimeline> m_graphicsTimeline;
+    static std::shared_ptr<VksTimeline> m_transferTimeline;
+    static std::shared_ptr<VksTimeline> m_computeTimeline;
 
     const std::vector<const char*> deviceExtensions = { VK_KHR_SWAPCHAIN_EXTENSION_NAME };
 
@@ -68,6 +122,32 @@ public:
     virtual ~VkEngine();
     
     static VksCommand* getGraphicVksCommand();
+    static VksAllocator* getAllocator();
+    static VksSyncPool* getSyncPool();
+    static VksStagingPool* getStagingPool();
+    static VksSamplerCache* getSamplerCache();
+
+    static bool hasDedicatedTransferQueue();
+    static bool hasDedicatedComputeQueue();
+    static const VkPhysicalDeviceFeatures& getEnabledFeatures();
+    static bool hasTimelineSemaphore();
+    static bool hasSynchronization2();
+    static VksTimeline* getGraphicsTimeline();
+
+    // Must be called before the first engine object is created. A headless engine
+    // never touches GLFW, creates no surface and needs no present-capable queue.
+    static void setHeadless( bool headless );
+    static bool isHeadless();
+
+    // Directory of the on-disk pipeline cache, the working directory by default.
+    // Must be called before the first engine object is created.
+    static void setPipelineCacheDirectory( const std::string& directory );
+
+    // Submissions use per-queue timeline semaphores when the device supports
+    // VK_KHR_timeline_semaphore, and fences and binary semaphores otherwise. Passing
+    // false keeps the fence path. Must be called before the first engine object is created.
+    static void setTimelineSubmission( bool enabled );
+    static VkPipelineCache getVkPipelineCache();
 
 };
 #endif
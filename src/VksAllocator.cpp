@@ -0,0 +1,353 @@
+//
+//  VksAllocator.cpp
+//  Vulkan
+//
+//
+
+#include "VksAllocator.hpp"
+#include <algorithm>
+
+static VkDeviceSize alignUp( VkDeviceSize value, VkDeviceSize alignment )
+{
+    if( alignment <= 1 ) return value;
+    return ( value + alignment - 1 ) / alignment * alignment;
+}
+
+std::shared_ptr<VksAllocator> VksAllocator::createAllocator( VkDeviceSize blockSize )
+{
+    return std::shared_ptr<VksAllocator>( new VksAllocator( blockSize ) );
+}
+
+VksAllocator::VksAllocator( VkDeviceSize blockSize )
+    :m_blockSize( blockSize )
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties( m_physicalDevice, &properties );
+    m_bufferImageGranularity = std::max<VkDeviceSize>( properties.limits.bufferImageGranularity, 1 );
+    m_nonCoherentAtomSize = std::max<VkDeviceSize>( properties.limits.nonCoherentAtomSize, 1 );
+
+    vkGetPhysicalDeviceMemoryProperties( m_physicalDevice, &m_memoryProperties );
+}
+
+VksAllocator::~VksAllocator()
+{
+    for( auto& blocks : m_blocks )
+    {
+        for( auto& block : blocks )
+        {
+            vkFreeMemory( m_logicDevice, block->memory, nullptr );
+        }
+        blocks.clear();
+    }
+}
+
+VkDeviceSize VksAllocator::__blockSizeForType( uint32_t memoryTypeIndex )
+{
+    uint32_t heapIndex = m_memoryProperties.memoryTypes[ memoryTypeIndex ].heapIndex;
+    VkDeviceSize heapSize = m_memoryProperties.memoryHeaps[ heapIndex ].size;
+    // Small heaps (e.g. the 256MB host-visible device-local heap) get smaller blocks.
+    return std::min( m_blockSize, alignUp( heapSize / 8, m_bufferImageGranularity ) );
+}
+
+VksAllocator::Block* VksAllocator::__createBlock( uint32_t memoryTypeIndex, VkDeviceSize size, bool dedicated )
+{
+    VkMemoryAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocInfo.allocationSize = size;
+    allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    if( vkAllocateMemory( m_logicDevice, &allocInfo, nullptr, &memory ) != VK_SUCCESS )
+    {
+        throw std::runtime_error("fail to alloc memory");
+    }
+
+    std::unique_ptr<Block> block( new Block );
+    block->memory = memory;
+    block->size = size;
+    block->memoryTypeIndex = memoryTypeIndex;
+    block->dedicated = dedicated;
+    if( m_memoryProperties.memoryTypes[ memoryTypeIndex ].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT )
+    {
+        if( vkMapMemory( m_logicDevice, memory, 0, VK_WHOLE_SIZE, 0, &block->mappedData ) != VK_SUCCESS )
+        {
+            vkFreeMemory( m_logicDevice, memory, nullptr );
+            throw std::runtime_error("fail to map memory");
+        }
+    }
+    if( !dedicated )
+    {
+        __insertFreeRange( block.get(), 0, size );
+    }
+
+    Block* blockPtr = block.get();
+    m_blocks[ memoryTypeIndex ].push_back( std::move( block ) );
+    return blockPtr;
+}
+
+void VksAllocator::__destroyBlock( Block* block )
+{
+    auto& blocks = m_blocks[ block->memoryTypeIndex ];
+    auto it = std::find_if( blocks.begin(), blocks.end(), [block]( const std::unique_ptr<Block>& b ) {
+        return b.get() == block;
+    });
+    if( it == blocks.end() ) return;
+
+    // freeing implicitly unmaps a persistently mapped block
+    vkFreeMemory( m_logicDevice, block->memory, nullptr );
+    blocks.erase( it );
+}
+
+void VksAllocator::__eraseFreeBySize( Block* block, VkDeviceSize offset, VkDeviceSize size )
+{
+    auto range = block->freeBySize.equal_range( size );
+    for( auto it = range.first; it != range.second; it++ )
+    {
+        if( it->second == offset )
+        {
+            block->freeBySize.erase( it );
+            return;
+        }
+    }
+}
+
+void VksAllocator::__insertFreeRange( Block* block, VkDeviceSize offset, VkDeviceSize size )
+{
+    // coalesce with the neighbouring free ranges
+    auto next = block->freeByOffset.lower_bound( offset );
+    if( next != block->freeByOffset.begin() )
+    {
+        auto prev = std::prev( next );
+        if( prev->first + prev->second == offset )
+        {
+            __eraseFreeBySize( block, prev->first, prev->second );
+            offset = prev->first;
+            size += prev->second;
+            block->freeByOffset.erase( prev );
+        }
+    }
+    if( next != block->freeByOffset.end() && offset + size == next->first )
+    {
+        __eraseFreeBySize( block, next->first, next->second );
+        size += next->second;
+        block->freeByOffset.erase( next );
+    }
+
+    block->freeByOffset[ offset ] = size;
+    block->freeBySize.insert( std::make_pair( size, offset ) );
+}
+
+bool VksAllocator::__allocateFromBlock( Block* block, VkDeviceSize size, VkDeviceSize alignment, Allocation& allocation )
+{
+    // best fit: smallest free range that still holds the aligned request
+    for( auto it = block->freeBySize.lower_bound( size ); it != block->freeBySize.end(); it++ )
+    {
+        VkDeviceSize rangeSize = it->first;
+        VkDeviceSize rangeOffset = it->second;
+        VkDeviceSize alignedOffset = alignUp( rangeOffset, alignment );
+        if( alignedOffset + size > rangeOffset + rangeSize )
+            continue;
+
+        block->freeBySize.erase( it );
+        block->freeByOffset.erase( rangeOffset );
+
+        if( alignedOffset > rangeOffset )
+        {
+            __insertFreeRange( block, rangeOffset, alignedOffset - rangeOffset );
+        }
+        VkDeviceSize tail = rangeOffset + rangeSize - ( alignedOffset + size );
+        if( tail > 0 )
+        {
+            __insertFreeRange( block, alignedOffset + size, tail );
+        }
+
+        allocation.memory = block->memory;
+        allocation.offset = alignedOffset;
+        allocation.size = size;
+        allocation.block = block;
+        return true;
+    }
+    return false;
+}
+
+VksAllocator::Allocation VksAllocator::allocate( const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, bool linear )
+{
+    std::optional<uint32_t> memoryTypeIndex;
+    for( uint32_t i = 0; i < m_memoryProperties.memoryTypeCount; i++ )
+    {
+        if( requirements.memoryTypeBits & ( 1 << i ) &&
+           ( m_memoryProperties.memoryTypes[i].propertyFlags & properties ) == properties )
+        {
+            memoryTypeIndex = i;
+            break;
+        }
+    }
+
+    if( memoryTypeIndex == std::nullopt )
+    {
+        throw std::runtime_error(" Can not find related memory property flags ");
+    }
+
+    VkDeviceSize size = requirements.size;
+    VkDeviceSize alignment = std::max<VkDeviceSize>( requirements.alignment, 1 );
+    if( !linear )
+    {
+        alignment = std::max( alignment, m_bufferImageGranularity );
+        size = alignUp( size, m_bufferImageGranularity );
+    }
+
+    Allocation allocation;
+    allocation.memoryTypeIndex = memoryTypeIndex.value();
+    allocation.propertyFlags = m_memoryProperties.memoryTypes[ allocation.memoryTypeIndex ].propertyFlags;
+
+    std::lock_guard<std::mutex> lock( m_mutex );
+
+    VkDeviceSize blockSize = __blockSizeForType( allocation.memoryTypeIndex );
+    if( size > blockSize / 2 )
+    {
+        Block* block = __createBlock( allocation.memoryTypeIndex, size, true );
+        block->allocationCount = 1;
+        block->usedBytes = size;
+        allocation.memory = block->memory;
+        allocation.offset = 0;
+        allocation.size = size;
+        allocation.block = block;
+        return allocation;
+    }
+
+    bool found = false;
+    for( auto& block : m_blocks[ allocation.memoryTypeIndex ] )
+    {
+        if( block->dedicated ) continue;
+        if( __allocateFromBlock( block.get(), size, alignment, allocation ) )
+        {
+            found = true;
+            break;
+        }
+    }
+
+    if( !found )
+    {
+        Block* block = __createBlock( allocation.memoryTypeIndex, blockSize, false );
+        if( !__allocateFromBlock( block, size, alignment, allocation ) )
+        {
+            throw std::runtime_error("fail to alloc memory");
+        }
+    }
+
+    allocation.block->allocationCount++;
+    allocation.block->usedBytes += allocation.size;
+    return allocation;
+}
+
+void VksAllocator::freeMemory( const Allocation& allocation )
+{
+    if( allocation.block == nullptr ) return;
+
+    std::lock_guard<std::mutex> lock( m_mutex );
+
+    Block* block = allocation.block;
+    block->allocationCount--;
+    block->usedBytes -= allocation.size;
+
+    if( block->dedicated )
+    {
+        __destroyBlock( block );
+        return;
+    }
+
+    __insertFreeRange( block, allocation.offset, allocation.size );
+
+    if( block->allocationCount == 0 )
+    {
+        // keep a single empty block per memory type around to avoid allocation churn
+        for( auto& other : m_blocks[ block->memoryTypeIndex ] )
+        {
+            if( other.get() != block && !other->dedicated && other->allocationCount == 0 )
+            {
+                __destroyBlock( block );
+                return;
+            }
+        }
+    }
+}
+
+void* VksAllocator::mapMemory( const Allocation& allocation )
+{
+    if( allocation.block == nullptr || allocation.block->mappedData == nullptr )
+    {
+        return nullptr;
+    }
+
+    return reinterpret_cast<char*>( allocation.block->mappedData ) + allocation.offset;
+}
+
+void VksAllocator::flushMemory( const Allocation& allocation, VkDeviceSize offset, VkDeviceSize size )
+{
+    VkMappedMemoryRange range;
+    if( __mappedRange( allocation, offset, size, range ) )
+        VK_CHECK( vkFlushMappedMemoryRanges( m_logicDevice, 1, &range ) )
+}
+
+void VksAllocator::invalidateMemory( const Allocation& allocation, VkDeviceSize offset, VkDeviceSize size )
+{
+    VkMappedMemoryRange range;
+    if( __mappedRange( allocation, offset, size, range ) )
+        VK_CHECK( vkInvalidateMappedMemoryRanges( m_logicDevice, 1, &range ) )
+}
+
+bool VksAllocator::__mappedRange( const Allocation& allocation, VkDeviceSize offset, VkDeviceSize size, VkMappedMemoryRange& range )
+{
+    if( allocation.block == nullptr || allocation.propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT )
+        return false;
+
+    if( size == VK_WHOLE_SIZE || offset + size > allocation.size )
+    {
+        size = allocation.size - offset;
+    }
+
+    // ranges must be multiples of nonCoherentAtomSize, clamped to the block
+    VkDeviceSize begin = ( allocation.offset + offset ) / m_nonCoherentAtomSize * m_nonCoherentAtomSize;
+    VkDeviceSize end = std::min( alignUp( allocation.offset + offset + size, m_nonCoherentAtomSize ), allocation.block->size );
+
+    range = {};
+    range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    range.memory = allocation.memory;
+    range.offset = begin;
+    range.size = end - begin;
+    return true;
+}
+
+VksAllocator::Statistics VksAllocator::getStatistics( uint32_t memoryTypeIndex )
+{
+    Statistics stats;
+    if( memoryTypeIndex >= VK_MAX_MEMORY_TYPES ) return stats;
+
+    std::lock_guard<std::mutex> lock( m_mutex );
+    for( auto& block : m_blocks[ memoryTypeIndex ] )
+    {
+        if( block->dedicated )
+            stats.dedicatedCount++;
+        else
+            stats.blockCount++;
+        stats.allocationCount += block->allocationCount;
+        stats.reservedBytes += block->size;
+        stats.usedBytes += block->usedBytes;
+    }
+    return stats;
+}
+
+VksAllocator::Statistics VksAllocator::getStatistics()
+{
+    Statistics total;
+    for( uint32_t i = 0; i < VK_MAX_MEMORY_TYPES; i++ )
+    {
+        Statistics stats = getStatistics( i );
+        total.blockCount += stats.blockCount;
+        total.dedicatedCount += stats.dedicatedCount;
+        total.allocationCount += stats.allocationCount;
+        total.reservedBytes += stats.reservedBytes;
+        total.usedBytes += stats.usedBytes;
+    }
+    return total;
+}
@@ -0,0 +1,97 @@
+//
+//  VksAllocator.hpp
+//  Vulkan
+//
+//
+
+#ifndef VksAllocator_hpp
+#define VksAllocator_hpp
+
+#include "VkEngine.hpp"
+#include <map>
+#include <mutex>
+#include <memory>
+
+// Carves buffers and images out of large per-memory-type VkDeviceMemory blocks so
+// that thousands of small resources only cost a handful of vkAllocateMemory calls.
+class VksAllocator : protected VkEngine
+{
+public:
+    static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64ull * 1024 * 1024;
+
+    struct Block;
+
+    struct Allocation
+    {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize offset = 0;
+        VkDeviceSize size = 0;
+        uint32_t memoryTypeIndex = 0;
+        VkMemoryPropertyFlags propertyFlags = 0;
+        Block* block = nullptr;
+    };
+
+    struct Statistics
+    {
+        uint32_t blockCount = 0;
+        uint32_t dedicatedCount = 0;
+        uint32_t allocationCount = 0;
+        VkDeviceSize reservedBytes = 0;
+        VkDeviceSize usedBytes = 0;
+    };
+
+    static std::shared_ptr<VksAllocator> createAllocator( VkDeviceSize blockSize = DEFAULT_BLOCK_SIZE );
+
+    ~VksAllocator();
+
+    // linear is true for buffers and linear-tiled images, false for optimal-tiled images.
+    // Non-linear allocations are padded to bufferImageGranularity on both ends so they
+    // never share a granularity page with a linear resource.
+    Allocation allocate( const VkMemoryRequirements& requirements, VkMemoryPropertyFlags properties, bool linear );
+    void freeMemory( const Allocation& allocation );
+
+    // Host-visible blocks stay mapped for their whole lifetime, so this is only
+    // pointer arithmetic. Returns nullptr for memory that is not host visible.
+    void* mapMemory( const Allocation& allocation );
+    // Makes host writes visible for memory types without HOST_COHERENT.
+    void flushMemory( const Allocation& allocation, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE );
+    // Makes device writes visible to the host for memory types without HOST_COHERENT.
+    void invalidateMemory( const Allocation& allocation, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE );
+
+    Statistics getStatistics();
+    Statistics getStatistics( uint32_t memoryTypeIndex );
+
+    struct Block
+    {
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+        VkDeviceSize size = 0;
+        uint32_t memoryTypeIndex = 0;
+        bool dedicated = false;
+        uint32_t allocationCount = 0;
+        VkDeviceSize usedBytes = 0;
+        void* mappedData = nullptr;
+        std::map<VkDeviceSize, VkDeviceSize> freeByOffset;
+        std::multimap<VkDeviceSize, VkDeviceSize> freeBySize;
+    };
+
+private:
+    VksAllocator( VkDeviceSize blockSize );
+
+    VkDeviceSize m_blockSize;
+    VkDeviceSize m_bufferImageGranularity;
+    VkDeviceSize m_nonCoherentAtomSize;
+    VkPhysicalDeviceMemoryProperties m_memoryProperties;
+    std::vector<std::unique_ptr<Block>> m_blocks[ VK_MAX_MEMORY_TYPES ];
+    std::mutex m_mutex;
+
+    Block* __createBlock( uint32_t memoryTypeIndex, VkDeviceSize size, bool dedicated );
+    void __destroyBlock( Block* block );
+    bool __allocateFromBlock( Block* block, VkDeviceSize size, VkDeviceSize alignment, Allocation& allocation );
+    void __insertFreeRange( Block* block, VkDeviceSize offset, VkDeviceSize size );
+    void __eraseFreeBySize( Block* block, VkDeviceSize offset, VkDeviceSize size );
+    VkDeviceSize __blockSizeForType( uint32_t memoryTypeIndex );
+    // false when the memory needs no flush or invalidate
+    bool __mappedRange( const Allocation& allocation, VkDeviceSize offset, VkDeviceSize size, VkMappedMemoryRange& range );
+};
+
+#endif /* VksAllocator_hpp */
@@ -1,4 +1,5 @@
 #include "VksAttribute.hpp"
+#include "VksStagingPool.hpp"
 
 
 VksAttribute::VksAttribute(int stride, std::vector<VkVertexInputAttributeDescription>& attriDescs)
@@ -44,20 +45,13 @@ void VksAttribute::setTopology(VkPrimitiveTopology topology)
 void VksAttribute::createVertexBuffer(const void *data, int byteSize)
 {
     VkDeviceSize bufferSize = byteSize;
-    auto stagingBuffer = VksBuffer::createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
-    
-    void *stagingData = nullptr;
-    stagingBuffer->mapMemory(0, byteSize, &stagingData);
-    
-    if( stagingData != nullptr )
-    {
-        memcpy(stagingData, data, byteSize);
-    }
-    stagingBuffer->unMapMemory();
+    auto stagingBuffer = m_stagingPool->acquire(bufferSize);
+    stagingBuffer->copyHostDataToBuffer(const_cast<void*>(data), bufferSize);
     
     m_vertexBuffer = VksBuffer::createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
     
-    m_vertexBuffer->copyFromBuffer( *stagingBuffer );
+    // the staging buffer is rounded up to its size class
+    m_vertexBuffer->copyFromBuffer( *stagingBuffer, bufferSize );
 }
 
 std::shared_ptr<VksBuffer> VksAttribute::getVertexBuffer() const
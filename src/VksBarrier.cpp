@@ -9,11 +9,18 @@
 #include "VksBarrier.hpp"
 #include "VksTexture.hpp"
 #include "VksBuffer.hpp"
+#include <algorithm>
 
 VksBarrier::VksBarrier()
+    :m_srcStage( 0 ), m_dstStage( 0 )
 {
     
 }
+
+std::shared_ptr<VksBarrier> VksBarrier::createBatch()
+{
+    return std::shared_ptr<VksBarrier>( new VksBarrier );
+}
 std::shared_ptr<VksBarrier> VksBarrier::createImageBarrier( const std::shared_ptr<VksTexture>& srcImage,
                                                             VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask,
                                                            VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage )
@@ -53,6 +60,90 @@ std::shared_ptr<VksBarrier> VksBarrier::createMemoryBarrier(VkAccessFlags srcAcc
     return barrierPtr;
 }
 
+std::shared_ptr<VksBarrier> VksBarrier::createQueueTransferBarrier(uint32_t srcQueueFamily, uint32_t dstQueueFamily, VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage)
+{
+    std::shared_ptr<VksBarrier> barrierPtr( new VksBarrier );
+    
+    if( srcQueueFamily != dstQueueFamily )
+    {
+        barrierPtr->m_srcQueueFamily = srcQueueFamily;
+        barrierPtr->m_dstQueueFamily = dstQueueFamily;
+    }
+    barrierPtr->m_srcStage = srcStage;
+    barrierPtr->m_dstStage = dstStage;
+    
+    return barrierPtr;
+}
+
+void VksBarrier::addImageTransfer(VkImage image, const VkImageSubresourceRange &range, VkImageLayout oldLayout, VkImageLayout newLayout, VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask)
+{
+    VkImageMemoryBarrier imageMemoryBarrier = {};
+    imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    imageMemoryBarrier.srcAccessMask = srcAccessMask;
+    imageMemoryBarrier.dstAccessMask = dstAccessMask;
+    
+    imageMemoryBarrier.srcQueueFamilyIndex = m_srcQueueFamily;
+    imageMemoryBarrier.dstQueueFamilyIndex = m_dstQueueFamily;
+    
+    imageMemoryBarrier.oldLayout = oldLayout;
+    imageMemoryBarrier.newLayout = newLayout;
+    imageMemoryBarrier.image = image;
+    imageMemoryBarrier.subresourceRange = range;
+    
+    m_imageBarriers.push_back( imageMemoryBarrier );
+}
+
+void VksBarrier::addImageTransfer(const std::shared_ptr<VksTexture> &image, VkImageLayout oldLayout, VkImageLayout newLayout, VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask)
+{
+    addImageTransfer( image->getImage(), image->getSubresourceRange(), oldLayout, newLayout, srcAccessMask, dstAccessMask );
+    image->assumeState( newLayout, dstAccessMask, m_dstStage );
+}
+
+void VksBarrier::addBufferTransfer(const std::shared_ptr<VksBuffer> &buffer, VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask)
+{
+    __addBufferBarrier( buffer, srcAccessMask, dstAccessMask );
+    m_bufferBarriers.back().srcQueueFamilyIndex = m_srcQueueFamily;
+    m_bufferBarriers.back().dstQueueFamilyIndex = m_dstQueueFamily;
+}
+
+void VksBarrier::setReleaseBarrier(VkCommandBuffer commandBuffer)
+{
+    if( !isQueueTransfer() )
+    {
+        setBarrier( commandBuffer );
+        return;
+    }
+    
+    // the destination access is ignored by a release, the acquire makes it visible
+    std::vector< VkImageMemoryBarrier > imageBarriers( m_imageBarriers );
+    std::vector< VkBufferMemoryBarrier> bufferBarriers( m_bufferBarriers );
+    for( auto& barrier : imageBarriers )
+        barrier.dstAccessMask = 0;
+    for( auto& barrier : bufferBarriers )
+        barrier.dstAccessMask = 0;
+    
+    vkCmdPipelineBarrier(commandBuffer, m_srcStage, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr,
+                         static_cast<uint32_t>( bufferBarriers.size() ), bufferBarriers.empty() ? nullptr : bufferBarriers.data(),
+                         static_cast<uint32_t>( imageBarriers.size() ), imageBarriers.empty() ? nullptr : imageBarriers.data());
+}
+
+void VksBarrier::setAcquireBarrier(VkCommandBuffer commandBuffer)
+{
+    if( !isQueueTransfer() )
+        return;
+    
+    std::vector< VkImageMemoryBarrier > imageBarriers( m_imageBarriers );
+    std::vector< VkBufferMemoryBarrier> bufferBarriers( m_bufferBarriers );
+    for( auto& barrier : imageBarriers )
+        barrier.srcAccessMask = 0;
+    for( auto& barrier : bufferBarriers )
+        barrier.srcAccessMask = 0;
+    
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_dstStage, 0, 0, nullptr,
+                         static_cast<uint32_t>( bufferBarriers.size() ), bufferBarriers.empty() ? nullptr : bufferBarriers.data(),
+                         static_cast<uint32_t>( imageBarriers.size() ), imageBarriers.empty() ? nullptr : imageBarriers.data());
+}
+
 void VksBarrier::addImageBarrier( const std::shared_ptr<VksTexture>& srcImage,
                      VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask )
 {
@@ -114,15 +205,127 @@ void VksBarrier::__addMemoryBarrier(VkAccessFlags srcAccessMask, VkAccessFlags d
     m_memoryBarriers.push_back( memoryBarrier );
 }
 
+void VksBarrier::addImageState(const std::shared_ptr<VksTexture> &texture, VkImageLayout layout, VkAccessFlags access, VkPipelineStageFlags stage,
+                               uint32_t baseMipLevel, uint32_t levelCount)
+{
+    uint32_t mipLevels = texture->getMipLevels();
+    uint32_t endMipLevel = levelCount == VK_REMAINING_MIP_LEVELS ? mipLevels : std::min( baseMipLevel + levelCount, mipLevels );
+    
+    for( uint32_t mipLevel = baseMipLevel; mipLevel < endMipLevel; mipLevel++ )
+    {
+        auto pending = std::find_if( m_pendingImages.begin(), m_pendingImages.end(), [&]( const PendingImage& image ) {
+            return image.texture == texture && image.barrier.subresourceRange.baseMipLevel == mipLevel;
+        });
+        if( pending != m_pendingImages.end() )
+        {
+            pending->barrier.newLayout = layout;
+            pending->barrier.dstAccessMask |= access;
+            pending->dstStage |= stage;
+            m_pendingDstStage |= stage;
+            texture->assumeState( layout, pending->barrier.dstAccessMask, pending->dstStage, mipLevel, 1 );
+            continue;
+        }
+        
+        PendingImage image;
+        image.texture = texture;
+        VkPipelineStageFlags srcStage = 0;
+        if( !texture->__transitionState( mipLevel, layout, access, stage, image.barrier, srcStage ) )
+            continue;
+        
+        image.dstStage = stage;
+        m_pendingSrcStage |= srcStage;
+        m_pendingDstStage |= stage;
+        m_pendingImages.push_back( image );
+    }
+}
+
+void VksBarrier::addBufferState(const std::shared_ptr<VksBuffer> &buffer, VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask,
+                                VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage, VkDeviceSize offset, VkDeviceSize size)
+{
+    VkDeviceSize bufferSize = buffer->getVkBufferSize();
+    VkDeviceSize end = size == VK_WHOLE_SIZE ? bufferSize : std::min( offset + size, bufferSize );
+    
+    m_pendingSrcStage |= srcStage;
+    m_pendingDstStage |= dstStage;
+    for( auto& pending : m_pendingBuffers )
+    {
+        if( pending.buffer != buffer->getVkBuffer() )
+            continue;
+        
+        VkDeviceSize pendingEnd = pending.offset + pending.size;
+        pending.offset = std::min( pending.offset, offset );
+        pending.size = std::max( pendingEnd, end ) - pending.offset;
+        pending.srcAccessMask |= srcAccessMask;
+        pending.dstAccessMask |= dstAccessMask;
+        return;
+    }
+    
+    VkBufferMemoryBarrier bufferBarrier = {};
+    bufferBarrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    bufferBarrier.srcAccessMask = srcAccessMask;
+    bufferBarrier.dstAccessMask = dstAccessMask;
+    bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    bufferBarrier.offset = offset;
+    bufferBarrier.size = end - offset;
+    bufferBarrier.buffer = buffer->getVkBuffer();
+    m_pendingBuffers.push_back( bufferBarrier );
+}
+
 void VksBarrier::setBarrier(VkCommandBuffer commandBuffer)
 {
-    uint32_t imageCount = m_imageBarriers.size();
-    uint32_t bufferCount = m_bufferBarriers.size();
+    // a batch with nothing pending records nothing; a plain barrier always records, even
+    // when it is only an execution dependency
+    bool batchOnly = m_srcStage == 0 && m_dstStage == 0;
+    if( batchOnly && !hasPendingBarriers() && m_imageBarriers.empty() && m_bufferBarriers.empty() && m_memoryBarriers.empty() )
+        return;
+    
+    std::vector< VkImageMemoryBarrier > imageBarriers( m_imageBarriers );
+    std::vector< VkBufferMemoryBarrier> bufferBarriers( m_bufferBarriers );
+    bufferBarriers.insert( bufferBarriers.end(), m_pendingBuffers.begin(), m_pendingBuffers.end() );
+    
+    // coalesce consecutive mip levels of the same image that transition identically
+    std::sort( m_pendingImages.begin(), m_pendingImages.end(), []( const PendingImage& a, const PendingImage& b ) {
+        if( a.texture != b.texture )
+            return a.texture < b.texture;
+        return a.barrier.subresourceRange.baseMipLevel < b.barrier.subresourceRange.baseMipLevel;
+    });
+    for( auto& pending : m_pendingImages )
+    {
+        const VkImageMemoryBarrier& barrier = pending.barrier;
+        if( !imageBarriers.empty() )
+        {
+            VkImageMemoryBarrier& last = imageBarriers.back();
+            if( last.image == barrier.image && last.oldLayout == barrier.oldLayout && last.newLayout == barrier.newLayout &&
+                last.srcAccessMask == barrier.srcAccessMask && last.dstAccessMask == barrier.dstAccessMask &&
+                last.subresourceRange.baseMipLevel + last.subresourceRange.levelCount == barrier.subresourceRange.baseMipLevel )
+            {
+                last.subresourceRange.levelCount++;
+                continue;
+            }
+        }
+        imageBarriers.push_back( barrier );
+    }
+    
+    VkPipelineStageFlags srcStage = m_srcStage | m_pendingSrcStage;
+    VkPipelineStageFlags dstStage = m_dstStage | m_pendingDstStage;
+    if( srcStage == 0 )
+        srcStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    if( dstStage == 0 )
+        dstStage = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+    
+    uint32_t imageCount = imageBarriers.size();
+    uint32_t bufferCount = bufferBarriers.size();
     uint32_t memoryCount = m_memoryBarriers.size();
     
-    const VkImageMemoryBarrier *imageBarrierPtr = imageCount > 0 ? m_imageBarriers.data() : nullptr;
-    const VkBufferMemoryBarrier* bufferBarrierPtr = bufferCount > 0 ? m_bufferBarriers.data() : nullptr;
+    const VkImageMemoryBarrier *imageBarrierPtr = imageCount > 0 ? imageBarriers.data() : nullptr;
+    const VkBufferMemoryBarrier* bufferBarrierPtr = bufferCount > 0 ? bufferBarriers.data() : nullptr;
     const VkMemoryBarrier* memoryBarrierPtr = memoryCount > 0 ? m_memoryBarriers.data() : nullptr;
     
-    vkCmdPipelineBarrier(commandBuffer, m_srcStage, m_dstStage, 0, memoryCount, memoryBarrierPtr, bufferCount, bufferBarrierPtr, imageCount, imageBarrierPtr);
+    vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, memoryCount, memoryBarrierPtr, bufferCount, bufferBarrierPtr, imageCount, imageBarrierPtr);
+    
+    m_pendingImages.clear();
+    m_pendingBuffers.clear();
+    m_pendingSrcStage = 0;
+    m_pendingDstStage = 0;
 }
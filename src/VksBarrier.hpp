@@ -28,6 +28,49 @@ public:
     static std::shared_ptr<VksBarrier> createMemoryBarrier( VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask,
                                                           VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage );
     
+    // Queue family ownership transfer between two exclusive-sharing queues. The same
+    // barrier is recorded twice: setReleaseBarrier() on the source queue and
+    // setAcquireBarrier() on the destination queue, ordered by a semaphore. With equal
+    // families this degrades to a plain barrier recorded by setReleaseBarrier().
+    static std::shared_ptr<VksBarrier> createQueueTransferBarrier( uint32_t srcQueueFamily, uint32_t dstQueueFamily,
+                                                                  VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage );
+    
+    // Collects transitions of many resources and records them as one vkCmdPipelineBarrier
+    // with the union of their stages. Pending barriers are recorded and dropped by the next
+    // setBarrier(), which VksFramebuffer::bind and VksCompute::prepareCompute call right
+    // before the render pass or dispatch.
+    static std::shared_ptr<VksBarrier> createBatch();
+    
+    // Goes through the state tracking of the texture. A mip level that already has a
+    // pending transition in this batch is retargeted instead of getting a second barrier,
+    // since nothing can use the intermediate state before the batch is recorded. The
+    // texture's tracked state moves immediately, so it must not be used before then.
+    void addImageState( const std::shared_ptr<VksTexture>& texture, VkImageLayout layout, VkAccessFlags access, VkPipelineStageFlags stage,
+                        uint32_t baseMipLevel = 0, uint32_t levelCount = VK_REMAINING_MIP_LEVELS );
+    // Pending barriers on the same buffer are merged into one covering both ranges
+    void addBufferState( const std::shared_ptr<VksBuffer>& buffer, VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask,
+                         VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage,
+                         VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE );
+    
+    bool hasPendingBarriers() const
+    {
+        return !m_pendingImages.empty() || !m_pendingBuffers.empty();
+    }
+    
+    void addImageTransfer( VkImage image, const VkImageSubresourceRange& range, VkImageLayout oldLayout, VkImageLayout newLayout,
+                          VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask );
+    void addImageTransfer( const std::shared_ptr<VksTexture>& image, VkImageLayout oldLayout, VkImageLayout newLayout,
+                          VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask );
+    void addBufferTransfer( const std::shared_ptr<VksBuffer>& buffer, VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask );
+    
+    void setReleaseBarrier( VkCommandBuffer commandBuffer );
+    void setAcquireBarrier( VkCommandBuffer commandBuffer );
+    
+    bool isQueueTransfer() const
+    {
+        return m_srcQueueFamily != m_dstQueueFamily;
+    }
+    
     void addImageBarrier( const std::shared_ptr<VksTexture>& srcImage,
                          VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask );
     
@@ -51,6 +94,20 @@ private:
     std::vector< VkMemoryBarrier > m_memoryBarriers;
     VkPipelineStageFlags m_srcStage;
     VkPipelineStageFlags m_dstStage;
+    
+    // one entry per mip level, coalesced into ranges when recorded
+    struct PendingImage
+    {
+        std::shared_ptr<VksTexture> texture;
+        VkImageMemoryBarrier barrier;
+        VkPipelineStageFlags dstStage;
+    };
+    std::vector< PendingImage > m_pendingImages;
+    std::vector< VkBufferMemoryBarrier > m_pendingBuffers;
+    VkPipelineStageFlags m_pendingSrcStage = 0;
+    VkPipelineStageFlags m_pendingDstStage = 0;
+    uint32_t m_srcQueueFamily = VK_QUEUE_FAMILY_IGNORED;
+    uint32_t m_dstQueueFamily = VK_QUEUE_FAMILY_IGNORED;
 };
 
 #endif /* VksBarrier_h */
@@ -0,0 +1,1031 @@
+//
+//  VksBlockCompress.cpp
+//  Vulkan
+//
+//
+
+#include "VksBlockCompress.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#if defined( __SSE2__ ) || defined( _M_X64 )
+#include <emmintrin.h>
+#define VKS_BC_SSE2 1
+#endif
+
+std::string VksBlockCompress::m_cacheDirectory = "texture_cache";
+
+// 4x4 texels as floats in 0..255, one array per channel so the palette search can take
+// four texels at a time
+struct TexelBlock
+{
+    float channel[4][16];
+};
+
+static const float kBC7Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+static void loadBlock( const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t blockX, uint32_t blockY, TexelBlock& block )
+{
+    for( uint32_t y = 0; y < 4; y++ )
+    {
+        uint32_t row = std::min( blockY * 4 + y, height - 1 );
+        for( uint32_t x = 0; x < 4; x++ )
+        {
+            uint32_t column = std::min( blockX * 4 + x, width - 1 );
+            const uint8_t* texel = rgba + ( (size_t)row * width + column ) * 4;
+            for( uint32_t c = 0; c < 4; c++ )
+            {
+                block.channel[c][y * 4 + x] = texel[c];
+            }
+        }
+    }
+}
+
+// Closest palette entry for every texel, returns the summed weighted squared error.
+// A zero channel weight leaves that channel out.
+static float nearestIndices( const TexelBlock& block, const float ( *palette )[4], uint32_t paletteSize,
+                             const float weights[4], uint8_t indices[16] )
+{
+    float totalError = 0.0f;
+#ifdef VKS_BC_SSE2
+    for( uint32_t i = 0; i < 16; i += 4 )
+    {
+        __m128 texel[4];
+        for( uint32_t c = 0; c < 4; c++ )
+        {
+            texel[c] = _mm_loadu_ps( block.channel[c] + i );
+        }
+        __m128 bestError = _mm_set1_ps( FLT_MAX );
+        __m128 bestIndex = _mm_setzero_ps();
+        for( uint32_t p = 0; p < paletteSize; p++ )
+        {
+            __m128 error = _mm_setzero_ps();
+            for( uint32_t c = 0; c < 4; c++ )
+            {
+                __m128 delta = _mm_sub_ps( texel[c], _mm_set1_ps( palette[p][c] ) );
+                error = _mm_add_ps( error, _mm_mul_ps( _mm_mul_ps( delta, delta ), _mm_set1_ps( weights[c] ) ) );
+            }
+            __m128 closer = _mm_cmplt_ps( error, bestError );
+            bestError = _mm_min_ps( error, bestError );
+            bestIndex = _mm_or_ps( _mm_and_ps( closer, _mm_set1_ps( (float)p ) ), _mm_andnot_ps( closer, bestIndex ) );
+        }
+        float errors[4], best[4];
+        _mm_storeu_ps( errors, bestError );
+        _mm_storeu_ps( best, bestIndex );
+        for( uint32_t k = 0; k < 4; k++ )
+        {
+            totalError += errors[k];
+            indices[i + k] = static_cast<uint8_t>( best[k] );
+        }
+    }
+#else
+    for( uint32_t i = 0; i < 16; i++ )
+    {
+        float bestError = FLT_MAX;
+        for( uint32_t p = 0; p < paletteSize; p++ )
+        {
+            float error = 0.0f;
+            for( uint32_t c = 0; c < 4; c++ )
+            {
+                float delta = block.channel[c][i] - palette[p][c];
+                error += delta * delta * weights[c];
+            }
+            if( error < bestError )
+            {
+                bestError = error;
+                indices[i] = static_cast<uint8_t>( p );
+            }
+        }
+        totalError += bestError;
+    }
+#endif
+    return totalError;
+}
+
+// Endpoints along the principal axis of the texels in mask, inset by 1/16 of the range
+static void fitEndpoints( const TexelBlock& block, uint32_t channels, uint32_t mask, float e0[4], float e1[4] )
+{
+    float mean[4] = {}, minimum[4], maximum[4];
+    uint32_t count = 0;
+    for( uint32_t c = 0; c < 4; c++ )
+    {
+        minimum[c] = 255.0f;
+        maximum[c] = 0.0f;
+    }
+    for( uint32_t i = 0; i < 16; i++ )
+    {
+        if( !( mask & ( 1u << i ) ) ) continue;
+        count++;
+        for( uint32_t c = 0; c < channels; c++ )
+        {
+            mean[c] += block.channel[c][i];
+            minimum[c] = std::min( minimum[c], block.channel[c][i] );
+            maximum[c] = std::max( maximum[c], block.channel[c][i] );
+        }
+    }
+    for( uint32_t c = 0; c < 4; c++ )
+    {
+        mean[c] = count ? mean[c] / count : 0.0f;
+        e0[c] = e1[c] = mean[c];
+    }
+    if( count == 0 ) return;
+
+    float covariance[4][4] = {};
+    for( uint32_t i = 0; i < 16; i++ )
+    {
+        if( !( mask & ( 1u << i ) ) ) continue;
+        for( uint32_t a = 0; a < channels; a++ )
+        {
+            for( uint32_t b = 0; b < channels; b++ )
+            {
+                covariance[a][b] += ( block.channel[a][i] - mean[a] ) * ( block.channel[b][i] - mean[b] );
+            }
+        }
+    }
+
+    // power iteration from the bounding box diagonal
+    float axis[4] = {};
+    for( uint32_t c = 0; c < channels; c++ )
+    {
+        axis[c] = maximum[c] - minimum[c];
+    }
+    for( uint32_t iteration = 0; iteration < 8; iteration++ )
+    {
+        float next[4] = {};
+        float largest = 0.0f;
+        for( uint32_t a = 0; a < channels; a++ )
+        {
+            for( uint32_t b = 0; b < channels; b++ )
+            {
+                next[a] += covariance[a][b] * axis[b];
+            }
+            largest = std::max( largest, std::fabs( next[a] ) );
+        }
+        if( largest < 1e-6f ) break;
+        for( uint32_t c = 0; c < channels; c++ )
+        {
+            axis[c] = next[c] / largest;
+        }
+    }
+    float length = 0.0f;
+    for( uint32_t c = 0; c < channels; c++ )
+    {
+        length += axis[c] * axis[c];
+    }
+    if( length < 1e-12f ) return;
+    length = std::sqrt( length );
+    for( uint32_t c = 0; c < channels; c++ )
+    {
+        axis[c] /= length;
+    }
+
+    float low = FLT_MAX, high = -FLT_MAX;
+    for( uint32_t i = 0; i < 16; i++ )
+    {
+        if( !( mask & ( 1u << i ) ) ) continue;
+        float t = 0.0f;
+        for( uint32_t c = 0; c < channels; c++ )
+        {
+            t += ( block.channel[c][i] - mean[c] ) * axis[c];
+        }
+        low = std::min( low, t );
+        high = std::max( high, t );
+    }
+    float inset = ( high - low ) / 16.0f;
+    low += inset;
+    high -= inset;
+    for( uint32_t c = 0; c < channels; c++ )
+    {
+        e0[c] = std::min( std::max( mean[c] + axis[c] * low, 0.0f ), 255.0f );
+        e1[c] = std::min( std::max( mean[c] + axis[c] * high, 0.0f ), 255.0f );
+    }
+}
+
+// Least squares endpoints for fixed indices, texel = ( 1 - w ) * e0 + w * e1
+static bool refineEndpoints( const TexelBlock& block, uint32_t channels, uint32_t mask, const uint8_t indices[16],
+                             const float* indexWeights, float e0[4], float e1[4] )
+{
+    float a = 0.0f, b = 0.0f, c = 0.0f;
+    float d0[4] = {}, d1[4] = {};
+    for( uint32_t i = 0; i < 16; i++ )
+    {
+        if( !( mask & ( 1u << i ) ) ) continue;
+        float w = indexWeights[ indices[i] ];
+        a += ( 1.0f - w ) * ( 1.0f - w );
+        b += ( 1.0f - w ) * w;
+        c += w * w;
+        for( uint32_t k = 0; k < channels; k++ )
+        {
+            d0[k] += ( 1.0f - w ) * block.channel[k][i];
+            d1[k] += w * block.channel[k][i];
+        }
+    }
+    float determinant = a * c - b * b;
+    if( std::fabs( determinant ) < 1e-6f ) return false;
+    for( uint32_t k = 0; k < channels; k++ )
+    {
+        e0[k] = std::min( std::max( ( c * d0[k] - b * d1[k] ) / determinant, 0.0f ), 255.0f );
+        e1[k] = std::min( std::max( ( a * d1[k] - b * d0[k] ) / determinant, 0.0f ), 255.0f );
+    }
+    return true;
+}
+
+static uint16_t packRGB565( const float color[4] )
+{
+    uint32_t r = static_cast<uint32_t>( color[0] * 31.0f / 255.0f + 0.5f );
+    uint32_t g = static_cast<uint32_t>( color[1] * 63.0f / 255.0f + 0.5f );
+    uint32_t b = static_cast<uint32_t>( color[2] * 31.0f / 255.0f + 0.5f );
+    return static_cast<uint16_t>( ( r << 11 ) | ( g << 5 ) | b );
+}
+
+static void unpackRGB565( uint16_t packed, float color[4] )
+{
+    uint32_t r = ( packed >> 11 ) & 31, g = ( packed >> 5 ) & 63, b = packed & 31;
+    color[0] = static_cast<float>( ( r << 3 ) | ( r >> 2 ) );
+    color[1] = static_cast<float>( ( g << 2 ) | ( g >> 4 ) );
+    color[2] = static_cast<float>( ( b << 3 ) | ( b >> 2 ) );
+    color[3] = 255.0f;
+}
+
+// palette of a BC1 color block; c0 > c1 selects four colors, otherwise three and transparent black
+static void colorPalette( uint16_t c0, uint16_t c1, bool fourColors, float palette[4][4] )
+{
+    unpackRGB565( c0, palette[0] );
+    unpackRGB565( c1, palette[1] );
+    for( uint32_t c = 0; c < 3; c++ )
+    {
+        if( fourColors )
+        {
+            palette[2][c] = std::floor( ( 2.0f * palette[0][c] + palette[1][c] ) / 3.0f );
+            palette[3][c] = std::floor( ( palette[0][c] + 2.0f * palette[1][c] ) / 3.0f );
+        }
+        else
+        {
+            palette[2][c] = std::floor( ( palette[0][c] + palette[1][c] ) / 2.0f );
+            palette[3][c] = 0.0f;
+        }
+    }
+    palette[2][3] = 255.0f;
+    palette[3][3] = fourColors ? 255.0f : 0.0f;
+}
+
+static void writeColorBlock( uint16_t c0, uint16_t c1, const uint8_t indices[16], uint8_t* out )
+{
+    uint32_t bits = 0;
+    for( uint32_t i = 0; i < 16; i++ )
+    {
+        bits |= static_cast<uint32_t>( indices[i] & 3 ) << ( i * 2 );
+    }
+    out[0] = c0 & 0xff;
+    out[1] = c0 >> 8;
+    out[2] = c1 & 0xff;
+    out[3] = c1 >> 8;
+    memcpy( out + 4, &bits, 4 );
+}
+
+// Four color mode unless punchThrough finds texels with alpha below 128, which then
+// use the transparent entry of the three color mode. BC3 always passes false.
+static void encodeColorBlock( const TexelBlock& block, bool punchThrough, uint8_t* out )
+{
+    static const float kRGBWeights[4] = { 1.0f, 1.0f, 1.0f, 0.0f };
+    static const float kFourColorWeights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+    static const float kThreeColorWeights[4] = { 0.0f, 1.0f, 0.5f, 0.0f };
+
+    uint32_t opaque = 0xffff;
+    if( punchThrough )
+    {
+        opaque = 0;
+        for( uint32_t i = 0; i < 16; i++ )
+        {
+            if( block.channel[3][i] >= 128.0f ) opaque |= 1u << i;
+        }
+    }
+    uint8_t indices[16];
+    if( opaque == 0 )
+    {
+        memset( indices, 3, sizeof( indices ) );
+        writeColorBlock( 0, 0, indices, out );
+        return;
+    }
+    bool fourColors = opaque == 0xffff;
+    const float* indexWeights = fourColors ? kFourColorWeights : kThreeColorWeights;
+
+    float e0[4], e1[4];
+    fitEndpoints( block, 3, opaque, e0, e1 );
+
+    uint16_t best0 = 0, best1 = 0;
+    uint8_t bestIndices[16];
+    float bestError = FLT_MAX;
+    for( uint32_t attempt = 0; attempt < 2; attempt++ )
+    {
+        uint16_t c0 = packRGB565( e0 ), c1 = packRGB565( e1 );
+        float palette[4][4];
+        colorPalette( c0, c1, fourColors, palette );
+        float error = nearestIndices( block, palette, fourColors ? 4 : 3, kRGBWeights, indices );
+        if( !fourColors )
+        {
+            // the transparent texels never count, whatever entry the search gave them
+            for( uint32_t i = 0; i < 16; i++ )
+            {
+                if( opaque & ( 1u << i ) ) continue;
+                float delta = 0.0f;
+                for( uint32_t c = 0; c < 3; c++ )
+                {
+                    float d = block.channel[c][i] - palette[ indices[i] ][c];
+                    delta += d * d;
+                }
+                error -= delta;
+                indices[i] = 3;
+            }
+        }
+        if( error < bestError )
+        {
+            bestError = error;
+            best0 = c0;
+            best1 = c1;
+            memcpy( bestIndices, indices, sizeof( indices ) );
+        }
+        if( !refineEndpoints( block, 3, opaque, indices, indexWeights, e0, e1 ) ) break;
+    }
+
+    // the endpoint order selects the mode, swapping the endpoints swaps entries 0 and 1
+    // ( and 2 and 3 with four colors )
+    if( fourColors )
+    {
+        if( best0 == best1 )
+        {
+            memset( bestIndices, 0, sizeof( bestIndices ) );
+        }
+        else if( best0 < best1 )
+        {
+            std::swap( best0, best1 );
+            for( auto& index : bestIndices ) index ^= 1;
+        }
+    }
+    else if( best0 > best1 )
+    {
+        std::swap( best0, best1 );
+        for( auto& index : bestIndices )
+        {
+            if( index < 2 ) index ^= 1;
+        }
+    }
+    writeColorBlock( best0, best1, bestIndices, out );
+}
+
+static void singlePalette( uint32_t a0, uint32_t a1, float palette[8] )
+{
+    palette[0] = static_cast<float>( a0 );
+    palette[1] = static_cast<float>( a1 );
+    if( a0 > a1 )
+    {
+        for( uint32_t k = 1; k < 7; k++ )
+        {
+            palette[k + 1] = static_cast<float>( ( ( 7 - k ) * a0 + k * a1 ) / 7 );
+        }
+    }
+    else
+    {
+        for( uint32_t k = 1; k < 5; k++ )
+        {
+            palette[k + 1] = static_cast<float>( ( ( 5 - k ) * a0 + k * a1 ) / 5 );
+        }
+        palette[6] = 0.0f;
+        palette[7] = 255.0f;
+    }
+}
+
+static float singleIndices( const float* values, const float palette[8], uint8_t indices[16] )
+{
+    float totalError = 0.0f;
+    for( uint32_t i = 0; i < 16; i++ )
+    {
+        float bestError = FLT_MAX;
+        for( uint32_t p = 0; p < 8; p++ )
+        {
+            float delta = values[i] - palette[p];
+            if( delta * delta < bestError )
+            {
+                bestError = delta * delta;
+                indices[i] = static_cast<uint8_t>( p );
+            }
+        }
+        totalError += bestError;
+    }
+    return totalError;
+}
+
+// BC4 block of one channel; tries the eight value ramp and the six value ramp with
+// explicit 0 and 255
+static void encodeSingleBlock( const float* values, uint8_t* out )
+{
+    float low = 255.0f, high = 0.0f, innerLow = 255.0f, innerHigh = 0.0f;
+    for( uint32_t i = 0; i < 16; i++ )
+    {
+        low = std::min( low, values[i] );
+        high = std::max( high, values[i] );
+        if( values[i] > 0.0f && values[i] < 255.0f )
+        {
+            innerLow = std::min( innerLow, values[i] );
+            innerHigh = std::max( innerHigh, values[i] );
+        }
+    }
+
+    uint32_t a0 = static_cast<uint32_t>( high ), a1 = static_cast<uint32_t>( low );
+    uint8_t indices[16];
+    float palette[8];
+    float error = 0.0f;
+    if( a0 == a1 )
+    {
+        memset( indices, 0, sizeof( indices ) );
+    }
+    else
+    {
+        singlePalette( a0, a1, palette );
+        error = singleIndices( values, palette, indices );
+        if( innerLow <= innerHigh )
+        {
+            uint32_t b0 = static_cast<uint32_t>( innerLow ), b1 = static_cast<uint32_t>( innerHigh );
+            uint8_t innerIndices[16];
+            singlePalette( b0, b1, palette );
+            if( singleIndices( values, palette, innerIndices ) < error )
+            {
+                a0 = b0;
+                a1 = b1;
+                memcpy( indices, innerIndices, sizeof( indices ) );
+            }
+        }
+    }
+
+    uint64_t bits = 0;
+    for( uint32_t i = 0; i < 16; i++ )
+    {
+        bits |= static_cast<uint64_t>( indices[i] ) << ( i * 3 );
+    }
+    out[0] = static_cast<uint8_t>( a0 );
+    out[1] = static_cast<uint8_t>( a1 );
+    for( uint32_t i = 0; i < 6; i++ )
+    {
+        out[2 + i] = static_cast<uint8_t>( bits >> ( i * 8 ) );
+    }
+}
+
+// 7 bit endpoint plus the shared p-bit that rounds it closest
+static void quantizeBC7Endpoint( const float endpoint[4], uint32_t quantized[4], uint32_t& pBit )
+{
+    float bestError = FLT_MAX;
+    for( uint32_t p = 0; p < 2; p++ )
+    {
+        uint32_t candidate[4];
+        float error = 0.0f;
+        for( uint32_t c = 0; c < 4; c++ )
+        {
+            float value = ( endpoint[c] - p ) / 2.0f;
+            candidate[c] = static_cast<uint32_t>( std::min( std::max( value + 0.5f, 0.0f ), 127.0f ) );
+            float delta = static_cast<float>( ( candidate[c] << 1 ) | p ) - endpoint[c];
+            error += delta * delta;
+        }
+        if( error < bestError )
+        {
+            bestError = error;
+            memcpy( quantized, candidate, sizeof( candidate ) );
+            pBit = p;
+        }
+    }
+}
+
+static void bc7Palette( const uint32_t q0[4], uint32_t p0, const uint32_t q1[4], uint32_t p1, float palette[16][4] )
+{
+    for( uint32_t c = 0; c < 4; c++ )
+    {
+        uint32_t v0 = ( q0[c] << 1 ) | p0, v1 = ( q1[c] << 1 ) | p1;
+        for( uint32_t i = 0; i < 16; i++ )
+        {
+            uint32_t w = static_cast<uint32_t>( kBC7Weights[i] );
+            palette[i][c] = static_cast<float>( ( ( 64 - w ) * v0 + w * v1 + 32 ) >> 6 );
+        }
+    }
+}
+
+struct BitWriter
+{
+    uint64_t bits[2] = {};
+    uint32_t position = 0;
+
+    void write( uint64_t value, uint32_t count )
+    {
+        for( uint32_t i = 0; i < count; i++, position++ )
+        {
+            bits[ position / 64 ] |= ( ( value >> i ) & 1 ) << ( position % 64 );
+        }
+    }
+};
+
+struct BitReader
+{
+    uint64_t bits[2];
+    uint32_t position = 0;
+
+    uint32_t read( uint32_t count )
+    {
+        uint32_t value = 0;
+        for( uint32_t i = 0; i < count; i++, position++ )
+        {
+            value |= static_cast<uint32_t>( ( bits[ position / 64 ] >> ( position % 64 ) ) & 1 ) << i;
+        }
+        return value;
+    }
+};
+
+// Mode 6: one subset, RGBA endpoints of 7 bits plus a p-bit each, 4 bit indices
+static void encodeBC7Block( const TexelBlock& block, uint8_t* out )
+{
+    static const float kRGBAWeights[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    float indexWeights[16];
+    for( uint32_t i = 0; i < 16; i++ )
+    {
+        indexWeights[i] = kBC7Weights[i] / 64.0f;
+    }
+
+    float e0[4], e1[4];
+    fitEndpoints( block, 4, 0xffff, e0, e1 );
+
+    uint32_t best0[4] = {}, best1[4] = {}, bestP0 = 0, bestP1 = 0;
+    uint8_t indices[16], bestIndices[16];
+    float bestError = FLT_MAX;
+    for( uint32_t attempt = 0; attempt < 2; attempt++ )
+    {
+        uint32_t q0[4], q1[4], p0, p1;
+        quantizeBC7Endpoint( e0, q0, p0 );
+        quantizeBC7Endpoint( e1, q1, p1 );
+        float palette[16][4];
+        bc7Palette( q0, p0, q1, p1, palette );
+        float error = nearestIndices( block, palette, 16, kRGBAWeights, indices );
+        if( error < bestError )
+        {
+            bestError = error;
+            memcpy( best0, q0, sizeof( q0 ) );
+            memcpy( best1, q1, sizeof( q1 ) );
+            bestP0 = p0;
+            bestP1 = p1;
+            memcpy( bestIndices, indices, sizeof( indices ) );
+        }
+        if( !refineEndpoints( block, 4, 0xffff, indices, indexWeights, e0, e1 ) ) break;
+    }
+
+    // the anchor index is stored without its top bit, so it has to be below 8
+    if( bestIndices[0] >= 8 )
+    {
+        std::swap( best0, best1 );
+        std::swap( bestP0, bestP1 );
+        for( auto& index : bestIndices ) index = 15 - index;
+    }
+
+    BitWriter writer;
+    writer.write( 1u << 6, 7 );
+    for( uint32_t c = 0; c < 4; c++ )
+    {
+        writer.write( best0[c], 7 );
+        writer.write( best1[c], 7 );
+    }
+    writer.write( bestP0, 1 );
+    writer.write( bestP1, 1 );
+    writer.write( bestIndices[0], 3 );
+    for( uint32_t i = 1; i < 16; i++ )
+    {
+        writer.write( bestIndices[i], 4 );
+    }
+    memcpy( out, writer.bits, 16 );
+}
+
+static void decodeColorBlock( const uint8_t* in, bool alwaysFourColors, uint8_t texels[16][4] )
+{
+    uint16_t c0 = static_cast<uint16_t>( in[0] | ( in[1] << 8 ) );
+    uint16_t c1 = static_cast<uint16_t>( in[2] | ( in[3] << 8 ) );
+    uint32_t bits;
+    memcpy( &bits, in + 4, 4 );
+    float palette[4][4];
+    colorPalette( c0, c1, alwaysFourColors || c0 > c1, palette );
+    for( uint32_t i = 0; i < 16; i++ )
+    {
+        const float* color = palette[ ( bits >> ( i * 2 ) ) & 3 ];
+        for( uint32_t c = 0; c < 4; c++ )
+        {
+            texels[i][c] = static_cast<uint8_t>( color[c] );
+        }
+    }
+}
+
+static void decodeSingleBlock( const uint8_t* in, uint8_t values[16] )
+{
+    float palette[8];
+    singlePalette( in[0], in[1], palette );
+    uint64_t bits = 0;
+    for( uint32_t i = 0; i < 6; i++ )
+    {
+        bits |= static_cast<uint64_t>( in[2 + i] ) << ( i * 8 );
+    }
+    for( uint32_t i = 0; i < 16; i++ )
+    {
+        values[i] = static_cast<uint8_t>( palette[ ( bits >> ( i * 3 ) ) & 7 ] );
+    }
+}
+
+static void decodeBC7Block( const uint8_t* in, uint8_t texels[16][4] )
+{
+    BitReader reader;
+    memcpy( reader.bits, in, 16 );
+    if( reader.read( 7 ) != ( 1u << 6 ) )
+    {
+        memset( texels, 0, 16 * 4 );
+        return;
+    }
+    uint32_t q0[4], q1[4];
+    for( uint32_t c = 0; c < 4; c++ )
+    {
+        q0[c] = reader.read( 7 );
+        q1[c] = reader.read( 7 );
+    }
+    uint32_t p0 = reader.read( 1 ), p1 = reader.read( 1 );
+    float palette[16][4];
+    bc7Palette( q0, p0, q1, p1, palette );
+    for( uint32_t i = 0; i < 16; i++ )
+    {
+        uint32_t index = reader.read( i == 0 ? 3 : 4 );
+        for( uint32_t c = 0; c < 4; c++ )
+        {
+            texels[i][c] = static_cast<uint8_t>( palette[index][c] );
+        }
+    }
+}
+
+static void encodeBlock( VkFormat format, const TexelBlock& block, uint8_t* out )
+{
+    switch( format )
+    {
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+            encodeColorBlock( block, false, out );
+            break;
+        case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+            encodeColorBlock( block, true, out );
+            break;
+        case VK_FORMAT_BC3_UNORM_BLOCK:
+        case VK_FORMAT_BC3_SRGB_BLOCK:
+            encodeSingleBlock( block.channel[3], out );
+            encodeColorBlock( block, false, out + 8 );
+            break;
+        case VK_FORMAT_BC4_UNORM_BLOCK:
+            encodeSingleBlock( block.channel[0], out );
+            break;
+        case VK_FORMAT_BC5_UNORM_BLOCK:
+            encodeSingleBlock( block.channel[0], out );
+            encodeSingleBlock( block.channel[1], out + 8 );
+            break;
+        case VK_FORMAT_BC7_UNORM_BLOCK:
+        case VK_FORMAT_BC7_SRGB_BLOCK:
+            encodeBC7Block( block, out );
+            break;
+        default:
+            throw std::runtime_error("unsupported block compressed format");
+    }
+}
+
+static void decodeBlock( VkFormat format, const uint8_t* in, uint8_t texels[16][4] )
+{
+    uint8_t values[16];
+    switch( format )
+    {
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+            decodeColorBlock( in, false, texels );
+            // without alpha the transparent entry reads as opaque black
+            for( uint32_t i = 0; i < 16; i++ ) texels[i][3] = 255;
+            break;
+        case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+            decodeColorBlock( in, false, texels );
+            break;
+        case VK_FORMAT_BC3_UNORM_BLOCK:
+        case VK_FORMAT_BC3_SRGB_BLOCK:
+            decodeColorBlock( in + 8, true, texels );
+            decodeSingleBlock( in, values );
+            for( uint32_t i = 0; i < 16; i++ ) texels[i][3] = values[i];
+            break;
+        case VK_FORMAT_BC4_UNORM_BLOCK:
+            decodeSingleBlock( in, values );
+            for( uint32_t i = 0; i < 16; i++ )
+            {
+                texels[i][0] = values[i];
+                texels[i][1] = texels[i][2] = 0;
+                texels[i][3] = 255;
+            }
+            break;
+        case VK_FORMAT_BC5_UNORM_BLOCK:
+            decodeSingleBlock( in, values );
+            for( uint32_t i = 0; i < 16; i++ )
+            {
+                texels[i][0] = values[i];
+                texels[i][2] = 0;
+                texels[i][3] = 255;
+            }
+            decodeSingleBlock( in + 8, values );
+            for( uint32_t i = 0; i < 16; i++ ) texels[i][1] = values[i];
+            break;
+        case VK_FORMAT_BC7_UNORM_BLOCK:
+        case VK_FORMAT_BC7_SRGB_BLOCK:
+            decodeBC7Block( in, texels );
+            break;
+        default:
+            throw std::runtime_error("unsupported block compressed format");
+    }
+}
+
+bool VksBlockCompress::isSupported( VkFormat format )
+{
+    switch( format )
+    {
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+        case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+        case VK_FORMAT_BC3_UNORM_BLOCK:
+        case VK_FORMAT_BC3_SRGB_BLOCK:
+        case VK_FORMAT_BC4_UNORM_BLOCK:
+        case VK_FORMAT_BC5_UNORM_BLOCK:
+        case VK_FORMAT_BC7_UNORM_BLOCK:
+        case VK_FORMAT_BC7_SRGB_BLOCK:
+            return true;
+        default:
+            return false;
+    }
+}
+
+uint32_t VksBlockCompress::blockSize( VkFormat format )
+{
+    switch( format )
+    {
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+        case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+        case VK_FORMAT_BC4_UNORM_BLOCK:
+            return 8;
+        default:
+            return 16;
+    }
+}
+
+size_t VksBlockCompress::compressedSize( VkFormat format, uint32_t width, uint32_t height )
+{
+    return static_cast<size_t>( ( width + 3 ) / 4 ) * ( ( height + 3 ) / 4 ) * blockSize( format );
+}
+
+void VksBlockCompress::compress( VkFormat format, const uint8_t* rgba, uint32_t width, uint32_t height, void* blocks,
+                                 uint32_t threadCount )
+{
+    if( !isSupported( format ) )
+    {
+        throw std::runtime_error("unsupported block compressed format");
+    }
+    uint32_t blocksX = ( width + 3 ) / 4, blocksY = ( height + 3 ) / 4;
+    uint32_t size = blockSize( format );
+    uint8_t* out = static_cast<uint8_t*>( blocks );
+
+    std::atomic<uint32_t> nextRow( 0 );
+    auto worker = [&]() {
+        TexelBlock block;
+        for( uint32_t y = nextRow++; y < blocksY; y = nextRow++ )
+        {
+            uint8_t* row = out + static_cast<size_t>( y ) * blocksX * size;
+            for( uint32_t x = 0; x < blocksX; x++ )
+            {
+                loadBlock( rgba, width, height, x, y, block );
+                encodeBlock( format, block, row + x * size );
+            }
+        }
+    };
+
+    if( threadCount == 0 )
+    {
+        threadCount = std::max( std::thread::hardware_concurrency(), 1u );
+    }
+    // a thread per 16 block rows at most, small levels are not worth the start up
+    threadCount = std::min( threadCount, ( blocksY + 15 ) / 16 );
+    std::vector<std::thread> threads;
+    for( uint32_t i = 1; i < threadCount; i++ )
+    {
+        threads.emplace_back( worker );
+    }
+    worker();
+    for( auto& thread : threads )
+    {
+        thread.join();
+    }
+}
+
+void VksBlockCompress::decompress( VkFormat format, const void* blocks, uint32_t width, uint32_t height, uint8_t* rgba )
+{
+    uint32_t blocksX = ( width + 3 ) / 4, blocksY = ( height + 3 ) / 4;
+    uint32_t size = blockSize( format );
+    const uint8_t* in = static_cast<const uint8_t*>( blocks );
+    uint8_t texels[16][4];
+    for( uint32_t by = 0; by < blocksY; by++ )
+    {
+        for( uint32_t bx = 0; bx < blocksX; bx++ )
+        {
+            decodeBlock( format, in + ( static_cast<size_t>( by ) * blocksX + bx ) * size, texels );
+            for( uint32_t y = 0; y < 4 && by * 4 + y < height; y++ )
+            {
+                for( uint32_t x = 0; x < 4 && bx * 4 + x < width; x++ )
+                {
+                    memcpy( rgba + ( static_cast<size_t>( by * 4 + y ) * width + bx * 4 + x ) * 4, texels[y * 4 + x], 4 );
+                }
+            }
+        }
+    }
+}
+
+double VksBlockCompress::psnr( VkFormat format, const uint8_t* reference, const uint8_t* rgba, uint32_t width, uint32_t height )
+{
+    uint32_t channelMask = 0xf;
+    switch( format )
+    {
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+            channelMask = 0x7;
+            break;
+        case VK_FORMAT_BC4_UNORM_BLOCK:
+            channelMask = 0x1;
+            break;
+        case VK_FORMAT_BC5_UNORM_BLOCK:
+            channelMask = 0x3;
+            break;
+        default:
+            break;
+    }
+
+    double squaredError = 0.0;
+    size_t samples = 0;
+    for( size_t i = 0; i < static_cast<size_t>( width ) * height; i++ )
+    {
+        for( uint32_t c = 0; c < 4; c++ )
+        {
+            if( !( channelMask & ( 1u << c ) ) ) continue;
+            double delta = static_cast<double>( reference[i * 4 + c] ) - rgba[i * 4 + c];
+            squaredError += delta * delta;
+            samples++;
+        }
+    }
+    if( squaredError == 0.0 || samples == 0 ) return INFINITY;
+    return 10.0 * std::log10( 255.0 * 255.0 / ( squaredError / samples ) );
+}
+
+void VksBlockCompress::downsample( const uint8_t* rgba, uint32_t width, uint32_t height, uint8_t* dst )
+{
+    uint32_t dstWidth = std::max( width / 2, 1u ), dstHeight = std::max( height / 2, 1u );
+    for( uint32_t y = 0; y < dstHeight; y++ )
+    {
+        uint32_t y0 = std::min( y * 2, height - 1 ), y1 = std::min( y * 2 + 1, height - 1 );
+        for( uint32_t x = 0; x < dstWidth; x++ )
+        {
+            uint32_t x0 = std::min( x * 2, width - 1 ), x1 = std::min( x * 2 + 1, width - 1 );
+            for( uint32_t c = 0; c < 4; c++ )
+            {
+                uint32_t sum = rgba[ ( static_cast<size_t>( y0 ) * width + x0 ) * 4 + c ] + rgba[ ( static_cast<size_t>( y0 ) * width + x1 ) * 4 + c ]
+                             + rgba[ ( static_cast<size_t>( y1 ) * width + x0 ) * 4 + c ] + rgba[ ( static_cast<size_t>( y1 ) * width + x1 ) * 4 + c ];
+                dst[ ( static_cast<size_t>( y ) * dstWidth + x ) * 4 + c ] = static_cast<uint8_t>( ( sum + 2 ) / 4 );
+            }
+        }
+    }
+}
+
+// header of a cache file, followed by the blocks of every level
+struct BlockCacheHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t mipLevels;
+    uint64_t dataSize;
+};
+
+static const uint32_t kBlockCacheMagic = 0x43424b56; // "VKBC"
+
+static uint64_t fnv1a( uint64_t hash, const void* data, size_t size )
+{
+    const uint8_t* bytes = static_cast<const uint8_t*>( data );
+    for( size_t i = 0; i < size; i++ )
+    {
+        hash = ( hash ^ bytes[i] ) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static size_t chainSize( VkFormat format, uint32_t width, uint32_t height, uint32_t mipLevels )
+{
+    size_t size = 0;
+    for( uint32_t level = 0; level < mipLevels; level++ )
+    {
+        size += VksBlockCompress::compressedSize( format, std::max( width >> level, 1u ), std::max( height >> level, 1u ) );
+    }
+    return size;
+}
+
+void VksBlockCompress::setCacheDirectory( const std::string& directory )
+{
+    m_cacheDirectory = directory;
+}
+
+const std::string& VksBlockCompress::getCacheDirectory()
+{
+    return m_cacheDirectory;
+}
+
+std::string VksBlockCompress::__cachePath( const char* sourcePath, VkFormat format, bool mipmaps )
+{
+    if( m_cacheDirectory.empty() ) return std::string();
+
+    std::error_code error;
+    uint64_t fileSize = std::filesystem::file_size( sourcePath, error );
+    if( error ) return std::string();
+    int64_t modified = std::filesystem::last_write_time( sourcePath, error ).time_since_epoch().count();
+    if( error ) return std::string();
+
+    uint64_t hash = 0xcbf29ce484222325ull;
+    hash = fnv1a( hash, sourcePath, strlen( sourcePath ) );
+    hash = fnv1a( hash, &fileSize, sizeof( fileSize ) );
+    hash = fnv1a( hash, &modified, sizeof( modified ) );
+    uint32_t key[3] = { static_cast<uint32_t>( format ), mipmaps ? 1u : 0u, ENCODER_VERSION };
+    hash = fnv1a( hash, key, sizeof( key ) );
+
+    char fileName[32];
+    snprintf( fileName, sizeof( fileName ), "%016llx.bc", static_cast<unsigned long long>( hash ) );
+    return m_cacheDirectory + "/" + fileName;
+}
+
+bool VksBlockCompress::loadCached( const char* sourcePath, VkFormat format, bool mipmaps, uint32_t& width, uint32_t& height,
+                                   uint32_t& mipLevels, const std::function<void*( size_t )>& allocate )
+{
+    std::string cachePath = __cachePath( sourcePath, format, mipmaps );
+    if( cachePath.empty() ) return false;
+
+    std::ifstream file( cachePath, std::ios::binary );
+    if( !file.is_open() ) return false;
+
+    BlockCacheHeader header;
+    file.read( reinterpret_cast<char*>( &header ), sizeof( header ) );
+    if( !file || header.magic != kBlockCacheMagic || header.version != ENCODER_VERSION || header.format != static_cast<uint32_t>( format )
+        || header.width == 0 || header.height == 0 || header.mipLevels == 0
+        || header.dataSize != chainSize( format, header.width, header.height, header.mipLevels ) )
+    {
+        return false;
+    }
+
+    void* blocks = allocate( header.dataSize );
+    if( blocks == nullptr ) return false;
+    file.read( static_cast<char*>( blocks ), header.dataSize );
+    if( !file ) return false;
+
+    width = header.width;
+    height = header.height;
+    mipLevels = header.mipLevels;
+    return true;
+}
+
+bool VksBlockCompress::storeCached( const char* sourcePath, VkFormat format, bool mipmaps, uint32_t width, uint32_t height,
+                                    uint32_t mipLevels, const void* blocks, size_t size )
+{
+    std::string cachePath = __cachePath( sourcePath, format, mipmaps );
+    if( cachePath.empty() ) return false;
+
+    std::error_code error;
+    std::filesystem::create_directories( m_cacheDirectory, error );
+
+    BlockCacheHeader header = { kBlockCacheMagic, ENCODER_VERSION, static_cast<uint32_t>( format ), width, height, mipLevels, size };
+
+    // write aside and rename, so a crash never leaves a truncated file behind
+    std::string tempPath = cachePath + ".tmp";
+    std::ofstream file( tempPath, std::ios::binary | std::ios::trunc );
+    if( !file.is_open() ) return false;
+    file.write( reinterpret_cast<const char*>( &header ), sizeof( header ) );
+    file.write( static_cast<const char*>( blocks ), size );
+    file.close();
+    if( !file )
+    {
+        std::remove( tempPath.c_str() );
+        return false;
+    }
+    return std::rename( tempPath.c_str(), cachePath.c_str() ) == 0;
+}
@@ -0,0 +1,61 @@
+//
+//  VksBlockCompress.hpp
+//  Vulkan
+//
+//
+
+#ifndef VksBlockCompress_hpp
+#define VksBlockCompress_hpp
+
+#include <vulkan/vulkan.h>
+#include <functional>
+#include <string>
+
+// CPU encoder for the BC formats VksTexture can create from files: BC1, BC3, BC4, BC5
+// and BC7 ( mode 6 only ). Block rows are spread over worker threads and the palette
+// search uses SSE2 when it is available. Nothing here needs a device, so the encoder can
+// be checked against decompress() and psnr() on the CPU alone.
+class VksBlockCompress
+{
+public:
+    // Bumped whenever the encoder output changes, invalidates the disk cache
+    static constexpr uint32_t ENCODER_VERSION = 1;
+
+    static bool isSupported( VkFormat format );
+    // bytes per 4x4 block, 8 or 16
+    static uint32_t blockSize( VkFormat format );
+    static size_t compressedSize( VkFormat format, uint32_t width, uint32_t height );
+
+    // rgba is tightly packed RGBA8; partial blocks at the right and bottom edges repeat
+    // the last column / row. threadCount 0 uses every hardware thread.
+    static void compress( VkFormat format, const uint8_t* rgba, uint32_t width, uint32_t height, void* blocks,
+                          uint32_t threadCount = 0 );
+    // Back to RGBA8; channels the format does not store read as 0, alpha as 255.
+    // BC7 blocks in other modes than 6 decode to transparent black.
+    static void decompress( VkFormat format, const void* blocks, uint32_t width, uint32_t height, uint8_t* rgba );
+    // Over the channels the format stores, infinity when the images are identical
+    static double psnr( VkFormat format, const uint8_t* reference, const uint8_t* rgba, uint32_t width, uint32_t height );
+
+    // 2x2 box filter into the next mip level, max( width / 2, 1 ) x max( height / 2, 1 ),
+    // for mip chains built on the CPU
+    static void downsample( const uint8_t* rgba, uint32_t width, uint32_t height, uint8_t* dst );
+
+    // Encoded chains are cached in directory, keyed by the source path, size and
+    // modification time, the format and whether mipmaps were built. "texture_cache"
+    // relative to the working directory by default, an empty string disables the cache.
+    static void setCacheDirectory( const std::string& directory );
+    static const std::string& getCacheDirectory();
+
+    // On a hit fills the dimensions and reads the blocks of every level, back to back,
+    // into the memory returned by allocate( size ).
+    static bool loadCached( const char* sourcePath, VkFormat format, bool mipmaps, uint32_t& width, uint32_t& height,
+                            uint32_t& mipLevels, const std::function<void*( size_t )>& allocate );
+    static bool storeCached( const char* sourcePath, VkFormat format, bool mipmaps, uint32_t width, uint32_t height,
+                             uint32_t mipLevels, const void* blocks, size_t size );
+private:
+    static std::string m_cacheDirectory;
+
+    static std::string __cachePath( const char* sourcePath, VkFormat format, bool mipmaps );
+};
+
+#endif /* VksBlockCompress_hpp */
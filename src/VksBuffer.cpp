@@ -1,5 +1,6 @@
 #include "VksBuffer.hpp"
 #include "VksCommand.hpp"
+#include "VksTrace.hpp"
 
 VksBuffer::VksBuffer()
 {
@@ -8,28 +9,15 @@ VksBuffer::VksBuffer()
 
 VksBuffer::~VksBuffer()
 {
-    if( m_bufferMemory )
-    {
-        vkFreeMemory(m_logicDevice, m_bufferMemory, nullptr);
-    }
-
     if( m_buffer )
     {
         vkDestroyBuffer(m_logicDevice, m_buffer, nullptr);
     }
-}
 
-std::optional<uint32_t> VksBuffer::__findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties)
-{
-    VkPhysicalDeviceMemoryProperties memProperties;
-    vkGetPhysicalDeviceMemoryProperties(m_physicalDevice, &memProperties);
-    for (uint32_t i = 0; i < memProperties.memoryTypeCount; i++) {
-        if (typeFilter & (1 << i) && (memProperties.memoryTypes[i].propertyFlags & properties) == properties ) {
-            return i;
-        }
+    if( m_allocation.memory )
+    {
+        m_allocator->freeMemory( m_allocation );
     }
-
-    return std::nullopt;
 }
 
 std::shared_ptr<VksBuffer> VksBuffer::createBuffer(VkDeviceSize size, VkBufferUsageFlags bufferUsage, VkMemoryPropertyFlags flags)
@@ -49,40 +37,32 @@ std::shared_ptr<VksBuffer> VksBuffer::createBuffer(VkDeviceSize size, VkBufferUs
     VkMemoryRequirements memRequirements;
     vkGetBufferMemoryRequirements(m_logicDevice, buffer->m_buffer, &memRequirements);
     
-    VkMemoryAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memRequirements.size;
-    
-    std::optional<uint32_t> memoIndex = buffer->__findMemoryType(memRequirements.memoryTypeBits, flags );
-
-    if( memoIndex == std::nullopt )
-    {
-        throw std::runtime_error("");
-    }
-
-    allocInfo.memoryTypeIndex = memoIndex.value();
-
-    if( vkAllocateMemory(m_logicDevice, &allocInfo, nullptr, &buffer->m_bufferMemory) != VK_SUCCESS )
-    {
-        throw std::runtime_error("fail to alloc memory");
-    }
-    
+    buffer->m_allocation = m_allocator->allocate( memRequirements, flags, true );
     buffer->m_memoryFlags = flags;
     
-    vkBindBufferMemory(m_logicDevice, buffer->m_buffer, buffer->m_bufferMemory, 0);
+    VK_CHECK( vkBindBufferMemory(m_logicDevice, buffer->m_buffer, buffer->m_allocation.memory, buffer->m_allocation.offset) )
+    buffer->m_mappedData = m_allocator->mapMemory( buffer->m_allocation );
     return buffer;
 }
 
 bool VksBuffer::copyFromBuffer(const VksBuffer &srcBuffer)
 {
+    VKS_TRACE_ZONE( "VksBuffer::copyFromBuffer" );
     if( srcBuffer.getVkBufferSize() != this->getVkBufferSize() )
         return false;
+    return copyFromBuffer( srcBuffer, srcBuffer.getVkBufferSize() );
+}
+
+bool VksBuffer::copyFromBuffer(const VksBuffer &srcBuffer, VkDeviceSize size, VkDeviceSize srcOffset, VkDeviceSize dstOffset)
+{
+    if( srcOffset + size > srcBuffer.getVkBufferSize() || dstOffset + size > this->getVkBufferSize() )
+        return false;
     VkCommandBuffer commandBuffer = m_graphicCommand->beginOnceSubmitBuffer();
     
     VkBufferCopy copyRegion = {};
-    copyRegion.srcOffset = 0;
-    copyRegion.dstOffset = 0;
-    copyRegion.size = srcBuffer.getVkBufferSize();
+    copyRegion.srcOffset = srcOffset;
+    copyRegion.dstOffset = dstOffset;
+    copyRegion.size = size;
     
     vkCmdCopyBuffer(commandBuffer, srcBuffer.getVkBuffer(), m_buffer, 1, &copyRegion);
     
@@ -99,32 +79,33 @@ void VksBuffer::mapMemory(int offset, VkDeviceSize size, void** ppData)
         return;
     }
     
-    vkMapMemory(m_logicDevice, m_bufferMemory, offset, size, 0, ppData);
+    *ppData = reinterpret_cast<char*>( m_mappedData ) + offset;
 }
 
 void VksBuffer::unMapMemory()
 {
+    // the memory stays mapped, only make the writes visible to the device
     if( __canMapped() )
-        vkUnmapMemory(m_logicDevice, m_bufferMemory);
+        flushMemory();
 }
 
-bool VksBuffer::__canMapped()
+void VksBuffer::flushMemory(VkDeviceSize offset, VkDeviceSize size)
 {
-    VkMemoryRequirements memoryReq;
-    vkGetBufferMemoryRequirements(m_logicDevice, m_buffer, &memoryReq);
-    
-    auto ret = __findMemoryType(memoryReq.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT );
-    return ret != std::nullopt;
+    m_allocator->flushMemory( m_allocation, offset, size );
+}
+
+void VksBuffer::invalidateMemory(VkDeviceSize offset, VkDeviceSize size)
+{
+    m_allocator->invalidateMemory( m_allocation, offset, size );
 }
 
 bool VksBuffer::copyHostDataToBuffer(void *pData, VkDeviceSize size, int offset)
 {
+    VKS_TRACE_ZONE( "VksBuffer::copyHostDataToBuffer" );
     if( !__canMapped() )
         return false;
-    void *bufferAddr;
-    mapMemory(offset, size, &bufferAddr);
-    memcpy( bufferAddr, pData, size );
-    unMapMemory();
+    memcpy( reinterpret_cast<char*>( m_mappedData ) + offset, pData, size );
+    flushMemory( offset, size );
     
     return true;
 }
@@ -2,11 +2,13 @@
 #define VKSBUFFER_HPP
 
 #include "VkEngine.hpp"
+#include "VksAllocator.hpp"
 #include <optional>
 #include <memory>
 
 class VksBuffer : protected VkEngine
 {
+    friend class VksStagingPool;
 public:
     static constexpr bool value = true;
     static std::shared_ptr<VksBuffer> createBuffer( VkDeviceSize size, VkBufferUsageFlags bufferUsage, VkMemoryPropertyFlags flags );
@@ -21,7 +23,11 @@ public:
     }
 
     VkDeviceMemory getVkBufferMemory() const {
-        return m_bufferMemory;
+        return m_allocation.memory;
+    }
+
+    VkDeviceSize getMemoryOffset() const {
+        return m_allocation.offset;
     }
     
     const VkMemoryPropertyFlags getMemoryFlags()
@@ -29,21 +35,32 @@ public:
         return m_memoryFlags;
     }
 
+    // host-visible buffers are persistently mapped, nullptr otherwise
+    void* getMappedData() const {
+        return m_mappedData;
+    }
+
     bool copyFromBuffer( const VksBuffer& srcBuffer );
+    // Blocking copy of size bytes; unlike the overload above the buffer sizes may differ
+    bool copyFromBuffer( const VksBuffer& srcBuffer, VkDeviceSize size, VkDeviceSize srcOffset = 0, VkDeviceSize dstOffset = 0 );
     void mapMemory( int offset, VkDeviceSize size, void** ppData );
     void unMapMemory();
+    void flushMemory( VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE );
+    // before reading what the device wrote to a host-cached buffer
+    void invalidateMemory( VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE );
     
     bool copyHostDataToBuffer( void* pData, VkDeviceSize size, int offset = 0 );
 protected:
     VksBuffer();
     VkBuffer m_buffer = VK_NULL_HANDLE;
-    VkDeviceMemory m_bufferMemory = VK_NULL_HANDLE;
+    VksAllocator::Allocation m_allocation;
     VkDeviceSize m_bufferSize = 0;
     VkMemoryPropertyFlags m_memoryFlags;
-
-    std::optional<uint32_t> __findMemoryType(uint32_t typeFilter, VkMemoryPropertyFlags properties);
+    void* m_mappedData = nullptr;
     
-    bool __canMapped();
+    bool __canMapped() const {
+        return m_mappedData != nullptr;
+    }
 };
 
 #endif
@@ -1,13 +1,15 @@
 #include "VksCommand.hpp"
+#include "VksTrace.hpp"
+#include "VksSyncPool.hpp"
 #include <array>
 #include "VksBarrier.hpp"
 
-std::shared_ptr<VksCommand> VksCommand::createCommandPool(uint32_t queueFamilyIndex)
+std::shared_ptr<VksCommand> VksCommand::createCommandPool(uint32_t queueFamilyIndex, VkCommandPoolCreateFlags flags)
 {
     VkCommandPoolCreateInfo info = {
         .sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
         .pNext = nullptr,
-        .flags = 0,
+        .flags = flags,
         .queueFamilyIndex = queueFamilyIndex
     };
 
@@ -49,23 +51,23 @@ VkCommandBuffer VksCommand::beginOnceSubmitBuffer()
 
 void VksCommand::endOnceSubmitBuffer( VkCommandBuffer commandbuffer )
 {
+    VKS_TRACE_ZONE( "VksCommand::endOnceSubmitBuffer" );
     vkEndCommandBuffer( commandbuffer );
     VkSubmitInfo submit = {};
     submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
     submit.commandBufferCount = 1;
     submit.pCommandBuffers = &commandbuffer;
 
-    VkFenceCreateInfo fenceCreateInfo = {};
-    fenceCreateInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    
-    VkFence fence;
-    vkCreateFence(m_logicDevice, &fenceCreateInfo, nullptr, &fence);
+    VkFence fence = m_syncPool->acquireFence();
 
-    vkQueueSubmit( m_graphicsQueue, 1, &submit, fence);
+    {
+        std::lock_guard<std::mutex> lock( _queueMutex( m_graphicsQueue ) );
+        vkQueueSubmit( m_graphicsQueue, 1, &submit, fence);
+    }
     vkWaitForFences(m_logicDevice, 1, &fence, VK_TRUE, UINT64_MAX);
 
     vkFreeCommandBuffers(m_logicDevice, m_commandPool, 1, &commandbuffer);
-    vkDestroyFence(m_logicDevice, fence, nullptr);
+    m_syncPool->releaseFence(fence);
 }
 
 std::vector<VkCommandBuffer> VksCommand::createPrimaryBuffer(int size)
@@ -104,7 +106,13 @@ VkCommandPool VksCommand::getCommandPool() const
 }
 
 void VksCommand::beginRenderPass( VkCommandBuffer commandBuffer, const std::shared_ptr<VksFramebuffer> dstFramebuffer,
-                                 std::shared_ptr<VksBarrier> barrier)
+                                 std::shared_ptr<VksBarrier> barrier, VkSubpassContents contents)
+{
+    beginCommandBuffer( commandBuffer, barrier );
+    cmdBeginRenderPass( commandBuffer, dstFramebuffer, contents );
+}
+
+void VksCommand::beginCommandBuffer( VkCommandBuffer commandBuffer, std::shared_ptr<VksBarrier> barrier )
 {
     VkCommandBufferBeginInfo bufferBeginInfo = {};
     bufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -117,7 +125,11 @@ void VksCommand::beginRenderPass( VkCommandBuffer commandBuffer, const std::shar
     {
         barrier->setBarrier( commandBuffer );
     }
-    
+}
+
+void VksCommand::cmdBeginRenderPass( VkCommandBuffer commandBuffer, const std::shared_ptr<VksFramebuffer> dstFramebuffer,
+                                    VkSubpassContents contents )
+{
     VkRenderPassBeginInfo renderBeginInfo = {};
     renderBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
     std::array<VkClearValue, 2> clearValues{};
@@ -133,7 +145,17 @@ void VksCommand::beginRenderPass( VkCommandBuffer commandBuffer, const std::shar
     renderBeginInfo.renderArea.extent = renderSize;
     renderBeginInfo.renderPass = dstFramebuffer->getVkRenderPass();
     
-    vkCmdBeginRenderPass(commandBuffer, &renderBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+    vkCmdBeginRenderPass(commandBuffer, &renderBeginInfo, contents);
+    
+    // secondary command buffers set their own dynamic state
+    if( contents == VK_SUBPASS_CONTENTS_INLINE )
+    {
+        setDynamicStates( commandBuffer, renderSize );
+    }
+}
+
+void VksCommand::setDynamicStates(VkCommandBuffer commandBuffer, VkExtent2D renderSize)
+{
     VkViewport viewport = {  };
     viewport.x = 0;
     viewport.y = 0;
@@ -150,12 +172,22 @@ void VksCommand::beginRenderPass( VkCommandBuffer commandBuffer, const std::shar
     VkRect2D scissors[] = { scissor };
     
     vkCmdSetScissor(commandBuffer, 0, 1, scissors);
+    vkCmdSetLineWidth(commandBuffer, 1.0f);
 }
 
 void VksCommand::endRenderPass(VkCommandBuffer commandBuffer)
+{
+    cmdEndRenderPass( commandBuffer );
+    endCommandBuffer( commandBuffer );
+}
+
+void VksCommand::cmdEndRenderPass(VkCommandBuffer commandBuffer)
 {
     vkCmdEndRenderPass(commandBuffer);
-    
+}
+
+void VksCommand::endCommandBuffer(VkCommandBuffer commandBuffer)
+{
     VK_CHECK( vkEndCommandBuffer( commandBuffer ) )
 }
 
@@ -187,3 +219,9 @@ void VksCommand::bindUniformSet(VkCommandBuffer commandBuffer, const std::shared
 {
     vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shaderPtr->getPipelineLayout(), 0, 1, &descriptorSet, 0, nullptr);
 }
+
+void VksCommand::bindUniformSet(VkCommandBuffer commandBuffer, const std::shared_ptr<VksShaderProgram> &shaderPtr, VkDescriptorSet descriptorSet, const std::vector<uint32_t> &dynamicOffsets)
+{
+    vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, shaderPtr->getPipelineLayout(), 0, 1, &descriptorSet,
+                            static_cast<uint32_t>( dynamicOffsets.size() ), dynamicOffsets.data());
+}
@@ -12,7 +12,7 @@ class VksBarrier;
 class VksCommand : protected VkEngine
 {
 public:
-    static std::shared_ptr<VksCommand> createCommandPool(uint32_t queueFamilyIndex);
+    static std::shared_ptr<VksCommand> createCommandPool(uint32_t queueFamilyIndex, VkCommandPoolCreateFlags flags = 0);
 
     VkCommandBuffer beginOnceSubmitBuffer();
     void endOnceSubmitBuffer( VkCommandBuffer commandbuffer );
@@ -24,12 +24,23 @@ public:
 
     VkCommandPool getCommandPool() const;
     
-    void beginRenderPass( VkCommandBuffer commandBuffer, const std::shared_ptr<VksFramebuffer> dstFramebuffer, std::shared_ptr<VksBarrier> barrier = nullptr );
+    void beginRenderPass( VkCommandBuffer commandBuffer, const std::shared_ptr<VksFramebuffer> dstFramebuffer, std::shared_ptr<VksBarrier> barrier = nullptr,
+                          VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE );
+    // beginRenderPass split in two, so commands that are not allowed inside a render
+    // pass (query resets, barriers) can be recorded in between
+    void beginCommandBuffer( VkCommandBuffer commandBuffer, std::shared_ptr<VksBarrier> barrier = nullptr );
+    void cmdBeginRenderPass( VkCommandBuffer commandBuffer, const std::shared_ptr<VksFramebuffer> dstFramebuffer,
+                             VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE );
+    // viewport, scissor and line width, the dynamic states of VksGraphicPipeline
+    void setDynamicStates( VkCommandBuffer commandBuffer, VkExtent2D renderSize );
     void endRenderPass( VkCommandBuffer commandBuffer );
+    void cmdEndRenderPass( VkCommandBuffer commandBuffer );
+    void endCommandBuffer( VkCommandBuffer commandBuffer );
     
     void bindVertexBuffer( VkCommandBuffer commandBuffer, const std::shared_ptr<VksBuffer> vertexBuffer );
     void bindIndexBuffer( VkCommandBuffer commandBuffer, const std::shared_ptr<VksBuffer> indexBuffer, VkIndexType indexValType = VK_INDEX_TYPE_UINT16 );
     void bindUniformSet( VkCommandBuffer commandBuffer, const std::shared_ptr<VksShaderProgram>& shaderPtr, VkDescriptorSet descriptorSet);
+    void bindUniformSet( VkCommandBuffer commandBuffer, const std::shared_ptr<VksShaderProgram>& shaderPtr, VkDescriptorSet descriptorSet, const std::vector<uint32_t>& dynamicOffsets );
     
     void drawIndexed( VkCommandBuffer commandBuffer, uint32_t indexCount );
     void draw( VkCommandBuffer commandBuffer, uint32_t vertexCount );
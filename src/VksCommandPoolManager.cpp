@@ -0,0 +1,164 @@
+//
+//  VksCommandPoolManager.cpp
+//  Vulkan
+//
+//
+
+#include "VksCommandPoolManager.hpp"
+#include "VksCommand.hpp"
+#include "VksFramebuffer.hpp"
+#include "VksGraphicPipeline.hpp"
+#include <unordered_map>
+#include <algorithm>
+
+std::atomic<uint64_t> VksCommandPoolManager::s_nextId( 1 );
+
+std::shared_ptr<VksCommandPoolManager> VksCommandPoolManager::createCommandPoolManager( uint32_t frameCount, uint32_t queueFamilyIndex )
+{
+    return std::shared_ptr<VksCommandPoolManager>( new VksCommandPoolManager( frameCount, queueFamilyIndex ) );
+}
+
+VksCommandPoolManager::VksCommandPoolManager( uint32_t frameCount, uint32_t queueFamilyIndex )
+    :m_frameCount( std::max<uint32_t>( frameCount, 1 ) )
+    ,m_queueFamily( queueFamilyIndex )
+    ,m_id( s_nextId++ )
+{
+}
+
+VksCommandPoolManager::~VksCommandPoolManager()
+{
+    for( auto& threadPools : m_threadPools )
+    {
+        for( auto& frame : threadPools->frames )
+        {
+            // destroying the pool frees every command buffer allocated from it
+            vkDestroyCommandPool( m_logicDevice, frame.pool, nullptr );
+        }
+    }
+    m_threadPools.clear();
+}
+
+VksCommandPoolManager::FramePool& VksCommandPoolManager::__framePool( uint32_t frameIndex )
+{
+    if( frameIndex >= m_frameCount )
+    {
+        throw std::runtime_error("command pool frame index out of range");
+    }
+
+    // manager ids are never reused, so entries of destroyed managers are never hit again
+    thread_local std::unordered_map<uint64_t, ThreadPools*> threadCache;
+    auto it = threadCache.find( m_id );
+    if( it != threadCache.end() )
+    {
+        return it->second->frames[ frameIndex ];
+    }
+
+    std::unique_ptr<ThreadPools> threadPools( new ThreadPools );
+    threadPools->frames.resize( m_frameCount );
+    for( auto& frame : threadPools->frames )
+    {
+        VkCommandPoolCreateInfo info = {};
+        info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+        info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        info.queueFamilyIndex = m_queueFamily;
+        VK_CHECK( vkCreateCommandPool( m_logicDevice, &info, nullptr, &frame.pool ) )
+    }
+
+    ThreadPools* threadPoolsPtr = threadPools.get();
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_threadPools.push_back( std::move( threadPools ) );
+    }
+    threadCache[ m_id ] = threadPoolsPtr;
+    return threadPoolsPtr->frames[ frameIndex ];
+}
+
+VkCommandBuffer VksCommandPoolManager::__allocate( uint32_t frameIndex, VkCommandBufferLevel level )
+{
+    FramePool& frame = __framePool( frameIndex );
+    bool primary = level == VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    auto& buffers = primary ? frame.primaries : frame.secondaries;
+    size_t& used = primary ? frame.usedPrimaries : frame.usedSecondaries;
+
+    // buffers are reset together with their pool and handed out again
+    if( used < buffers.size() )
+    {
+        return buffers[ used++ ];
+    }
+
+    VkCommandBufferAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = frame.pool;
+    allocInfo.level = level;
+    allocInfo.commandBufferCount = 1;
+
+    VkCommandBuffer commandBuffer;
+    VK_CHECK( vkAllocateCommandBuffers( m_logicDevice, &allocInfo, &commandBuffer ) )
+    buffers.push_back( commandBuffer );
+    used++;
+    return commandBuffer;
+}
+
+VkCommandBuffer VksCommandPoolManager::allocatePrimary( uint32_t frameIndex )
+{
+    return __allocate( frameIndex, VK_COMMAND_BUFFER_LEVEL_PRIMARY );
+}
+
+VkCommandBuffer VksCommandPoolManager::allocateSecondary( uint32_t frameIndex )
+{
+    return __allocate( frameIndex, VK_COMMAND_BUFFER_LEVEL_SECONDARY );
+}
+
+VkCommandBuffer VksCommandPoolManager::beginSecondary( uint32_t frameIndex, const std::shared_ptr<VksFramebuffer>& dstFramebuffer, uint32_t subpass )
+{
+    VkCommandBuffer commandBuffer = allocateSecondary( frameIndex );
+
+    VkCommandBufferInheritanceInfo inheritanceInfo = {};
+    inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritanceInfo.renderPass = dstFramebuffer->getVkRenderPass();
+    inheritanceInfo.subpass = subpass;
+    inheritanceInfo.framebuffer = dstFramebuffer->getVkFramebuffer();
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+    VK_CHECK( vkBeginCommandBuffer( commandBuffer, &beginInfo ) )
+
+    // dynamic state is not inherited from the primary buffer
+    m_graphicCommand->setDynamicStates( commandBuffer, dstFramebuffer->getFramebufferSize() );
+
+    auto graphicPipeline = dstFramebuffer->getGraphicPipeline();
+    if( graphicPipeline )
+    {
+        vkCmdBindPipeline( commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicPipeline->getVkGraphicPipele() );
+    }
+    return commandBuffer;
+}
+
+void VksCommandPoolManager::resetFrame( uint32_t frameIndex )
+{
+    if( frameIndex >= m_frameCount ) return;
+
+    std::lock_guard<std::mutex> lock( m_mutex );
+    for( auto& threadPools : m_threadPools )
+    {
+        FramePool& frame = threadPools->frames[ frameIndex ];
+        if( frame.usedPrimaries == 0 && frame.usedSecondaries == 0 ) continue;
+
+        VK_CHECK( vkResetCommandPool( m_logicDevice, frame.pool, 0 ) )
+        frame.usedPrimaries = 0;
+        frame.usedSecondaries = 0;
+    }
+}
+
+uint32_t VksCommandPoolManager::getFrameCount()
+{
+    return m_frameCount;
+}
+
+uint32_t VksCommandPoolManager::getQueueFamily()
+{
+    return m_queueFamily;
+}
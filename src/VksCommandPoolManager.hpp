@@ -0,0 +1,72 @@
+//
+//  VksCommandPoolManager.hpp
+//  Vulkan
+//
+//
+
+#ifndef VksCommandPoolManager_hpp
+#define VksCommandPoolManager_hpp
+
+#include "VkEngine.hpp"
+#include <atomic>
+#include <mutex>
+#include <memory>
+
+class VksFramebuffer;
+
+// Hands every recording thread its own VkCommandPool per frame in flight, so command
+// buffers can be recorded on several cores without locking. Pools of a frame are reset
+// as a whole with resetFrame() once the GPU is done with that frame; VksSwapChain does
+// this for every manager attached with attachCommandPools().
+class VksCommandPoolManager : protected VkEngine
+{
+public:
+    static std::shared_ptr<VksCommandPoolManager> createCommandPoolManager( uint32_t frameCount, uint32_t queueFamilyIndex );
+
+    ~VksCommandPoolManager();
+
+    // Both are served from the pool of the calling thread; the buffers stay valid until
+    // the next resetFrame() of the same frame.
+    VkCommandBuffer allocatePrimary( uint32_t frameIndex );
+    VkCommandBuffer allocateSecondary( uint32_t frameIndex );
+
+    // Allocates a secondary buffer and begins it inside the render pass of dstFramebuffer,
+    // with the dynamic states set and the framebuffer's pipeline bound. Execute it with
+    // VksFramebuffer::executeSecondaries() after bind( barrier, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS ).
+    VkCommandBuffer beginSecondary( uint32_t frameIndex, const std::shared_ptr<VksFramebuffer>& dstFramebuffer, uint32_t subpass = 0 );
+
+    // Must only be called while no thread records for frameIndex.
+    void resetFrame( uint32_t frameIndex );
+
+    uint32_t getFrameCount();
+    uint32_t getQueueFamily();
+private:
+    VksCommandPoolManager( uint32_t frameCount, uint32_t queueFamilyIndex );
+
+    struct FramePool
+    {
+        VkCommandPool pool = VK_NULL_HANDLE;
+        std::vector<VkCommandBuffer> primaries;
+        std::vector<VkCommandBuffer> secondaries;
+        size_t usedPrimaries = 0;
+        size_t usedSecondaries = 0;
+    };
+
+    struct ThreadPools
+    {
+        std::vector<FramePool> frames;
+    };
+
+    uint32_t m_frameCount;
+    uint32_t m_queueFamily;
+    uint64_t m_id;
+    std::vector<std::unique_ptr<ThreadPools>> m_threadPools;
+    std::mutex m_mutex;
+
+    static std::atomic<uint64_t> s_nextId;
+
+    FramePool& __framePool( uint32_t frameIndex );
+    VkCommandBuffer __allocate( uint32_t frameIndex, VkCommandBufferLevel level );
+};
+
+#endif /* VksCommandPoolManager_hpp */
@@ -12,6 +12,11 @@
 #include "VkEngine.hpp"
 #include "VksShaderProgram.hpp"
 #include "VksCommand.hpp"
+#include "VksProfiler.hpp"
+#include "VksTrace.hpp"
+#include "VksBarrier.hpp"
+#include "VksTimeline.hpp"
+#include "VksSyncPool.hpp"
 #include <cmath>
 #include <type_traits>
 
@@ -35,25 +40,38 @@ public:
     using IN_TYPE = typename std::enable_if< check<INPUT>::value, INPUT >::type;
     using OUT_TYPE = typename std::enable_if< check<OUTPUT>::value, OUTPUT >::type;
 
-    VksCompute( const std::shared_ptr<VksShaderProgram>& shader )
+    // asyncCompute submits to the dedicated compute queue when the device has one, so the
+    // dispatch overlaps with rendering. Exclusive resources shared with the graphics queue
+    // then need a VksBarrier queue transfer between getQueueFamily() and the graphics family.
+    VksCompute( const std::shared_ptr<VksShaderProgram>& shader, bool asyncCompute = false )
     :m_computePipeline( VK_NULL_HANDLE ), m_commandBuffer( VK_NULL_HANDLE )
     ,m_computeShader( shader ), m_computeComplete( VK_NULL_HANDLE )
     {
-        m_commandBuffer = m_graphicCommand->createPrimaryBuffer();
+        m_command = m_graphicCommand.get();
+        m_queue = m_graphicsQueue;
+        m_queueFamily = m_familyIndices.graphicsFamily.value();
+        m_timeline = m_graphicsTimeline.get();
+        if( asyncCompute && m_computeCommand )
+        {
+            m_command = m_computeCommand.get();
+            m_queue = m_computeQueue;
+            m_queueFamily = m_familyIndices.computeFamily.value();
+            m_timeline = m_computeTimeline.get();
+        }
+        m_commandBuffer = m_command->createPrimaryBuffer();
         __createComputePipeline();
         
-        VkSemaphoreCreateInfo createInfo = {};
-        createInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-        
-        vkCreateSemaphore(m_logicDevice, &createInfo, nullptr, &m_computeComplete);
-        
+        m_computeComplete = m_syncPool->acquireSemaphore();
     }
     
     ~VksCompute()
     {
+        // the last submit may still run the command buffer and signal the semaphore
+        __waitSubmit();
+        
         if( m_commandBuffer )
         {
-            vkFreeCommandBuffers(m_logicDevice, m_graphicCommand->getCommandPool(), 1, &m_commandBuffer);
+            vkFreeCommandBuffers(m_logicDevice, m_command->getCommandPool(), 1, &m_commandBuffer);
         }
         
         if( m_computePipeline )
@@ -61,15 +79,22 @@ public:
             vkDestroyPipeline(m_logicDevice, m_computePipeline, nullptr);
         }
         
-        if( m_computeComplete )
+        // nothing is known to have waited on a signaled m_computeComplete, so it can not be recycled
+        if( m_computeCompleteSignaled )
+            m_syncPool->discardSemaphore(m_computeComplete);
+        else
+            m_syncPool->releaseSemaphore(m_computeComplete);
+        
+        if( m_fence != VK_NULL_HANDLE )
         {
-            vkDestroySemaphore(m_logicDevice, m_computeComplete, nullptr);
+            m_syncPool->releaseFence(m_fence);
         }
     }
     
     void prepareCompute( int globalWidth, int groupWidth, int globalHeight, int groupHeight,
                          int globalDepth = -1, int groupDepth = -1 )
     {
+        VKS_TRACE_ZONE( "VksCompute::prepareCompute" );
         VkCommandBufferBeginInfo beginInfo = {};
         beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
         beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
@@ -78,16 +103,50 @@ public:
         VkDescriptorSet descSet = m_computeShader->getDescriptorSet();
         
         vkBeginCommandBuffer(m_commandBuffer, &beginInfo);
-     
-        vkCmdBindPipeline(m_commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_computePipeline);
-        vkCmdBindDescriptorSets(m_commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, layout, 0, 1, &descSet, 0, nullptr);
         
-        vkCmdDispatch( m_commandBuffer, (uint32_t)ceil( globalWidth / (float)groupWidth ),
-                      (uint32_t)ceil( globalHeight / (float)groupHeight ),
-                      (uint32_t)ceil( globalDepth / (float)groupDepth ) );
+        // pending transitions of a batch go in right before the dispatch
+        if( m_barrier )
+        {
+            m_barrier->setBarrier( m_commandBuffer );
+        }
+     
+        {
+            VksProfiler::Scope zone( m_profiler.get(), m_commandBuffer, m_zoneName, m_queueFamily );
+            
+            vkCmdBindPipeline(m_commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_computePipeline);
+            vkCmdBindDescriptorSets(m_commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, layout, 0, 1, &descSet, 0, nullptr);
+            
+            vkCmdDispatch( m_commandBuffer, (uint32_t)ceil( globalWidth / (float)groupWidth ),
+                          (uint32_t)ceil( globalHeight / (float)groupHeight ),
+                          (uint32_t)ceil( globalDepth / (float)groupDepth ) );
+        }
         vkEndCommandBuffer(m_commandBuffer);
     }
     
+    // Group size taken from the LocalSize execution mode of the compute shader
+    void prepareCompute( int globalWidth, int globalHeight, int globalDepth = 1 )
+    {
+        auto& localSize = m_computeShader->getReflection().getLocalSize();
+        if( localSize[0] == 0 )
+        {
+            throw std::runtime_error("compute shader has no reflected local size");
+        }
+        prepareCompute( globalWidth, localSize[0], globalHeight, localSize[1], globalDepth, localSize[2] );
+    }
+    
+    // Recorded by prepareCompute in front of the dispatch, typically a VksBarrier::createBatch
+    void setBarrier( const std::shared_ptr<VksBarrier>& barrier )
+    {
+        m_barrier = barrier;
+    }
+    
+    // The dispatch recorded by the next prepareCompute is timed as a zone of profiler
+    void setProfiler( const std::shared_ptr<VksProfiler>& profiler, const std::string& zoneName )
+    {
+        m_profiler = profiler;
+        m_zoneName = zoneName;
+    }
+    
     void setComputeInputOutput( std::shared_ptr<IN_TYPE> input, std::shared_ptr<OUT_TYPE> output )
     {
         m_input = input;
@@ -96,17 +155,51 @@ public:
     
     void submitWork( const std::vector<VkSemaphore>& waitSemaphores, std::vector<VkSemaphore>& signalSemaphores )
     {
-        VkPipelineStageFlags waitDstStages[] = { VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT  };
-        VkSubmitInfo submitInfo = {};
-        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-        submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &m_commandBuffer;
-        submitInfo.pWaitDstStageMask = waitDstStages;
-        submitInfo.waitSemaphoreCount = waitSemaphores.size();
-        submitInfo.pWaitSemaphores = waitSemaphores.data();
-        submitInfo.signalSemaphoreCount = 1;
-        submitInfo.pSignalSemaphores = &m_computeComplete;
-        vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
+        VKS_TRACE_ZONE( "VksCompute::submitWork" );
+        if( waitSemaphores.size() > VksTimeline::MAX_SUBMIT_SEMAPHORES )
+        {
+            throw std::runtime_error("too many wait semaphores for submitWork");
+        }
+        if( m_timeline )
+        {
+            VksTimeline::SemaphoreValue waits[ VksTimeline::MAX_SUBMIT_SEMAPHORES ];
+            for( int i = 0; i < waitSemaphores.size(); i++ )
+            {
+                waits[i] = { waitSemaphores[i], 0, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT };
+            }
+            m_submitValue = m_timeline->submit(&m_commandBuffer, 1, waits, static_cast<uint32_t>(waitSemaphores.size()), &m_computeComplete, 1);
+        }
+        else
+        {
+            // the pooled fence is taken on the first submit, later ones wait for the previous
+            if( m_fence == VK_NULL_HANDLE )
+            {
+                m_fence = m_syncPool->acquireFence();
+            }
+            else
+            {
+                __waitSubmit();
+                vkResetFences(m_logicDevice, 1, &m_fence);
+            }
+
+            VkPipelineStageFlags waitDstStages[ VksTimeline::MAX_SUBMIT_SEMAPHORES ];
+            for( int i = 0; i < waitSemaphores.size(); i++ )
+            {
+                waitDstStages[i] = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+            }
+            VkSubmitInfo submitInfo = {};
+            submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            submitInfo.commandBufferCount = 1;
+            submitInfo.pCommandBuffers = &m_commandBuffer;
+            submitInfo.pWaitDstStageMask = waitDstStages;
+            submitInfo.waitSemaphoreCount = waitSemaphores.size();
+            submitInfo.pWaitSemaphores = waitSemaphores.data();
+            submitInfo.signalSemaphoreCount = 1;
+            submitInfo.pSignalSemaphores = &m_computeComplete;
+            std::lock_guard<std::mutex> lock( _queueMutex( m_queue ) );
+            vkQueueSubmit(m_queue, 1, &submitInfo, m_fence);
+        }
+        m_computeCompleteSignaled = true;
         
         signalSemaphores.clear();
         signalSemaphores.push_back( m_computeComplete );
@@ -114,6 +207,30 @@ public:
 //        vkQueueWaitIdle(m_graphicsQueue);
     }
     
+    // Timeline path only: signals nothing but the next value of getTimeline(), which a
+    // consumer waits on with getTimeline()->waitValue( value, stage ) or getTimeline()->wait( value ).
+    uint64_t submitWork( const VksTimeline::SemaphoreValue* waits = nullptr, uint32_t waitCount = 0 )
+    {
+        VKS_TRACE_ZONE( "VksCompute::submitWork" );
+        if( m_timeline == nullptr )
+        {
+            throw std::runtime_error("submitWork with wait values needs timeline semaphores");
+        }
+        m_submitValue = m_timeline->submit(&m_commandBuffer, 1, waits, waitCount);
+        return m_submitValue;
+    }
+    
+    // timeline of the queue the work is submitted to, nullptr without timeline semaphores
+    VksTimeline* getTimeline()
+    {
+        return m_timeline;
+    }
+    
+    uint64_t getSubmitValue()
+    {
+        return m_submitValue;
+    }
+    
     std::shared_ptr<OUT_TYPE> getOutput()
     {
         return m_output;
@@ -129,6 +246,11 @@ public:
         return m_commandBuffer;
     }
     
+    uint32_t getQueueFamily()
+    {
+        return m_queueFamily;
+    }
+    
 protected:
 private:
     VkPipeline m_computePipeline;
@@ -137,9 +259,21 @@ private:
     std::shared_ptr<IN_TYPE> m_input;
     std::shared_ptr<OUT_TYPE> m_output;
     VkSemaphore m_computeComplete;
+    bool m_computeCompleteSignaled = false;
+    // fence path only, from the sync pool on the first submit
+    VkFence m_fence = VK_NULL_HANDLE;
+    VksCommand* m_command;
+    VkQueue m_queue;
+    uint32_t m_queueFamily;
+    VksTimeline* m_timeline;
+    uint64_t m_submitValue = 0;
+    std::shared_ptr<VksProfiler> m_profiler;
+    std::string m_zoneName;
+    std::shared_ptr<VksBarrier> m_barrier;
 
     void __createComputePipeline()
     {
+        VKS_TRACE_ZONE( "VksCompute::createComputePipeline" );
         VkComputePipelineCreateInfo createInfo = {};
         createInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
         createInfo.flags = 0;
@@ -148,7 +282,19 @@ private:
         createInfo.stage = shaderStages[0];
         createInfo.pNext = nullptr;
         
-        VK_CHECK( vkCreateComputePipelines(m_logicDevice, nullptr, 1, &createInfo, nullptr, &m_computePipeline) );
+        VK_CHECK( vkCreateComputePipelines(m_logicDevice, getVkPipelineCache(), 1, &createInfo, nullptr, &m_computePipeline) );
+    }
+    
+    void __waitSubmit()
+    {
+        if( m_timeline )
+        {
+            m_timeline->wait(m_submitValue);
+        }
+        else if( m_fence != VK_NULL_HANDLE )
+        {
+            vkWaitForFences(m_logicDevice, 1, &m_fence, VK_TRUE, UINT64_MAX);
+        }
     }
 };
 
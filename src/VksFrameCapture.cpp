@@ -0,0 +1,409 @@
+//
+//  VksFrameCapture.cpp
+//  Vulkan
+//
+//
+
+#include "VksFrameCapture.hpp"
+#include "VksTexture.hpp"
+#include "VksFramebuffer.hpp"
+#include "VksTrace.hpp"
+#include "lodepng.h"
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#if defined( __SSE2__ ) || defined( _M_X64 )
+#include <emmintrin.h>
+#define VKS_PNG_SSE2 1
+#endif
+
+// PNG filter types, in the order of the byte written before each row
+enum PNGFilter
+{
+    FILTER_NONE,
+    FILTER_SUB,
+    FILTER_UP,
+    FILTER_AVERAGE,
+    FILTER_PAETH,
+    FILTER_COUNT
+};
+
+static uint8_t paethPredictor( int a, int b, int c )
+{
+    int pa = abs( b - c );
+    int pb = abs( a - c );
+    int pc = abs( a + b - 2 * c );
+    if( pa <= pb && pa <= pc ) return static_cast<uint8_t>( a );
+    if( pb <= pc ) return static_cast<uint8_t>( b );
+    return static_cast<uint8_t>( c );
+}
+
+static uint8_t predictor( int filter, uint8_t a, uint8_t b, uint8_t c )
+{
+    switch( filter )
+    {
+        case FILTER_SUB: return a;
+        case FILTER_UP: return b;
+        case FILTER_AVERAGE: return static_cast<uint8_t>( ( a + b ) / 2 );
+        case FILTER_PAETH: return paethPredictor( a, b, c );
+        default: return 0;
+    }
+}
+
+#ifdef VKS_PNG_SSE2
+static __m128i abs16( __m128i x )
+{
+    return _mm_max_epi16( x, _mm_sub_epi16( _mm_setzero_si128(), x ) );
+}
+
+static __m128i select16( __m128i mask, __m128i ifSet, __m128i ifClear )
+{
+    return _mm_or_si128( _mm_and_si128( mask, ifSet ), _mm_andnot_si128( mask, ifClear ) );
+}
+
+// paethPredictor on 16 bytes, in 16 bit lanes one half at a time
+static __m128i paethPredictor16( __m128i a, __m128i b, __m128i c )
+{
+    __m128i zero = _mm_setzero_si128();
+    __m128i halves[2];
+    for( int half = 0; half < 2; half++ )
+    {
+        __m128i a16 = half ? _mm_unpackhi_epi8( a, zero ) : _mm_unpacklo_epi8( a, zero );
+        __m128i b16 = half ? _mm_unpackhi_epi8( b, zero ) : _mm_unpacklo_epi8( b, zero );
+        __m128i c16 = half ? _mm_unpackhi_epi8( c, zero ) : _mm_unpacklo_epi8( c, zero );
+        __m128i pa = abs16( _mm_sub_epi16( b16, c16 ) );
+        __m128i pb = abs16( _mm_sub_epi16( a16, c16 ) );
+        __m128i pc = abs16( _mm_sub_epi16( _mm_add_epi16( a16, b16 ), _mm_add_epi16( c16, c16 ) ) );
+        __m128i notA = _mm_or_si128( _mm_cmpgt_epi16( pa, pb ), _mm_cmpgt_epi16( pa, pc ) );
+        __m128i notB = _mm_cmpgt_epi16( pb, pc );
+        halves[half] = select16( notA, select16( notB, c16, b16 ), a16 );
+    }
+    return _mm_packus_epi16( halves[0], halves[1] );
+}
+
+static __m128i predictor16( int filter, __m128i a, __m128i b, __m128i c )
+{
+    switch( filter )
+    {
+        case FILTER_SUB: return a;
+        case FILTER_UP: return b;
+        // _mm_avg_epu8 rounds up, the filter rounds down
+        case FILTER_AVERAGE: return _mm_sub_epi8( _mm_avg_epu8( a, b ), _mm_and_si128( _mm_xor_si128( a, b ), _mm_set1_epi8( 1 ) ) );
+        case FILTER_PAETH: return paethPredictor16( a, b, c );
+        default: return _mm_setzero_si128();
+    }
+}
+#endif
+
+// Filtering reads only unfiltered bytes, so every byte is independent: a is the byte one
+// texel to the left, b the one above, c above left, all zero outside the image
+static void filterRow( int filter, const uint8_t* row, const uint8_t* prior, size_t size, uint32_t bpp, uint8_t* out )
+{
+    size_t i = 0;
+    for( ; i < bpp && i < size; i++ )
+    {
+        out[i] = row[i] - predictor( filter, 0, prior[i], 0 );
+    }
+#ifdef VKS_PNG_SSE2
+    for( ; i + 16 <= size; i += 16 )
+    {
+        __m128i x = _mm_loadu_si128( reinterpret_cast<const __m128i*>( row + i ) );
+        __m128i a = _mm_loadu_si128( reinterpret_cast<const __m128i*>( row + i - bpp ) );
+        __m128i b = _mm_loadu_si128( reinterpret_cast<const __m128i*>( prior + i ) );
+        __m128i c = _mm_loadu_si128( reinterpret_cast<const __m128i*>( prior + i - bpp ) );
+        _mm_storeu_si128( reinterpret_cast<__m128i*>( out + i ), _mm_sub_epi8( x, predictor16( filter, a, b, c ) ) );
+    }
+#endif
+    for( ; i < size; i++ )
+    {
+        out[i] = row[i] - predictor( filter, row[i - bpp], prior[i], prior[i - bpp] );
+    }
+}
+
+// sum of the filtered bytes taken as signed, the usual estimate of how well a row deflates
+static uint64_t rowCost( const uint8_t* filtered, size_t size )
+{
+    uint64_t cost = 0;
+    size_t i = 0;
+#ifdef VKS_PNG_SSE2
+    __m128i zero = _mm_setzero_si128();
+    __m128i sum = zero;
+    for( ; i + 16 <= size; i += 16 )
+    {
+        __m128i x = _mm_loadu_si128( reinterpret_cast<const __m128i*>( filtered + i ) );
+        // | x | as unsigned bytes is the smaller of x and -x
+        __m128i magnitude = _mm_min_epu8( x, _mm_sub_epi8( zero, x ) );
+        sum = _mm_add_epi64( sum, _mm_sad_epu8( magnitude, zero ) );
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128( reinterpret_cast<__m128i*>( lanes ), sum );
+    cost = lanes[0] + lanes[1];
+#endif
+    for( ; i < size; i++ )
+    {
+        cost += filtered[i] < 128 ? filtered[i] : 256 - filtered[i];
+    }
+    return cost;
+}
+
+static uint32_t captureChannels( VkFormat format )
+{
+    switch( format )
+    {
+        case VK_FORMAT_R8_UNORM:
+        case VK_FORMAT_R8_SRGB:
+            return 1;
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SRGB:
+        case VK_FORMAT_B8G8R8A8_UNORM:
+        case VK_FORMAT_B8G8R8A8_SRGB:
+            return 4;
+        default:
+            return 0;
+    }
+}
+
+std::shared_ptr<VksFrameCapture> VksFrameCapture::createFrameCapture( const Options& options, const std::shared_ptr<VksReadback>& readback )
+{
+    return std::shared_ptr<VksFrameCapture>( new VksFrameCapture( options, readback ) );
+}
+
+VksFrameCapture::VksFrameCapture( const Options& options, const std::shared_ptr<VksReadback>& readback )
+    :m_options( options ), m_readback( readback )
+{
+    if( m_readback == nullptr )
+    {
+        m_readback = VksReadback::createReadback();
+    }
+    m_options.maxQueuedFrames = std::max( m_options.maxQueuedFrames, 1u );
+
+    uint32_t threadCount = m_options.threadCount;
+    if( threadCount == 0 )
+    {
+        uint32_t hardwareThreads = std::thread::hardware_concurrency();
+        threadCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+    }
+    for( uint32_t i = 0; i < threadCount; i++ )
+    {
+        m_threads.emplace_back( &VksFrameCapture::__worker, this );
+    }
+}
+
+VksFrameCapture::~VksFrameCapture()
+{
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_stop = true;
+    }
+    m_frameReady.notify_all();
+    for( auto& thread : m_threads )
+    {
+        thread.join();
+    }
+}
+
+bool VksFrameCapture::capture( const std::shared_ptr<VksTexture>& texture, const std::string& path )
+{
+    VKS_TRACE_ZONE( "VksFrameCapture::capture" );
+    if( captureChannels( texture->getFormat() ) == 0 )
+    {
+        throw std::runtime_error("frame capture needs an 8 bit R, RGBA or BGRA texture");
+    }
+
+    {
+        std::unique_lock<std::mutex> lock( m_mutex );
+        if( m_frames.size() + m_encoding >= m_options.maxQueuedFrames )
+        {
+            if( m_options.overflow == OVERFLOW_BLOCK )
+            {
+                m_frameDone.wait( lock, [this] { return m_frames.size() + m_encoding < m_options.maxQueuedFrames; } );
+            }
+            else if( m_options.overflow == OVERFLOW_DROP_OLDEST && !m_frames.empty() )
+            {
+                // its readback still completes, nothing waits for it
+                m_frames.pop_front();
+                m_statistics.dropped++;
+            }
+            else
+            {
+                m_statistics.dropped++;
+                return false;
+            }
+        }
+
+        Frame frame;
+        frame.download = m_readback->readTexture( texture );
+        // submitted on the capturing thread before a worker can see the frame, so the
+        // workers only wait on the batch fence and never submit to the queue themselves
+        m_readback->flush();
+        frame.path = path;
+        frame.format = texture->getFormat();
+        m_frames.push_back( std::move( frame ) );
+        m_statistics.captured++;
+    }
+
+    m_frameReady.notify_one();
+    return true;
+}
+
+bool VksFrameCapture::capture( const std::shared_ptr<VksFramebuffer>& framebuffer, const std::string& path )
+{
+    return capture( framebuffer->getColorTexture(), path );
+}
+
+void VksFrameCapture::waitIdle()
+{
+    VKS_TRACE_ZONE( "VksFrameCapture::waitIdle" );
+    std::unique_lock<std::mutex> lock( m_mutex );
+    m_frameDone.wait( lock, [this] { return m_frames.empty() && m_encoding == 0; } );
+}
+
+VksFrameCapture::Statistics VksFrameCapture::getStatistics()
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    return m_statistics;
+}
+
+std::vector<uint8_t> VksFrameCapture::encodePNG( const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t channels, uint32_t windowSize )
+{
+    VKS_TRACE_ZONE( "VksFrameCapture::encodePNG" );
+    if( channels != 1 && channels != 4 )
+    {
+        throw std::runtime_error("encodePNG takes gray or RGBA pixels");
+    }
+
+    // every row with the filter byte in front, then zlib compressed as one IDAT chunk
+    size_t rowSize = static_cast<size_t>( width ) * channels;
+    std::vector<uint8_t> filtered( ( rowSize + 1 ) * height );
+    std::vector<uint8_t> candidates( rowSize * FILTER_COUNT );
+    std::vector<uint8_t> zeroRow( rowSize, 0 );
+    for( uint32_t y = 0; y < height; y++ )
+    {
+        const uint8_t* row = pixels + y * rowSize;
+        const uint8_t* prior = y > 0 ? row - rowSize : zeroRow.data();
+
+        int bestFilter = FILTER_NONE;
+        uint64_t bestCost = UINT64_MAX;
+        for( int filter = FILTER_NONE; filter < FILTER_COUNT; filter++ )
+        {
+            uint8_t* candidate = candidates.data() + filter * rowSize;
+            filterRow( filter, row, prior, rowSize, channels, candidate );
+            uint64_t cost = rowCost( candidate, rowSize );
+            if( cost < bestCost )
+            {
+                bestCost = cost;
+                bestFilter = filter;
+            }
+        }
+
+        uint8_t* out = filtered.data() + y * ( rowSize + 1 );
+        out[0] = static_cast<uint8_t>( bestFilter );
+        memcpy( out + 1, candidates.data() + bestFilter * rowSize, rowSize );
+    }
+
+    LodePNGCompressSettings settings;
+    lodepng_compress_settings_init( &settings );
+    settings.windowsize = windowSize;
+
+    unsigned char* idat = nullptr;
+    size_t idatSize = 0;
+    unsigned error = lodepng_zlib_compress( &idat, &idatSize, filtered.data(), filtered.size(), &settings );
+
+    uint8_t header[13] = {
+        static_cast<uint8_t>( width >> 24 ), static_cast<uint8_t>( width >> 16 ), static_cast<uint8_t>( width >> 8 ), static_cast<uint8_t>( width ),
+        static_cast<uint8_t>( height >> 24 ), static_cast<uint8_t>( height >> 16 ), static_cast<uint8_t>( height >> 8 ), static_cast<uint8_t>( height ),
+        // bit depth, color type gray or RGBA, then deflate, adaptive filtering and no interlace
+        8, static_cast<uint8_t>( channels == 4 ? 6 : 0 ), 0, 0, 0
+    };
+    unsigned char* chunks = nullptr;
+    size_t chunksSize = 0;
+    if( !error ) error = lodepng_chunk_create( &chunks, &chunksSize, sizeof( header ), "IHDR", header );
+    if( !error ) error = lodepng_chunk_create( &chunks, &chunksSize, static_cast<unsigned>( idatSize ), "IDAT", idat );
+    if( !error ) error = lodepng_chunk_create( &chunks, &chunksSize, 0, "IEND", header );
+    free( idat );
+    if( error )
+    {
+        free( chunks );
+        throw std::runtime_error( lodepng_error_text( error ) );
+    }
+
+    static const uint8_t signature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+    std::vector<uint8_t> png( signature, signature + sizeof( signature ) );
+    png.insert( png.end(), chunks, chunks + chunksSize );
+    free( chunks );
+    return png;
+}
+
+void VksFrameCapture::__worker()
+{
+    while( true )
+    {
+        Frame frame;
+        {
+            std::unique_lock<std::mutex> lock( m_mutex );
+            m_frameReady.wait( lock, [this] { return m_stop || !m_frames.empty(); } );
+            // queued frames are still written on shutdown
+            if( m_frames.empty() ) return;
+            frame = std::move( m_frames.front() );
+            m_frames.pop_front();
+            m_encoding++;
+        }
+
+        size_t fileSize = 0;
+        bool written = false;
+        try
+        {
+            fileSize = __write( frame );
+            written = true;
+        }
+        catch( const std::exception& e )
+        {
+            printf("frame capture of %s failed: %s\n", frame.path.c_str(), e.what());
+        }
+
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            m_encoding--;
+            if( written )
+            {
+                m_statistics.written++;
+                m_statistics.bytesWritten += fileSize;
+            }
+            else
+            {
+                m_statistics.failed++;
+            }
+        }
+        m_frameDone.notify_all();
+    }
+}
+
+size_t VksFrameCapture::__write( const Frame& frame )
+{
+    VKS_TRACE_ZONE( "VksFrameCapture::__write" );
+    const std::vector<uint8_t>& data = frame.download->wait();
+    VkExtent2D extent = frame.download->getExtent();
+    uint32_t channels = captureChannels( frame.format );
+
+    const uint8_t* pixels = data.data();
+    std::vector<uint8_t> swizzled;
+    if( frame.format == VK_FORMAT_B8G8R8A8_UNORM || frame.format == VK_FORMAT_B8G8R8A8_SRGB )
+    {
+        swizzled = data;
+        for( size_t i = 0; i + 3 < swizzled.size(); i += 4 )
+        {
+            std::swap( swizzled[i], swizzled[i + 2] );
+        }
+        pixels = swizzled.data();
+    }
+
+    std::vector<uint8_t> png = encodePNG( pixels, extent.width, extent.height, channels, m_options.windowSize );
+
+    std::ofstream file( frame.path, std::ios::binary );
+    file.write( reinterpret_cast<const char*>( png.data() ), png.size() );
+    if( !file )
+    {
+        throw std::runtime_error("can not write the file");
+    }
+    return png.size();
+}
@@ -0,0 +1,110 @@
+//
+//  VksFrameCapture.hpp
+//  Vulkan
+//
+//
+
+#ifndef VksFrameCapture_hpp
+#define VksFrameCapture_hpp
+
+#include "VkEngine.hpp"
+#include "VksReadback.hpp"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+class VksTexture;
+class VksFramebuffer;
+
+// Writes rendered frames to PNG files off the render thread. capture() only records and
+// submits a readback and queues the frame; workers wait for the download on the host,
+// filter every row with the PNG filter that leaves the smallest residual, deflate with
+// lodepng and write the file. Workers never submit to the queue the frames render on.
+// When maxQueuedFrames frames are queued or encoding, the overflow policy decides
+// whether capture() blocks or a frame is dropped.
+//
+// Frames are 8 bit R, RGBA or BGRA textures with TRANSFER_SRC usage, written as gray or
+// RGBA PNGs. The work that renders a frame must be submitted before capture() is called
+// for it.
+class VksFrameCapture
+{
+public:
+    enum OverflowPolicy
+    {
+        // capture() waits for a frame to finish
+        OVERFLOW_BLOCK,
+        // the frame being captured is dropped
+        OVERFLOW_DROP_NEWEST,
+        // the oldest frame no worker has started is dropped, else the new one
+        OVERFLOW_DROP_OLDEST,
+    };
+
+    struct Options
+    {
+        // 0 uses one thread less than the hardware has, at least one
+        uint32_t threadCount = 0;
+        uint32_t maxQueuedFrames = 8;
+        OverflowPolicy overflow = OVERFLOW_BLOCK;
+        // deflate window, a power of two up to 32768; larger compresses better and slower
+        uint32_t windowSize = 2048;
+    };
+
+    struct Statistics
+    {
+        uint64_t captured = 0;
+        uint64_t dropped = 0;
+        uint64_t written = 0;
+        // frames that could not be encoded or written
+        uint64_t failed = 0;
+        uint64_t bytesWritten = 0;
+    };
+
+    // Without a readback the capture creates its own
+    static std::shared_ptr<VksFrameCapture> createFrameCapture( const Options& options, const std::shared_ptr<VksReadback>& readback = nullptr );
+
+    // Writes the frames already queued
+    ~VksFrameCapture();
+
+    // Returns false when the overflow policy dropped the frame
+    bool capture( const std::shared_ptr<VksTexture>& texture, const std::string& path );
+    // the color attachment
+    bool capture( const std::shared_ptr<VksFramebuffer>& framebuffer, const std::string& path );
+
+    // Blocks until every queued frame is written
+    void waitIdle();
+
+    Statistics getStatistics();
+
+    // channels is 1 for gray or 4 for RGBA, rows tightly packed
+    static std::vector<uint8_t> encodePNG( const uint8_t* pixels, uint32_t width, uint32_t height, uint32_t channels,
+                                           uint32_t windowSize = 2048 );
+
+private:
+    struct Frame
+    {
+        std::shared_ptr<VksReadback::Download> download;
+        std::string path;
+        VkFormat format;
+    };
+
+    VksFrameCapture( const Options& options, const std::shared_ptr<VksReadback>& readback );
+
+    Options m_options;
+    std::shared_ptr<VksReadback> m_readback;
+    std::vector<std::thread> m_threads;
+    std::deque<Frame> m_frames;
+    // frames a worker took and has not written yet
+    uint32_t m_encoding = 0;
+    bool m_stop = false;
+    Statistics m_statistics;
+    std::mutex m_mutex;
+    std::condition_variable m_frameReady;
+    std::condition_variable m_frameDone;
+
+    void __worker();
+    // returns the file size, throws when the frame could not be encoded or written
+    size_t __write( const Frame& frame );
+};
+
+#endif /* VksFrameCapture_hpp */
@@ -10,8 +10,11 @@
 #include "VksTexture.hpp"
 #include "VksRenderPass.hpp"
 #include "VksGraphicPipeline.hpp"
+#include "VksProfiler.hpp"
+#include "VksTrace.hpp"
 #include "VksBarrier.hpp"
 #include "VksBuffer.hpp"
+#include "VksSyncPool.hpp"
 #include "VksFramebuffer.hpp"
 #include <array>
 #include <iostream>
@@ -19,7 +22,8 @@
 VksFramebuffer::VksFramebuffer( const std::shared_ptr<VksTexture>& colorTexture,
                                const std::shared_ptr<VksRenderPass>& renderPass )
     :VkEngine(), m_framebuffer(VK_NULL_HANDLE), m_colorTexture( colorTexture )
-    ,m_commandBuffer( VK_NULL_HANDLE )
+    ,m_commandBuffer( VK_NULL_HANDLE ), m_fence( VK_NULL_HANDLE )
+    ,m_zone( -1 )
 {
     VkFramebufferCreateInfo framebufferInfo = {};
     framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
@@ -38,22 +42,14 @@ VksFramebuffer::VksFramebuffer( const std::shared_ptr<VksTexture>& colorTexture,
     VK_CHECK( vkCreateFramebuffer(m_logicDevice, &framebufferInfo, nullptr, &m_framebuffer) )
     m_commandBuffer = m_graphicCommand->createPrimaryBuffer();
     
-    VkSemaphoreCreateInfo semaphoreCreate = {};
-    semaphoreCreate.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-    
-    VK_CHECK( vkCreateSemaphore(m_logicDevice, &semaphoreCreate, nullptr, &m_renderComplete) )
-    
-    VkFenceCreateInfo fenceInfo = {};
-    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-    
-    VK_CHECK( vkCreateFence(m_logicDevice, &fenceInfo, nullptr, &m_fence) )
+    m_renderComplete = m_syncPool->acquireSemaphore();
 }
 
 VksFramebuffer::VksFramebuffer( const std::shared_ptr<VksTexture>& colorTexture, const std::shared_ptr<VksTexture>& depthStencilTexture, const std::shared_ptr<VksRenderPass>& renderPass)
     :VkEngine(), m_framebuffer(VK_NULL_HANDLE), m_colorTexture(colorTexture)
     ,m_depthStencilTexture( depthStencilTexture )
-    ,m_commandBuffer( VK_NULL_HANDLE )
+    ,m_commandBuffer( VK_NULL_HANDLE ), m_fence( VK_NULL_HANDLE )
+    ,m_zone( -1 )
 {
     VkFramebufferCreateInfo framebufferInfo = {};
     framebufferInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
@@ -79,16 +75,7 @@ VksFramebuffer::VksFramebuffer( const std::shared_ptr<VksTexture>& colorTexture,
     VK_CHECK( vkCreateFramebuffer(m_logicDevice, &framebufferInfo, nullptr, &m_framebuffer) )
     m_commandBuffer = m_graphicCommand->createPrimaryBuffer();
     
-    VkSemaphoreCreateInfo semaphoreCreate = {};
-    semaphoreCreate.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
-    
-    VK_CHECK( vkCreateSemaphore(m_logicDevice, &semaphoreCreate, nullptr, &m_renderComplete) )
-    
-    VkFenceCreateInfo fenceInfo = {};
-    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
-    
-    VK_CHECK( vkCreateFence(m_logicDevice, &fenceInfo, nullptr, &m_fence) )
+    m_renderComplete = m_syncPool->acquireSemaphore();
 }
 
 VkFramebuffer VksFramebuffer::getVkFramebuffer()
@@ -120,14 +107,51 @@ void VksFramebuffer::useGraphicPipeline(const std::shared_ptr<VksGraphicPipeline
     vkCmdBindPipeline(m_commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicPipeline->getVkGraphicPipele());
 }
 
-void VksFramebuffer::bind( std::shared_ptr<VksBarrier> barrier )
+const std::shared_ptr<VksGraphicPipeline> VksFramebuffer::getGraphicPipeline()
+{
+    return m_graphicPipeline;
+}
+
+void VksFramebuffer::bind( std::shared_ptr<VksBarrier> barrier, VkSubpassContents contents )
 {
-    m_graphicCommand->beginRenderPass(m_commandBuffer, shared_from_this(), barrier);
+    VKS_TRACE_ZONE( "VksFramebuffer::bind" );
+    __waitSubmit();
+    m_graphicCommand->beginCommandBuffer(m_commandBuffer, barrier);
+    m_zone = m_profiler ? m_profiler->beginZone(m_commandBuffer, m_zoneName) : -1;
+    m_graphicCommand->cmdBeginRenderPass(m_commandBuffer, shared_from_this(), contents);
 }
 
 void VksFramebuffer::unBind()
 {
-    m_graphicCommand->endRenderPass(m_commandBuffer);
+    m_graphicCommand->cmdEndRenderPass(m_commandBuffer);
+    
+    // the render pass moved the attachments to their final layouts
+    if( m_colorTexture && m_rendePass->getColorFinalLayout() != VK_IMAGE_LAYOUT_UNDEFINED )
+    {
+        m_colorTexture->assumeState(m_rendePass->getColorFinalLayout(), VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+    }
+    if( m_depthStencilTexture && m_rendePass->getDepthFinalLayout() != VK_IMAGE_LAYOUT_UNDEFINED )
+    {
+        m_depthStencilTexture->assumeState(m_rendePass->getDepthFinalLayout(), VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+                                           VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT);
+    }
+    if( m_profiler )
+    {
+        m_profiler->endZone(m_commandBuffer, m_zone);
+    }
+    m_graphicCommand->endCommandBuffer(m_commandBuffer);
+}
+
+void VksFramebuffer::setProfiler(const std::shared_ptr<VksProfiler> &profiler, const std::string &zoneName)
+{
+    m_profiler = profiler;
+    m_zoneName = zoneName;
+}
+
+void VksFramebuffer::executeSecondaries(const std::vector<VkCommandBuffer> &secondaries)
+{
+    if( secondaries.empty() ) return;
+    vkCmdExecuteCommands(m_commandBuffer, static_cast<uint32_t>(secondaries.size()), secondaries.data());
 }
 
 void VksFramebuffer::bindUniformSets(int setsIndex)
@@ -136,6 +160,12 @@ void VksFramebuffer::bindUniformSets(int setsIndex)
     m_graphicCommand->bindUniformSet(m_commandBuffer, shader, shader->getDescriptorSet( setsIndex ));
 }
 
+void VksFramebuffer::bindUniformSets(int setsIndex, const std::vector<uint32_t> &dynamicOffsets)
+{
+    auto shader = m_graphicPipeline->m_Shader;
+    m_graphicCommand->bindUniformSet(m_commandBuffer, shader, shader->getDescriptorSet( setsIndex ), dynamicOffsets);
+}
+
 void VksFramebuffer::bindIndexBuffer(const std::shared_ptr<VksBuffer> &indexBuffer)
 {
     m_graphicCommand->bindIndexBuffer(m_commandBuffer, indexBuffer);
@@ -156,15 +186,29 @@ void VksFramebuffer::drawIndexed(int indexCount)
     m_graphicCommand->drawIndexed(m_commandBuffer, indexCount);
 }
 
+void VksFramebuffer::__waitSubmit()
+{
+    VKS_TRACE_ZONE( "VksFramebuffer::waitFence" );
+    if( m_graphicsTimeline )
+    {
+        m_graphicsTimeline->wait(m_submitValue);
+    }
+    else if( m_fence != VK_NULL_HANDLE )
+    {
+        vkWaitForFences(m_logicDevice, 1, &m_fence, VK_TRUE, UINT64_MAX);
+    }
+}
+
 void VksFramebuffer::submitRender(const std::vector<VkSemaphore> &waitSemaphores, std::vector<VkPipelineStageFlags> &waitStages, std::vector<VkSemaphore> &signalSemaphores)
 {
-    vkWaitForFences(m_logicDevice, 1, &m_fence, VK_TRUE, UINT_MAX);
-    VkSubmitInfo submitInfo = {};
-    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submitInfo.pWaitSemaphores = waitSemaphores.data();
-    submitInfo.waitSemaphoreCount = waitSemaphores.size();
-    
-    VkPipelineStageFlags *waitDstStageMasks = new VkPipelineStageFlags[ waitStages.size() + 2 ];
+    VKS_TRACE_ZONE( "VksFramebuffer::submitRender" );
+    __waitSubmit();
+
+    if( waitSemaphores.size() > VksTimeline::MAX_SUBMIT_SEMAPHORES || waitStages.size() + 2 > VksTimeline::MAX_SUBMIT_SEMAPHORES )
+    {
+        throw std::runtime_error("too many wait semaphores for submitRender");
+    }
+    VkPipelineStageFlags waitDstStageMasks[ VksTimeline::MAX_SUBMIT_SEMAPHORES ];
     waitDstStageMasks[0] = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
     waitDstStageMasks[1] = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
     
@@ -173,6 +217,23 @@ void VksFramebuffer::submitRender(const std::vector<VkSemaphore> &waitSemaphores
         waitDstStageMasks[ 2 + i ] = waitStages.at(i);
     }
     
+    signalSemaphores.push_back( m_renderComplete );
+    m_renderCompleteSignaled = true;
+    if( m_graphicsTimeline )
+    {
+        VksTimeline::SemaphoreValue waits[ VksTimeline::MAX_SUBMIT_SEMAPHORES ];
+        for( int i = 0; i < waitSemaphores.size(); i++ )
+        {
+            waits[i] = { waitSemaphores[i], 0, waitDstStageMasks[i] };
+        }
+        m_submitValue = m_graphicsTimeline->submit(&m_commandBuffer, 1, waits, static_cast<uint32_t>(waitSemaphores.size()), &m_renderComplete, 1);
+        return;
+    }
+
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.pWaitSemaphores = waitSemaphores.data();
+    submitInfo.waitSemaphoreCount = waitSemaphores.size();
     submitInfo.pWaitDstStageMask = waitDstStageMasks;
     submitInfo.commandBufferCount = 1;
     submitInfo.pCommandBuffers = &m_commandBuffer;
@@ -181,14 +242,42 @@ void VksFramebuffer::submitRender(const std::vector<VkSemaphore> &waitSemaphores
     submitInfo.signalSemaphoreCount = 1;
     submitInfo.pSignalSemaphores = signalSema;
     
-    signalSemaphores.push_back( m_renderComplete );
-    vkResetFences(m_logicDevice, 1, &m_fence);
+    // the pooled fence is taken on the first submit, so there is nothing to wait for before it
+    if( m_fence == VK_NULL_HANDLE )
+    {
+        m_fence = m_syncPool->acquireFence();
+    }
+    else
+    {
+        vkResetFences(m_logicDevice, 1, &m_fence);
+    }
+    std::lock_guard<std::mutex> lock( _queueMutex( m_graphicsQueue ) );
     vkQueueSubmit(m_graphicsQueue, 1, &submitInfo, m_fence);
-    delete [] waitDstStageMasks;
+}
+
+uint64_t VksFramebuffer::submitRender(const VksTimeline::SemaphoreValue* waits, uint32_t waitCount, VkSemaphore signalSemaphore)
+{
+    VKS_TRACE_ZONE( "VksFramebuffer::submitRender" );
+    if( !m_graphicsTimeline )
+    {
+        throw std::runtime_error("submitRender with wait values needs timeline semaphores");
+    }
+    __waitSubmit();
+    m_submitValue = m_graphicsTimeline->submit(&m_commandBuffer, 1, waits, waitCount,
+                                               &signalSemaphore, signalSemaphore != VK_NULL_HANDLE ? 1 : 0);
+    return m_submitValue;
+}
+
+uint64_t VksFramebuffer::getSubmitValue()
+{
+    return m_submitValue;
 }
 
 VksFramebuffer::~VksFramebuffer()
 {
+    // the command buffer, semaphore and fence may still be used by the last submit
+    __waitSubmit();
+
     if( m_framebuffer != VK_NULL_HANDLE )
     {
         vkDestroyFramebuffer(m_logicDevice, m_framebuffer, nullptr);
@@ -199,14 +288,15 @@ VksFramebuffer::~VksFramebuffer()
         vkFreeCommandBuffers(m_logicDevice, m_graphicCommand->getCommandPool(), 1, &m_commandBuffer);
     }
     
-    if( m_renderComplete != VK_NULL_HANDLE )
-    {
-        vkDestroySemaphore(m_logicDevice, m_renderComplete, nullptr);
-    }
+    // offscreen users never wait on m_renderComplete, so once signaled it can not go back to the pool
+    if( m_renderCompleteSignaled )
+        m_syncPool->discardSemaphore(m_renderComplete);
+    else
+        m_syncPool->releaseSemaphore(m_renderComplete);
     
     if( m_fence != VK_NULL_HANDLE )
     {
-        vkDestroyFence(m_logicDevice, m_fence, nullptr);
+        m_syncPool->releaseFence(m_fence);
     }
 }
 
@@ -11,12 +11,14 @@
 
 #include <stdio.h>
 #include "VkEngine.hpp"
+#include "VksTimeline.hpp"
 
 class VksBarrier;
 class VksTexture;
 class VksRenderPass;
 class VksGraphicPipeline;
 class VksBuffer;
+class VksProfiler;
 class VksFramebuffer : protected VkEngine, public std::enable_shared_from_this<VksFramebuffer>
 {
 public:
@@ -38,10 +40,20 @@ public:
     const std::shared_ptr<VksTexture> getColorTexture();
     const std::shared_ptr<VksTexture> getDepthStencilTexture();
 
-    void bind( std::shared_ptr<VksBarrier> barrier = nullptr );
+    const std::shared_ptr<VksGraphicPipeline> getGraphicPipeline();
+
+    // Re-recording waits for the previous submission of this framebuffer. Pass
+    // VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS to draw with executeSecondaries() only.
+    void bind( std::shared_ptr<VksBarrier> barrier = nullptr, VkSubpassContents contents = VK_SUBPASS_CONTENTS_INLINE );
     void unBind();
     
+    void executeSecondaries( const std::vector<VkCommandBuffer>& secondaries );
+    
+    // The render pass recorded by the next bind()/unBind() is timed as a zone of profiler
+    void setProfiler( const std::shared_ptr<VksProfiler>& profiler, const std::string& zoneName );
+    
     void bindUniformSets( int setsIndex );
+    void bindUniformSets( int setsIndex, const std::vector<uint32_t>& dynamicOffsets );
     void bindVertexBuffer( const std::shared_ptr<VksBuffer>& vertexBuffer );
     void bindIndexBuffer( const std::shared_ptr<VksBuffer>& indexBuffer );
     void draw( int vertexCount );
@@ -49,6 +61,12 @@ public:
     
     void submitRender( const std::vector<VkSemaphore>& waitSemaphores, std::vector<VkPipelineStageFlags>& waitStages,
                       std::vector<VkSemaphore>& signalSemaphores );
+    // Timeline path only: waits carry their own stages and values, signalSemaphore is an
+    // optional binary semaphore ( e.g. for present ). Returns the graphics timeline value
+    // the render completes at.
+    uint64_t submitRender( const VksTimeline::SemaphoreValue* waits, uint32_t waitCount, VkSemaphore signalSemaphore = VK_NULL_HANDLE );
+    // 0 before the first submit and without timeline semaphores
+    uint64_t getSubmitValue();
     
 private:
     VkFramebuffer m_framebuffer;
@@ -59,9 +77,19 @@ private:
     std::shared_ptr<VksGraphicPipeline> m_graphicPipeline;
     VkCommandBuffer m_commandBuffer;
     VkSemaphore m_renderComplete;
+    // set by the first submit that signals m_renderComplete
+    bool m_renderCompleteSignaled = false;
+    // from the sync pool on the first fence-path submit; the timeline path waits for
+    // m_submitValue instead
     VkFence m_fence;
+    uint64_t m_submitValue = 0;
+    std::shared_ptr<VksProfiler> m_profiler;
+    std::string m_zoneName;
+    int m_zone;
     uint32_t m_width;
     uint32_t m_height;
+
+    void __waitSubmit();
 };
 
 #endif /* VksFramebuffer_hpp */
@@ -7,6 +7,7 @@
 //
 
 #include "VksGraphicPipeline.hpp"
+#include "VksTrace.hpp"
 #include <iostream>
 
 VksGraphicPipeline::VksGraphicPipeline()
@@ -96,6 +97,8 @@ void VksGraphicPipeline::__createGraphicPipeline()
 {
     if( m_graphicPipeline != VK_NULL_HANDLE )
         return;
+    
+    VKS_TRACE_ZONE( "VksGraphicPipeline::createGraphicPipeline" );
     VkPipelineRasterizationStateCreateInfo rasterizationState = {};
     rasterizationState.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
     rasterizationState.polygonMode = VK_POLYGON_MODE_FILL;
@@ -134,7 +137,7 @@ void VksGraphicPipeline::__createGraphicPipeline()
     
     m_graphicPipelineInfo.pDynamicState = &dynamicState;
     
-    VK_CHECK( vkCreateGraphicsPipelines(m_logicDevice, VK_NULL_HANDLE, 1, &m_graphicPipelineInfo, nullptr, &m_graphicPipeline) )
+    VK_CHECK( vkCreateGraphicsPipelines(m_logicDevice, getVkPipelineCache(), 1, &m_graphicPipelineInfo, nullptr, &m_graphicPipeline) )
     
 }
 
@@ -0,0 +1,287 @@
+//
+//  VksImageDecode.cpp
+//  Vulkan
+//
+//
+
+#include "VksImageDecode.hpp"
+#include "VksTrace.hpp"
+#include "stb_image.h"
+#include "lodepng.h"
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+static const uint8_t kPNGSignature[8] = { 137, 80, 78, 71, 13, 10, 26, 10 };
+// the largest side stb_image accepts as well
+static const uint32_t kMaxDimension = 1u << 24;
+
+static uint32_t readBE32( const uint8_t* p )
+{
+    return ( uint32_t( p[0] ) << 24 ) | ( uint32_t( p[1] ) << 16 ) | ( uint32_t( p[2] ) << 8 ) | p[3];
+}
+
+static uint8_t paeth( uint8_t a, uint8_t b, uint8_t c )
+{
+    int p = int( a ) + b - c;
+    int pa = abs( p - a ), pb = abs( p - b ), pc = abs( p - c );
+    if( pa <= pb && pa <= pc ) return a;
+    return pb <= pc ? b : c;
+}
+
+// undoes the filter of one row in place; prev is nullptr for the first row
+static void unfilterRow( uint8_t* row, const uint8_t* prev, size_t length, uint32_t bpp, uint8_t filter )
+{
+    switch( filter )
+    {
+        case 0:
+            break;
+        case 1:
+            for( size_t i = bpp; i < length; i++ ) row[i] += row[i - bpp];
+            break;
+        case 2:
+            if( prev == nullptr ) break;
+            for( size_t i = 0; i < length; i++ ) row[i] += prev[i];
+            break;
+        case 3:
+            for( size_t i = 0; i < length; i++ )
+            {
+                uint32_t up = prev ? prev[i] : 0;
+                uint32_t left = i >= bpp ? row[i - bpp] : 0;
+                row[i] += static_cast<uint8_t>( ( up + left ) / 2 );
+            }
+            break;
+        case 4:
+            for( size_t i = 0; i < length; i++ )
+            {
+                uint8_t up = prev ? prev[i] : 0;
+                uint8_t left = i >= bpp ? row[i - bpp] : 0;
+                uint8_t upLeft = prev && i >= bpp ? prev[i - bpp] : 0;
+                row[i] += paeth( left, up, upLeft );
+            }
+            break;
+        default:
+            throw std::runtime_error("invalid PNG filter type");
+    }
+}
+
+size_t VksImageDecode::rowPitch( uint32_t width, size_t rowAlignment )
+{
+    size_t pitch = size_t( width ) * 4;
+    if( rowAlignment > 1 )
+    {
+        pitch = ( pitch + rowAlignment - 1 ) / rowAlignment * rowAlignment;
+    }
+    return ( pitch + 3 ) / 4 * 4;
+}
+
+bool VksImageDecode::decode( const uint8_t* data, size_t size, size_t rowAlignment, const Allocate& allocate )
+{
+    VKS_TRACE_ZONE( "VksImageDecode::decode" );
+    if( __decodePNG( data, size, rowAlignment, allocate ) )
+        return true;
+    __decodeSTB( data, size, rowAlignment, allocate );
+    return false;
+}
+
+bool VksImageDecode::__decodePNG( const uint8_t* data, size_t size, size_t rowAlignment, const Allocate& allocate )
+{
+    if( size < sizeof( kPNGSignature ) || memcmp( data, kPNGSignature, sizeof( kPNGSignature ) ) != 0 )
+        return false;
+
+    uint32_t width = 0, height = 0;
+    uint8_t bitDepth = 0, colorType = 0, interlace = 0;
+    const uint8_t* palette = nullptr;
+    uint32_t paletteSize = 0;
+    const uint8_t* transparency = nullptr;
+    uint32_t transparencySize = 0;
+    std::vector<uint8_t> compressed;
+
+    size_t position = sizeof( kPNGSignature );
+    bool header = false;
+    while( size - position >= 12 )
+    {
+        uint32_t length = readBE32( data + position );
+        const uint8_t* type = data + position + 4;
+        const uint8_t* chunk = data + position + 8;
+        if( length > size - position - 12 )
+        {
+            throw std::runtime_error("PNG chunk runs past the end of the file");
+        }
+        if( !header )
+        {
+            // anything but IHDR first, e.g. Apple's CgBI, is left to stb_image
+            if( memcmp( type, "IHDR", 4 ) != 0 || length < 13 )
+                return false;
+            width = readBE32( chunk );
+            height = readBE32( chunk + 4 );
+            bitDepth = chunk[8];
+            colorType = chunk[9];
+            interlace = chunk[12];
+            if( width == 0 || height == 0 || width > kMaxDimension || height > kMaxDimension )
+            {
+                throw std::runtime_error("PNG size out of range");
+            }
+            if( bitDepth != 8 || interlace != 0 || ( colorType != 0 && colorType != 2 && colorType != 3 && colorType != 4 && colorType != 6 ) )
+                return false;
+            header = true;
+        }
+        else if( memcmp( type, "PLTE", 4 ) == 0 )
+        {
+            palette = chunk;
+            paletteSize = std::min<uint32_t>( length / 3, 256 );
+        }
+        else if( memcmp( type, "tRNS", 4 ) == 0 )
+        {
+            transparency = chunk;
+            transparencySize = length;
+        }
+        else if( memcmp( type, "IDAT", 4 ) == 0 )
+        {
+            compressed.insert( compressed.end(), chunk, chunk + length );
+        }
+        else if( memcmp( type, "IEND", 4 ) == 0 )
+        {
+            break;
+        }
+        position += size_t( length ) + 12;
+    }
+    if( !header || compressed.empty() || ( colorType == 3 && palette == nullptr ) )
+    {
+        throw std::runtime_error("PNG without header, image data or palette");
+    }
+
+    static const uint32_t channelCounts[] = { 1, 0, 3, 1, 2, 0, 4 };
+    uint32_t channels = channelCounts[ colorType ];
+    size_t rowSize = size_t( width ) * channels;
+
+    // the filtered scanlines are inflated into the heap: un-filtering reads back the row
+    // above, so only converted rows go to the destination
+    unsigned char* inflated = nullptr;
+    size_t inflatedSize = 0;
+    unsigned error = lodepng_zlib_decompress( &inflated, &inflatedSize, compressed.data(), compressed.size(),
+                                              &lodepng_default_decompress_settings );
+    std::unique_ptr<unsigned char, void(*)( void* )> scanlines( inflated, free );
+    if( error )
+    {
+        throw std::runtime_error( lodepng_error_text( error ) );
+    }
+    if( inflatedSize / ( rowSize + 1 ) < height )
+    {
+        throw std::runtime_error("PNG image data is shorter than the image");
+    }
+
+    // tRNS keys are 16 bit samples, an 8 bit image compares their low byte
+    bool keyed = false;
+    uint8_t key[3] = {};
+    if( transparency != nullptr && ( colorType == 0 || colorType == 2 ) && transparencySize >= channels * 2u )
+    {
+        keyed = true;
+        for( uint32_t c = 0; c < channels; c++ )
+        {
+            key[c] = transparency[ c * 2 + 1 ];
+        }
+    }
+    uint8_t paletteRGBA[256][4];
+    if( colorType == 3 )
+    {
+        for( uint32_t i = 0; i < 256; i++ )
+        {
+            bool defined = i < paletteSize;
+            paletteRGBA[i][0] = defined ? palette[ i * 3 + 0 ] : 0;
+            paletteRGBA[i][1] = defined ? palette[ i * 3 + 1 ] : 0;
+            paletteRGBA[i][2] = defined ? palette[ i * 3 + 2 ] : 0;
+            paletteRGBA[i][3] = transparency != nullptr && i < transparencySize ? transparency[i] : 255;
+        }
+    }
+
+    size_t pitch = rowPitch( width, rowAlignment );
+    uint8_t* destination = allocate( width, height, pitch );
+
+    const uint8_t* prev = nullptr;
+    for( uint32_t y = 0; y < height; y++ )
+    {
+        uint8_t* line = scanlines.get() + y * ( rowSize + 1 );
+        uint8_t* row = line + 1;
+        unfilterRow( row, prev, rowSize, channels, line[0] );
+        prev = row;
+
+        uint8_t* dst = destination + y * pitch;
+        switch( colorType )
+        {
+            case 0:
+                for( uint32_t x = 0; x < width; x++, dst += 4 )
+                {
+                    dst[0] = dst[1] = dst[2] = row[x];
+                    dst[3] = keyed && row[x] == key[0] ? 0 : 255;
+                }
+                break;
+            case 2:
+                for( uint32_t x = 0; x < width; x++, dst += 4 )
+                {
+                    const uint8_t* src = row + x * 3;
+                    dst[0] = src[0];
+                    dst[1] = src[1];
+                    dst[2] = src[2];
+                    dst[3] = keyed && src[0] == key[0] && src[1] == key[1] && src[2] == key[2] ? 0 : 255;
+                }
+                break;
+            case 3:
+                for( uint32_t x = 0; x < width; x++, dst += 4 )
+                {
+                    memcpy( dst, paletteRGBA[ row[x] ], 4 );
+                }
+                break;
+            case 4:
+                for( uint32_t x = 0; x < width; x++, dst += 4 )
+                {
+                    dst[0] = dst[1] = dst[2] = row[ x * 2 ];
+                    dst[3] = row[ x * 2 + 1 ];
+                }
+                break;
+            default:
+                memcpy( dst, row, rowSize );
+                break;
+        }
+        // the padding after each row is not left uninitialized
+        memset( destination + y * pitch + size_t( width ) * 4, 0, pitch - size_t( width ) * 4 );
+    }
+    return true;
+}
+
+void VksImageDecode::__decodeSTB( const uint8_t* data, size_t size, size_t rowAlignment, const Allocate& allocate )
+{
+    if( size > INT_MAX )
+    {
+        throw std::runtime_error("image file too large for stb_image");
+    }
+    int width = 0, height = 0, channels = 0;
+    stbi_uc* pixels = stbi_load_from_memory( data, static_cast<int>( size ), &width, &height, &channels, STBI_rgb_alpha );
+    if( pixels == nullptr )
+    {
+        throw std::runtime_error("fail to load texture file");
+    }
+
+    size_t rowSize = size_t( width ) * 4;
+    size_t pitch = rowPitch( width, rowAlignment );
+    uint8_t* destination = nullptr;
+    try
+    {
+        destination = allocate( width, height, pitch );
+    }
+    catch( ... )
+    {
+        stbi_image_free( pixels );
+        throw;
+    }
+    for( int y = 0; y < height; y++ )
+    {
+        memcpy( destination + y * pitch, pixels + y * rowSize, rowSize );
+        memset( destination + y * pitch + rowSize, 0, pitch - rowSize );
+    }
+    stbi_image_free( pixels );
+}
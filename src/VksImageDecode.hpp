@@ -0,0 +1,40 @@
+//
+//  VksImageDecode.hpp
+//  Vulkan
+//
+//
+
+#ifndef VksImageDecode_hpp
+#define VksImageDecode_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+// Decodes image files to RGBA8 rows at a pitch the caller's copy can describe, so the
+// pixels land straight in mapped staging memory. 8 bit, non-interlaced PNGs are inflated
+// with lodepng and un-filtered row by row in host memory, each row converted into the
+// destination as soon as it is done. Everything else goes through stb_image, which only
+// decodes into a buffer of its own, and is copied row by row. Needs no device.
+class VksImageDecode
+{
+public:
+    // Gets the image size and the row pitch in bytes, returns where row 0 goes; the
+    // memory must hold rowPitch * height bytes
+    typedef std::function<uint8_t*( uint32_t width, uint32_t height, size_t rowPitch )> Allocate;
+
+    // rowAlignment rounds the pitch up from width * 4; the pitch stays a multiple of 4 so
+    // it is a whole number of texels. Returns true when the rows were decoded in place,
+    // false when they were copied from stb_image's output; throws when data is no image
+    // either decoder reads.
+    static bool decode( const uint8_t* data, size_t size, size_t rowAlignment, const Allocate& allocate );
+
+    static size_t rowPitch( uint32_t width, size_t rowAlignment );
+
+private:
+    // false when the file is a PNG this path does not take
+    static bool __decodePNG( const uint8_t* data, size_t size, size_t rowAlignment, const Allocate& allocate );
+    static void __decodeSTB( const uint8_t* data, size_t size, size_t rowAlignment, const Allocate& allocate );
+};
+
+#endif /* VksImageDecode_hpp */
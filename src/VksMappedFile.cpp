@@ -0,0 +1,60 @@
+//
+//  VksMappedFile.cpp
+//  Vulkan
+//
+//
+
+#include "VksMappedFile.hpp"
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+std::shared_ptr<VksMappedFile> VksMappedFile::open( const char* filePath )
+{
+    std::shared_ptr<VksMappedFile> file( new VksMappedFile() );
+#ifdef _WIN32
+    std::ifstream stream( filePath, std::ios::ate | std::ios::binary );
+    if( !stream.is_open() ) return nullptr;
+    file->m_fileData.resize( static_cast<size_t>( stream.tellg() ) );
+    stream.seekg( 0 );
+    stream.read( reinterpret_cast<char*>( file->m_fileData.data() ), file->m_fileData.size() );
+    if( file->m_fileData.empty() ) return nullptr;
+    file->m_data = file->m_fileData.data();
+    file->m_size = file->m_fileData.size();
+#else
+    int fd = ::open( filePath, O_RDONLY );
+    if( fd < 0 ) return nullptr;
+    struct stat fileStat;
+    if( fstat( fd, &fileStat ) != 0 || fileStat.st_size == 0 )
+    {
+        close( fd );
+        return nullptr;
+    }
+    void* data = mmap( nullptr, static_cast<size_t>( fileStat.st_size ), PROT_READ, MAP_PRIVATE, fd, 0 );
+    // the mapping keeps the file referenced
+    close( fd );
+    if( data == MAP_FAILED ) return nullptr;
+    file->m_data = static_cast<const uint8_t*>( data );
+    file->m_size = static_cast<size_t>( fileStat.st_size );
+#endif
+    return file;
+}
+
+VksMappedFile::VksMappedFile()
+{
+}
+
+VksMappedFile::~VksMappedFile()
+{
+#ifndef _WIN32
+    if( m_data )
+    {
+        munmap( const_cast<uint8_t*>( m_data ), m_size );
+    }
+#endif
+}
@@ -0,0 +1,42 @@
+//
+//  VksMappedFile.hpp
+//  Vulkan
+//
+//
+
+#ifndef VksMappedFile_hpp
+#define VksMappedFile_hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Read only view of a whole file: mmap on POSIX, read into memory on Windows
+class VksMappedFile
+{
+public:
+    // nullptr when the file can not be opened or is empty
+    static std::shared_ptr<VksMappedFile> open( const char* filePath );
+
+    ~VksMappedFile();
+
+    const uint8_t* getData() const {
+        return m_data;
+    }
+
+    size_t getSize() const {
+        return m_size;
+    }
+
+private:
+    VksMappedFile();
+
+    const uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+#ifdef _WIN32
+    std::vector<uint8_t> m_fileData;
+#endif
+};
+
+#endif /* VksMappedFile_hpp */
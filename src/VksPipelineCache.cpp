@@ -0,0 +1,105 @@
+//
+//  VksPipelineCache.cpp
+//  Vulkan
+//
+//
+
+#include "VksPipelineCache.hpp"
+#include <fstream>
+#include <cstdio>
+
+std::shared_ptr<VksPipelineCache> VksPipelineCache::createPipelineCache( const std::string& directory )
+{
+    return std::shared_ptr<VksPipelineCache>( new VksPipelineCache( directory ) );
+}
+
+VksPipelineCache::VksPipelineCache( const std::string& directory )
+{
+    vkGetPhysicalDeviceProperties( m_physicalDevice, &m_properties );
+
+    char fileName[96];
+    snprintf( fileName, sizeof( fileName ), "pipeline_cache_%08x_%08x_%08x.bin",
+              m_properties.vendorID, m_properties.deviceID, m_properties.driverVersion );
+    m_filePath = directory.empty() ? fileName : directory + "/" + fileName;
+
+    std::vector<char> data;
+    std::ifstream file( m_filePath, std::ios::ate | std::ios::binary );
+    if( file.is_open() )
+    {
+        size_t fileSize = static_cast<size_t>( file.tellg() );
+        data.resize( fileSize );
+        file.seekg( 0 );
+        file.read( data.data(), fileSize );
+        file.close();
+    }
+
+    m_loaded = __isValidHeader( data );
+
+    VkPipelineCacheCreateInfo createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    createInfo.initialDataSize = m_loaded ? data.size() : 0;
+    createInfo.pInitialData = m_loaded ? data.data() : nullptr;
+
+    if( vkCreatePipelineCache( m_logicDevice, &createInfo, nullptr, &m_cache ) != VK_SUCCESS )
+    {
+        // the driver may still reject a blob with a valid header, start over empty
+        m_loaded = false;
+        createInfo.initialDataSize = 0;
+        createInfo.pInitialData = nullptr;
+        VK_CHECK( vkCreatePipelineCache( m_logicDevice, &createInfo, nullptr, &m_cache ) )
+    }
+}
+
+VksPipelineCache::~VksPipelineCache()
+{
+    if( m_cache != VK_NULL_HANDLE )
+    {
+        save();
+        vkDestroyPipelineCache( m_logicDevice, m_cache, nullptr );
+    }
+}
+
+bool VksPipelineCache::__isValidHeader( const std::vector<char>& data )
+{
+    // VkPipelineCacheHeaderVersionOne: length, version, vendorID, deviceID, UUID
+    const size_t headerSize = 4 * sizeof( uint32_t ) + VK_UUID_SIZE;
+    if( data.size() < headerSize )
+        return false;
+
+    uint32_t header[4];
+    memcpy( header, data.data(), sizeof( header ) );
+    if( header[0] < headerSize || header[0] > data.size() )
+        return false;
+    if( header[1] != VK_PIPELINE_CACHE_HEADER_VERSION_ONE )
+        return false;
+    if( header[2] != m_properties.vendorID || header[3] != m_properties.deviceID )
+        return false;
+
+    return memcmp( data.data() + sizeof( header ), m_properties.pipelineCacheUUID, VK_UUID_SIZE ) == 0;
+}
+
+bool VksPipelineCache::save()
+{
+    size_t dataSize = 0;
+    if( vkGetPipelineCacheData( m_logicDevice, m_cache, &dataSize, nullptr ) != VK_SUCCESS || dataSize == 0 )
+        return false;
+
+    std::vector<char> data( dataSize );
+    if( vkGetPipelineCacheData( m_logicDevice, m_cache, &dataSize, data.data() ) != VK_SUCCESS )
+        return false;
+
+    // write aside and rename, so a crash never leaves a truncated cache behind
+    std::string tempPath = m_filePath + ".tmp";
+    std::ofstream file( tempPath, std::ios::binary | std::ios::trunc );
+    if( !file.is_open() )
+        return false;
+    file.write( data.data(), dataSize );
+    file.close();
+    if( !file )
+    {
+        std::remove( tempPath.c_str() );
+        return false;
+    }
+
+    return std::rename( tempPath.c_str(), m_filePath.c_str() ) == 0;
+}
@@ -0,0 +1,49 @@
+//
+//  VksPipelineCache.hpp
+//  Vulkan
+//
+//
+
+#ifndef VksPipelineCache_hpp
+#define VksPipelineCache_hpp
+
+#include "VkEngine.hpp"
+#include <string>
+
+// Engine-wide VkPipelineCache persisted between runs. The file name is keyed by vendor,
+// device and driver version, and the blob is only reused when its header matches the
+// device's pipelineCacheUUID, so a driver update silently starts from an empty cache.
+class VksPipelineCache : protected VkEngine
+{
+public:
+    static std::shared_ptr<VksPipelineCache> createPipelineCache( const std::string& directory );
+
+    ~VksPipelineCache();
+
+    VkPipelineCache getVkPipelineCache() const {
+        return m_cache;
+    }
+
+    const std::string& getFilePath() const {
+        return m_filePath;
+    }
+
+    bool isLoadedFromDisk() const {
+        return m_loaded;
+    }
+
+    // Writes the current cache contents; also done on destruction.
+    bool save();
+
+private:
+    VksPipelineCache( const std::string& directory );
+
+    VkPipelineCache m_cache = VK_NULL_HANDLE;
+    VkPhysicalDeviceProperties m_properties;
+    std::string m_filePath;
+    bool m_loaded = false;
+
+    bool __isValidHeader( const std::vector<char>& data );
+};
+
+#endif /* VksPipelineCache_hpp */
@@ -0,0 +1,305 @@
+//
+//  VksProfiler.cpp
+//  Vulkan
+//
+//
+
+#include "VksProfiler.hpp"
+#include "VksCommand.hpp"
+#include "VksTrace.hpp"
+#include <algorithm>
+#include <cmath>
+
+static const VkQueryPipelineStatisticFlags kStatisticFlags =
+    VK_QUERY_PIPELINE_STATISTIC_INPUT_ASSEMBLY_VERTICES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_VERTEX_SHADER_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_CLIPPING_PRIMITIVES_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT |
+    VK_QUERY_PIPELINE_STATISTIC_COMPUTE_SHADER_INVOCATIONS_BIT;
+
+VksProfiler::Scope::Scope( VksProfiler* profiler, VkCommandBuffer commandBuffer, const std::string& name, uint32_t queueFamily )
+    :m_profiler( profiler ), m_commandBuffer( commandBuffer ), m_zone( -1 )
+{
+    if( m_profiler )
+    {
+        m_zone = m_profiler->beginZone( m_commandBuffer, name, queueFamily );
+    }
+}
+
+VksProfiler::Scope::~Scope()
+{
+    if( m_profiler )
+    {
+        m_profiler->endZone( m_commandBuffer, m_zone );
+    }
+}
+
+std::shared_ptr<VksProfiler> VksProfiler::createProfiler( uint32_t maxZones, bool pipelineStatistics, uint32_t historySize )
+{
+    return std::shared_ptr<VksProfiler>( new VksProfiler( maxZones, pipelineStatistics, historySize ) );
+}
+
+VksProfiler::VksProfiler( uint32_t maxZones, bool pipelineStatistics, uint32_t historySize )
+    :m_timestampPool( VK_NULL_HANDLE ), m_statisticsPool( VK_NULL_HANDLE )
+    ,m_maxZones( std::max<uint32_t>( maxZones, 1 ) ), m_historySize( std::max<uint32_t>( historySize, 1 ) )
+    ,m_timestampPeriod( 0.0 ), m_gpuToCpuOffset( 0 )
+{
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties( m_physicalDevice, &properties );
+    m_timestampPeriod = properties.limits.timestampPeriod;
+
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties( m_physicalDevice, &familyCount, nullptr );
+    std::vector<VkQueueFamilyProperties> families( familyCount );
+    vkGetPhysicalDeviceQueueFamilyProperties( m_physicalDevice, &familyCount, families.data() );
+    bool anyTimestamps = false;
+    m_timestampMasks.resize( familyCount, 0 );
+    for( uint32_t i = 0; i < familyCount && m_timestampPeriod != 0.0; i++ )
+    {
+        uint32_t validBits = families[i].timestampValidBits;
+        m_timestampMasks[i] = validBits >= 64 ? ~0ull : ( ( 1ull << validBits ) - 1 );
+        anyTimestamps |= validBits != 0;
+    }
+    if( !anyTimestamps )
+    {
+        // no timestamp support, every zone becomes a no-op
+        return;
+    }
+
+    VkQueryPoolCreateInfo createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    createInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    // one extra query for calibrate()
+    createInfo.queryCount = m_maxZones * 2 + 1;
+    VK_CHECK( vkCreateQueryPool( m_logicDevice, &createInfo, nullptr, &m_timestampPool ) )
+    calibrate();
+
+    if( pipelineStatistics && getEnabledFeatures().pipelineStatisticsQuery )
+    {
+        createInfo.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS;
+        createInfo.queryCount = m_maxZones;
+        createInfo.pipelineStatistics = kStatisticFlags;
+        VK_CHECK( vkCreateQueryPool( m_logicDevice, &createInfo, nullptr, &m_statisticsPool ) )
+    }
+}
+
+VksProfiler::~VksProfiler()
+{
+    if( m_timestampPool != VK_NULL_HANDLE )
+    {
+        vkDestroyQueryPool( m_logicDevice, m_timestampPool, nullptr );
+    }
+    if( m_statisticsPool != VK_NULL_HANDLE )
+    {
+        vkDestroyQueryPool( m_logicDevice, m_statisticsPool, nullptr );
+    }
+}
+
+bool VksProfiler::hasPipelineStatistics()
+{
+    return m_statisticsPool != VK_NULL_HANDLE;
+}
+
+void VksProfiler::calibrate()
+{
+    uint64_t mask = m_timestampMasks[ m_familyIndices.graphicsFamily.value() ];
+    if( m_timestampPool == VK_NULL_HANDLE || mask == 0 ) return;
+
+    uint32_t query = m_maxZones * 2;
+    VkCommandBuffer commandBuffer = m_graphicCommand->beginOnceSubmitBuffer();
+    vkCmdResetQueryPool( commandBuffer, m_timestampPool, query, 1 );
+    vkCmdWriteTimestamp( commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_timestampPool, query );
+
+    // the timestamp lands somewhere between submit and the fence; take the middle
+    uint64_t before = VksTrace::now();
+    m_graphicCommand->endOnceSubmitBuffer( commandBuffer );
+    uint64_t after = VksTrace::now();
+
+    uint64_t timestamp = 0;
+    VK_CHECK( vkGetQueryPoolResults( m_logicDevice, m_timestampPool, query, 1, sizeof( timestamp ), &timestamp,
+                                     sizeof( timestamp ), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT ) )
+    double gpuNs = ( timestamp & mask ) * m_timestampPeriod;
+    m_gpuToCpuOffset = static_cast<int64_t>( before + ( after - before ) / 2 ) - static_cast<int64_t>( gpuNs );
+}
+
+uint32_t VksProfiler::__slotIndex( VkCommandBuffer commandBuffer, const std::string& name )
+{
+    auto key = std::make_pair( commandBuffer, name );
+    auto it = m_slotIndices.find( key );
+    if( it != m_slotIndices.end() )
+    {
+        return it->second;
+    }
+    if( m_slots.size() >= m_maxZones )
+    {
+        return UINT32_MAX;
+    }
+
+    auto zoneIt = std::find_if( m_zones.begin(), m_zones.end(), [&name]( const Zone& zone ) {
+        return zone.name == name;
+    });
+    Slot slot;
+    slot.zone = static_cast<uint32_t>( zoneIt - m_zones.begin() );
+    if( zoneIt == m_zones.end() )
+    {
+        Zone zone;
+        zone.name = name;
+        m_zones.push_back( zone );
+    }
+
+    uint32_t index = static_cast<uint32_t>( m_slots.size() );
+    m_slots.push_back( slot );
+    m_slotIndices[ key ] = index;
+    return index;
+}
+
+int VksProfiler::beginZone( VkCommandBuffer commandBuffer, const std::string& name, uint32_t queueFamily )
+{
+    uint32_t graphicsFamily = m_familyIndices.graphicsFamily.value();
+    if( queueFamily == UINT32_MAX )
+    {
+        queueFamily = graphicsFamily;
+    }
+    if( m_timestampPool == VK_NULL_HANDLE || queueFamily >= m_timestampMasks.size() || m_timestampMasks[ queueFamily ] == 0 ) return -1;
+
+    std::lock_guard<std::mutex> lock( m_mutex );
+    uint32_t index = __slotIndex( commandBuffer, name );
+    if( index == UINT32_MAX ) return -1;
+
+    // the reset is recorded with the zone, so every submission re-arms its queries
+    vkCmdResetQueryPool( commandBuffer, m_timestampPool, index * 2, 2 );
+    vkCmdWriteTimestamp( commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, m_timestampPool, index * 2 );
+
+    Slot& slot = m_slots[ index ];
+    slot.queueFamily = queueFamily;
+    slot.statistics = false;
+    if( slot.queueFamily == graphicsFamily && m_statisticsPool != VK_NULL_HANDLE && m_statisticsOwner.count( commandBuffer ) == 0 )
+    {
+        vkCmdResetQueryPool( commandBuffer, m_statisticsPool, index, 1 );
+        vkCmdBeginQuery( commandBuffer, m_statisticsPool, index, 0 );
+        m_statisticsOwner[ commandBuffer ] = static_cast<int>( index );
+        slot.statistics = true;
+    }
+    return static_cast<int>( index );
+}
+
+void VksProfiler::endZone( VkCommandBuffer commandBuffer, int zone )
+{
+    if( zone < 0 ) return;
+
+    std::lock_guard<std::mutex> lock( m_mutex );
+    uint32_t index = static_cast<uint32_t>( zone );
+    if( m_slots[ index ].statistics )
+    {
+        vkCmdEndQuery( commandBuffer, m_statisticsPool, index );
+        m_statisticsOwner.erase( commandBuffer );
+    }
+    vkCmdWriteTimestamp( commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, m_timestampPool, index * 2 + 1 );
+}
+
+void VksProfiler::__addSample( Zone& zone, double milliseconds )
+{
+    if( zone.samples.size() < m_historySize )
+    {
+        zone.samples.push_back( milliseconds );
+        return;
+    }
+    zone.samples[ zone.nextSample ] = milliseconds;
+    zone.nextSample = ( zone.nextSample + 1 ) % m_historySize;
+}
+
+void VksProfiler::collect()
+{
+    if( m_timestampPool == VK_NULL_HANDLE ) return;
+
+    std::lock_guard<std::mutex> lock( m_mutex );
+    for( uint32_t i = 0; i < m_slots.size(); i++ )
+    {
+        Slot& slot = m_slots[ i ];
+
+        // { value, availability } per query; VK_NOT_READY still fills the available ones
+        uint64_t timestamps[4] = {};
+        VkResult result = vkGetQueryPoolResults( m_logicDevice, m_timestampPool, i * 2, 2, sizeof( timestamps ), timestamps,
+                                                 sizeof( uint64_t ) * 2, VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT );
+        if( result != VK_SUCCESS && result != VK_NOT_READY ) continue;
+        if( timestamps[1] == 0 || timestamps[3] == 0 ) continue;
+
+        // timestamps only grow, so an unchanged begin is a sample that was already taken
+        uint64_t mask = m_timestampMasks[ slot.queueFamily ];
+        uint64_t begin = timestamps[0] & mask;
+        uint64_t end = timestamps[2] & mask;
+        if( begin == slot.lastBegin ) continue;
+        slot.lastBegin = begin;
+
+        Zone& zone = m_zones[ slot.zone ];
+        double durationNs = ( ( end - begin ) & mask ) * m_timestampPeriod;
+        __addSample( zone, durationNs / 1000000.0 );
+        
+        if( VksTrace::isEnabled() )
+        {
+            uint64_t beginNs = static_cast<uint64_t>( static_cast<int64_t>( begin * m_timestampPeriod ) + m_gpuToCpuOffset );
+            VksTrace::addGpuEvent( zone.name, beginNs, beginNs + static_cast<uint64_t>( durationNs ), slot.queueFamily );
+        }
+
+        if( slot.statistics )
+        {
+            uint64_t statistics[ STATISTIC_COUNT + 1 ] = {};
+            result = vkGetQueryPoolResults( m_logicDevice, m_statisticsPool, i, 1, sizeof( statistics ), statistics,
+                                            sizeof( statistics ), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT );
+            if( result == VK_SUCCESS && statistics[ STATISTIC_COUNT ] != 0 )
+            {
+                for( int s = 0; s < STATISTIC_COUNT; s++ )
+                {
+                    zone.statisticsSum[s] += statistics[s];
+                }
+                zone.statisticsCount++;
+            }
+        }
+    }
+}
+
+std::vector<VksProfiler::ZoneStats> VksProfiler::getResults()
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    std::vector<ZoneStats> results;
+    results.reserve( m_zones.size() );
+    for( auto& zone : m_zones )
+    {
+        ZoneStats stats;
+        stats.name = zone.name;
+        stats.sampleCount = static_cast<uint32_t>( zone.samples.size() );
+        if( !zone.samples.empty() )
+        {
+            std::vector<double> sorted( zone.samples );
+            std::sort( sorted.begin(), sorted.end() );
+            double sum = 0.0;
+            for( double sample : sorted ) sum += sample;
+
+            size_t p99 = static_cast<size_t>( std::ceil( sorted.size() * 0.99 ) );
+            stats.minMs = sorted.front();
+            stats.avgMs = sum / sorted.size();
+            stats.p99Ms = sorted[ std::max<size_t>( p99, 1 ) - 1 ];
+        }
+        if( zone.statisticsCount > 0 )
+        {
+            for( int s = 0; s < STATISTIC_COUNT; s++ )
+            {
+                stats.statistics[s] = zone.statisticsSum[s] / (double)zone.statisticsCount;
+            }
+        }
+        results.push_back( stats );
+    }
+    return results;
+}
+
+void VksProfiler::clearResults()
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    for( auto& zone : m_zones )
+    {
+        zone.samples.clear();
+        zone.nextSample = 0;
+        zone.statisticsSum = {};
+        zone.statisticsCount = 0;
+    }
+}
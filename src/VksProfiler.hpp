@@ -0,0 +1,124 @@
+//
+//  VksProfiler.hpp
+//  Vulkan
+//
+//
+
+#ifndef VksProfiler_hpp
+#define VksProfiler_hpp
+
+#include "VkEngine.hpp"
+#include <array>
+#include <map>
+#include <mutex>
+#include <memory>
+#include <string>
+
+// GPU timing zones built on timestamp queries, with optional pipeline statistics.
+// Every zone owns its own queries per command buffer and resets them inside that
+// command buffer, so zones work in buffers that are recorded once and submitted
+// every frame. collect() polls the results without waiting; a sample that is not
+// available yet is picked up by a later call, which VksSwapChain makes once per
+// frame for every profiler attached with attachProfiler().
+class VksProfiler : protected VkEngine
+{
+public:
+    enum Statistic
+    {
+        INPUT_ASSEMBLY_VERTICES = 0,
+        VERTEX_SHADER_INVOCATIONS,
+        CLIPPING_PRIMITIVES,
+        FRAGMENT_SHADER_INVOCATIONS,
+        COMPUTE_SHADER_INVOCATIONS,
+        STATISTIC_COUNT
+    };
+
+    struct ZoneStats
+    {
+        std::string name;
+        uint32_t sampleCount = 0;
+        double minMs = 0.0;
+        double avgMs = 0.0;
+        double p99Ms = 0.0;
+        // averaged per sample, all zero without pipeline statistics
+        std::array<double, STATISTIC_COUNT> statistics = {};
+    };
+
+    // Records a zone around everything between its construction and destruction.
+    class Scope
+    {
+    public:
+        Scope( VksProfiler* profiler, VkCommandBuffer commandBuffer, const std::string& name, uint32_t queueFamily = UINT32_MAX );
+        ~Scope();
+    private:
+        VksProfiler* m_profiler;
+        VkCommandBuffer m_commandBuffer;
+        int m_zone;
+    };
+
+    // maxZones bounds the number of distinct ( name, command buffer ) pairs, historySize
+    // the number of samples the statistics of a zone are computed from.
+    static std::shared_ptr<VksProfiler> createProfiler( uint32_t maxZones = 64, bool pipelineStatistics = false, uint32_t historySize = 256 );
+
+    ~VksProfiler();
+
+    // Both must be recorded outside of a render pass. Returns -1 when the profiler is
+    // out of zones or queueFamily has no timestamp support; endZone ignores -1.
+    // queueFamily is the family of the pool commandBuffer comes from, the graphics family
+    // by default; pipeline statistics are only recorded on the graphics family.
+    int beginZone( VkCommandBuffer commandBuffer, const std::string& name, uint32_t queueFamily = UINT32_MAX );
+    void endZone( VkCommandBuffer commandBuffer, int zone );
+
+    void collect();
+
+    std::vector<ZoneStats> getResults();
+    void clearResults();
+
+    bool hasPipelineStatistics();
+
+    // Re-measures the offset between GPU timestamps and VksTrace::now(). Zones are
+    // forwarded to VksTrace while tracing is enabled; the clocks drift apart slowly,
+    // so long captures may want to call this now and then. Waits for the graphics queue.
+    void calibrate();
+private:
+    VksProfiler( uint32_t maxZones, bool pipelineStatistics, uint32_t historySize );
+
+    struct Zone
+    {
+        std::string name;
+        std::vector<double> samples;
+        size_t nextSample = 0;
+        std::array<uint64_t, STATISTIC_COUNT> statisticsSum = {};
+        uint32_t statisticsCount = 0;
+    };
+
+    struct Slot
+    {
+        uint32_t zone = 0;
+        uint32_t queueFamily = 0;
+        bool statistics = false;
+        uint64_t lastBegin = 0;
+    };
+
+    VkQueryPool m_timestampPool;
+    VkQueryPool m_statisticsPool;
+    uint32_t m_maxZones;
+    uint32_t m_historySize;
+    double m_timestampPeriod;
+    // valid bits per queue family, 0 for families without timestamps
+    std::vector<uint64_t> m_timestampMasks;
+    // VksTrace::now() - GPU time in nanoseconds
+    int64_t m_gpuToCpuOffset;
+
+    std::vector<Zone> m_zones;
+    std::vector<Slot> m_slots;
+    std::map<std::pair<VkCommandBuffer, std::string>, uint32_t> m_slotIndices;
+    // command buffers with an open pipeline statistics query, which cannot nest
+    std::map<VkCommandBuffer, int> m_statisticsOwner;
+    std::mutex m_mutex;
+
+    uint32_t __slotIndex( VkCommandBuffer commandBuffer, const std::string& name );
+    void __addSample( Zone& zone, double milliseconds );
+};
+
+#endif /* VksProfiler_hpp */
@@ -0,0 +1,370 @@
+//
+//  VksReadback.cpp
+//  Vulkan
+//
+//
+
+#include "VksReadback.hpp"
+#include "VksTexture.hpp"
+#include "VksBuffer.hpp"
+#include "VksUploadContext.hpp"
+#include "VksTrace.hpp"
+#include <cstring>
+
+// ring offsets stay aligned for every texel size and the 4 byte copy alignment
+static const VkDeviceSize RING_ALIGNMENT = 16;
+
+static VkDeviceSize alignRing( VkDeviceSize size )
+{
+    return ( size + RING_ALIGNMENT - 1 ) / RING_ALIGNMENT * RING_ALIGNMENT;
+}
+
+VksReadback::Download::Download( VksReadback* readback, VkExtent2D extent, VkDeviceSize rowSize, VkDeviceSize rowPitch, uint32_t rows )
+    :m_readback( readback ), m_extent( extent ), m_rowSize( rowSize ), m_rowPitch( rowPitch ), m_rows( rows )
+{
+}
+
+bool VksReadback::Download::isReady()
+{
+    if( m_ready.load() )
+        return true;
+
+    std::lock_guard<std::mutex> lock( m_readback->m_mutex );
+    m_readback->__retire( false, 0 );
+    return m_ready.load();
+}
+
+const std::vector<uint8_t>& VksReadback::Download::wait()
+{
+    if( !m_ready.load() )
+    {
+        VKS_TRACE_ZONE( "VksReadback::Download::wait" );
+        std::lock_guard<std::mutex> lock( m_readback->m_mutex );
+        m_readback->__retire( true, m_value );
+    }
+    return m_data;
+}
+
+std::shared_ptr<VksReadback> VksReadback::createReadback( const std::shared_ptr<VksUploadContext>& uploadContext, VkDeviceSize ringSize )
+{
+    return std::shared_ptr<VksReadback>( new VksReadback( uploadContext, ringSize ) );
+}
+
+VksReadback::VksReadback( const std::shared_ptr<VksUploadContext>& uploadContext, VkDeviceSize ringSize )
+    :m_uploadContext( uploadContext ), m_ringSize( alignRing( ringSize ) )
+{
+    if( m_uploadContext == nullptr )
+    {
+        m_uploadContext = VksUploadContext::createUploadContext();
+    }
+
+    // cached memory makes the CPU reads fast, coherent is the fallback every device has
+    m_memoryFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+    if( __findMemoryType( UINT32_MAX, m_memoryFlags ) == std::nullopt )
+    {
+        m_memoryFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    }
+    m_ring = VksBuffer::createBuffer( m_ringSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT, m_memoryFlags );
+}
+
+VksReadback::~VksReadback()
+{
+    // downloads still pending point back here
+    waitIdle();
+}
+
+uint32_t VksReadback::texelSize( VkFormat format )
+{
+    switch( format )
+    {
+        case VK_FORMAT_R8_UNORM:
+        case VK_FORMAT_R8_SRGB:
+        case VK_FORMAT_R8_UINT:
+            return 1;
+        case VK_FORMAT_R8G8_UNORM:
+        case VK_FORMAT_R16_SFLOAT:
+        case VK_FORMAT_R16_UNORM:
+        case VK_FORMAT_R16_UINT:
+            return 2;
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SRGB:
+        case VK_FORMAT_R8G8B8A8_UINT:
+        case VK_FORMAT_B8G8R8A8_UNORM:
+        case VK_FORMAT_B8G8R8A8_SRGB:
+        case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+        case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+        case VK_FORMAT_R16G16_SFLOAT:
+        case VK_FORMAT_R32_SFLOAT:
+        case VK_FORMAT_R32_UINT:
+            return 4;
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+        case VK_FORMAT_R16G16B16A16_UNORM:
+        case VK_FORMAT_R32G32_SFLOAT:
+            return 8;
+        case VK_FORMAT_R32G32B32A32_SFLOAT:
+        case VK_FORMAT_R32G32B32A32_UINT:
+            return 16;
+        default:
+            return 0;
+    }
+}
+
+std::shared_ptr<VksReadback::Download> VksReadback::readTexture( const std::shared_ptr<VksTexture>& texture, VkRect2D rect, VkDeviceSize rowPitch,
+                                                                 uint32_t mipLevel, uint32_t layer )
+{
+    VKS_TRACE_ZONE( "VksReadback::readTexture" );
+    uint32_t bytesPerTexel = texelSize( texture->getFormat() );
+    if( bytesPerTexel == 0 )
+    {
+        throw std::runtime_error("readTexture does not support the texture format");
+    }
+    if( mipLevel >= texture->getMipLevels() || layer >= texture->getLayerCount() )
+    {
+        throw std::runtime_error("readTexture mip level or layer out of range");
+    }
+
+    uint32_t levelWidth = std::max( texture->getWidth() >> mipLevel, 1u );
+    uint32_t levelHeight = std::max( texture->getHeight() >> mipLevel, 1u );
+    if( rect.extent.width == 0 || rect.extent.height == 0 )
+    {
+        rect = { { 0, 0 }, { levelWidth, levelHeight } };
+    }
+    // summed in 64 bit, an offset plus a huge extent must not wrap back inside the level
+    if( rect.offset.x < 0 || rect.offset.y < 0 ||
+        static_cast<uint64_t>( rect.offset.x ) + rect.extent.width > levelWidth ||
+        static_cast<uint64_t>( rect.offset.y ) + rect.extent.height > levelHeight )
+    {
+        throw std::runtime_error("readTexture rectangle is outside the mip level");
+    }
+
+    VkDeviceSize rowSize = static_cast<VkDeviceSize>( rect.extent.width ) * bytesPerTexel;
+    if( rowPitch == 0 )
+    {
+        rowPitch = rowSize;
+    }
+    else if( rowPitch < rowSize )
+    {
+        throw std::runtime_error("readTexture row pitch is smaller than a row");
+    }
+
+    std::shared_ptr<Download> download( new Download( this, rect.extent, rowSize, rowPitch, rect.extent.height ) );
+
+    std::lock_guard<std::mutex> lock( m_mutex );
+    Pending pending = __allocate( rowSize * rect.extent.height );
+    pending.download = download;
+
+    // tightly packed in staging, the pitch is applied when the rows are copied out
+    VkBufferImageCopy region = {};
+    region.bufferOffset = pending.offset;
+    region.imageSubresource.aspectMask = texture->getSubresourceRange().aspectMask;
+    region.imageSubresource.mipLevel = mipLevel;
+    region.imageSubresource.baseArrayLayer = layer;
+    region.imageSubresource.layerCount = 1;
+    region.imageOffset = { rect.offset.x, rect.offset.y, 0 };
+    region.imageExtent = { rect.extent.width, rect.extent.height, 1 };
+
+    VkBuffer dstBuffer = pending.buffer ? pending.buffer->getVkBuffer() : m_ring->getVkBuffer();
+    uint64_t value = m_uploadContext->recordGraphics( [&]( VkCommandBuffer commandBuffer ) {
+        VksTexture::ImageState previous = texture->getState( mipLevel );
+        texture->requireState( commandBuffer, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_TRANSFER_READ_BIT,
+                               VK_PIPELINE_STAGE_TRANSFER_BIT, mipLevel, 1 );
+        vkCmdCopyImageToBuffer( commandBuffer, texture->getImage(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, dstBuffer, 1, &region );
+        __hostBarrier( commandBuffer );
+        if( previous.layout != VK_IMAGE_LAYOUT_UNDEFINED )
+        {
+            texture->requireState( commandBuffer, previous.layout, previous.access, previous.stage, mipLevel, 1 );
+        }
+    } );
+    m_uploadContext->keepAlive( texture );
+    __push( pending, value );
+    return download;
+}
+
+std::shared_ptr<VksReadback::Download> VksReadback::readBuffer( const std::shared_ptr<VksBuffer>& buffer, VkDeviceSize offset, VkDeviceSize size )
+{
+    VKS_TRACE_ZONE( "VksReadback::readBuffer" );
+    if( size == VK_WHOLE_SIZE )
+    {
+        size = offset < buffer->getVkBufferSize() ? buffer->getVkBufferSize() - offset : 0;
+    }
+    if( size == 0 || offset > buffer->getVkBufferSize() || size > buffer->getVkBufferSize() - offset )
+    {
+        throw std::runtime_error("readBuffer range is outside the buffer");
+    }
+
+    std::shared_ptr<Download> download( new Download( this, { static_cast<uint32_t>( size ), 1 }, size, size, 1 ) );
+
+    std::lock_guard<std::mutex> lock( m_mutex );
+    Pending pending = __allocate( size );
+    pending.download = download;
+
+    VkBufferCopy region = {};
+    region.srcOffset = offset;
+    region.dstOffset = pending.offset;
+    region.size = size;
+
+    VkBuffer dstBuffer = pending.buffer ? pending.buffer->getVkBuffer() : m_ring->getVkBuffer();
+    uint64_t value = m_uploadContext->recordGraphics( [&]( VkCommandBuffer commandBuffer ) {
+        // buffers carry no state, so wait for any earlier write on the queue
+        VkMemoryBarrier barrier = {};
+        barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_MEMORY_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        vkCmdPipelineBarrier( commandBuffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                              1, &barrier, 0, nullptr, 0, nullptr );
+        vkCmdCopyBuffer( commandBuffer, buffer->getVkBuffer(), dstBuffer, 1, &region );
+        __hostBarrier( commandBuffer );
+    } );
+    m_uploadContext->keepAlive( buffer );
+    __push( pending, value );
+    return download;
+}
+
+void VksReadback::flush()
+{
+    m_uploadContext->flush();
+}
+
+void VksReadback::waitIdle()
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    __retire( true, UINT64_MAX );
+}
+
+VksReadback::Statistics VksReadback::getStatistics()
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    return m_statistics;
+}
+
+VksReadback::Pending VksReadback::__allocate( VkDeviceSize size )
+{
+    Pending pending;
+    pending.size = size;
+
+    VkDeviceSize alignedSize = alignRing( size );
+    if( alignedSize > m_ringSize )
+    {
+        pending.buffer = VksBuffer::createBuffer( size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, m_memoryFlags );
+        m_statistics.transientBuffers++;
+        return pending;
+    }
+
+    for( ;; )
+    {
+        const Pending* oldest = nullptr;
+        for( const Pending& inFlight : m_pending )
+        {
+            if( inFlight.buffer == nullptr )
+            {
+                oldest = &inFlight;
+                break;
+            }
+        }
+
+        if( oldest == nullptr )
+        {
+            pending.offset = 0;
+            m_head = alignedSize;
+            return pending;
+        }
+
+        // free space is [ head, end ) and [ 0, tail ) when head is past the tail, [ head, tail ) otherwise
+        VkDeviceSize tail = oldest->offset;
+        if( m_head > tail )
+        {
+            if( m_head + alignedSize <= m_ringSize )
+            {
+                pending.offset = m_head;
+                m_head += alignedSize;
+                return pending;
+            }
+            if( alignedSize <= tail )
+            {
+                pending.offset = 0;
+                m_head = alignedSize;
+                return pending;
+            }
+        }
+        else if( m_head < tail && m_head + alignedSize <= tail )
+        {
+            pending.offset = m_head;
+            m_head += alignedSize;
+            return pending;
+        }
+
+        m_statistics.stalls++;
+        __retire( true, oldest->download->m_value );
+    }
+}
+
+void VksReadback::__push( Pending& pending, uint64_t value )
+{
+    pending.download->m_value = value;
+    if( pending.buffer )
+    {
+        m_uploadContext->keepAlive( pending.buffer );
+    }
+    m_statistics.readbacks++;
+    m_statistics.bytesRead += pending.size;
+    m_pending.push_back( std::move( pending ) );
+}
+
+void VksReadback::__retire( bool block, uint64_t value )
+{
+    while( !m_pending.empty() )
+    {
+        Pending& pending = m_pending.front();
+        uint64_t pendingValue = pending.download->m_value;
+        if( block && pendingValue <= value )
+        {
+            // only a batch that is still recording gets submitted from here; readbacks
+            // their producer flushed are waited on without touching the queue
+            if( pendingValue > m_uploadContext->getFlushedValue() )
+            {
+                m_uploadContext->flush();
+            }
+            m_uploadContext->wait( pendingValue );
+        }
+        else if( !m_uploadContext->isComplete( pendingValue ) )
+        {
+            break;
+        }
+
+        __resolve( pending );
+        m_pending.pop_front();
+    }
+}
+
+void VksReadback::__resolve( Pending& pending )
+{
+    VksBuffer* buffer = pending.buffer ? pending.buffer.get() : m_ring.get();
+    VkDeviceSize offset = pending.buffer ? 0 : pending.offset;
+    buffer->invalidateMemory( offset, pending.size );
+
+    const uint8_t* src = reinterpret_cast<const uint8_t*>( buffer->getMappedData() ) + offset;
+    Download& download = *pending.download;
+    if( download.m_rowPitch == download.m_rowSize )
+    {
+        download.m_data.assign( src, src + pending.size );
+    }
+    else
+    {
+        download.m_data.assign( download.m_rowPitch * download.m_rows, 0 );
+        for( uint32_t row = 0; row < download.m_rows; row++ )
+        {
+            memcpy( download.m_data.data() + row * download.m_rowPitch, src + row * download.m_rowSize, download.m_rowSize );
+        }
+    }
+    download.m_ready.store( true );
+}
+
+void VksReadback::__hostBarrier( VkCommandBuffer commandBuffer )
+{
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier( commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+                          1, &barrier, 0, nullptr, 0, nullptr );
+}
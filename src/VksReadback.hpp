@@ -0,0 +1,133 @@
+//
+//  VksReadback.hpp
+//  Vulkan
+//
+//
+
+#ifndef VksReadback_hpp
+#define VksReadback_hpp
+
+#include "VkEngine.hpp"
+#include <atomic>
+#include <deque>
+#include <mutex>
+
+class VksBuffer;
+class VksTexture;
+class VksUploadContext;
+
+// Copies texture regions and device-local buffers back to the host. Every readback is
+// recorded into the graphics batch of an upload context, lands in one host-cached staging
+// ring and hands back a Download that fills in once the batch completes, so nothing waits
+// until the data is asked for. Only a full ring blocks, on the oldest readback.
+//
+// The copies run when the batch is submitted by flush(), Download::wait() or the upload
+// context itself; work that writes the texture or buffer must be submitted before that.
+// Thread safe. Download::wait() only submits when its batch was not flushed yet, and then
+// under the engine's queue lock like every other submit.
+class VksReadback : protected VkEngine
+{
+public:
+    static constexpr VkDeviceSize DEFAULT_RING_SIZE = 32ull * 1024 * 1024;
+
+    struct Statistics
+    {
+        uint64_t readbacks = 0;
+        uint64_t bytesRead = 0;
+        // readbacks that waited for the ring to drain
+        uint64_t stalls = 0;
+        // readbacks larger than the ring, given a staging buffer of their own
+        uint64_t transientBuffers = 0;
+    };
+
+    class Download
+    {
+        friend class VksReadback;
+    public:
+        // Never blocks; collects every finished readback of the same VksReadback on the way
+        bool isReady();
+        // Submits the batch when it is still recording and blocks until the data is on
+        // the host: rows of getRowPitch() bytes, the padding after each row zeroed
+        const std::vector<uint8_t>& wait();
+
+        // texels for textures, { bytes, 1 } for buffers
+        VkExtent2D getExtent() const {
+            return m_extent;
+        }
+
+        VkDeviceSize getRowPitch() const {
+            return m_rowPitch;
+        }
+
+    private:
+        Download( VksReadback* readback, VkExtent2D extent, VkDeviceSize rowSize, VkDeviceSize rowPitch, uint32_t rows );
+
+        // only touched before the download is ready, the readback resolves everything it
+        // still holds when destroyed
+        VksReadback* m_readback;
+        uint64_t m_value = 0;
+        std::atomic<bool> m_ready { false };
+        std::vector<uint8_t> m_data;
+        VkExtent2D m_extent;
+        VkDeviceSize m_rowSize;
+        VkDeviceSize m_rowPitch;
+        uint32_t m_rows;
+    };
+
+    // Without a context the readback submits through one of its own
+    static std::shared_ptr<VksReadback> createReadback( const std::shared_ptr<VksUploadContext>& uploadContext = nullptr,
+                                                        VkDeviceSize ringSize = DEFAULT_RING_SIZE );
+
+    ~VksReadback();
+
+    // Reads rect of one mip level and array layer; an empty rect reads the whole level.
+    // rowPitch 0 packs the rows tightly, otherwise it must hold a row. The texture needs
+    // TRANSFER_SRC usage and a color format of up to 16 bytes per texel; it is left in
+    // the layout it was in.
+    std::shared_ptr<Download> readTexture( const std::shared_ptr<VksTexture>& texture, VkRect2D rect = {}, VkDeviceSize rowPitch = 0,
+                                           uint32_t mipLevel = 0, uint32_t layer = 0 );
+    // The buffer needs TRANSFER_SRC usage
+    std::shared_ptr<Download> readBuffer( const std::shared_ptr<VksBuffer>& buffer, VkDeviceSize offset = 0, VkDeviceSize size = VK_WHOLE_SIZE );
+
+    // Submits the recorded readbacks without waiting
+    void flush();
+    // Submits and resolves every readback
+    void waitIdle();
+
+    // bytes per texel, 0 for formats readTexture does not take
+    static uint32_t texelSize( VkFormat format );
+
+    Statistics getStatistics();
+
+private:
+    struct Pending
+    {
+        std::shared_ptr<Download> download;
+        VkDeviceSize offset = 0;
+        VkDeviceSize size = 0;
+        // set when the readback did not fit in the ring
+        std::shared_ptr<VksBuffer> buffer;
+    };
+
+    VksReadback( const std::shared_ptr<VksUploadContext>& uploadContext, VkDeviceSize ringSize );
+
+    std::shared_ptr<VksUploadContext> m_uploadContext;
+    VkMemoryPropertyFlags m_memoryFlags;
+    std::shared_ptr<VksBuffer> m_ring;
+    VkDeviceSize m_ringSize;
+    // where the next readback goes, the ring is used up to the oldest pending one
+    VkDeviceSize m_head = 0;
+    std::deque<Pending> m_pending;
+    Statistics m_statistics;
+    std::mutex m_mutex;
+
+    // caller holds m_mutex for the rest
+    Pending __allocate( VkDeviceSize size );
+    void __push( Pending& pending, uint64_t value );
+    // resolves pending readbacks in order, blocking for those up to value
+    void __retire( bool block, uint64_t value );
+    void __resolve( Pending& pending );
+    static void __hostBarrier( VkCommandBuffer commandBuffer );
+};
+
+#endif /* VksReadback_hpp */
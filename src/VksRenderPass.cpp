@@ -11,6 +11,7 @@
 
 VksRenderPass::VksRenderPass()
 :VkEngine(), m_renderPass( VK_NULL_HANDLE ), m_subpassDesc({} )
+,m_colorFinalLayout( VK_IMAGE_LAYOUT_UNDEFINED ), m_depthFinalLayout( VK_IMAGE_LAYOUT_UNDEFINED )
 {
     m_subpassDesc.flags = 0;
     m_subpassDesc.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
@@ -34,6 +35,7 @@ std::shared_ptr<VksRenderPass> VksRenderPass::createSimpleColorAttachmentRenderP
     attachment.samples = VK_SAMPLE_COUNT_1_BIT;
     attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
     attachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    renderPass->m_colorFinalLayout = attachment.finalLayout;
     attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
     attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
     attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
@@ -93,6 +95,7 @@ std::shared_ptr<VksRenderPass> VksRenderPass::createColorDepthRenderPass(VkForma
     colorAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
     colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
     colorAttachment.finalLayout = colorImageLayout;
+    renderPass->m_colorFinalLayout = colorImageLayout;
     colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
     colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
     colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
@@ -109,6 +112,7 @@ std::shared_ptr<VksRenderPass> VksRenderPass::createColorDepthRenderPass(VkForma
     depthAttatchment.samples = VK_SAMPLE_COUNT_1_BIT;
     depthAttatchment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
     depthAttatchment.finalLayout = depthImageLayout;
+    renderPass->m_depthFinalLayout = depthImageLayout;
     depthAttatchment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
     depthAttatchment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     depthAttatchment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
@@ -169,6 +173,8 @@ void VksRenderPass::addColorAttachment(VkFormat attachFormat, VkImageLayout fina
     attachment.samples = VK_SAMPLE_COUNT_1_BIT;
     attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
     attachment.finalLayout = finalImagelayout;
+    if( m_colorRefs.empty() )
+        m_colorFinalLayout = finalImagelayout;
     attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
     attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
     attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
@@ -205,6 +211,7 @@ void VksRenderPass::addDepthAttachment(VkFormat attachFormat, VkImageLayout imag
     attachment.samples = VK_SAMPLE_COUNT_1_BIT;
     attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
     attachment.finalLayout = imageLayout;
+    m_depthFinalLayout = imageLayout;
     attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
     attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
     attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
@@ -246,3 +253,13 @@ VkRenderPass VksRenderPass::getVkRenderPass()
 {
     return m_renderPass;
 }
+
+VkImageLayout VksRenderPass::getColorFinalLayout()
+{
+    return m_colorFinalLayout;
+}
+
+VkImageLayout VksRenderPass::getDepthFinalLayout()
+{
+    return m_depthFinalLayout;
+}
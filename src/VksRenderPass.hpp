@@ -25,6 +25,10 @@ public:
     void createRenderPass();
 
     VkRenderPass getVkRenderPass();
+    
+    // layouts the attachments are left in, VK_IMAGE_LAYOUT_UNDEFINED when there is none
+    VkImageLayout getColorFinalLayout();
+    VkImageLayout getDepthFinalLayout();
 private:
     VkRenderPass m_renderPass;
     std::vector<VkAttachmentDescription> m_attachDescs;
@@ -33,6 +37,8 @@ private:
  
     VkSubpassDescription m_subpassDesc;
     std::vector<VkSubpassDependency> m_dependencies;
+    VkImageLayout m_colorFinalLayout;
+    VkImageLayout m_depthFinalLayout;
 };
 
 #endif /* VksRenderPass_hpp */
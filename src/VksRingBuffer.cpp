@@ -0,0 +1,69 @@
+//
+//  VksRingBuffer.cpp
+//  Vulkan
+//
+//
+
+#include "VksRingBuffer.hpp"
+#include "VksBuffer.hpp"
+#include <algorithm>
+
+static VkDeviceSize alignUp( VkDeviceSize value, VkDeviceSize alignment )
+{
+    return ( value + alignment - 1 ) / alignment * alignment;
+}
+
+std::shared_ptr<VksRingBuffer> VksRingBuffer::createRingBuffer( VkDeviceSize frameSize, uint32_t frameCount, VkBufferUsageFlags usage )
+{
+    return std::shared_ptr<VksRingBuffer>( new VksRingBuffer( frameSize, frameCount, usage ) );
+}
+
+VksRingBuffer::VksRingBuffer( VkDeviceSize frameSize, uint32_t frameCount, VkBufferUsageFlags usage )
+    :m_frameCount( frameCount )
+{
+    if( frameCount == 0 )
+    {
+        throw std::runtime_error("ring buffer needs at least one frame");
+    }
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties( m_physicalDevice, &properties );
+    if( usage & VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT )
+        m_alignment = std::max( m_alignment, properties.limits.minUniformBufferOffsetAlignment );
+    if( usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT )
+        m_alignment = std::max( m_alignment, properties.limits.minStorageBufferOffsetAlignment );
+
+    m_frameSize = alignUp( frameSize, m_alignment );
+    m_buffer = VksBuffer::createBuffer( m_frameSize * frameCount, usage,
+                                        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT );
+}
+
+void VksRingBuffer::beginFrame( uint32_t frameIndex )
+{
+    m_frameIndex = frameIndex % m_frameCount;
+    m_head = 0;
+}
+
+VksRingBuffer::Range VksRingBuffer::allocate( VkDeviceSize size )
+{
+    VkDeviceSize offset = alignUp( m_head, m_alignment );
+    if( offset + size > m_frameSize )
+    {
+        throw std::runtime_error("ring buffer frame segment is full");
+    }
+    m_head = offset + size;
+
+    Range range;
+    range.buffer = m_buffer->getVkBuffer();
+    range.offset = m_frameIndex * m_frameSize + offset;
+    range.size = size;
+    range.data = reinterpret_cast<char*>( m_buffer->getMappedData() ) + range.offset;
+    return range;
+}
+
+VksRingBuffer::Range VksRingBuffer::push( const void* pData, VkDeviceSize size )
+{
+    Range range = allocate( size );
+    memcpy( range.data, pData, size );
+    return range;
+}
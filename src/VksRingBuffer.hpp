@@ -0,0 +1,69 @@
+//
+//  VksRingBuffer.hpp
+//  Vulkan
+//
+//
+
+#ifndef VksRingBuffer_hpp
+#define VksRingBuffer_hpp
+
+#include "VkEngine.hpp"
+#include <memory>
+
+class VksBuffer;
+
+// A persistently mapped buffer split into one segment per frame in flight. Each frame
+// sub-allocates aligned ranges for dynamic UBO/SSBO offsets from its own segment; the
+// segment is rewound by beginFrame() once the fence of that frame has signaled, which
+// VksSwapChain does for every ring attached with attachRingBuffer().
+class VksRingBuffer : protected VkEngine
+{
+public:
+    struct Range
+    {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VkDeviceSize offset = 0;
+        VkDeviceSize size = 0;
+        void* data = nullptr;
+
+        uint32_t dynamicOffset() const {
+            return static_cast<uint32_t>( offset );
+        }
+    };
+
+    static std::shared_ptr<VksRingBuffer> createRingBuffer( VkDeviceSize frameSize, uint32_t frameCount,
+                                                            VkBufferUsageFlags usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT );
+
+    void beginFrame( uint32_t frameIndex );
+
+    Range allocate( VkDeviceSize size );
+    Range push( const void* pData, VkDeviceSize size );
+
+    const std::shared_ptr<VksBuffer>& getBuffer() const {
+        return m_buffer;
+    }
+
+    VkDeviceSize getAlignment() const {
+        return m_alignment;
+    }
+
+    VkDeviceSize getFrameSize() const {
+        return m_frameSize;
+    }
+
+    uint32_t getFrameCount() const {
+        return m_frameCount;
+    }
+
+private:
+    VksRingBuffer( VkDeviceSize frameSize, uint32_t frameCount, VkBufferUsageFlags usage );
+
+    std::shared_ptr<VksBuffer> m_buffer;
+    VkDeviceSize m_alignment = 1;
+    VkDeviceSize m_frameSize = 0;
+    uint32_t m_frameCount = 0;
+    uint32_t m_frameIndex = 0;
+    VkDeviceSize m_head = 0;
+};
+
+#endif /* VksRingBuffer_hpp */
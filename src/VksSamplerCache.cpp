@@ -0,0 +1,119 @@
+//
+//  VksSamplerCache.cpp
+//  Vulkan
+//
+//
+
+#include "VksSamplerCache.hpp"
+#include <cstring>
+
+static uint32_t floatBits( float value )
+{
+    uint32_t bits;
+    memcpy( &bits, &value, sizeof( bits ) );
+    return bits;
+}
+
+std::shared_ptr<VksSamplerCache> VksSamplerCache::createSamplerCache()
+{
+    return std::shared_ptr<VksSamplerCache>( new VksSamplerCache() );
+}
+
+VksSamplerCache::VksSamplerCache()
+{
+}
+
+VksSamplerCache::~VksSamplerCache()
+{
+    for( auto& sampler : m_samplers )
+    {
+        vkDestroySampler( m_logicDevice, sampler.second.sampler, nullptr );
+    }
+}
+
+size_t VksSamplerCache::KeyHash::operator()( const Key& key ) const
+{
+    // FNV-1a over the fields
+    uint64_t hash = 14695981039346656037ull;
+    for( uint32_t value : key )
+    {
+        hash = ( hash ^ value ) * 1099511628211ull;
+    }
+    return static_cast<size_t>( hash );
+}
+
+VksSamplerCache::Key VksSamplerCache::__key( const VkSamplerCreateInfo& createInfo )
+{
+    return {
+        static_cast<uint32_t>( createInfo.flags ),
+        static_cast<uint32_t>( createInfo.magFilter ),
+        static_cast<uint32_t>( createInfo.minFilter ),
+        static_cast<uint32_t>( createInfo.mipmapMode ),
+        static_cast<uint32_t>( createInfo.addressModeU ),
+        static_cast<uint32_t>( createInfo.addressModeV ),
+        static_cast<uint32_t>( createInfo.addressModeW ),
+        floatBits( createInfo.mipLodBias ),
+        static_cast<uint32_t>( createInfo.anisotropyEnable ),
+        floatBits( createInfo.maxAnisotropy ),
+        static_cast<uint32_t>( createInfo.compareEnable ),
+        static_cast<uint32_t>( createInfo.compareOp ),
+        floatBits( createInfo.minLod ),
+        floatBits( createInfo.maxLod ),
+        static_cast<uint32_t>( createInfo.borderColor ),
+        static_cast<uint32_t>( createInfo.unnormalizedCoordinates )
+    };
+}
+
+VkSampler VksSamplerCache::acquire( const VkSamplerCreateInfo& createInfo )
+{
+    if( createInfo.pNext != nullptr )
+    {
+        throw std::runtime_error("VksSamplerCache can not key samplers with a pNext chain");
+    }
+    Key key = __key( createInfo );
+
+    std::lock_guard<std::mutex> lock( m_mutex );
+    m_statistics.acquisitions++;
+    auto found = m_samplers.find( key );
+    if( found != m_samplers.end() )
+    {
+        found->second.refCount++;
+        m_statistics.hits++;
+        return found->second.sampler;
+    }
+
+    VkSampler sampler = VK_NULL_HANDLE;
+    VK_CHECK( vkCreateSampler( m_logicDevice, &createInfo, nullptr, &sampler ) )
+    m_samplers[key] = { sampler, 1 };
+    m_keys[sampler] = key;
+    m_statistics.samplersCreated++;
+    m_statistics.samplersLive++;
+    return sampler;
+}
+
+void VksSamplerCache::release( VkSampler sampler )
+{
+    if( sampler == VK_NULL_HANDLE ) return;
+
+    std::lock_guard<std::mutex> lock( m_mutex );
+    auto key = m_keys.find( sampler );
+    if( key == m_keys.end() )
+    {
+        throw std::runtime_error("sampler was not acquired from VksSamplerCache");
+    }
+    auto entry = m_samplers.find( key->second );
+    if( --entry->second.refCount > 0 )
+        return;
+
+    vkDestroySampler( m_logicDevice, sampler, nullptr );
+    m_samplers.erase( entry );
+    m_keys.erase( key );
+    m_statistics.samplersDestroyed++;
+    m_statistics.samplersLive--;
+}
+
+VksSamplerCache::Statistics VksSamplerCache::getStatistics()
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    return m_statistics;
+}
@@ -0,0 +1,82 @@
+//
+//  VksSamplerCache.hpp
+//  Vulkan
+//
+//
+
+#ifndef VksSamplerCache_hpp
+#define VksSamplerCache_hpp
+
+#include "VkEngine.hpp"
+#include <array>
+#include <mutex>
+#include <memory>
+#include <unordered_map>
+
+// Sampler settings exposed on texture creation. The defaults are nearest filtering and
+// clamp to edge, upgraded to trilinear for mip chains whose format filters linearly.
+struct VksSamplerOptions
+{
+    VkFilter magFilter = VK_FILTER_NEAREST;
+    VkFilter minFilter = VK_FILTER_NEAREST;
+    VkSamplerMipmapMode mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    VkSamplerAddressMode addressMode = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    // anisotropic filtering above 1, clamped to maxSamplerAnisotropy; ignored without the
+    // samplerAnisotropy feature
+    float maxAnisotropy = 1.0f;
+    // linear filtering of mip chains when the format supports it, whatever the filters above
+    bool trilinearMipmaps = true;
+};
+
+// Shares VkSampler objects between identical VkSamplerCreateInfo, so thousands of textures
+// stay far below maxSamplerAllocationCount. Samplers are reference counted and destroyed
+// with their last release. The engine owns one, reachable through VkEngine::getSamplerCache().
+class VksSamplerCache : protected VkEngine
+{
+public:
+    struct Statistics
+    {
+        uint32_t samplersCreated = 0;
+        uint32_t samplersDestroyed = 0;
+        // alive right now, distinct create infos
+        uint32_t samplersLive = 0;
+        uint64_t acquisitions = 0;
+        // acquisitions served by an existing sampler
+        uint64_t hits = 0;
+    };
+
+    static std::shared_ptr<VksSamplerCache> createSamplerCache();
+
+    ~VksSamplerCache();
+
+    // createInfo must not have a pNext chain
+    VkSampler acquire( const VkSamplerCreateInfo& createInfo );
+    // Once per acquire; no command using the sampler may still be pending when the
+    // last reference goes
+    void release( VkSampler sampler );
+
+    Statistics getStatistics();
+private:
+    VksSamplerCache();
+
+    // every field of VkSamplerCreateInfo but sType and pNext, floats by bit pattern
+    typedef std::array<uint32_t, 16> Key;
+    struct KeyHash
+    {
+        size_t operator()( const Key& key ) const;
+    };
+    struct Entry
+    {
+        VkSampler sampler;
+        uint32_t refCount;
+    };
+
+    static Key __key( const VkSamplerCreateInfo& createInfo );
+
+    std::unordered_map<Key, Entry, KeyHash> m_samplers;
+    std::unordered_map<VkSampler, Key> m_keys;
+    Statistics m_statistics;
+    std::mutex m_mutex;
+};
+
+#endif /* VksSamplerCache_hpp */
@@ -1,15 +1,20 @@
 #include "VksShaderProgram.hpp"
 #include <fstream>
+#include <algorithm>
+#include <map>
 
 VksShaderProgram::VksShaderProgram( const std::vector<char>& vertexCode, const std::vector<char>& fragCode )
 {
     m_vertexShader = __createShaderModule( vertexCode );
     m_fragShader = __createShaderModule( fragCode );
+    __reflect( vertexCode );
+    __reflect( fragCode );
 }
 
 VksShaderProgram::VksShaderProgram( const std::vector<char>& computeCode)
 {
     m_computeShader = __createShaderModule( computeCode );
+    __reflect( computeCode );
 }
 
 VksShaderProgram::VksShaderProgram( const std::string& vertexFilePath, const std::string& fragFilePath)
@@ -21,6 +26,8 @@ VksShaderProgram::VksShaderProgram( const std::string& vertexFilePath, const std
     {
         m_vertexShader = __createShaderModule( vertexCode.value() );
         m_fragShader = __createShaderModule( fragCode.value() );
+        __reflect( vertexCode.value() );
+        __reflect( fragCode.value() );
     }
 }
 
@@ -30,6 +37,23 @@ VksShaderProgram::VksShaderProgram( const std::string& computeFilePath )
     if( computeCode.has_value() )
     {
         m_computeShader = __createShaderModule( computeCode.value() );
+        __reflect( computeCode.value() );
+    }
+}
+
+void VksShaderProgram::__reflect( const std::vector<char>& code )
+{
+    // a failed reflection only disables the reflected initialize()
+    if( m_reflection.getStageFlags() == 0 )
+    {
+        m_reflection.reflect( code );
+        return;
+    }
+    
+    VksSpirvReflect stage;
+    if( m_reflection.isValid() && stage.reflect( code ) )
+    {
+        m_reflection.merge( stage );
     }
 }
 
@@ -65,6 +89,11 @@ VksShaderProgram::~VksShaderProgram()
         vkDestroyShaderModule(m_logicDevice, m_computeShader, nullptr);
     }
 
+    for( size_t i = 1; i < m_setLayouts.size(); i++ )
+    {
+        vkDestroyDescriptorSetLayout(m_logicDevice, m_setLayouts[i], nullptr );
+    }
+    
     if( m_descSetLayout )
     {
         vkDestroyDescriptorSetLayout(m_logicDevice, m_descSetLayout, nullptr );
@@ -162,6 +191,99 @@ void VksShaderProgram::initialize(  const std::vector<UniformLayoutBinding>& lay
     m_inited = true;
 }
 
+void VksShaderProgram::initialize( int swapChainCount, const std::vector<std::pair<uint32_t, uint32_t>>& dynamicBindings )
+{
+    if( !m_reflection.isValid() )
+    {
+        throw std::runtime_error( "shader reflection failed: " + m_reflection.getError() );
+    }
+    
+    uint32_t setCount = std::max( m_reflection.getSetCount(), 1u );
+    std::vector<std::vector<VkDescriptorSetLayoutBinding>> setBindings( setCount );
+    std::map<VkDescriptorType, uint32_t> typeCounts;
+    
+    for( const auto& binding : m_reflection.getBindings() )
+    {
+        VkDescriptorSetLayoutBinding layoutBinding = {};
+        layoutBinding.binding = binding.binding;
+        layoutBinding.descriptorType = binding.type;
+        // runtime sized arrays would need descriptor indexing, bind a single element
+        layoutBinding.descriptorCount = std::max( binding.count, 1u );
+        layoutBinding.stageFlags = binding.stageFlags;
+        layoutBinding.pImmutableSamplers = nullptr;
+        
+        std::pair<uint32_t, uint32_t> key( binding.set, binding.binding );
+        if( std::find( dynamicBindings.begin(), dynamicBindings.end(), key ) != dynamicBindings.end() )
+        {
+            if( binding.type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER )
+                layoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+            else if( binding.type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER )
+                layoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+        }
+        
+        setBindings[ binding.set ].push_back( layoutBinding );
+        typeCounts[ layoutBinding.descriptorType ] += layoutBinding.descriptorCount * swapChainCount;
+    }
+    
+    m_setLayouts.resize( setCount );
+    for( uint32_t set = 0; set < setCount; set++ )
+    {
+        VkDescriptorSetLayoutCreateInfo setLayoutInfo = {};
+        setLayoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+        setLayoutInfo.bindingCount = static_cast<uint32_t>( setBindings[set].size() );
+        setLayoutInfo.pBindings = setBindings[set].empty() ? nullptr : setBindings[set].data();
+        
+        VK_CHECK( vkCreateDescriptorSetLayout( m_logicDevice, &setLayoutInfo, nullptr, &m_setLayouts[set] ) )
+    }
+    m_descSetLayout = m_setLayouts[0];
+    
+    std::vector<VkDescriptorPoolSize> poolSizes;
+    for( const auto& typeCount : typeCounts )
+    {
+        poolSizes.push_back( { typeCount.first, typeCount.second } );
+    }
+    
+    VkDescriptorPoolCreateInfo poolCreateInfo = {};
+    poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolCreateInfo.poolSizeCount = static_cast<uint32_t>( poolSizes.size() );
+    poolCreateInfo.pPoolSizes = poolSizes.empty() ? nullptr : poolSizes.data();
+    poolCreateInfo.maxSets = setCount * swapChainCount;
+    
+    VK_CHECK( vkCreateDescriptorPool( m_logicDevice, &poolCreateInfo, nullptr, &m_descPool ) )
+    
+    m_setDescSets.resize( setCount );
+    for( uint32_t set = 0; set < setCount; set++ )
+    {
+        std::vector<VkDescriptorSetLayout> layouts( swapChainCount, m_setLayouts[set] );
+        VkDescriptorSetAllocateInfo setAllocInfo = {};
+        setAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+        setAllocInfo.descriptorPool = m_descPool;
+        setAllocInfo.descriptorSetCount = static_cast<uint32_t>( swapChainCount );
+        setAllocInfo.pSetLayouts = layouts.data();
+        
+        m_setDescSets[set].resize( swapChainCount );
+        VK_CHECK( vkAllocateDescriptorSets( m_logicDevice, &setAllocInfo, m_setDescSets[set].data() ) )
+    }
+    m_descSets = m_setDescSets[0];
+    
+    std::vector<VkPushConstantRange> pushConstants;
+    for( const auto& range : m_reflection.getPushConstants() )
+    {
+        pushConstants.push_back( { range.stageFlags, range.offset, range.size } );
+    }
+    
+    VkPipelineLayoutCreateInfo pipelineInfo = {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    pipelineInfo.setLayoutCount = setCount;
+    pipelineInfo.pSetLayouts = m_setLayouts.data();
+    pipelineInfo.pushConstantRangeCount = static_cast<uint32_t>( pushConstants.size() );
+    pipelineInfo.pPushConstantRanges = pushConstants.empty() ? nullptr : pushConstants.data();
+    
+    VK_CHECK( vkCreatePipelineLayout(m_logicDevice, &pipelineInfo, nullptr, &m_pipelineLayout) )
+    
+    m_inited = true;
+}
+
 VkShaderModule VksShaderProgram::__createShaderModule(const std::vector<char>& code)
 {
     VkShaderModuleCreateInfo createInfo = {};
@@ -175,11 +297,16 @@ VkShaderModule VksShaderProgram::__createShaderModule(const std::vector<char>& c
     return shader;
 }
 void VksShaderProgram::updateShaderUniform( int index, uint32_t binding, VkDescriptorType type, const VksBuffer& buffer )
+{
+    updateShaderUniform( index, binding, type, buffer, 0, buffer.getVkBufferSize() );
+}
+
+void VksShaderProgram::updateShaderUniform( int index, uint32_t binding, VkDescriptorType type, const VksBuffer& buffer, VkDeviceSize offset, VkDeviceSize range )
 {
     VkDescriptorBufferInfo bufferInfo = {};
     bufferInfo.buffer = buffer.getVkBuffer();
-    bufferInfo.offset = 0;
-    bufferInfo.range = buffer.getVkBufferSize();
+    bufferInfo.offset = offset;
+    bufferInfo.range = range;
 
     VkWriteDescriptorSet writeDesc = {};
     writeDesc.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
@@ -256,3 +383,10 @@ VkDescriptorSet VksShaderProgram::getDescriptorSet(int index)
 {
     return m_descSets[index];
 }
+
+VkDescriptorSet VksShaderProgram::getDescriptorSet(int index, uint32_t set)
+{
+    if( set == 0 )
+        return m_descSets[index];
+    return m_setDescSets.at( set )[index];
+}
@@ -4,6 +4,7 @@
 #include "VkEngine.hpp"
 #include "VksBuffer.hpp"
 #include "VksTexture.hpp"
+#include "VksSpirvReflect.hpp"
 #include <tuple>
 #include <vector>
 
@@ -59,7 +60,11 @@ protected:
     VkPipelineLayout m_pipelineLayout = VK_NULL_HANDLE;
     
     std::vector<VkDescriptorSet> m_descSets;
+    // only filled by the reflected initialize(); index 0 aliases m_descSetLayout / m_descSets
+    std::vector<VkDescriptorSetLayout> m_setLayouts;
+    std::vector<std::vector<VkDescriptorSet>> m_setDescSets;
     std::vector<VkPipelineShaderStageCreateInfo> m_shaderStageInfos;
+    VksSpirvReflect m_reflection;
     bool m_inited = false;
 protected:
     VkShaderModule __createShaderModule( const std::vector<char>& code );
@@ -73,8 +78,18 @@ public:
     ~VksShaderProgram();
 
     void initialize( const std::vector<UniformLayoutBinding>& layoutBindings, const std::vector<DescriptorPoolInfo>& poolValues, int swapChainCount );
+    // Builds the set layouts, an exactly sized pool and the push constant ranges from the
+    // SPIR-V itself. Bindings listed in dynamicBindings as (set, binding) become
+    // UNIFORM_BUFFER_DYNAMIC / STORAGE_BUFFER_DYNAMIC.
+    void initialize( int swapChainCount, const std::vector<std::pair<uint32_t, uint32_t>>& dynamicBindings = {} );
+    
+    const VksSpirvReflect& getReflection() const {
+        return m_reflection;
+    }
 
     void updateShaderUniform( int index, uint32_t binding, VkDescriptorType type, const VksBuffer& buffer );
+    // binds a sub-range, e.g. one ring buffer range with a *_DYNAMIC descriptor type
+    void updateShaderUniform( int index, uint32_t binding, VkDescriptorType type, const VksBuffer& buffer, VkDeviceSize offset, VkDeviceSize range );
     void updateSampler( int index, uint32_t binding, VkDescriptorType type, const VksTexture& texture );
     
     const std::vector<VkPipelineShaderStageCreateInfo>& getShaderStageCreateInfo();
@@ -82,8 +97,10 @@ public:
 //    VkDescriptorSetLayout getDescriptorSetLayout();
     VkPipelineLayout getPipelineLayout();
     VkDescriptorSet getDescriptorSet( int index = 0 );
+    VkDescriptorSet getDescriptorSet( int index, uint32_t set );
 private:
     std::optional<std::vector<char> > __readShaderFile( const char* path );
+    void __reflect( const std::vector<char>& code );
 };
 
 #endif
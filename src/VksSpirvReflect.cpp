@@ -0,0 +1,527 @@
+//
+//  VksSpirvReflect.cpp
+//  Vulkan
+//
+//
+
+#include "VksSpirvReflect.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+    const uint32_t SpvMagicNumber = 0x07230203;
+
+    enum SpvOp
+    {
+        SpvOpEntryPoint = 15,
+        SpvOpExecutionMode = 16,
+        SpvOpTypeInt = 21,
+        SpvOpTypeFloat = 22,
+        SpvOpTypeVector = 23,
+        SpvOpTypeMatrix = 24,
+        SpvOpTypeImage = 25,
+        SpvOpTypeSampler = 26,
+        SpvOpTypeSampledImage = 27,
+        SpvOpTypeArray = 28,
+        SpvOpTypeRuntimeArray = 29,
+        SpvOpTypeStruct = 30,
+        SpvOpTypePointer = 32,
+        SpvOpConstant = 43,
+        SpvOpSpecConstant = 50,
+        SpvOpVariable = 59,
+        SpvOpDecorate = 71,
+        SpvOpMemberDecorate = 72,
+    };
+
+    enum SpvDecoration
+    {
+        SpvDecorationBlock = 2,
+        SpvDecorationBufferBlock = 3,
+        SpvDecorationArrayStride = 6,
+        SpvDecorationMatrixStride = 7,
+        SpvDecorationBinding = 33,
+        SpvDecorationDescriptorSet = 34,
+        SpvDecorationOffset = 35,
+    };
+
+    enum SpvStorageClass
+    {
+        SpvStorageClassUniformConstant = 0,
+        SpvStorageClassUniform = 2,
+        SpvStorageClassPushConstant = 9,
+        SpvStorageClassStorageBuffer = 12,
+    };
+
+    enum SpvExecutionMode
+    {
+        SpvExecutionModeLocalSize = 17,
+        SpvExecutionModeLocalSizeId = 38,
+    };
+
+    enum SpvDim
+    {
+        SpvDimBuffer = 5,
+        SpvDimSubpassData = 6,
+    };
+
+    VkShaderStageFlags stageFromExecutionModel( uint32_t model )
+    {
+        switch( model )
+        {
+            case 0: return VK_SHADER_STAGE_VERTEX_BIT;
+            case 1: return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+            case 2: return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+            case 3: return VK_SHADER_STAGE_GEOMETRY_BIT;
+            case 4: return VK_SHADER_STAGE_FRAGMENT_BIT;
+            case 5: return VK_SHADER_STAGE_COMPUTE_BIT;
+            default: return 0;
+        }
+    }
+
+    const uint32_t MaxTypeDepth = 16;
+}
+
+bool VksSpirvReflect::__fail( const char* error )
+{
+    m_error = error;
+    m_valid = false;
+    return false;
+}
+
+bool VksSpirvReflect::reflect( const std::vector<char>& code )
+{
+    if( code.size() % sizeof( uint32_t ) != 0 )
+        return __fail( "SPIR-V size is not a multiple of 4" );
+
+    return reflect( reinterpret_cast<const uint32_t*>( code.data() ), code.size() / sizeof( uint32_t ) );
+}
+
+bool VksSpirvReflect::reflect( const uint32_t* code, size_t wordCount )
+{
+    m_bindings.clear();
+    m_pushConstants.clear();
+    m_members.clear();
+    m_memberDecorations.clear();
+    m_stageFlags = 0;
+    m_localSize = {{ 0, 0, 0 }};
+    m_error.clear();
+    m_valid = false;
+
+    if( code == nullptr || wordCount < 5 )
+        return __fail( "SPIR-V module is too small" );
+    if( code[0] != SpvMagicNumber )
+        return __fail( "bad SPIR-V magic number" );
+
+    // every id below the bound is defined by an instruction of at least two words, so a
+    // larger bound is a corrupt module, not a reason to allocate
+    uint32_t bound = code[3];
+    if( bound > wordCount )
+        return __fail( "SPIR-V id bound is larger than the module" );
+    m_ids.assign( bound, IdInfo() );
+
+    uint32_t localSizeIds[3] = { 0, 0, 0 };
+
+    size_t pos = 5;
+    while( pos < wordCount )
+    {
+        uint32_t opcode = code[pos] & 0xffff;
+        uint32_t length = code[pos] >> 16;
+        if( length == 0 || pos + length > wordCount )
+            return __fail( "truncated SPIR-V instruction" );
+
+        const uint32_t* ins = code + pos;
+        pos += length;
+
+        // every instruction below names its result id in a fixed word
+        auto id = [&]( uint32_t word ) -> IdInfo* {
+            if( word >= length || ins[word] >= bound ) return nullptr;
+            return &m_ids[ ins[word] ];
+        };
+
+        switch( opcode )
+        {
+            case SpvOpEntryPoint:
+                if( length > 1 )
+                    m_stageFlags |= stageFromExecutionModel( ins[1] );
+                break;
+            case SpvOpExecutionMode:
+                if( length >= 6 && ins[2] == SpvExecutionModeLocalSize )
+                {
+                    m_localSize = {{ ins[3], ins[4], ins[5] }};
+                }
+                else if( length >= 6 && ins[2] == SpvExecutionModeLocalSizeId )
+                {
+                    localSizeIds[0] = ins[3];
+                    localSizeIds[1] = ins[4];
+                    localSizeIds[2] = ins[5];
+                }
+                break;
+            case SpvOpDecorate:
+            {
+                IdInfo* info = id( 1 );
+                if( !info || length < 3 ) break;
+                uint32_t decoration = ins[2];
+                if( decoration == SpvDecorationDescriptorSet && length > 3 )
+                    info->set = ins[3];
+                else if( decoration == SpvDecorationBinding && length > 3 )
+                    info->binding = ins[3];
+                else if( decoration == SpvDecorationArrayStride && length > 3 )
+                    info->arrayStride = ins[3];
+                else if( decoration == SpvDecorationBlock )
+                    info->block = true;
+                else if( decoration == SpvDecorationBufferBlock )
+                    info->bufferBlock = true;
+                break;
+            }
+            case SpvOpMemberDecorate:
+            {
+                if( length < 5 ) break;
+                uint32_t decoration = ins[3];
+                if( decoration != SpvDecorationOffset && decoration != SpvDecorationMatrixStride )
+                    break;
+                auto it = std::find_if( m_memberDecorations.begin(), m_memberDecorations.end(), [&]( const MemberDecoration& m ) {
+                    return m.structId == ins[1] && m.member == ins[2];
+                });
+                if( it == m_memberDecorations.end() )
+                {
+                    m_memberDecorations.push_back( { ins[1], ins[2], 0, 0 } );
+                    it = m_memberDecorations.end() - 1;
+                }
+                if( decoration == SpvDecorationOffset )
+                    it->offset = ins[4];
+                else
+                    it->matrixStride = ins[4];
+                break;
+            }
+            case SpvOpTypeInt:
+            case SpvOpTypeFloat:
+            {
+                IdInfo* info = id( 1 );
+                if( !info || length < 3 ) break;
+                info->opcode = opcode;
+                info->value = ins[2];
+                break;
+            }
+            case SpvOpTypeVector:
+            case SpvOpTypeMatrix:
+            {
+                IdInfo* info = id( 1 );
+                if( !info || length < 4 ) break;
+                info->opcode = opcode;
+                info->typeId = ins[2];
+                info->value = ins[3];
+                break;
+            }
+            case SpvOpTypeImage:
+            {
+                IdInfo* info = id( 1 );
+                if( !info || length < 9 ) break;
+                info->opcode = opcode;
+                info->value = ins[3];
+                info->imageSampled = static_cast<uint8_t>( ins[7] );
+                break;
+            }
+            case SpvOpTypeSampler:
+            {
+                IdInfo* info = id( 1 );
+                if( info ) info->opcode = opcode;
+                break;
+            }
+            case SpvOpTypeSampledImage:
+            case SpvOpTypeRuntimeArray:
+            {
+                IdInfo* info = id( 1 );
+                if( !info || length < 3 ) break;
+                info->opcode = opcode;
+                info->typeId = ins[2];
+                break;
+            }
+            case SpvOpTypeArray:
+            {
+                IdInfo* info = id( 1 );
+                if( !info || length < 4 ) break;
+                info->opcode = opcode;
+                info->typeId = ins[2];
+                // length is a constant id, resolved once all constants are known
+                info->value = ins[3];
+                break;
+            }
+            case SpvOpTypeStruct:
+            {
+                IdInfo* info = id( 1 );
+                if( !info ) break;
+                info->opcode = opcode;
+                info->memberBegin = static_cast<uint32_t>( m_members.size() );
+                info->memberCount = length - 2;
+                m_members.insert( m_members.end(), ins + 2, ins + length );
+                break;
+            }
+            case SpvOpTypePointer:
+            {
+                IdInfo* info = id( 1 );
+                if( !info || length < 4 ) break;
+                info->opcode = opcode;
+                info->storageClass = ins[2];
+                info->typeId = ins[3];
+                break;
+            }
+            case SpvOpConstant:
+            case SpvOpSpecConstant:
+            {
+                IdInfo* info = id( 2 );
+                if( !info || length < 4 ) break;
+                info->opcode = SpvOpConstant;
+                info->typeId = ins[1];
+                info->value = ins[3];
+                break;
+            }
+            case SpvOpVariable:
+            {
+                IdInfo* info = id( 2 );
+                if( !info || length < 4 ) break;
+                info->opcode = opcode;
+                info->typeId = ins[1];
+                info->storageClass = ins[3];
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    for( int i = 0; i < 3; i++ )
+    {
+        if( localSizeIds[i] != 0 && localSizeIds[i] < bound && m_ids[ localSizeIds[i] ].opcode == SpvOpConstant )
+            m_localSize[i] = m_ids[ localSizeIds[i] ].value;
+    }
+
+    for( uint32_t i = 0; i < bound; i++ )
+    {
+        if( m_ids[i].opcode == SpvOpVariable && !__addVariable( i ) )
+            return false;
+    }
+
+    std::sort( m_bindings.begin(), m_bindings.end(), []( const Binding& a, const Binding& b ) {
+        return a.set != b.set ? a.set < b.set : a.binding < b.binding;
+    });
+
+    // the lookup tables are only needed while decoding
+    m_ids.clear();
+    m_ids.shrink_to_fit();
+    m_members.clear();
+    m_memberDecorations.clear();
+
+    m_valid = true;
+    return true;
+}
+
+bool VksSpirvReflect::__addVariable( uint32_t id )
+{
+    const IdInfo& variable = m_ids[id];
+    uint32_t storageClass = variable.storageClass;
+
+    if( storageClass != SpvStorageClassUniformConstant && storageClass != SpvStorageClassUniform &&
+        storageClass != SpvStorageClassStorageBuffer && storageClass != SpvStorageClassPushConstant )
+        return true;
+
+    if( variable.typeId >= m_ids.size() || m_ids[ variable.typeId ].opcode != SpvOpTypePointer )
+        return __fail( "variable without pointer type" );
+
+    uint32_t typeId = m_ids[ variable.typeId ].typeId;
+    if( typeId >= m_ids.size() )
+        return __fail( "pointer to unknown type" );
+
+    if( storageClass == SpvStorageClassPushConstant )
+    {
+        if( m_ids[typeId].opcode != SpvOpTypeStruct )
+            return __fail( "push constant block is not a struct" );
+
+        PushConstant range;
+        uint32_t minOffset = UINT32_MAX;
+        uint32_t end = __structSize( typeId, minOffset, 0 );
+        range.offset = minOffset == UINT32_MAX ? 0 : minOffset;
+        range.size = ( ( end - range.offset ) + 3 ) & ~3u;
+        range.stageFlags = m_stageFlags;
+        m_pushConstants.push_back( range );
+        return true;
+    }
+
+    if( variable.set == UINT32_MAX || variable.binding == UINT32_MAX )
+        return true;
+
+    Binding binding;
+    binding.set = variable.set;
+    binding.binding = variable.binding;
+    binding.stageFlags = m_stageFlags;
+
+    // strip (possibly nested) arrays, multiplying the element counts
+    for( uint32_t depth = 0; depth < MaxTypeDepth; depth++ )
+    {
+        const IdInfo& type = m_ids[typeId];
+        if( type.opcode == SpvOpTypeArray )
+        {
+            uint32_t count = 1;
+            if( type.value < m_ids.size() && m_ids[ type.value ].opcode == SpvOpConstant )
+                count = m_ids[ type.value ].value;
+            binding.count *= count;
+        }
+        else if( type.opcode == SpvOpTypeRuntimeArray )
+        {
+            binding.count = 0;
+        }
+        else
+        {
+            break;
+        }
+        typeId = type.typeId;
+        if( typeId >= m_ids.size() )
+            return __fail( "array of unknown type" );
+    }
+
+    const IdInfo& type = m_ids[typeId];
+    switch( type.opcode )
+    {
+        case SpvOpTypeSampler:
+            binding.type = VK_DESCRIPTOR_TYPE_SAMPLER;
+            break;
+        case SpvOpTypeSampledImage:
+        {
+            bool texelBuffer = type.typeId < m_ids.size() && m_ids[ type.typeId ].value == SpvDimBuffer;
+            binding.type = texelBuffer ? VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            break;
+        }
+        case SpvOpTypeImage:
+            if( type.value == SpvDimSubpassData )
+                binding.type = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+            else if( type.value == SpvDimBuffer )
+                binding.type = type.imageSampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+            else
+                binding.type = type.imageSampled == 2 ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+            break;
+        case SpvOpTypeStruct:
+            if( storageClass == SpvStorageClassStorageBuffer || type.bufferBlock )
+                binding.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+            else
+                binding.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+            break;
+        default:
+            // e.g. acceleration structures, not used by this engine
+            return true;
+    }
+
+    m_bindings.push_back( binding );
+    return true;
+}
+
+const VksSpirvReflect::MemberDecoration* VksSpirvReflect::__findMemberDecoration( uint32_t structId, uint32_t member )
+{
+    for( const auto& decoration : m_memberDecorations )
+    {
+        if( decoration.structId == structId && decoration.member == member )
+            return &decoration;
+    }
+    return nullptr;
+}
+
+uint32_t VksSpirvReflect::__structSize( uint32_t structId, uint32_t& minOffset, uint32_t depth )
+{
+    const IdInfo& type = m_ids[structId];
+    uint32_t end = 0;
+    for( uint32_t i = 0; i < type.memberCount; i++ )
+    {
+        uint32_t memberType = m_members[ type.memberBegin + i ];
+        if( memberType >= m_ids.size() )
+            continue;
+
+        const MemberDecoration* decoration = __findMemberDecoration( structId, i );
+        uint32_t offset = decoration ? decoration->offset : 0;
+        uint32_t size = 0;
+        if( decoration && decoration->matrixStride && m_ids[memberType].opcode == SpvOpTypeMatrix )
+            size = m_ids[memberType].value * decoration->matrixStride;
+        else
+            size = __typeSize( memberType, depth + 1 );
+
+        minOffset = std::min( minOffset, offset );
+        end = std::max( end, offset + size );
+    }
+    return end;
+}
+
+uint32_t VksSpirvReflect::__typeSize( uint32_t typeId, uint32_t depth )
+{
+    if( typeId >= m_ids.size() || depth > MaxTypeDepth )
+        return 0;
+
+    const IdInfo& type = m_ids[typeId];
+    switch( type.opcode )
+    {
+        case SpvOpTypeInt:
+        case SpvOpTypeFloat:
+            return type.value / 8;
+        case SpvOpTypeVector:
+        case SpvOpTypeMatrix:
+            return type.value * __typeSize( type.typeId, depth + 1 );
+        case SpvOpTypeArray:
+        {
+            uint32_t count = 1;
+            if( type.value < m_ids.size() && m_ids[ type.value ].opcode == SpvOpConstant )
+                count = m_ids[ type.value ].value;
+            uint32_t stride = type.arrayStride ? type.arrayStride : __typeSize( type.typeId, depth + 1 );
+            return count * stride;
+        }
+        case SpvOpTypeStruct:
+        {
+            uint32_t minOffset = UINT32_MAX;
+            return __structSize( typeId, minOffset, depth + 1 );
+        }
+        default:
+            return 0;
+    }
+}
+
+bool VksSpirvReflect::merge( const VksSpirvReflect& other )
+{
+    for( const auto& binding : other.m_bindings )
+    {
+        auto it = std::find_if( m_bindings.begin(), m_bindings.end(), [&]( const Binding& b ) {
+            return b.set == binding.set && b.binding == binding.binding;
+        });
+        if( it == m_bindings.end() )
+        {
+            m_bindings.push_back( binding );
+            continue;
+        }
+        if( it->type != binding.type || it->count != binding.count )
+            return __fail( "stages disagree on a descriptor binding" );
+        it->stageFlags |= binding.stageFlags;
+    }
+
+    for( const auto& range : other.m_pushConstants )
+    {
+        auto it = std::find_if( m_pushConstants.begin(), m_pushConstants.end(), [&]( const PushConstant& p ) {
+            return p.offset == range.offset && p.size == range.size;
+        });
+        if( it == m_pushConstants.end() )
+            m_pushConstants.push_back( range );
+        else
+            it->stageFlags |= range.stageFlags;
+    }
+
+    m_stageFlags |= other.m_stageFlags;
+    if( other.m_localSize[0] != 0 )
+        m_localSize = other.m_localSize;
+
+    std::sort( m_bindings.begin(), m_bindings.end(), []( const Binding& a, const Binding& b ) {
+        return a.set != b.set ? a.set < b.set : a.binding < b.binding;
+    });
+    return m_valid && other.m_valid;
+}
+
+uint32_t VksSpirvReflect::getSetCount() const
+{
+    uint32_t count = 0;
+    for( const auto& binding : m_bindings )
+        count = std::max( count, binding.set + 1 );
+    return count;
+}
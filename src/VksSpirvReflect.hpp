@@ -0,0 +1,118 @@
+//
+//  VksSpirvReflect.hpp
+//  Vulkan
+//
+//
+
+#ifndef VksSpirvReflect_hpp
+#define VksSpirvReflect_hpp
+
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <array>
+#include <string>
+
+// Minimal SPIR-V decoder: a single pass over the words of a module that extracts what is
+// needed to build descriptor set layouts, pools and pipeline layouts. It needs no device,
+// and allocates one table indexed by result id plus the small result vectors.
+class VksSpirvReflect
+{
+public:
+    struct Binding
+    {
+        uint32_t set = 0;
+        uint32_t binding = 0;
+        VkDescriptorType type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        // 0 for runtime sized arrays
+        uint32_t count = 1;
+        VkShaderStageFlags stageFlags = 0;
+    };
+
+    struct PushConstant
+    {
+        uint32_t offset = 0;
+        uint32_t size = 0;
+        VkShaderStageFlags stageFlags = 0;
+    };
+
+    VksSpirvReflect() = default;
+
+    bool reflect( const uint32_t* code, size_t wordCount );
+    bool reflect( const std::vector<char>& code );
+
+    // Adds the resources of another stage; the same set/binding must agree on the type.
+    bool merge( const VksSpirvReflect& other );
+
+    bool isValid() const {
+        return m_valid;
+    }
+
+    const std::string& getError() const {
+        return m_error;
+    }
+
+    VkShaderStageFlags getStageFlags() const {
+        return m_stageFlags;
+    }
+
+    // sorted by set, then binding
+    const std::vector<Binding>& getBindings() const {
+        return m_bindings;
+    }
+
+    const std::vector<PushConstant>& getPushConstants() const {
+        return m_pushConstants;
+    }
+
+    // largest set index + 1
+    uint32_t getSetCount() const;
+
+    // compute shaders only, zero otherwise
+    const std::array<uint32_t, 3>& getLocalSize() const {
+        return m_localSize;
+    }
+
+private:
+    struct IdInfo
+    {
+        uint32_t opcode = 0;
+        uint32_t typeId = 0;
+        uint32_t value = 0;
+        uint32_t storageClass = 0;
+        uint32_t set = UINT32_MAX;
+        uint32_t binding = UINT32_MAX;
+        uint32_t arrayStride = 0;
+        uint32_t memberBegin = 0;
+        uint32_t memberCount = 0;
+        uint8_t imageSampled = 0;
+        bool block = false;
+        bool bufferBlock = false;
+    };
+
+    struct MemberDecoration
+    {
+        uint32_t structId;
+        uint32_t member;
+        uint32_t offset;
+        uint32_t matrixStride;
+    };
+
+    std::vector<IdInfo> m_ids;
+    std::vector<uint32_t> m_members;
+    std::vector<MemberDecoration> m_memberDecorations;
+
+    std::vector<Binding> m_bindings;
+    std::vector<PushConstant> m_pushConstants;
+    VkShaderStageFlags m_stageFlags = 0;
+    std::array<uint32_t, 3> m_localSize = {{ 0, 0, 0 }};
+    bool m_valid = false;
+    std::string m_error;
+
+    bool __fail( const char* error );
+    bool __addVariable( uint32_t id );
+    uint32_t __typeSize( uint32_t typeId, uint32_t depth );
+    uint32_t __structSize( uint32_t structId, uint32_t& minOffset, uint32_t depth );
+    const MemberDecoration* __findMemberDecoration( uint32_t structId, uint32_t member );
+};
+
+#endif /* VksSpirvReflect_hpp */
@@ -0,0 +1,239 @@
+//
+//  VksStagingPool.cpp
+//  Vulkan
+//
+//
+
+#include "VksStagingPool.hpp"
+#include "VksBuffer.hpp"
+#include <algorithm>
+
+static const VkBufferUsageFlags kStagingUsage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+static const VkMemoryPropertyFlags kStagingMemory = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+static const VkMemoryPropertyFlags kCachedStagingMemory = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+
+std::shared_ptr<VksStagingPool> VksStagingPool::createStagingPool( VkDeviceSize memoryCap )
+{
+    return std::shared_ptr<VksStagingPool>( new VksStagingPool( memoryCap ) );
+}
+
+VksStagingPool::VksStagingPool( VkDeviceSize memoryCap )
+    :m_memoryCap( memoryCap )
+{
+    m_memoryFlags[0] = kStagingMemory;
+    m_memoryFlags[1] = kStagingMemory;
+    if( __findMemoryType( UINT32_MAX, kCachedStagingMemory ) != std::nullopt )
+    {
+        m_memoryFlags[1] = kCachedStagingMemory;
+    }
+}
+
+VksStagingPool::~VksStagingPool()
+{
+    for( auto& freeLists : m_freeLists )
+    {
+        for( auto& freeList : freeLists )
+        {
+            for( auto& entry : freeList )
+            {
+                __destroyEntry( entry );
+            }
+        }
+    }
+}
+
+uint32_t VksStagingPool::__classIndex( VkDeviceSize size )
+{
+    uint32_t classIndex = 0;
+    while( __classSize( classIndex ) < size )
+    {
+        classIndex++;
+    }
+    return classIndex;
+}
+
+VkDeviceSize VksStagingPool::__classSize( uint32_t classIndex )
+{
+    return MIN_CLASS_SIZE << classIndex;
+}
+
+std::shared_ptr<VksBuffer> VksStagingPool::acquire( VkDeviceSize size )
+{
+    return __acquire( size, 0 );
+}
+
+std::shared_ptr<VksBuffer> VksStagingPool::acquireCached( VkDeviceSize size )
+{
+    // without a cached type both kinds share the coherent free lists
+    return __acquire( size, m_memoryFlags[1] == m_memoryFlags[0] ? 0 : 1 );
+}
+
+std::shared_ptr<VksBuffer> VksStagingPool::__acquire( VkDeviceSize size, uint32_t kind )
+{
+    uint32_t classIndex = __classIndex( size );
+    VkDeviceSize classSize = __classSize( classIndex );
+    auto& freeLists = m_freeLists[kind];
+
+    Entry entry;
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_statistics.acquisitions++;
+        if( classIndex < freeLists.size() && !freeLists[classIndex].empty() )
+        {
+            entry = freeLists[classIndex].back();
+            freeLists[classIndex].pop_back();
+            m_statistics.freeBytes -= classSize;
+            m_statistics.recycled++;
+            return __wrap( entry, classSize, kind );
+        }
+
+        __trimTo( classSize );
+        if( m_statistics.pooledBytes + classSize > m_memoryCap )
+        {
+            // the buffers in use already fill the cap; this one is not kept
+            m_statistics.transientBuffers++;
+            return VksBuffer::createBuffer( size, kStagingUsage, m_memoryFlags[kind] );
+        }
+        m_statistics.pooledBytes += classSize;
+        m_statistics.peakPooledBytes = std::max( m_statistics.peakPooledBytes, m_statistics.pooledBytes );
+        m_statistics.buffersCreated++;
+    }
+
+    try
+    {
+        entry = __createEntry( classSize, kind );
+    }
+    catch( ... )
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_statistics.pooledBytes -= classSize;
+        m_statistics.buffersCreated--;
+        throw;
+    }
+    return __wrap( entry, classSize, kind );
+}
+
+void VksStagingPool::setMemoryCap( VkDeviceSize memoryCap )
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    m_memoryCap = memoryCap;
+    __trimTo( 0 );
+}
+
+VkDeviceSize VksStagingPool::getMemoryCap()
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    return m_memoryCap;
+}
+
+void VksStagingPool::trim()
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    for( auto& freeLists : m_freeLists )
+    {
+        for( uint32_t classIndex = 0; classIndex < freeLists.size(); classIndex++ )
+        {
+            for( auto& entry : freeLists[classIndex] )
+            {
+                __destroyEntry( entry );
+                m_statistics.pooledBytes -= __classSize( classIndex );
+                m_statistics.freeBytes -= __classSize( classIndex );
+                m_statistics.buffersTrimmed++;
+            }
+            freeLists[classIndex].clear();
+        }
+    }
+}
+
+VksStagingPool::Statistics VksStagingPool::getStatistics()
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    return m_statistics;
+}
+
+VksStagingPool::Entry VksStagingPool::__createEntry( VkDeviceSize size, uint32_t kind )
+{
+    // borrow VksBuffer's creation path and keep only the handles
+    auto buffer = VksBuffer::createBuffer( size, kStagingUsage, m_memoryFlags[kind] );
+    Entry entry;
+    entry.buffer = buffer->m_buffer;
+    entry.allocation = buffer->m_allocation;
+    entry.mappedData = buffer->m_mappedData;
+    buffer->m_buffer = VK_NULL_HANDLE;
+    buffer->m_allocation = VksAllocator::Allocation();
+    return entry;
+}
+
+void VksStagingPool::__destroyEntry( const Entry& entry )
+{
+    vkDestroyBuffer( m_logicDevice, entry.buffer, nullptr );
+    m_allocator->freeMemory( entry.allocation );
+}
+
+std::shared_ptr<VksBuffer> VksStagingPool::__wrap( const Entry& entry, VkDeviceSize size, uint32_t kind )
+{
+    std::weak_ptr<VksStagingPool> weakPool = shared_from_this();
+    std::shared_ptr<VksBuffer> buffer( new VksBuffer(), [weakPool]( VksBuffer* buffer ) {
+        if( auto pool = weakPool.lock() )
+        {
+            pool->__recycle( buffer );
+        }
+        // a recycled buffer no longer owns its handles
+        delete buffer;
+    });
+    buffer->m_buffer = entry.buffer;
+    buffer->m_allocation = entry.allocation;
+    buffer->m_mappedData = entry.mappedData;
+    buffer->m_bufferSize = size;
+    buffer->m_memoryFlags = m_memoryFlags[kind];
+    return buffer;
+}
+
+void VksStagingPool::__recycle( VksBuffer* buffer )
+{
+    Entry entry;
+    entry.buffer = buffer->m_buffer;
+    entry.allocation = buffer->m_allocation;
+    entry.mappedData = buffer->m_mappedData;
+    buffer->m_buffer = VK_NULL_HANDLE;
+    buffer->m_allocation = VksAllocator::Allocation();
+
+    VkDeviceSize classSize = buffer->m_bufferSize;
+    uint32_t classIndex = __classIndex( classSize );
+    auto& freeLists = m_freeLists[ buffer->m_memoryFlags == m_memoryFlags[0] ? 0 : 1 ];
+
+    std::lock_guard<std::mutex> lock( m_mutex );
+    if( m_statistics.pooledBytes > m_memoryCap )
+    {
+        // the cap was lowered while this buffer was in use
+        __destroyEntry( entry );
+        m_statistics.pooledBytes -= classSize;
+        m_statistics.buffersTrimmed++;
+        return;
+    }
+    if( classIndex >= freeLists.size() )
+    {
+        freeLists.resize( classIndex + 1 );
+    }
+    freeLists[classIndex].push_back( entry );
+    m_statistics.freeBytes += classSize;
+}
+
+void VksStagingPool::__trimTo( VkDeviceSize bytes )
+{
+    for( auto& freeLists : m_freeLists )
+    {
+        for( uint32_t classIndex = static_cast<uint32_t>( freeLists.size() ); classIndex-- > 0; )
+        {
+            auto& freeList = freeLists[classIndex];
+            while( !freeList.empty() && m_statistics.pooledBytes + bytes > m_memoryCap )
+            {
+                __destroyEntry( freeList.back() );
+                freeList.pop_back();
+                m_statistics.pooledBytes -= __classSize( classIndex );
+                m_statistics.freeBytes -= __classSize( classIndex );
+                m_statistics.buffersTrimmed++;
+            }
+        }
+    }
+}
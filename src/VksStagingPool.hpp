@@ -0,0 +1,95 @@
+//
+//  VksStagingPool.hpp
+//  Vulkan
+//
+//
+
+#ifndef VksStagingPool_hpp
+#define VksStagingPool_hpp
+
+#include "VkEngine.hpp"
+#include "VksAllocator.hpp"
+#include <mutex>
+#include <memory>
+#include <vector>
+
+class VksBuffer;
+
+// Recycles persistently mapped staging buffers in power-of-two size classes, so
+// streaming uploads stop allocating once every size they use has been seen. A buffer
+// goes back to its class when its last reference drops; handed to
+// VksUploadContext::keepAlive() that happens after the batch's fence has signaled,
+// and the blocking once-submit paths hold it until their fence wait returns.
+// The engine owns one, reachable through VkEngine::getStagingPool().
+class VksStagingPool : protected VkEngine, public std::enable_shared_from_this<VksStagingPool>
+{
+public:
+    static constexpr VkDeviceSize MIN_CLASS_SIZE = 64ull * 1024;
+    static constexpr VkDeviceSize DEFAULT_MEMORY_CAP = 128ull * 1024 * 1024;
+
+    struct Statistics
+    {
+        // pooled buffers allocated / destroyed to respect the cap over the lifetime of the pool
+        uint32_t buffersCreated = 0;
+        uint32_t buffersTrimmed = 0;
+        // requests that did not fit under the cap and got a buffer destroyed on release
+        uint32_t transientBuffers = 0;
+        uint64_t acquisitions = 0;
+        // acquisitions served from the free lists
+        uint64_t recycled = 0;
+        // memory of every pooled buffer, handed out or free
+        VkDeviceSize pooledBytes = 0;
+        VkDeviceSize freeBytes = 0;
+        VkDeviceSize peakPooledBytes = 0;
+    };
+
+    static std::shared_ptr<VksStagingPool> createStagingPool( VkDeviceSize memoryCap = DEFAULT_MEMORY_CAP );
+
+    ~VksStagingPool();
+
+    // Host visible, coherent and mapped, usable as transfer source and destination.
+    // getVkBufferSize() reports the size class, which may be larger than size.
+    std::shared_ptr<VksBuffer> acquire( VkDeviceSize size );
+    // Same from host cached memory when the device has it, for writers that also read
+    // what they wrote, like decoders. It may not be coherent, so writers call flushMemory().
+    std::shared_ptr<VksBuffer> acquireCached( VkDeviceSize size );
+
+    // Lowering the cap destroys free buffers until the pool fits; buffers still in
+    // use are never touched.
+    void setMemoryCap( VkDeviceSize memoryCap );
+    VkDeviceSize getMemoryCap();
+
+    // Destroys every free buffer
+    void trim();
+
+    Statistics getStatistics();
+private:
+    struct Entry
+    {
+        VkBuffer buffer = VK_NULL_HANDLE;
+        VksAllocator::Allocation allocation;
+        void* mappedData = nullptr;
+    };
+
+    VksStagingPool( VkDeviceSize memoryCap );
+
+    // coherent and cached memory, the same flags when the device has no cached type
+    VkMemoryPropertyFlags m_memoryFlags[2];
+    // per memory kind, indexed by log2( size / MIN_CLASS_SIZE )
+    std::vector<std::vector<Entry>> m_freeLists[2];
+    VkDeviceSize m_memoryCap;
+    Statistics m_statistics;
+    std::mutex m_mutex;
+
+    static uint32_t __classIndex( VkDeviceSize size );
+    static VkDeviceSize __classSize( uint32_t classIndex );
+    std::shared_ptr<VksBuffer> __acquire( VkDeviceSize size, uint32_t kind );
+    Entry __createEntry( VkDeviceSize size, uint32_t kind );
+    void __destroyEntry( const Entry& entry );
+    std::shared_ptr<VksBuffer> __wrap( const Entry& entry, VkDeviceSize size, uint32_t kind );
+    void __recycle( VksBuffer* buffer );
+    // frees buffers, largest class first, until bytes more fit under the cap
+    void __trimTo( VkDeviceSize bytes );
+};
+
+#endif /* VksStagingPool_hpp */
@@ -2,6 +2,11 @@
 #include "VksTexture.hpp"
 #include "VksBuffer.hpp"
 #include "VksRenderPass.hpp"
+#include "VksRingBuffer.hpp"
+#include "VksCommandPoolManager.hpp"
+#include "VksProfiler.hpp"
+#include "VksTrace.hpp"
+#include "VksTimeline.hpp"
 #include <iostream>
 #include <array>
 #include <chrono>
@@ -11,6 +16,10 @@ const int MAX_FLIGHT_IMAGE_COUNT = 2;
 VksSwapChain::VksSwapChain()
     : VkEngine()
 {
+    if( m_headless )
+    {
+        throw std::runtime_error("VksSwapChain is not available on a headless engine");
+    }
     __createSwapChain();
     __createColorTextures();
     __createDepthTextures();
@@ -49,6 +58,90 @@ std::shared_ptr<VksFramebuffer> VksSwapChain::getSwapChainFrameBuffer(int index)
     return m_swapChainFramebuffers[ index ];
 }
 
+uint32_t VksSwapChain::getFrameCount()
+{
+    return MAX_FLIGHT_IMAGE_COUNT;
+}
+
+uint32_t VksSwapChain::getCurrentFrame()
+{
+    return m_currentFrame;
+}
+
+void VksSwapChain::attachRingBuffer(const std::shared_ptr<VksRingBuffer> &ringBuffer)
+{
+    if( ringBuffer->getFrameCount() != MAX_FLIGHT_IMAGE_COUNT )
+    {
+        throw std::runtime_error("ring buffer frame count does not match the swap chain");
+    }
+    m_ringBuffers.push_back( ringBuffer );
+}
+
+void VksSwapChain::attachCommandPools(const std::shared_ptr<VksCommandPoolManager> &commandPools)
+{
+    if( commandPools->getFrameCount() != MAX_FLIGHT_IMAGE_COUNT )
+    {
+        throw std::runtime_error("command pool frame count does not match the swap chain");
+    }
+    m_commandPools.push_back( commandPools );
+}
+
+void VksSwapChain::attachProfiler(const std::shared_ptr<VksProfiler> &profiler)
+{
+    m_profilers.push_back( profiler );
+}
+
+void VksSwapChain::__beginFrame()
+{
+    VKS_TRACE_ZONE( "VksSwapChain::beginFrame" );
+    // everything the GPU read for this frame slot is retired once its fence signals
+    if( m_graphicsTimeline )
+    {
+        m_graphicsTimeline->wait( m_frameValues[ m_currentFrame ] );
+    }
+    else
+    {
+        vkWaitForFences(m_logicDevice, 1, &m_fence[ m_currentFrame ], VK_TRUE, UINT64_MAX);
+    }
+    
+    for( auto it = m_ringBuffers.begin(); it != m_ringBuffers.end(); )
+    {
+        auto ringBuffer = it->lock();
+        if( !ringBuffer )
+        {
+            it = m_ringBuffers.erase( it );
+            continue;
+        }
+        ringBuffer->beginFrame( m_currentFrame );
+        it++;
+    }
+    
+    for( auto it = m_commandPools.begin(); it != m_commandPools.end(); )
+    {
+        auto commandPools = it->lock();
+        if( !commandPools )
+        {
+            it = m_commandPools.erase( it );
+            continue;
+        }
+        commandPools->resetFrame( m_currentFrame );
+        it++;
+    }
+    
+    // never waits, zones still in flight are read on a later frame
+    for( auto it = m_profilers.begin(); it != m_profilers.end(); )
+    {
+        auto profiler = it->lock();
+        if( !profiler )
+        {
+            it = m_profilers.erase( it );
+            continue;
+        }
+        profiler->collect();
+        it++;
+    }
+}
+
 void VksSwapChain::__createFbs()
 {
     for (int i = 0; i < m_swapChainColorTextures.size(); i++) {
@@ -204,6 +297,7 @@ void VksSwapChain::__createSemaphores()
     m_imageAvailableSemaphore.resize(MAX_FLIGHT_IMAGE_COUNT);
     m_renderFinishedSemaphore.resize(MAX_FLIGHT_IMAGE_COUNT);
     m_fence.resize(MAX_FLIGHT_IMAGE_COUNT);
+    m_frameValues.resize(MAX_FLIGHT_IMAGE_COUNT, 0);
     m_imageFence.resize(m_swapChainImages.size(), VK_NULL_HANDLE);
     
     for(int i = 0; i < MAX_FLIGHT_IMAGE_COUNT; i++)
@@ -234,6 +328,7 @@ void VksSwapChain::drawFrames( std::function<void (const std::vector<VkSemaphore
     {
         auto start = std::chrono::system_clock::now();
         glfwPollEvents();
+        __beginFrame();
         submitWork( submitWait, drawWait, nextStages );
         submitWait.clear();
         __drawFrames( drawWait, nextStages, submitWait );
@@ -245,7 +340,7 @@ void VksSwapChain::drawFrames( std::function<void (const std::vector<VkSemaphore
         nextStages.clear();
     }
     
-    vkDeviceWaitIdle(m_logicDevice);
+    _deviceWaitIdle();
 }
 
 void VksSwapChain::drawFrames(std::function<void (int)> drawTime)
@@ -257,13 +352,14 @@ void VksSwapChain::drawFrames(std::function<void (int)> drawTime)
     {
         auto start = std::chrono::system_clock::now();
         glfwPollEvents();
+        __beginFrame();
         __drawFrames( drawWait, nextStages, drawSignal );
         auto end = std::chrono::system_clock::now();
         auto duration = std::chrono::duration_cast< std::chrono::milliseconds>(end - start);
         drawTime( duration.count() );
     }
     
-    vkDeviceWaitIdle(m_logicDevice);
+    _deviceWaitIdle();
 }
 
 void VksSwapChain::drawFrames()
@@ -274,15 +370,17 @@ void VksSwapChain::drawFrames()
     while( !glfwWindowShouldClose( m_window ) )
     {
         glfwPollEvents();
+        __beginFrame();
         __drawFrames( drawWait, nextStages, drawSignal );
     }
     
-    vkDeviceWaitIdle(m_logicDevice);
+    _deviceWaitIdle();
 }
 
 void VksSwapChain::__drawFrames( std::vector< VkSemaphore >& waitSemas, std::vector<VkPipelineStageFlags>& waitStages,
                                  std::vector<VkSemaphore>& signalSemas )
 {
+    VKS_TRACE_ZONE( "VksSwapChain::drawFrame" );
     uint32_t imageIndex = 0;
 
     vkAcquireNextImageKHR(m_logicDevice, m_swapchain, UINT32_MAX, m_imageAvailableSemaphore[ m_currentFrame ], VK_NULL_HANDLE, &imageIndex);
@@ -302,7 +400,24 @@ void VksSwapChain::__drawFrames( std::vector< VkSemaphore >& waitSemas, std::vec
     presentInfo.pResults = nullptr;
     presentInfo.swapchainCount = 1;
     
-    VK_CHECK( vkQueuePresentKHR(m_presentQueue, &presentInfo) )
+    {
+        VKS_TRACE_ZONE( "vkQueuePresentKHR" );
+        std::lock_guard<std::mutex> lock( _queueMutex( m_presentQueue ) );
+        VK_CHECK( vkQueuePresentKHR(m_presentQueue, &presentInfo) )
+    }
+    
+    if( m_graphicsTimeline )
+    {
+        // the timeline value of the last graphics submit covers everything queued before it
+        m_frameValues[ m_currentFrame ] = m_graphicsTimeline->getSubmittedValue();
+    }
+    else
+    {
+        // an empty submit signals the frame fence after all work queued for this frame
+        vkResetFences(m_logicDevice, 1, &m_fence[ m_currentFrame ]);
+        std::lock_guard<std::mutex> lock( _queueMutex( m_graphicsQueue ) );
+        VK_CHECK( vkQueueSubmit(m_graphicsQueue, 0, nullptr, m_fence[ m_currentFrame ]) )
+    }
     signalSemas.clear();
 //    signalSemas.push_back( m_imageAvailableSemaphore[ m_currentFrame ] );
     
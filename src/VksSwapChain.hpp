@@ -4,6 +4,9 @@
 #include "VkEngine.hpp"
 #include "VksFramebuffer.hpp"
 
+class VksRingBuffer;
+class VksCommandPoolManager;
+class VksProfiler;
 class VksSwapChain : protected VkEngine {
 public:
     VksSwapChain();
@@ -20,6 +23,18 @@ public:
     void drawFrames();
     
     void drawFrames( std::function<void (int)> drawTime );
+    
+    // frames in flight; a ring buffer attached to the swap chain needs one segment per frame
+    uint32_t getFrameCount();
+    uint32_t getCurrentFrame();
+    // The ring is rewound for a frame once its fence signals, so ranges for a frame
+    // must be allocated from submitWork (or before drawFrames), not from drawTime.
+    void attachRingBuffer( const std::shared_ptr<VksRingBuffer>& ringBuffer );
+    // Resets the pools of a frame together with its ring buffers; the manager needs
+    // getFrameCount() frames.
+    void attachCommandPools( const std::shared_ptr<VksCommandPoolManager>& commandPools );
+    // Results of the profiler are collected at the start of every frame
+    void attachProfiler( const std::shared_ptr<VksProfiler>& profiler );
 private:
     VkSwapchainKHR m_swapchain;
     VkSurfaceFormatKHR m_format;
@@ -34,8 +49,13 @@ private:
     std::vector<VkSemaphore> m_imageAvailableSemaphore;
     std::vector<VkSemaphore> m_renderFinishedSemaphore;
     std::vector<VkFence> m_fence;
+    // graphics timeline value per frame slot, replaces m_fence on the timeline path
+    std::vector<uint64_t> m_frameValues;
     std::vector<VkFence> m_imageFence;
     uint32_t m_currentFrame = 0;
+    std::vector<std::weak_ptr<VksRingBuffer>> m_ringBuffers;
+    std::vector<std::weak_ptr<VksCommandPoolManager>> m_commandPools;
+    std::vector<std::weak_ptr<VksProfiler>> m_profilers;
 
     void __chooseFormat();
     void __chooseExtent2D();
@@ -45,6 +65,7 @@ private:
     void __createRenderPass();
     void __createFbs();
     void __createSemaphores();
+    void __beginFrame();
     void __drawFrames( std::vector< VkSemaphore >& waitSemas, std::vector<VkPipelineStageFlags>& waitStages,
                       std::vector<VkSemaphore>& signalSemas);
 };
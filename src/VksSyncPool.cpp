@@ -0,0 +1,102 @@
+//
+//  VksSyncPool.cpp
+//  Vulkan
+//
+//
+
+#include "VksSyncPool.hpp"
+
+std::shared_ptr<VksSyncPool> VksSyncPool::createSyncPool()
+{
+    return std::shared_ptr<VksSyncPool>( new VksSyncPool() );
+}
+
+VksSyncPool::VksSyncPool()
+{
+}
+
+VksSyncPool::~VksSyncPool()
+{
+    for( auto fence : m_freeFences )
+    {
+        vkDestroyFence( m_logicDevice, fence, nullptr );
+    }
+    for( auto semaphore : m_freeSemaphores )
+    {
+        vkDestroySemaphore( m_logicDevice, semaphore, nullptr );
+    }
+}
+
+VkFence VksSyncPool::acquireFence()
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    m_statistics.fencesOutstanding++;
+    if( !m_freeFences.empty() )
+    {
+        VkFence fence = m_freeFences.back();
+        m_freeFences.pop_back();
+        m_statistics.fencesRecycled++;
+        return fence;
+    }
+
+    VkFenceCreateInfo fenceInfo = {};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    VkFence fence;
+    VK_CHECK( vkCreateFence( m_logicDevice, &fenceInfo, nullptr, &fence ) )
+    m_statistics.fencesCreated++;
+    return fence;
+}
+
+void VksSyncPool::releaseFence( VkFence fence )
+{
+    if( fence == VK_NULL_HANDLE ) return;
+
+    VK_CHECK( vkResetFences( m_logicDevice, 1, &fence ) )
+    std::lock_guard<std::mutex> lock( m_mutex );
+    m_freeFences.push_back( fence );
+    m_statistics.fencesOutstanding--;
+}
+
+VkSemaphore VksSyncPool::acquireSemaphore()
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    m_statistics.semaphoresOutstanding++;
+    if( !m_freeSemaphores.empty() )
+    {
+        VkSemaphore semaphore = m_freeSemaphores.back();
+        m_freeSemaphores.pop_back();
+        m_statistics.semaphoresRecycled++;
+        return semaphore;
+    }
+
+    VkSemaphoreCreateInfo semaphoreInfo = {};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    VkSemaphore semaphore;
+    VK_CHECK( vkCreateSemaphore( m_logicDevice, &semaphoreInfo, nullptr, &semaphore ) )
+    m_statistics.semaphoresCreated++;
+    return semaphore;
+}
+
+void VksSyncPool::releaseSemaphore( VkSemaphore semaphore )
+{
+    if( semaphore == VK_NULL_HANDLE ) return;
+
+    std::lock_guard<std::mutex> lock( m_mutex );
+    m_freeSemaphores.push_back( semaphore );
+    m_statistics.semaphoresOutstanding--;
+}
+
+void VksSyncPool::discardSemaphore( VkSemaphore semaphore )
+{
+    if( semaphore == VK_NULL_HANDLE ) return;
+
+    vkDestroySemaphore( m_logicDevice, semaphore, nullptr );
+    std::lock_guard<std::mutex> lock( m_mutex );
+    m_statistics.semaphoresOutstanding--;
+}
+
+VksSyncPool::Statistics VksSyncPool::getStatistics()
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    return m_statistics;
+}
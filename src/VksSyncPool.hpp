@@ -0,0 +1,62 @@
+//
+//  VksSyncPool.hpp
+//  Vulkan
+//
+//
+
+#ifndef VksSyncPool_hpp
+#define VksSyncPool_hpp
+
+#include "VkEngine.hpp"
+#include <mutex>
+#include <memory>
+#include <vector>
+
+// Recycles fences and binary semaphores, so one-shot submits and short-lived
+// objects stop creating and destroying driver objects. The engine owns one,
+// reachable through VkEngine::getSyncPool().
+class VksSyncPool : protected VkEngine
+{
+public:
+    struct Statistics
+    {
+        // driver objects created over the lifetime of the pool
+        uint32_t fencesCreated = 0;
+        uint32_t semaphoresCreated = 0;
+        // handed out and not released yet
+        uint32_t fencesOutstanding = 0;
+        uint32_t semaphoresOutstanding = 0;
+        // acquisitions served from the free lists
+        uint64_t fencesRecycled = 0;
+        uint64_t semaphoresRecycled = 0;
+    };
+
+    static std::shared_ptr<VksSyncPool> createSyncPool();
+
+    ~VksSyncPool();
+
+    // Always unsignaled
+    VkFence acquireFence();
+    // The fence must not be pending; it is reset here, signaled or not.
+    void releaseFence( VkFence fence );
+
+    // Unsignaled binary semaphore
+    VkSemaphore acquireSemaphore();
+    // No signal or wait on the semaphore may be pending, and it must be unsignaled:
+    // release it once the submit that waited on it has completed.
+    void releaseSemaphore( VkSemaphore semaphore );
+    // For a semaphore that may be left signaled because nothing is known to have waited
+    // on it: destroyed instead of recycled. The submits that used it must have completed.
+    void discardSemaphore( VkSemaphore semaphore );
+
+    Statistics getStatistics();
+private:
+    VksSyncPool();
+
+    std::vector<VkFence> m_freeFences;
+    std::vector<VkSemaphore> m_freeSemaphores;
+    Statistics m_statistics;
+    std::mutex m_mutex;
+};
+
+#endif /* VksSyncPool_hpp */
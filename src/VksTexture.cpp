@@ -9,39 +9,126 @@
 #include "VksTexture.hpp"
 #include "VksCommand.hpp"
 #include "VksBuffer.hpp"
+#include "VksUploadContext.hpp"
+#include "VksStagingPool.hpp"
+#include "VksBlockCompress.hpp"
+#include "VksTextureContainer.hpp"
+#include "VksImageDecode.hpp"
+#include "VksMappedFile.hpp"
+#include "VksTrace.hpp"
+#include "VksShaderProgram.hpp"
+#include <algorithm>
+
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+static const VkAccessFlags kWriteAccess = VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+static std::string s_mipmapShaderPath = "shaders/mipdownsample.comp.spv";
+
+class VksTexture::MipmapCompute : protected VkEngine
+{
+public:
+    MipmapCompute( VksTexture* texture )
+    {
+        m_shader = std::make_shared<VksShaderProgram>( s_mipmapShaderPath );
+        if( !m_shader->getReflection().isValid() )
+        {
+            throw std::runtime_error("failed to load the mipmap shader " + s_mipmapShaderPath);
+        }
+        // one set per generated level: its source level at binding 0, itself at binding 1
+        uint32_t setCount = texture->m_mipLevels - 1;
+        m_shader->initialize( setCount );
+        
+        m_views.resize( texture->m_mipLevels, VK_NULL_HANDLE );
+        for( uint32_t mipLevel = 0; mipLevel < texture->m_mipLevels; mipLevel++ )
+        {
+            VkImageViewCreateInfo viewInfo = {};
+            viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+            viewInfo.format = texture->m_format;
+            viewInfo.image = texture->m_texture;
+            viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+            viewInfo.subresourceRange = { texture->m_aspectFlag, mipLevel, 1, 0, 1 };
+            VK_CHECK( vkCreateImageView(m_logicDevice, &viewInfo, nullptr, &m_views[ mipLevel ]) )
+        }
+        
+        for( uint32_t set = 0; set < setCount; set++ )
+        {
+            VkDescriptorImageInfo imageInfos[2] = {
+                { VK_NULL_HANDLE, m_views[ set ], VK_IMAGE_LAYOUT_GENERAL },
+                { VK_NULL_HANDLE, m_views[ set + 1 ], VK_IMAGE_LAYOUT_GENERAL }
+            };
+            VkWriteDescriptorSet writes[2] = {};
+            for( uint32_t binding = 0; binding < 2; binding++ )
+            {
+                writes[ binding ].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+                writes[ binding ].dstSet = m_shader->getDescriptorSet( set );
+                writes[ binding ].dstBinding = binding;
+                writes[ binding ].descriptorCount = 1;
+                writes[ binding ].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+                writes[ binding ].pImageInfo = &imageInfos[ binding ];
+            }
+            vkUpdateDescriptorSets(m_logicDevice, 2, writes, 0, nullptr);
+        }
+        
+        VkComputePipelineCreateInfo createInfo = {};
+        createInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+        createInfo.layout = m_shader->getPipelineLayout();
+        createInfo.stage = m_shader->getShaderStageCreateInfo()[0];
+        VK_CHECK( vkCreateComputePipelines(m_logicDevice, getVkPipelineCache(), 1, &createInfo, nullptr, &m_pipeline) )
+    }
+    
+    ~MipmapCompute()
+    {
+        vkDestroyPipeline(m_logicDevice, m_pipeline, nullptr);
+        for( auto view : m_views )
+        {
+            vkDestroyImageView(m_logicDevice, view, nullptr);
+        }
+    }
+    
+    std::shared_ptr<VksShaderProgram> m_shader;
+    VkPipeline m_pipeline = VK_NULL_HANDLE;
+    std::vector<VkImageView> m_views;
+};
+
 VksTexture::VksTexture()
-    :m_ownTexture( true )
+    :m_textureSampler( VK_NULL_HANDLE ), m_ownTexture( true ), m_mipLevels( 1 ), m_layerCount( 1 ), m_viewType( VK_IMAGE_VIEW_TYPE_2D ), m_states( 1 ),
+     m_mipmapMethod( MIPMAP_NONE )
 {
 }
 
 VksTexture::~VksTexture()
 {
+    m_mipmapCompute.reset();
     vkDestroyImageView(m_logicDevice, m_textureView, nullptr);
-    vkDestroySampler(m_logicDevice, m_textureSampler, nullptr);
+    m_samplerCache->release( m_textureSampler );
     if( m_ownTexture )
     {
-        vkFreeMemory(m_logicDevice, m_textureMemory, nullptr);
         vkDestroyImage(m_logicDevice, m_texture, nullptr);
+        m_allocator->freeMemory( m_textureAllocation );
     }
 }
 
 std::shared_ptr<VksTexture> VksTexture::createEmptyTexture(uint32_t width, uint32_t height, VkFormat format, VkImageLayout imageLayout, VkImageUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropties,
-                                                           VkImageAspectFlags aspectFlag)
+                                                           VkImageAspectFlags aspectFlag, bool mipmaps, const VksSamplerOptions& samplerOptions)
 {
     std::shared_ptr<VksTexture> texture( new VksTexture() );
-    texture->__createImage(width, height, format, VK_IMAGE_LAYOUT_UNDEFINED, usageFlags, memoryPropties);
+    uint32_t mipLevels = mipmaps ? texture->__prepareMipmaps(width, height, format, usageFlags) : 1;
+    texture->__createImage(width, height, format, VK_IMAGE_LAYOUT_UNDEFINED, usageFlags, memoryPropties, mipLevels);
     texture->m_width = width;
     texture->m_height = height;
     texture->m_format = format;
     texture->m_aspectFlag = aspectFlag;
     
-    texture->__transferImageLayout(VK_IMAGE_LAYOUT_UNDEFINED, imageLayout);
+    VkAccessFlags accessMask = 0;
+    VkPipelineStageFlags stageFlag = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    __dstAccessStage( imageLayout, accessMask, stageFlag );
+    texture->requireState( imageLayout, accessMask, stageFlag );
     
     texture->__createImageView();
-    texture->__createSampler();
+    texture->__createSampler( samplerOptions );
     
     texture->m_descriptor.imageLayout = imageLayout;
     texture->m_descriptor.imageView = texture->m_textureView;
@@ -50,57 +137,172 @@ std::shared_ptr<VksTexture> VksTexture::createEmptyTexture(uint32_t width, uint3
     return texture;
 }
 
-std::shared_ptr<VksTexture> VksTexture::createFromFile(const char *filePath, VkImageUsageFlags imageUsageFlags, VkImageLayout imageLayout )
+std::shared_ptr<VksTexture> VksTexture::createFromFile(const char *filePath, VkImageUsageFlags imageUsageFlags, VkImageLayout imageLayout,
+                                                       VksUploadContext* uploadContext, bool mipmaps, VkFormat format,
+                                                       const VksSamplerOptions& samplerOptions )
 {
-    std::shared_ptr<VksTexture> texture( new VksTexture() );
+    return __createFromFile( filePath, imageUsageFlags, imageLayout, uploadContext, mipmaps, format, samplerOptions, nullptr );
+}
+
+std::shared_ptr<VksTexture> VksTexture::__createFromFile(const char *filePath, VkImageUsageFlags imageUsageFlags, VkImageLayout imageLayout,
+                                                         VksUploadContext* uploadContext, bool mipmaps, VkFormat format,
+                                                         const VksSamplerOptions& samplerOptions, uint64_t* uploadValue)
+{
+    VKS_TRACE_ZONE( "VksTexture::createFromFile" );
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(m_physicalDevice, &deviceProperties);
+    auto container = VksTextureContainer::open( filePath, deviceProperties.limits.maxImageArrayLayers );
+    if( container )
+    {
+        return __createFromContainer( *container, imageUsageFlags, imageLayout, uploadContext, samplerOptions, uploadValue );
+    }
     
-    int texWidth = 0, texHeight = 0, texChannel = 0;
-    stbi_uc* pixel = stbi_load(filePath, &texWidth, &texHeight, &texChannel, STBI_rgb_alpha);
+    uint32_t texWidth = 0, texHeight = 0;
+    if( format == VK_FORMAT_R8G8B8A8_UNORM )
+    {
+        uint32_t rowLength = 0;
+        auto stagingBuffer = __decodeToStaging( filePath, texWidth, texHeight, rowLength );
+        VkBufferImageCopy region = {};
+        region.bufferRowLength = rowLength;
+        region.imageExtent = { texWidth, texHeight, 1 };
+        region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+        return __createFromRegions( stagingBuffer, { region }, texWidth, texHeight, format, 1, 1, false, imageUsageFlags, imageLayout,
+                                    uploadContext, mipmaps, samplerOptions, uploadValue );
+    }
     
-    VkDeviceSize imageSize = texWidth * texHeight * 4;
+    uint32_t mipLevels = 1;
+    auto stagingBuffer = __encodeToStaging( filePath, format, mipmaps, texWidth, texHeight, mipLevels );
+    return __createFromStaging( stagingBuffer, texWidth, texHeight, format, mipLevels, imageUsageFlags, imageLayout, uploadContext, false,
+                                samplerOptions, uploadValue );
+}
+
+std::shared_ptr<VksTexture> VksTexture::__createFromContainer(const VksTextureContainer &container, VkImageUsageFlags imageUsageFlags,
+                                                              VkImageLayout imageLayout, VksUploadContext* uploadContext,
+                                                              const VksSamplerOptions& samplerOptions, uint64_t* uploadValue)
+{
+    VKS_TRACE_ZONE( "VksTexture::__createFromContainer" );
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(m_physicalDevice, container.getFormat(), &formatProperties);
+    if( !( formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT ) )
+    {
+        throw std::runtime_error("texture container format is not supported by the device");
+    }
     
-    auto stagingBuffer = VksBuffer::createBuffer(imageSize,
-                                                 VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                                                 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT );
-    void* imageData;
-    stagingBuffer->mapMemory(0, imageSize, &imageData);
-    memcpy( imageData, pixel, imageSize );
-    stagingBuffer->unMapMemory();
+    // the payload goes from the file mapping into the staging buffer in one pass
+    size_t dataSize = 0;
+    container.stage( nullptr, dataSize );
+    auto stagingBuffer = m_stagingPool->acquire( dataSize );
+    auto regions = container.stage( stagingBuffer->getMappedData(), dataSize );
+    stagingBuffer->flushMemory( 0, dataSize );
     
-    stbi_image_free(pixel);
+    return __createFromRegions( stagingBuffer, regions, container.getWidth(), container.getHeight(), container.getFormat(),
+                                container.getMipLevels(), container.getLayerCount(), container.isCube(), imageUsageFlags, imageLayout,
+                                uploadContext, false, samplerOptions, uploadValue );
+}
+
+// bytes of one tightly packed level in a staging buffer
+static size_t stagedLevelSize( VkFormat format, uint32_t width, uint32_t height )
+{
+    if( VksBlockCompress::isSupported( format ) )
+        return VksBlockCompress::compressedSize( format, width, height );
+    return (size_t)width * height * 4;
+}
+
+std::shared_ptr<VksTexture> VksTexture::__createFromStaging(const std::shared_ptr<VksBuffer> &stagingBuffer, uint32_t texWidth, uint32_t texHeight,
+                                                            VkFormat format, uint32_t stagedLevels, VkImageUsageFlags imageUsageFlags, VkImageLayout imageLayout,
+                                                            VksUploadContext* uploadContext, bool mipmaps, const VksSamplerOptions& samplerOptions,
+                                                            uint64_t* uploadValue )
+{
+    std::vector<VkBufferImageCopy> regions( stagedLevels );
+    VkDeviceSize bufferOffset = 0;
+    for( uint32_t level = 0; level < stagedLevels; level++ )
+    {
+        uint32_t levelWidth = std::max( texWidth >> level, 1u );
+        uint32_t levelHeight = std::max( texHeight >> level, 1u );
+        regions[level] = {};
+        regions[level].bufferOffset = bufferOffset;
+        regions[level].imageExtent = { levelWidth, levelHeight, 1 };
+        regions[level].imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1 };
+        bufferOffset += stagedLevelSize( format, levelWidth, levelHeight );
+    }
+    return __createFromRegions( stagingBuffer, regions, texWidth, texHeight, format, stagedLevels, 1, false, imageUsageFlags, imageLayout,
+                                uploadContext, mipmaps, samplerOptions, uploadValue );
+}
+
+std::shared_ptr<VksTexture> VksTexture::__createFromRegions(const std::shared_ptr<VksBuffer> &stagingBuffer, const std::vector<VkBufferImageCopy> &regions,
+                                                            uint32_t texWidth, uint32_t texHeight, VkFormat format, uint32_t stagedLevels,
+                                                            uint32_t layerCount, bool cube, VkImageUsageFlags imageUsageFlags, VkImageLayout imageLayout,
+                                                            VksUploadContext* uploadContext, bool mipmaps, const VksSamplerOptions& samplerOptions,
+                                                            uint64_t* uploadValue )
+{
+    std::shared_ptr<VksTexture> texture( new VksTexture() );
     
-    texture->__createImage(texWidth, texHeight, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_USAGE_TRANSFER_DST_BIT | imageUsageFlags , VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    VkImageUsageFlags usageFlags = VK_IMAGE_USAGE_TRANSFER_DST_BIT | imageUsageFlags;
+    uint32_t mipLevels = mipmaps ? texture->__prepareMipmaps(texWidth, texHeight, format, usageFlags) : stagedLevels;
+    texture->__createImage(texWidth, texHeight, format, VK_IMAGE_LAYOUT_UNDEFINED, usageFlags, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, mipLevels,
+                           layerCount, cube ? VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT : 0);
+    if( cube )
+    {
+        texture->m_viewType = layerCount > 6 ? VK_IMAGE_VIEW_TYPE_CUBE_ARRAY : VK_IMAGE_VIEW_TYPE_CUBE;
+    }
+    else if( layerCount > 1 )
+    {
+        texture->m_viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
+    }
     
     texture->m_width = texWidth;
     texture->m_height = texHeight;
-    texture->m_format = VK_FORMAT_R8G8B8A8_UNORM;
-    
-    VkBufferImageCopy region = {};
-    region.bufferOffset = 0;
-    region.bufferRowLength = 0;
-    region.bufferImageHeight = 0;
-    
-    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    region.imageSubresource.mipLevel = 0;
-    region.imageSubresource.baseArrayLayer = 0;
-    region.imageSubresource.layerCount = 1;
+    texture->m_format = format;
     texture->m_aspectFlag = VK_IMAGE_ASPECT_COLOR_BIT;
-
-    region.imageOffset = {0,0,0};
-    region.imageExtent = { (uint32_t)texWidth, (uint32_t)texHeight, 1 };
-    
-    VkCommandBuffer commandBuffer = m_graphicCommand->beginOnceSubmitBuffer();
     
-    texture->__transferImageLayout(VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-    
-    vkCmdCopyBufferToImage(commandBuffer, stagingBuffer->getVkBuffer(), texture->m_texture, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-    
-    m_graphicCommand->endOnceSubmitBuffer(commandBuffer);
-    if( imageLayout != VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL )
-        texture->__transferImageLayout(VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, imageLayout);
+    if( uploadContext )
+    {
+        // copy on the upload queue, the final transition happens on the graphics queue
+        uploadContext->record( [&]( VkCommandBuffer commandBuffer ) {
+            texture->__recordUpload( commandBuffer, stagingBuffer->getVkBuffer(), regions, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL );
+        });
+        uploadContext->keepAlive( stagingBuffer );
+        
+        if( mipLevels > stagedLevels )
+        {
+            // only level 0 was written on the upload queue; the chain is built on the graphics
+            // queue, where the other levels start out undefined
+            VkImageSubresourceRange baseLevel = { texture->m_aspectFlag, 0, 1, 0, layerCount };
+            uploadContext->transferImageOwnership( texture->m_texture, baseLevel, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                                   VK_ACCESS_TRANSFER_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT );
+            texture->assumeState( VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_TRANSFER_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1 );
+            uint64_t value = uploadContext->recordGraphics( [&]( VkCommandBuffer commandBuffer ) {
+                texture->generateMipmaps( commandBuffer, imageLayout );
+            });
+            if( uploadValue ) *uploadValue = value;
+        }
+        else
+        {
+            VkAccessFlags dstAccessMask = 0;
+            VkPipelineStageFlags dstStageFlag = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+            __dstAccessStage( imageLayout, dstAccessMask, dstStageFlag );
+            uint64_t value = uploadContext->transferImageOwnership( texture->m_texture, texture->getSubresourceRange(), imageLayout, dstAccessMask, dstStageFlag );
+            texture->assumeState( imageLayout, dstAccessMask, dstStageFlag );
+            if( uploadValue ) *uploadValue = value;
+        }
+    }
+    else
+    {
+        VkCommandBuffer commandBuffer = m_graphicCommand->beginOnceSubmitBuffer();
+        if( mipLevels > stagedLevels )
+        {
+            texture->__recordUpload( commandBuffer, stagingBuffer->getVkBuffer(), regions, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL );
+            texture->generateMipmaps( commandBuffer, imageLayout );
+        }
+        else
+        {
+            texture->__recordUpload( commandBuffer, stagingBuffer->getVkBuffer(), regions, imageLayout );
+        }
+        m_graphicCommand->endOnceSubmitBuffer(commandBuffer);
+    }
     
     texture->__createImageView();
-    texture->__createSampler();
+    texture->__createSampler( samplerOptions );
     
     texture->m_descriptor.imageLayout = imageLayout;
     texture->m_descriptor.imageView = texture->m_textureView;
@@ -109,7 +311,8 @@ std::shared_ptr<VksTexture> VksTexture::createFromFile(const char *filePath, VkI
     return texture;
 }
 
-std::shared_ptr<VksTexture> VksTexture::createFromVkImage(VkImage vkImage, uint32_t width, uint32_t height, VkFormat format,  VkImageLayout imageLayout, VkImageAspectFlags aspectFlag)
+std::shared_ptr<VksTexture> VksTexture::createFromVkImage(VkImage vkImage, uint32_t width, uint32_t height, VkFormat format,  VkImageLayout imageLayout, VkImageAspectFlags aspectFlag,
+                                                          const VksSamplerOptions& samplerOptions)
 {
     std::shared_ptr<VksTexture> texture( new VksTexture() );
     
@@ -121,7 +324,7 @@ std::shared_ptr<VksTexture> VksTexture::createFromVkImage(VkImage vkImage, uint3
     texture->m_aspectFlag = aspectFlag;
 
     texture->__createImageView();
-    texture->__createSampler();
+    texture->__createSampler( samplerOptions );
     
     texture->m_descriptor.imageLayout = imageLayout;
     texture->m_descriptor.imageView = texture->m_textureView;
@@ -140,43 +343,84 @@ void VksTexture::__createImageView()
     viewInfo.subresourceRange.aspectMask = m_aspectFlag;
     viewInfo.subresourceRange.baseArrayLayer = 0;
     viewInfo.subresourceRange.baseMipLevel = 0;
-    viewInfo.subresourceRange.layerCount = 1;
-    viewInfo.subresourceRange.levelCount = 1;
-    viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewInfo.subresourceRange.layerCount = m_layerCount;
+    viewInfo.subresourceRange.levelCount = m_mipLevels;
+    viewInfo.viewType = m_viewType;
     
     VK_CHECK( vkCreateImageView(m_logicDevice, &viewInfo, nullptr, &m_textureView) )
 }
 
-void VksTexture::__createSampler()
+void VksTexture::__createSampler(const VksSamplerOptions &samplerOptions)
 {
     VkSamplerCreateInfo samplerInfo = {};
     samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-    samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-    samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-    samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerInfo.addressModeU = samplerOptions.addressMode;
+    samplerInfo.addressModeV = samplerOptions.addressMode;
+    samplerInfo.addressModeW = samplerOptions.addressMode;
     samplerInfo.maxAnisotropy = 1;
     samplerInfo.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
     samplerInfo.unnormalizedCoordinates = VK_FALSE;
     samplerInfo.compareEnable = VK_FALSE;
-    samplerInfo.magFilter = VK_FILTER_NEAREST;
-    samplerInfo.minFilter = VK_FILTER_NEAREST;
+    samplerInfo.magFilter = samplerOptions.magFilter;
+    samplerInfo.minFilter = samplerOptions.minFilter;
+    samplerInfo.mipmapMode = samplerOptions.mipmapMode;
+    samplerInfo.minLod = 0.0f;
+    samplerInfo.maxLod = static_cast<float>( m_mipLevels );
+    
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(m_physicalDevice, m_format, &formatProperties);
+    bool linearFilter = ( formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT ) != 0;
+    if( samplerOptions.trilinearMipmaps && m_mipLevels > 1 && linearFilter )
+    {
+        // trilinear, minified mip chains alias badly with nearest filtering
+        samplerInfo.magFilter = VK_FILTER_LINEAR;
+        samplerInfo.minFilter = VK_FILTER_LINEAR;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    }
+    else if( !linearFilter )
+    {
+        samplerInfo.magFilter = VK_FILTER_NEAREST;
+        samplerInfo.minFilter = VK_FILTER_NEAREST;
+        samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    }
+    
+    if( samplerOptions.maxAnisotropy > 1.0f && m_enabledFeatures.samplerAnisotropy )
+    {
+        VkPhysicalDeviceProperties deviceProperties;
+        vkGetPhysicalDeviceProperties(m_physicalDevice, &deviceProperties);
+        samplerInfo.anisotropyEnable = VK_TRUE;
+        samplerInfo.maxAnisotropy = std::min( samplerOptions.maxAnisotropy, deviceProperties.limits.maxSamplerAnisotropy );
+    }
     
-    VK_CHECK( vkCreateSampler(m_logicDevice, &samplerInfo, nullptr, &m_textureSampler) )
+    m_textureSampler = m_samplerCache->acquire( samplerInfo );
+}
+
+void VksTexture::setSampler(const VksSamplerOptions &samplerOptions)
+{
+    VkSampler oldSampler = m_textureSampler;
+    __createSampler( samplerOptions );
+    m_samplerCache->release( oldSampler );
+    m_descriptor.sampler = m_textureSampler;
 }
 
-void VksTexture::__createImage(uint32_t width, uint32_t height, VkFormat format, VkImageLayout imageLayout, VkImageUsageFlags usage, VkMemoryPropertyFlags properties)
+void VksTexture::__createImage(uint32_t width, uint32_t height, VkFormat format, VkImageLayout imageLayout, VkImageUsageFlags usage, VkMemoryPropertyFlags properties,
+                               uint32_t mipLevels, uint32_t arrayLayers, VkImageCreateFlags flags)
 {
+    m_mipLevels = std::max( mipLevels, 1u );
+    m_layerCount = std::max( arrayLayers, 1u );
+    m_states.assign( m_mipLevels, ImageState() );
+
     VkImageCreateInfo imageInfo = {};
     imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     imageInfo.format = format;
     imageInfo.imageType = VK_IMAGE_TYPE_2D;
-    imageInfo.flags = 0;
+    imageInfo.flags = flags;
     imageInfo.extent.width = width;
     imageInfo.extent.height = height;
     imageInfo.extent.depth = 1;
     imageInfo.initialLayout = imageLayout;
-    imageInfo.arrayLayers = 1;
-    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = m_layerCount;
+    imageInfo.mipLevels = m_mipLevels;
     imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
     imageInfo.usage = usage;
     imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
@@ -187,26 +431,15 @@ void VksTexture::__createImage(uint32_t width, uint32_t height, VkFormat format,
     VkMemoryRequirements memReq;
     vkGetImageMemoryRequirements(m_logicDevice, m_texture, &memReq);
     
-    VkMemoryAllocateInfo allocInfo = {};
-    allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    allocInfo.allocationSize = memReq.size;
+    m_textureAllocation = m_allocator->allocate( memReq, properties, imageInfo.tiling == VK_IMAGE_TILING_LINEAR );
     
-    auto memoryTypeIndex = __findMemoryType(memReq.memoryTypeBits, properties);
-    if( memoryTypeIndex == std::nullopt )
-    {
-        throw std::runtime_error(" Can not find related memory property flags ");
-    }
-    
-    allocInfo.memoryTypeIndex = memoryTypeIndex.value();
-    
-    vkAllocateMemory(m_logicDevice, &allocInfo, nullptr, &m_textureMemory);
-    
-    vkBindImageMemory(m_logicDevice, m_texture, m_textureMemory, 0);
+    VK_CHECK( vkBindImageMemory(m_logicDevice, m_texture, m_textureAllocation.memory, m_textureAllocation.offset) )
 }
 
 void VksTexture::transferImageLayout( VkImageLayout oldLayout, VkImageLayout newLayout, VkAccessFlags srcAccessFlag,
                          VkAccessFlags dstAccessFlag, VkPipelineStageFlags srcStageFlag, VkPipelineStageFlags dstStageFlag )
 {
+    VKS_TRACE_ZONE( "VksTexture::transferImageLayout" );
     VkImageMemoryBarrier imageBarrier = {};
     imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
     imageBarrier.oldLayout = oldLayout;
@@ -216,120 +449,271 @@ void VksTexture::transferImageLayout( VkImageLayout oldLayout, VkImageLayout new
     imageBarrier.dstAccessMask = dstAccessFlag;
     imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
     imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    imageBarrier.subresourceRange.aspectMask = m_aspectFlag;
-    imageBarrier.subresourceRange.baseArrayLayer = 0;
-    imageBarrier.subresourceRange.baseMipLevel = 0;
-    imageBarrier.subresourceRange.layerCount = 1;
-    imageBarrier.subresourceRange.levelCount = 1;
+    imageBarrier.subresourceRange = getSubresourceRange();
     
     VkCommandBuffer commandBuffer = m_graphicCommand->beginOnceSubmitBuffer();
     vkCmdPipelineBarrier(commandBuffer, srcStageFlag, dstStageFlag, 0, 0, nullptr, 0, nullptr, 1, &imageBarrier );
 
     m_graphicCommand->endOnceSubmitBuffer(commandBuffer);
+    assumeState( newLayout, dstAccessFlag, dstStageFlag );
 }
 
-void VksTexture::__transferImageLayout(VkImageLayout oldLayout, VkImageLayout newLayout)
+bool VksTexture::__transitionState(uint32_t mipLevel, VkImageLayout layout, VkAccessFlags access, VkPipelineStageFlags stage,
+                                   VkImageMemoryBarrier &imageBarrier, VkPipelineStageFlags &srcStageFlag)
 {
-    VkImageMemoryBarrier imageBarrier = {};
+    ImageState& state = m_states[ mipLevel ];
+    if( state.layout == layout && !( state.access & kWriteAccess ) && !( access & kWriteAccess ) )
+    {
+        // read after read needs no barrier, but a later write has to wait for both readers
+        state.access |= access;
+        state.stage |= stage;
+        return false;
+    }
+    
+    imageBarrier = {};
     imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    imageBarrier.oldLayout = oldLayout;
-    imageBarrier.newLayout = newLayout;
+    imageBarrier.oldLayout = state.layout;
+    imageBarrier.newLayout = layout;
     imageBarrier.image = m_texture;
-    imageBarrier.srcAccessMask = 0;
-    imageBarrier.dstAccessMask = 0;
+    // only writes need to be made available; a read before a write is covered by the
+    // execution dependency alone
+    imageBarrier.srcAccessMask = state.access & kWriteAccess;
+    imageBarrier.dstAccessMask = access;
     imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
     imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    imageBarrier.subresourceRange.aspectMask = m_aspectFlag;
-    imageBarrier.subresourceRange.baseArrayLayer = 0;
-    imageBarrier.subresourceRange.baseMipLevel = 0;
-    imageBarrier.subresourceRange.layerCount = 1;
-    imageBarrier.subresourceRange.levelCount = 1;
-    
-    VkPipelineStageFlags srcStageFlag = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
-    VkPipelineStageFlags dstStageFlag = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    imageBarrier.subresourceRange = { m_aspectFlag, mipLevel, 1, 0, m_layerCount };
     
-    VkCommandBuffer commandBuffer = m_graphicCommand->beginOnceSubmitBuffer();
+    // a never used image has nothing to wait for
+    srcStageFlag = state.stage != 0 ? state.stage : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    state = { layout, access, stage };
+    return true;
+}
+
+bool VksTexture::requireState(VkCommandBuffer commandBuffer, VkImageLayout layout, VkAccessFlags access, VkPipelineStageFlags stage,
+                              uint32_t baseMipLevel, uint32_t levelCount)
+{
+    uint32_t endMipLevel = levelCount == VK_REMAINING_MIP_LEVELS ? m_mipLevels : std::min( baseMipLevel + levelCount, m_mipLevels );
     
-    if( oldLayout == VK_IMAGE_LAYOUT_UNDEFINED )
-    {
-        imageBarrier.srcAccessMask = 0;
-        srcStageFlag = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-    }
-    else if( oldLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL )
+    std::vector<VkImageMemoryBarrier> imageBarriers;
+    VkPipelineStageFlags srcStageFlag = 0;
+    for( uint32_t mipLevel = baseMipLevel; mipLevel < endMipLevel; mipLevel++ )
     {
-        imageBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-        srcStageFlag = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        VkImageMemoryBarrier imageBarrier;
+        VkPipelineStageFlags mipStageFlag = 0;
+        if( !__transitionState( mipLevel, layout, access, stage, imageBarrier, mipStageFlag ) )
+            continue;
+        
+        srcStageFlag |= mipStageFlag;
+        if( !imageBarriers.empty() )
+        {
+            VkImageMemoryBarrier& last = imageBarriers.back();
+            if( last.oldLayout == imageBarrier.oldLayout && last.srcAccessMask == imageBarrier.srcAccessMask &&
+                last.subresourceRange.baseMipLevel + last.subresourceRange.levelCount == mipLevel )
+            {
+                last.subresourceRange.levelCount++;
+                continue;
+            }
+        }
+        imageBarriers.push_back( imageBarrier );
     }
-    else if( oldLayout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL )
+    
+    if( imageBarriers.empty() )
+        return false;
+    
+    vkCmdPipelineBarrier(commandBuffer, srcStageFlag, stage, 0, 0, nullptr, 0, nullptr,
+                         static_cast<uint32_t>( imageBarriers.size() ), imageBarriers.data() );
+    return true;
+}
+
+void VksTexture::requireState(VkImageLayout layout, VkAccessFlags access, VkPipelineStageFlags stage)
+{
+    VKS_TRACE_ZONE( "VksTexture::requireState" );
+    VkCommandBuffer commandBuffer = m_graphicCommand->beginOnceSubmitBuffer();
+    requireState( commandBuffer, layout, access, stage );
+    m_graphicCommand->endOnceSubmitBuffer(commandBuffer);
+}
+
+void VksTexture::assumeState(VkImageLayout layout, VkAccessFlags access, VkPipelineStageFlags stage, uint32_t baseMipLevel, uint32_t levelCount)
+{
+    uint32_t endMipLevel = levelCount == VK_REMAINING_MIP_LEVELS ? m_mipLevels : std::min( baseMipLevel + levelCount, m_mipLevels );
+    for( uint32_t mipLevel = baseMipLevel; mipLevel < endMipLevel; mipLevel++ )
     {
-        imageBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-        srcStageFlag = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        m_states[ mipLevel ] = { layout, access, stage };
     }
-    else if( oldLayout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL )
+}
+
+void VksTexture::__dstAccessStage(VkImageLayout layout, VkAccessFlags &accessMask, VkPipelineStageFlags &stageFlag)
+{
+    if( layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL )
     {
-        imageBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-        srcStageFlag = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+        accessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        stageFlag = VK_PIPELINE_STAGE_TRANSFER_BIT;
     }
-    else if( oldLayout == VK_IMAGE_LAYOUT_GENERAL )
+    else if( layout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL )
     {
-        imageBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
-        srcStageFlag = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        accessMask = VK_ACCESS_TRANSFER_READ_BIT;
+        stageFlag = VK_PIPELINE_STAGE_TRANSFER_BIT;
     }
-    
-    if( newLayout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL )
+    else if( layout == VK_IMAGE_LAYOUT_PRESENT_SRC_KHR )
     {
-        imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-        dstStageFlag = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        // presentation is ordered by semaphores, not by the barrier
+        accessMask = 0;
+        stageFlag = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
     }
-    else if( newLayout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL )
+    else if( layout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL )
     {
-        imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-        dstStageFlag = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        accessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+        stageFlag = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
     }
-    else if( newLayout == VK_IMAGE_LAYOUT_PRESENT_SRC_KHR )
+    else if( layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL )
     {
+        accessMask = VK_ACCESS_SHADER_READ_BIT;
+        stageFlag = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
     }
-    else if( newLayout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL )
+    else if( layout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL )
     {
-        imageBarrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT;
-        dstStageFlag = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        accessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+        stageFlag = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
     }
-    else if( newLayout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL )
+    else if( layout == VK_IMAGE_LAYOUT_GENERAL )
     {
-        imageBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-        dstStageFlag = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+        accessMask = VK_ACCESS_SHADER_READ_BIT;
+        stageFlag = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
     }
-    else if( newLayout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL )
+}
+
+VkImageSubresourceRange VksTexture::getSubresourceRange()
+{
+    return { m_aspectFlag, 0, m_mipLevels, 0, m_layerCount };
+}
+
+uint32_t VksTexture::mipLevelCount(uint32_t width, uint32_t height)
+{
+    uint32_t size = std::max( std::max( width, height ), 1u );
+    uint32_t levels = 1;
+    while( size > 1 )
     {
-        imageBarrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-        dstStageFlag = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+        size >>= 1;
+        levels++;
     }
-    else if( newLayout == VK_IMAGE_LAYOUT_GENERAL )
+    return levels;
+}
+
+void VksTexture::setMipmapShaderPath(const std::string &spirvPath)
+{
+    s_mipmapShaderPath = spirvPath;
+}
+
+VksTexture::MipmapMethod VksTexture::__mipmapMethod(VkFormat format)
+{
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(m_physicalDevice, format, &formatProperties);
+    VkFormatFeatureFlags features = formatProperties.optimalTilingFeatures;
+    
+    bool blit = ( features & VK_FORMAT_FEATURE_BLIT_SRC_BIT ) && ( features & VK_FORMAT_FEATURE_BLIT_DST_BIT );
+    if( blit && features & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT )
+        return MIPMAP_BLIT_LINEAR;
+    // the downsample shader declares no image format
+    if( features & VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT && m_enabledFeatures.shaderStorageImageReadWithoutFormat
+        && m_enabledFeatures.shaderStorageImageWriteWithoutFormat )
+        return MIPMAP_COMPUTE;
+    if( blit )
+        return MIPMAP_BLIT_NEAREST;
+    return MIPMAP_NONE;
+}
+
+uint32_t VksTexture::__prepareMipmaps(uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags &usage)
+{
+    m_mipmapMethod = __mipmapMethod( format );
+    // formats that can not be mipmapped get a single level, callers see it in getMipLevels()
+    if( m_mipmapMethod == MIPMAP_NONE )
+        return 1;
+    
+    usage |= m_mipmapMethod == MIPMAP_COMPUTE ? VK_IMAGE_USAGE_STORAGE_BIT
+                                              : VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    return mipLevelCount( width, height );
+}
+
+void VksTexture::generateMipmaps(VkCommandBuffer commandBuffer, VkImageLayout finalLayout)
+{
+    if( m_mipLevels > 1 )
     {
-        imageBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-        dstStageFlag = VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT;
+        if( m_mipmapMethod == MIPMAP_COMPUTE )
+            __computeMipmaps( commandBuffer );
+        else
+            __blitMipmaps( commandBuffer, m_mipmapMethod == MIPMAP_BLIT_LINEAR ? VK_FILTER_LINEAR : VK_FILTER_NEAREST );
     }
     
-    
-    vkCmdPipelineBarrier(commandBuffer, srcStageFlag, dstStageFlag, 0, 0, nullptr, 0, nullptr, 1, &imageBarrier );
-    
-    m_graphicCommand->endOnceSubmitBuffer(commandBuffer);
+    VkAccessFlags accessMask = 0;
+    VkPipelineStageFlags stageFlag = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    __dstAccessStage( finalLayout, accessMask, stageFlag );
+    requireState( commandBuffer, finalLayout, accessMask, stageFlag );
 }
 
-VkImageSubresourceRange VksTexture::getSubresourceRange()
+void VksTexture::generateMipmaps(VkImageLayout finalLayout)
 {
-    return { m_aspectFlag, 0, 1, 0, 1 };
+    VKS_TRACE_ZONE( "VksTexture::generateMipmaps" );
+    VkCommandBuffer commandBuffer = m_graphicCommand->beginOnceSubmitBuffer();
+    generateMipmaps( commandBuffer, finalLayout );
+    m_graphicCommand->endOnceSubmitBuffer(commandBuffer);
 }
 
-void VksTexture::updateTexture(const char *data, VkDeviceSize dataSize, VkOffset2D imageOffset, VkExtent2D imageExtent)
+void VksTexture::__blitMipmaps(VkCommandBuffer commandBuffer, VkFilter filter)
 {
-    auto stagingBuffer = VksBuffer::createBuffer(dataSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    // every level but the first becomes a blit destination in one barrier
+    requireState( commandBuffer, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 1 );
     
-    void *pData = reinterpret_cast<void*>( const_cast<char*>(data) );
+    int32_t width = static_cast<int32_t>( m_width );
+    int32_t height = static_cast<int32_t>( m_height );
+    for( uint32_t mipLevel = 1; mipLevel < m_mipLevels; mipLevel++ )
+    {
+        requireState( commandBuffer, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_TRANSFER_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, mipLevel - 1, 1 );
+        
+        int32_t mipWidth = std::max( width / 2, 1 );
+        int32_t mipHeight = std::max( height / 2, 1 );
+        
+        VkImageBlit blit = {};
+        blit.srcSubresource = { m_aspectFlag, mipLevel - 1, 0, m_layerCount };
+        blit.srcOffsets[1] = { width, height, 1 };
+        blit.dstSubresource = { m_aspectFlag, mipLevel, 0, m_layerCount };
+        blit.dstOffsets[1] = { mipWidth, mipHeight, 1 };
+        vkCmdBlitImage(commandBuffer, m_texture, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, m_texture, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                       1, &blit, filter);
+        
+        width = mipWidth;
+        height = mipHeight;
+    }
+}
+
+void VksTexture::__computeMipmaps(VkCommandBuffer commandBuffer)
+{
+    if( !m_mipmapCompute )
+    {
+        m_mipmapCompute = std::make_shared<MipmapCompute>( this );
+    }
     
-    stagingBuffer->copyHostDataToBuffer( pData, dataSize);
+    auto& shader = m_mipmapCompute->m_shader;
+    auto& localSize = shader->getReflection().getLocalSize();
+    vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_mipmapCompute->m_pipeline);
     
-    auto commandBuffer = m_graphicCommand->beginOnceSubmitBuffer();
+    uint32_t width = m_width;
+    uint32_t height = m_height;
+    for( uint32_t mipLevel = 1; mipLevel < m_mipLevels; mipLevel++ )
+    {
+        requireState( commandBuffer, VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, mipLevel - 1, 1 );
+        requireState( commandBuffer, VK_IMAGE_LAYOUT_GENERAL, VK_ACCESS_SHADER_WRITE_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, mipLevel, 1 );
+        
+        width = std::max( width / 2, 1u );
+        height = std::max( height / 2, 1u );
+        
+        VkDescriptorSet descSet = shader->getDescriptorSet( mipLevel - 1 );
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, shader->getPipelineLayout(), 0, 1, &descSet, 0, nullptr);
+        vkCmdDispatch(commandBuffer, ( width + localSize[0] - 1 ) / localSize[0], ( height + localSize[1] - 1 ) / localSize[1], 1);
+    }
+}
+
+VkBufferImageCopy VksTexture::__copyRegion(VkOffset2D imageOffset, VkExtent2D imageExtent)
+{
     VkBufferImageCopy copyRegion = {};
     
     copyRegion.bufferImageHeight = 0;
@@ -343,55 +727,212 @@ void VksTexture::updateTexture(const char *data, VkDeviceSize dataSize, VkOffset
     copyRegion.imageSubresource.baseArrayLayer = 0;
     copyRegion.imageSubresource.layerCount = 1;
     
-    VkImageLayout oriLayout = m_descriptor.imageLayout;
-    
-    __transferImageLayout( m_descriptor.imageLayout , VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-    m_descriptor.imageLayout  = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    return copyRegion;
+}
+
+void VksTexture::__recordUpdate(VkCommandBuffer commandBuffer, VkBuffer buffer, const VkBufferImageCopy &region, VkImageLayout newLayout)
+{
+    uint32_t mipLevel = region.imageSubresource.mipLevel;
+    requireState( commandBuffer, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, mipLevel, 1 );
     
-    vkCmdCopyBufferToImage(commandBuffer, stagingBuffer->getVkBuffer(), m_texture, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
-    m_graphicCommand->endOnceSubmitBuffer( commandBuffer );
+    vkCmdCopyBufferToImage(commandBuffer, buffer, m_texture, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
     
-    __transferImageLayout(VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, oriLayout);
+    if( newLayout != VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL )
+    {
+        VkAccessFlags accessMask = 0;
+        VkPipelineStageFlags stageFlag = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+        __dstAccessStage( newLayout, accessMask, stageFlag );
+        requireState( commandBuffer, newLayout, accessMask, stageFlag, mipLevel, 1 );
+    }
+}
+
+void VksTexture::__recordUpload(VkCommandBuffer commandBuffer, VkBuffer buffer, const std::vector<VkBufferImageCopy> &regions, VkImageLayout newLayout)
+{
+    uint32_t levelCount = 0;
+    for( auto& region : regions )
+    {
+        levelCount = std::max( levelCount, region.imageSubresource.mipLevel + 1 );
+    }
+    requireState( commandBuffer, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, levelCount );
     
-    m_descriptor.imageLayout = oriLayout;
+    vkCmdCopyBufferToImage(commandBuffer, buffer, m_texture, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                           static_cast<uint32_t>( regions.size() ), regions.data());
     
+    if( newLayout != VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL )
+    {
+        VkAccessFlags accessMask = 0;
+        VkPipelineStageFlags stageFlag = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+        __dstAccessStage( newLayout, accessMask, stageFlag );
+        requireState( commandBuffer, newLayout, accessMask, stageFlag, 0, levelCount );
+    }
 }
 
-void VksTexture::updateTexture(const std::shared_ptr<VksBuffer> &buffer, VkOffset2D imageOffset, VkExtent2D imageExtent)
+void VksTexture::updateTexture(const char *data, VkDeviceSize dataSize, VkOffset2D imageOffset, VkExtent2D imageExtent, VksUploadContext* uploadContext)
 {
-    VkBufferImageCopy copyRegion = {};
+    VKS_TRACE_ZONE( "VksTexture::updateTexture" );
+    auto stagingBuffer = m_stagingPool->acquire(dataSize);
     
-    copyRegion.bufferImageHeight = 0;
-    copyRegion.bufferOffset = 0;
-    copyRegion.bufferRowLength = 0;
-    copyRegion.imageExtent = { imageExtent.width, imageExtent.height, 1 };
-    copyRegion.imageOffset = { imageOffset.x, imageOffset.y, 0 };
+    void *pData = reinterpret_cast<void*>( const_cast<char*>(data) );
     
-    copyRegion.imageSubresource.aspectMask = m_aspectFlag;
-    copyRegion.imageSubresource.mipLevel = 0;
-    copyRegion.imageSubresource.baseArrayLayer = 0;
-    copyRegion.imageSubresource.layerCount = 1;
+    stagingBuffer->copyHostDataToBuffer( pData, dataSize);
+    
+    VkBufferImageCopy copyRegion = __copyRegion( imageOffset, imageExtent );
+    VkImageLayout layout = m_descriptor.imageLayout;
+    
+    if( uploadContext )
+    {
+        // the image is owned by the graphics queue, so the whole update is recorded there
+        uploadContext->recordGraphics( [&]( VkCommandBuffer commandBuffer ) {
+            __recordUpdate( commandBuffer, stagingBuffer->getVkBuffer(), copyRegion, layout );
+        });
+        uploadContext->keepAlive( stagingBuffer );
+        return;
+    }
     
     auto commandBuffer = m_graphicCommand->beginOnceSubmitBuffer();
+    __recordUpdate( commandBuffer, stagingBuffer->getVkBuffer(), copyRegion, layout );
+    m_graphicCommand->endOnceSubmitBuffer( commandBuffer );
+}
 
-    __transferImageLayout( m_descriptor.imageLayout , VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+void VksTexture::updateTexture(const std::shared_ptr<VksBuffer> &buffer, VkOffset2D imageOffset, VkExtent2D imageExtent)
+{
+    VkBufferImageCopy copyRegion = __copyRegion( imageOffset, imageExtent );
     
-    vkCmdCopyBufferToImage(commandBuffer, buffer->getVkBuffer(), m_texture, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
+    auto commandBuffer = m_graphicCommand->beginOnceSubmitBuffer();
+    __recordUpdate( commandBuffer, buffer->getVkBuffer(), copyRegion, m_descriptor.imageLayout );
+    m_graphicCommand->endOnceSubmitBuffer( commandBuffer );
+}
+
+void VksTexture::updateTexture(const std::shared_ptr<VksBuffer> &buffer, const std::vector<VkBufferImageCopy> &regions, VksUploadContext* uploadContext)
+{
+    if( regions.empty() ) return;
+    VkImageLayout layout = m_descriptor.imageLayout;
     
-    __transferImageLayout(VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, m_descriptor.imageLayout);
+    if( uploadContext )
+    {
+        uploadContext->recordGraphics( [&]( VkCommandBuffer commandBuffer ) {
+            __recordUpload( commandBuffer, buffer->getVkBuffer(), regions, layout );
+        });
+        uploadContext->keepAlive( buffer );
+        return;
+    }
     
+    auto commandBuffer = m_graphicCommand->beginOnceSubmitBuffer();
+    __recordUpload( commandBuffer, buffer->getVkBuffer(), regions, layout );
     m_graphicCommand->endOnceSubmitBuffer( commandBuffer );
 }
 
 void VksTexture::updateTexture(const char* filePath)
 {
+    VKS_TRACE_ZONE( "VksTexture::updateTexture" );
+    uint32_t texWidth = 0, texHeight = 0, rowLength = 0;
+    auto stagingBuffer = __decodeToStaging( filePath, texWidth, texHeight, rowLength );
+    
+    VkOffset2D offset = { 0,0 };
+    VkExtent2D imageExtent = { texWidth, texHeight };
+    VkBufferImageCopy copyRegion = __copyRegion( offset, imageExtent );
+    copyRegion.bufferRowLength = rowLength;
+    
+    auto commandBuffer = m_graphicCommand->beginOnceSubmitBuffer();
+    __recordUpdate( commandBuffer, stagingBuffer->getVkBuffer(), copyRegion, m_descriptor.imageLayout );
+    m_graphicCommand->endOnceSubmitBuffer( commandBuffer );
+}
+
+std::shared_ptr<VksBuffer> VksTexture::__decodeToStaging(const char *filePath, uint32_t &width, uint32_t &height, uint32_t &rowLength)
+{
+    VKS_TRACE_ZONE( "VksTexture::__decodeToStaging" );
+    auto file = VksMappedFile::open( filePath );
+    if( file == nullptr )
+    {
+        throw std::runtime_error("fail to load texture file");
+    }
+    
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(m_physicalDevice, &deviceProperties);
+    
+    // the decoder stores a channel or a texel at a time; cached staging memory, when the
+    // device has it, takes those small stores without going through write combining
+    std::shared_ptr<VksBuffer> stagingBuffer;
+    VkDeviceSize stagedSize = 0;
+    VksImageDecode::decode( file->getData(), file->getSize(), deviceProperties.limits.optimalBufferCopyRowPitchAlignment,
+                            [&]( uint32_t decodedWidth, uint32_t decodedHeight, size_t rowPitch ) {
+        width = decodedWidth;
+        height = decodedHeight;
+        rowLength = static_cast<uint32_t>( rowPitch / 4 );
+        stagedSize = rowPitch * decodedHeight;
+        stagingBuffer = m_stagingPool->acquireCached( stagedSize );
+        return static_cast<uint8_t*>( stagingBuffer->getMappedData() );
+    });
+    stagingBuffer->flushMemory( 0, stagedSize );
+    return stagingBuffer;
+}
+
+std::shared_ptr<VksBuffer> VksTexture::__encodeToStaging(const char *filePath, VkFormat format, bool mipmaps,
+                                                         uint32_t &width, uint32_t &height, uint32_t &mipLevels)
+{
+    VKS_TRACE_ZONE( "VksTexture::__encodeToStaging" );
+    if( !VksBlockCompress::isSupported( format ) )
+    {
+        throw std::runtime_error("createFromFile only supports RGBA8 and the BC formats VksBlockCompress encodes");
+    }
+    VkFormatProperties formatProperties;
+    vkGetPhysicalDeviceFormatProperties(m_physicalDevice, format, &formatProperties);
+    if( !( formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT ) )
+    {
+        throw std::runtime_error("block compressed format is not supported by the device");
+    }
+    
+    std::shared_ptr<VksBuffer> stagingBuffer;
+    bool cached = VksBlockCompress::loadCached( filePath, format, mipmaps, width, height, mipLevels, [&]( size_t size ) {
+        stagingBuffer = m_stagingPool->acquire( size );
+        return stagingBuffer->getMappedData();
+    });
+    if( cached )
+    {
+        stagingBuffer->flushMemory();
+        return stagingBuffer;
+    }
+    
     int texWidth = 0, texHeight = 0, texChannel = 0;
     stbi_uc* pixel = stbi_load(filePath, &texWidth, &texHeight, &texChannel, STBI_rgb_alpha);
+    if( pixel == nullptr )
+    {
+        throw std::runtime_error("fail to load texture file");
+    }
+    width = texWidth;
+    height = texHeight;
+    mipLevels = mipmaps ? mipLevelCount( width, height ) : 1;
     
-    VkDeviceSize imageSize = texWidth * texHeight * 4;
-    VkOffset2D offset = { 0,0 };
-    VkExtent2D imageExtent = { (uint32_t)texWidth, (uint32_t)texHeight };
+    size_t dataSize = 0;
+    for( uint32_t level = 0; level < mipLevels; level++ )
+    {
+        dataSize += VksBlockCompress::compressedSize( format, std::max( width >> level, 1u ), std::max( height >> level, 1u ) );
+    }
     
-    updateTexture( reinterpret_cast<const char*>( pixel ), imageSize, offset, imageExtent);
+    // encoded into heap memory, the cache file is written from it as well
+    std::vector<uint8_t> blocks( dataSize );
+    std::vector<uint8_t> levelPixels, nextPixels;
+    const uint8_t* source = pixel;
+    size_t offset = 0;
+    for( uint32_t level = 0; level < mipLevels; level++ )
+    {
+        uint32_t levelWidth = std::max( width >> level, 1u );
+        uint32_t levelHeight = std::max( height >> level, 1u );
+        VksBlockCompress::compress( format, source, levelWidth, levelHeight, blocks.data() + offset );
+        offset += VksBlockCompress::compressedSize( format, levelWidth, levelHeight );
+        if( level + 1 < mipLevels )
+        {
+            nextPixels.resize( (size_t)std::max( levelWidth / 2, 1u ) * std::max( levelHeight / 2, 1u ) * 4 );
+            VksBlockCompress::downsample( source, levelWidth, levelHeight, nextPixels.data() );
+            levelPixels.swap( nextPixels );
+            source = levelPixels.data();
+        }
+    }
     stbi_image_free( pixel );
+    
+    VksBlockCompress::storeCached( filePath, format, mipmaps, width, height, mipLevels, blocks.data(), dataSize );
+    
+    stagingBuffer = m_stagingPool->acquire( dataSize );
+    stagingBuffer->copyHostDataToBuffer( blocks.data(), dataSize );
+    return stagingBuffer;
 }
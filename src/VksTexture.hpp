@@ -11,24 +11,94 @@
 
 #include <stdio.h>
 #include "VkEngine.hpp"
+#include "VksAllocator.hpp"
+#include "VksSamplerCache.hpp"
 
 class VksBuffer;
+class VksUploadContext;
+class VksTextureContainer;
 class VksTexture : protected VkEngine
 {
-    
+    friend class VksBarrier;
+    friend class VksTextureLoader;
 public:
     static constexpr bool value = true;
     
     ~VksTexture();
     
+    // mipmaps allocates the full chain, filled later with generateMipmaps()
     static std::shared_ptr<VksTexture> createEmptyTexture( uint32_t width, uint32_t height, VkFormat format,
                                                VkImageLayout imageLayout, VkImageUsageFlags usageFlags, VkMemoryPropertyFlags memoryPropties = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-                                                          VkImageAspectFlags aspectFlag = VK_IMAGE_ASPECT_COLOR_BIT);
+                                                          VkImageAspectFlags aspectFlag = VK_IMAGE_ASPECT_COLOR_BIT, bool mipmaps = false,
+                                                          const VksSamplerOptions& samplerOptions = VksSamplerOptions() );
+    
+    // With an upload context the copy and transitions are only recorded into its current
+    // batch; the texture is usable once that batch completes. Without one the upload is a
+    // single blocking submit. mipmaps generates the full chain in the same submit.
+    // format may also be one of the BC formats VksBlockCompress encodes; the chain is then
+    // encoded on the CPU, or read from the encoder's disk cache, and usageFlags must not
+    // ask for more than sampling.
+    // KTX2 and DDS files are uploaded as stored: their own format, mip chain, array layers
+    // and cube faces, with format and mipmaps ignored and nothing decoded on the CPU.
+    static std::shared_ptr<VksTexture> createFromFile( const char* filePath, VkImageUsageFlags usageFlags, VkImageLayout imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+                                                      VksUploadContext* uploadContext = nullptr, bool mipmaps = false,
+                                                      VkFormat format = VK_FORMAT_R8G8B8A8_UNORM, const VksSamplerOptions& samplerOptions = VksSamplerOptions() );
+    
+    static std::shared_ptr<VksTexture> createFromVkImage( VkImage vkImage, uint32_t width, uint32_t height, VkFormat format, VkImageLayout imageLayout = VK_IMAGE_LAYOUT_GENERAL, VkImageAspectFlags aspectFlag = VK_IMAGE_ASPECT_COLOR_BIT,
+                                                         const VksSamplerOptions& samplerOptions = VksSamplerOptions() );
+    
+    // Layout, access and pipeline stage of the last use of a mip level. The state follows
+    // recording order, so command buffers that use the texture must be submitted in the
+    // order they were recorded.
+    struct ImageState
+    {
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        VkAccessFlags access = 0;
+        VkPipelineStageFlags stage = 0;
+    };
+    
+    // Records the minimal barrier that makes the mip levels usable in layout with access at
+    // stage, or nothing when the layout already matches and neither the last nor the new
+    // access writes. Returns whether a barrier was recorded. Must be outside a render pass.
+    bool requireState( VkCommandBuffer commandBuffer, VkImageLayout layout, VkAccessFlags access, VkPipelineStageFlags stage,
+                       uint32_t baseMipLevel = 0, uint32_t levelCount = VK_REMAINING_MIP_LEVELS );
+    // Same, submitted and waited for on the graphics queue
+    void requireState( VkImageLayout layout, VkAccessFlags access, VkPipelineStageFlags stage );
+    // Records a transition done outside the tracker: render pass final layouts, queue
+    // family transfers or raw barriers.
+    void assumeState( VkImageLayout layout, VkAccessFlags access, VkPipelineStageFlags stage,
+                      uint32_t baseMipLevel = 0, uint32_t levelCount = VK_REMAINING_MIP_LEVELS );
+    const ImageState& getState( uint32_t mipLevel = 0 ) const
+    {
+        return m_states.at( mipLevel );
+    }
+    
+    uint32_t getMipLevels() const
+    {
+        return m_mipLevels;
+    }
     
-    static std::shared_ptr<VksTexture> createFromFile( const char* filePath, VkImageUsageFlags usageFlags, VkImageLayout imageLayout = VK_IMAGE_LAYOUT_GENERAL );
+    // array layers, six per cube
+    uint32_t getLayerCount() const
+    {
+        return m_layerCount;
+    }
+    
+    // floor( log2( max( width, height ) ) ) + 1
+    static uint32_t mipLevelCount( uint32_t width, uint32_t height );
+    
+    // SPIR-V of the downsample used for formats that can not be blitted,
+    // shaders/mipdownsample.comp.spv relative to the working directory by default
+    static void setMipmapShaderPath( const std::string& spirvPath );
     
-    static std::shared_ptr<VksTexture> createFromVkImage( VkImage vkImage, uint32_t width, uint32_t height, VkFormat format, VkImageLayout imageLayout = VK_IMAGE_LAYOUT_GENERAL, VkImageAspectFlags aspectFlag = VK_IMAGE_ASPECT_COLOR_BIT );
+    // Fills levels 1.. from level 0 and leaves every level in finalLayout. Uses linear
+    // blits when the format supports them, the compute downsample when it is a storage
+    // format, and nearest blits otherwise. Must be outside a render pass.
+    void generateMipmaps( VkCommandBuffer commandBuffer, VkImageLayout finalLayout );
+    // Same, submitted and waited for on the graphics queue
+    void generateMipmaps( VkImageLayout finalLayout );
     
+    // Explicit transition, prefer requireState which derives the source side itself
     void transferImageLayout( VkImageLayout oldLayout, VkImageLayout newLayout, VkAccessFlags srcAccessFlag,
                              VkAccessFlags dstAccessFlag, VkPipelineStageFlags srcStageFlag, VkPipelineStageFlags dstStageFlag );
     
@@ -47,6 +117,11 @@ public:
         return m_textureSampler;
     }
     
+    // Swaps in the shared sampler for options and updates the descriptor info. Descriptor
+    // sets written with the old sampler must be rewritten, and must not be in use when this
+    // texture held its last reference.
+    void setSampler( const VksSamplerOptions& samplerOptions );
+    
     const VkDescriptorImageInfo& getDesscriptor() const
     {
         return m_descriptor;
@@ -74,16 +149,31 @@ public:
         return m_familyIndices.graphicsFamily;
     }
     
-    void updateTexture( const char* data, VkDeviceSize dataSize, VkOffset2D imageOffset, VkExtent2D imageExtent );
+    // Updates write level 0 only; call generateMipmaps() afterwards to refresh the chain
+    void updateTexture( const char* data, VkDeviceSize dataSize, VkOffset2D imageOffset, VkExtent2D imageExtent, VksUploadContext* uploadContext = nullptr );
     void updateTexture( const char* filePath );
     
     void updateTexture( const std::shared_ptr<VksBuffer>& buffer, VkOffset2D imageOffset, VkExtent2D imageExtent );
+    // Sub-region copies from buffer, all in one vkCmdCopyBufferToImage; recorded on the
+    // graphics queue of uploadContext when one is given
+    void updateTexture( const std::shared_ptr<VksBuffer>& buffer, const std::vector<VkBufferImageCopy>& regions,
+                        VksUploadContext* uploadContext = nullptr );
 private:
     VksTexture();
+    
+    enum MipmapMethod
+    {
+        MIPMAP_NONE = 0,
+        MIPMAP_BLIT_LINEAR,
+        MIPMAP_COMPUTE,
+        MIPMAP_BLIT_NEAREST
+    };
+    // per-level storage views, descriptor sets and pipeline of the compute downsample
+    class MipmapCompute;
 
     VkImage m_texture;
     VkImageView m_textureView;
-    VkDeviceMemory m_textureMemory;
+    VksAllocator::Allocation m_textureAllocation;
     VkSampler m_textureSampler;
     VkDescriptorImageInfo m_descriptor;
     VkFormat m_format;
@@ -91,13 +181,61 @@ private:
     uint32_t m_height;
     VkImageAspectFlags m_aspectFlag;
     bool m_ownTexture;
+    uint32_t m_mipLevels;
+    uint32_t m_layerCount;
+    VkImageViewType m_viewType;
+    std::vector<ImageState> m_states;
+    MipmapMethod m_mipmapMethod;
+    std::shared_ptr<MipmapCompute> m_mipmapCompute;
 
 private:
-    void __createImage( uint32_t width, uint32_t height, VkFormat format, VkImageLayout imageLayout, VkImageUsageFlags usage, VkMemoryPropertyFlags properties );
+    void __createImage( uint32_t width, uint32_t height, VkFormat format, VkImageLayout imageLayout, VkImageUsageFlags usage, VkMemoryPropertyFlags properties,
+                        uint32_t mipLevels = 1, uint32_t arrayLayers = 1, VkImageCreateFlags flags = 0 );
+    // createFromFile, uploadValue receives the batch value of the upload when an upload
+    // context records it
+    static std::shared_ptr<VksTexture> __createFromFile( const char* filePath, VkImageUsageFlags usageFlags, VkImageLayout imageLayout,
+                                                         VksUploadContext* uploadContext, bool mipmaps, VkFormat format,
+                                                         const VksSamplerOptions& samplerOptions, uint64_t* uploadValue );
+    static std::shared_ptr<VksTexture> __createFromContainer( const VksTextureContainer& container, VkImageUsageFlags usageFlags,
+                                                              VkImageLayout imageLayout, VksUploadContext* uploadContext,
+                                                              const VksSamplerOptions& samplerOptions, uint64_t* uploadValue );
+    // Decodes filePath to RGBA8 rows straight into a pooled staging buffer, rowLength
+    // texels apart, the bufferRowLength of the copy
+    static std::shared_ptr<VksBuffer> __decodeToStaging( const char* filePath, uint32_t& width, uint32_t& height, uint32_t& rowLength );
+    // Block compressed chain of filePath in a new staging buffer, from the disk cache when it has one
+    static std::shared_ptr<VksBuffer> __encodeToStaging( const char* filePath, VkFormat format, bool mipmaps,
+                                                         uint32_t& width, uint32_t& height, uint32_t& mipLevels );
+    // Creates a texture from the stagedLevels tightly packed levels in stagingBuffer; mipmaps
+    // generates the rest of the chain from level 0 on the GPU.
+    static std::shared_ptr<VksTexture> __createFromStaging( const std::shared_ptr<VksBuffer>& stagingBuffer, uint32_t width, uint32_t height,
+                                                            VkFormat format, uint32_t stagedLevels, VkImageUsageFlags usageFlags, VkImageLayout imageLayout,
+                                                            VksUploadContext* uploadContext, bool mipmaps, const VksSamplerOptions& samplerOptions,
+                                                            uint64_t* uploadValue );
+    // Same from arbitrary copy regions covering levels 0 .. stagedLevels - 1 of every layer,
+    // all written by a single vkCmdCopyBufferToImage
+    static std::shared_ptr<VksTexture> __createFromRegions( const std::shared_ptr<VksBuffer>& stagingBuffer, const std::vector<VkBufferImageCopy>& regions,
+                                                            uint32_t width, uint32_t height, VkFormat format, uint32_t stagedLevels,
+                                                            uint32_t layerCount, bool cube, VkImageUsageFlags usageFlags, VkImageLayout imageLayout,
+                                                            VksUploadContext* uploadContext, bool mipmaps, const VksSamplerOptions& samplerOptions,
+                                                            uint64_t* uploadValue );
+    static MipmapMethod __mipmapMethod( VkFormat format );
+    // extra usage the method needs; also sets m_mipmapMethod and returns the level count
+    uint32_t __prepareMipmaps( uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags& usage );
+    void __blitMipmaps( VkCommandBuffer commandBuffer, VkFilter filter );
+    void __computeMipmaps( VkCommandBuffer commandBuffer );
     
     void __createImageView();
-    void __createSampler();
-    void __transferImageLayout( VkImageLayout oldLayout, VkImageLayout newLayout );
+    // acquires m_textureSampler from the sampler cache
+    void __createSampler( const VksSamplerOptions& samplerOptions );
+    // Advances the tracked state of one mip level; returns false when no barrier is needed
+    bool __transitionState( uint32_t mipLevel, VkImageLayout layout, VkAccessFlags access, VkPipelineStageFlags stage,
+                            VkImageMemoryBarrier& imageBarrier, VkPipelineStageFlags& srcStageFlag );
+    // default access and stage for a layout when the caller gives none
+    static void __dstAccessStage( VkImageLayout layout, VkAccessFlags& accessMask, VkPipelineStageFlags& stageFlag );
+    VkBufferImageCopy __copyRegion( VkOffset2D imageOffset, VkExtent2D imageExtent );
+    void __recordUpdate( VkCommandBuffer commandBuffer, VkBuffer buffer, const VkBufferImageCopy& region, VkImageLayout newLayout );
+    // every region in one copy, the levels they touch transitioned together
+    void __recordUpload( VkCommandBuffer commandBuffer, VkBuffer buffer, const std::vector<VkBufferImageCopy>& regions, VkImageLayout newLayout );
 
 };
 
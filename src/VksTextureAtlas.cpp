@@ -0,0 +1,306 @@
+//
+//  VksTextureAtlas.cpp
+//  Vulkan
+//
+//
+
+#include "VksTextureAtlas.hpp"
+#include "VksTexture.hpp"
+#include "VksBuffer.hpp"
+#include "VksCommand.hpp"
+#include "VksStagingPool.hpp"
+#include "VksUploadContext.hpp"
+#include "VksTrace.hpp"
+#include <algorithm>
+#include <cstring>
+
+std::shared_ptr<VksTextureAtlas> VksTextureAtlas::createTextureAtlas(uint32_t width, uint32_t height, VkFormat format, uint32_t padding)
+{
+    uint32_t texelSize = 0;
+    switch( format )
+    {
+        case VK_FORMAT_R8_UNORM:
+        case VK_FORMAT_R8_SRGB:
+            texelSize = 1;
+            break;
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SRGB:
+        case VK_FORMAT_B8G8R8A8_UNORM:
+        case VK_FORMAT_B8G8R8A8_SRGB:
+            texelSize = 4;
+            break;
+        default:
+            throw std::runtime_error("texture atlas format is not supported");
+    }
+    return std::shared_ptr<VksTextureAtlas>( new VksTextureAtlas( width, height, format, padding, texelSize ) );
+}
+
+VksTextureAtlas::VksTextureAtlas( uint32_t width, uint32_t height, VkFormat format, uint32_t padding, uint32_t texelSize )
+    :m_width( width ), m_height( height ), m_format( format ), m_padding( padding ), m_texelSize( texelSize )
+{
+    m_texture = __createTexture( width, height, format );
+    m_skyline.push_back( { 0, 0, width } );
+}
+
+VksTextureAtlas::~VksTextureAtlas()
+{
+}
+
+std::shared_ptr<VksTexture> VksTextureAtlas::__createTexture(uint32_t width, uint32_t height, VkFormat format)
+{
+    // transfer source for repack
+    return VksTexture::createEmptyTexture( width, height, format, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                           VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT );
+}
+
+bool VksTextureAtlas::__fit(const std::vector<SkylineNode> &skyline, size_t index, uint32_t atlasWidth, uint32_t width, uint32_t &y)
+{
+    if( skyline[index].x + width > atlasWidth )
+        return false;
+
+    // the rectangle rests on the highest node it spans
+    y = 0;
+    uint32_t remaining = width;
+    for( size_t i = index; remaining > 0 && i < skyline.size(); i++ )
+    {
+        y = std::max( y, skyline[i].y );
+        remaining -= std::min( remaining, skyline[i].width );
+    }
+    return true;
+}
+
+bool VksTextureAtlas::__pack(std::vector<SkylineNode> &skyline, uint32_t atlasWidth, uint32_t atlasHeight, uint32_t width, uint32_t height,
+                             VkOffset2D &position)
+{
+    size_t bestIndex = skyline.size();
+    uint32_t bestTop = UINT32_MAX, bestWidth = UINT32_MAX, bestY = 0;
+    for( size_t i = 0; i < skyline.size(); i++ )
+    {
+        uint32_t y = 0;
+        if( !__fit( skyline, i, atlasWidth, width, y ) || y + height > atlasHeight )
+            continue;
+        // lowest top first, then the narrowest segment to waste the least
+        uint32_t top = y + height;
+        if( top < bestTop || ( top == bestTop && skyline[i].width < bestWidth ) )
+        {
+            bestIndex = i;
+            bestTop = top;
+            bestWidth = skyline[i].width;
+            bestY = y;
+        }
+    }
+    if( bestIndex == skyline.size() )
+        return false;
+
+    position = { static_cast<int32_t>( skyline[bestIndex].x ), static_cast<int32_t>( bestY ) };
+    skyline.insert( skyline.begin() + bestIndex, { skyline[bestIndex].x, bestTop, width } );
+
+    // cut the segments now covered by the new one
+    for( size_t i = bestIndex + 1; i < skyline.size(); )
+    {
+        uint32_t coveredEnd = skyline[i - 1].x + skyline[i - 1].width;
+        if( skyline[i].x >= coveredEnd )
+            break;
+        uint32_t shrink = coveredEnd - skyline[i].x;
+        if( skyline[i].width <= shrink )
+        {
+            skyline.erase( skyline.begin() + i );
+            continue;
+        }
+        skyline[i].x += shrink;
+        skyline[i].width -= shrink;
+        break;
+    }
+
+    for( size_t i = 0; i + 1 < skyline.size(); )
+    {
+        if( skyline[i].y == skyline[i + 1].y )
+        {
+            skyline[i].width += skyline[i + 1].width;
+            skyline.erase( skyline.begin() + i + 1 );
+        }
+        else
+        {
+            i++;
+        }
+    }
+    return true;
+}
+
+uint32_t VksTextureAtlas::add(const void *data, uint32_t width, uint32_t height)
+{
+    if( width == 0 || height == 0 )
+        return INVALID_ID;
+    uint32_t paddedWidth = width + 2 * m_padding;
+    uint32_t paddedHeight = height + 2 * m_padding;
+    VkOffset2D position;
+    if( !__pack( m_skyline, m_width, m_height, paddedWidth, paddedHeight, position ) )
+        return INVALID_ID;
+
+    uint32_t id;
+    if( !m_freeIds.empty() )
+    {
+        id = m_freeIds.back();
+        m_freeIds.pop_back();
+    }
+    else
+    {
+        id = static_cast<uint32_t>( m_entries.size() );
+        m_entries.emplace_back();
+    }
+    m_entries[id] = { { position, { paddedWidth, paddedHeight } }, true };
+    m_liveCount++;
+
+    // the copy offset must stay 4 byte aligned for single byte texels
+    size_t offset = ( m_pendingData.size() + 3 ) & ~static_cast<size_t>( 3 );
+    m_pendingData.resize( offset + (size_t)paddedWidth * paddedHeight * m_texelSize );
+    const uint8_t* source = static_cast<const uint8_t*>( data );
+    uint8_t* padded = m_pendingData.data() + offset;
+    for( uint32_t y = 0; y < paddedHeight; y++ )
+    {
+        uint32_t sourceY = static_cast<uint32_t>( std::min<int64_t>( std::max<int64_t>( (int64_t)y - m_padding, 0 ), height - 1 ) );
+        const uint8_t* sourceRow = source + (size_t)sourceY * width * m_texelSize;
+        uint8_t* paddedRow = padded + (size_t)y * paddedWidth * m_texelSize;
+        for( uint32_t x = 0; x < m_padding; x++ )
+        {
+            memcpy( paddedRow + x * m_texelSize, sourceRow, m_texelSize );
+            memcpy( paddedRow + ( m_padding + width + x ) * m_texelSize, sourceRow + ( width - 1 ) * m_texelSize, m_texelSize );
+        }
+        memcpy( paddedRow + m_padding * m_texelSize, sourceRow, (size_t)width * m_texelSize );
+    }
+    m_pending.push_back( { id, offset } );
+    return id;
+}
+
+void VksTextureAtlas::remove(uint32_t id)
+{
+    if( id >= m_entries.size() || !m_entries[id].live )
+        return;
+    m_entries[id].live = false;
+    m_freeIds.push_back( id );
+    m_liveCount--;
+    // a pending copy of the id is dropped in flush(); a reused id has a new pending copy
+    m_pending.erase( std::remove_if( m_pending.begin(), m_pending.end(), [id]( const PendingCopy& copy ) {
+        return copy.id == id;
+    }), m_pending.end() );
+}
+
+void VksTextureAtlas::flush(VksUploadContext* uploadContext)
+{
+    VKS_TRACE_ZONE( "VksTextureAtlas::flush" );
+    if( m_pending.empty() )
+    {
+        m_pendingData.clear();
+        return;
+    }
+
+    auto stagingBuffer = m_stagingPool->acquire( m_pendingData.size() );
+    stagingBuffer->copyHostDataToBuffer( m_pendingData.data(), m_pendingData.size() );
+
+    std::vector<VkBufferImageCopy> regions( m_pending.size() );
+    for( size_t i = 0; i < m_pending.size(); i++ )
+    {
+        const VkRect2D& rect = m_entries[ m_pending[i].id ].rect;
+        regions[i] = {};
+        regions[i].bufferOffset = m_pending[i].offset;
+        regions[i].imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+        regions[i].imageOffset = { rect.offset.x, rect.offset.y, 0 };
+        regions[i].imageExtent = { rect.extent.width, rect.extent.height, 1 };
+    }
+    m_texture->updateTexture( stagingBuffer, regions, uploadContext );
+
+    m_pending.clear();
+    m_pendingData.clear();
+}
+
+bool VksTextureAtlas::repack(VksUploadContext* uploadContext)
+{
+    VKS_TRACE_ZONE( "VksTextureAtlas::repack" );
+    flush( uploadContext );
+
+    std::vector<uint32_t> ids;
+    for( uint32_t id = 0; id < m_entries.size(); id++ )
+    {
+        if( m_entries[id].live ) ids.push_back( id );
+    }
+    std::sort( ids.begin(), ids.end(), [this]( uint32_t a, uint32_t b ) {
+        const VkExtent2D& extentA = m_entries[a].rect.extent;
+        const VkExtent2D& extentB = m_entries[b].rect.extent;
+        if( extentA.height != extentB.height ) return extentA.height > extentB.height;
+        if( extentA.width != extentB.width ) return extentA.width > extentB.width;
+        return a < b;
+    });
+
+    std::vector<SkylineNode> skyline = { { 0, 0, m_width } };
+    std::vector<VkOffset2D> positions( ids.size() );
+    for( size_t i = 0; i < ids.size(); i++ )
+    {
+        const VkExtent2D& extent = m_entries[ ids[i] ].rect.extent;
+        if( !__pack( skyline, m_width, m_height, extent.width, extent.height, positions[i] ) )
+            return false;
+    }
+    m_skyline = skyline;
+    if( ids.empty() )
+        return true;
+
+    std::vector<VkImageCopy> copies( ids.size() );
+    for( size_t i = 0; i < ids.size(); i++ )
+    {
+        VkRect2D& rect = m_entries[ ids[i] ].rect;
+        copies[i] = {};
+        copies[i].srcSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+        copies[i].srcOffset = { rect.offset.x, rect.offset.y, 0 };
+        copies[i].dstSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+        copies[i].dstOffset = { positions[i].x, positions[i].y, 0 };
+        copies[i].extent = { rect.extent.width, rect.extent.height, 1 };
+        rect.offset = positions[i];
+    }
+
+    // a new image, moving rectangles in place could overlap
+    auto oldTexture = m_texture;
+    m_texture = __createTexture( m_width, m_height, m_format );
+    auto record = [&]( VkCommandBuffer commandBuffer ) {
+        oldTexture->requireState( commandBuffer, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_ACCESS_TRANSFER_READ_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT );
+        m_texture->requireState( commandBuffer, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_ACCESS_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT );
+        vkCmdCopyImage(commandBuffer, oldTexture->getImage(), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, m_texture->getImage(),
+                       VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>( copies.size() ), copies.data());
+        m_texture->requireState( commandBuffer, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT,
+                                 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT );
+    };
+
+    if( uploadContext )
+    {
+        uploadContext->recordGraphics( record );
+        uploadContext->keepAlive( oldTexture );
+        return true;
+    }
+    VkCommandBuffer commandBuffer = m_graphicCommand->beginOnceSubmitBuffer();
+    record( commandBuffer );
+    m_graphicCommand->endOnceSubmitBuffer( commandBuffer );
+    return true;
+}
+
+VkRect2D VksTextureAtlas::getRect(uint32_t id) const
+{
+    const VkRect2D& rect = m_entries.at( id ).rect;
+    return { { rect.offset.x + static_cast<int32_t>( m_padding ), rect.offset.y + static_cast<int32_t>( m_padding ) },
+             { rect.extent.width - 2 * m_padding, rect.extent.height - 2 * m_padding } };
+}
+
+VksTextureAtlas::UVRect VksTextureAtlas::getUV(uint32_t id) const
+{
+    VkRect2D rect = getRect( id );
+    return { static_cast<float>( rect.offset.x ) / m_width, static_cast<float>( rect.offset.y ) / m_height,
+             static_cast<float>( rect.offset.x + rect.extent.width ) / m_width,
+             static_cast<float>( rect.offset.y + rect.extent.height ) / m_height };
+}
+
+float VksTextureAtlas::getOccupancy() const
+{
+    uint64_t area = 0;
+    for( auto& entry : m_entries )
+    {
+        if( entry.live ) area += (uint64_t)entry.rect.extent.width * entry.rect.extent.height;
+    }
+    return static_cast<float>( area ) / ( (float)m_width * m_height );
+}
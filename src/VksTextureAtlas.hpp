@@ -0,0 +1,117 @@
+//
+//  VksTextureAtlas.hpp
+//  Vulkan
+//
+//
+
+#ifndef VksTextureAtlas_hpp
+#define VksTextureAtlas_hpp
+
+#include "VkEngine.hpp"
+
+class VksTexture;
+class VksUploadContext;
+
+// Packs many small images into one VksTexture with an online skyline ( bottom left ) packer,
+// so they share one view, sampler, allocation and descriptor. add() only packs and keeps
+// the texels on the CPU; flush() sends every pending image in a single copy command.
+// Removing an image leaves a hole until repack() packs the live images again.
+//
+// Each image is surrounded by padding texels repeating its edge, so bilinear sampling at the
+// edge of its UV rectangle does not pick up its neighbours.
+class VksTextureAtlas : protected VkEngine
+{
+public:
+    static constexpr uint32_t INVALID_ID = UINT32_MAX;
+
+    struct UVRect
+    {
+        float u0, v0;
+        float u1, v1;
+    };
+
+    ~VksTextureAtlas();
+
+    // format must have 1 or 4 byte texels: R8, RGBA8 or BGRA8, unorm or srgb
+    static std::shared_ptr<VksTextureAtlas> createTextureAtlas( uint32_t width, uint32_t height, VkFormat format = VK_FORMAT_R8G8B8A8_UNORM,
+                                                                uint32_t padding = 1 );
+
+    // data is width x height tightly packed texels of the atlas format. Returns the image id,
+    // INVALID_ID when it does not fit.
+    uint32_t add( const void* data, uint32_t width, uint32_t height );
+    void remove( uint32_t id );
+
+    // Uploads every image added since the last flush in one command buffer, on the graphics
+    // queue of uploadContext when one is given, blocking otherwise
+    void flush( VksUploadContext* uploadContext = nullptr );
+
+    // Packs the live images again, tallest first, into a new texture and moves them there with
+    // one GPU copy. Returns false, changing nothing, when they no longer fit. Pending images
+    // are flushed first. Ids stay valid, but their rectangles and getTexture() change.
+    bool repack( VksUploadContext* uploadContext = nullptr );
+
+    // texels of the image, without padding
+    VkRect2D getRect( uint32_t id ) const;
+    // normalized texture coordinates of the image edges
+    UVRect getUV( uint32_t id ) const;
+
+    const std::shared_ptr<VksTexture>& getTexture() const {
+        return m_texture;
+    }
+
+    uint32_t getImageCount() const {
+        return m_liveCount;
+    }
+
+    // share of the atlas area taken by live images and their padding
+    float getOccupancy() const;
+
+private:
+    VksTextureAtlas( uint32_t width, uint32_t height, VkFormat format, uint32_t padding, uint32_t texelSize );
+
+    // a horizontal segment of the skyline, the top of everything packed below it
+    struct SkylineNode
+    {
+        uint32_t x;
+        uint32_t y;
+        uint32_t width;
+    };
+
+    struct Entry
+    {
+        // including padding
+        VkRect2D rect;
+        bool live;
+    };
+
+    struct PendingCopy
+    {
+        uint32_t id;
+        size_t offset;
+    };
+
+    uint32_t m_width;
+    uint32_t m_height;
+    VkFormat m_format;
+    uint32_t m_padding;
+    uint32_t m_texelSize;
+    std::shared_ptr<VksTexture> m_texture;
+
+    std::vector<SkylineNode> m_skyline;
+    std::vector<Entry> m_entries;
+    std::vector<uint32_t> m_freeIds;
+    uint32_t m_liveCount = 0;
+
+    // padded images waiting for flush(), back to back
+    std::vector<uint8_t> m_pendingData;
+    std::vector<PendingCopy> m_pending;
+
+    static std::shared_ptr<VksTexture> __createTexture( uint32_t width, uint32_t height, VkFormat format );
+    // bottom left position for a width x height rectangle, false when it does not fit
+    static bool __pack( std::vector<SkylineNode>& skyline, uint32_t atlasWidth, uint32_t atlasHeight,
+                        uint32_t width, uint32_t height, VkOffset2D& position );
+    // y the rectangle would rest at when its left edge is on node index, false past the atlas
+    static bool __fit( const std::vector<SkylineNode>& skyline, size_t index, uint32_t atlasWidth, uint32_t width, uint32_t& y );
+};
+
+#endif /* VksTextureAtlas_hpp */
@@ -0,0 +1,381 @@
+//
+//  VksTextureContainer.cpp
+//  Vulkan
+//
+//
+
+#include "VksTextureContainer.hpp"
+#include "VksMappedFile.hpp"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+static const uint8_t kKTX2Identifier[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+static const uint32_t kDDSMagic = 0x20534444; // "DDS "
+
+static uint32_t makeFourCC( char a, char b, char c, char d )
+{
+    return static_cast<uint32_t>( a ) | ( static_cast<uint32_t>( b ) << 8 ) | ( static_cast<uint32_t>( c ) << 16 ) | ( static_cast<uint32_t>( d ) << 24 );
+}
+
+template<typename T>
+static T readValue( const uint8_t* data, size_t offset )
+{
+    T value;
+    memcpy( &value, data + offset, sizeof( T ) );
+    return value;
+}
+
+// bytes per block and block edge in texels of the formats whose level sizes the loader checks
+static bool formatBlock( VkFormat format, uint32_t& blockBytes, uint32_t& blockDim )
+{
+    blockDim = 1;
+    switch( format )
+    {
+        case VK_FORMAT_R8_UNORM:
+            blockBytes = 1;
+            return true;
+        case VK_FORMAT_R8G8_UNORM:
+        case VK_FORMAT_R16_SFLOAT:
+            blockBytes = 2;
+            return true;
+        case VK_FORMAT_R8G8B8A8_UNORM:
+        case VK_FORMAT_R8G8B8A8_SRGB:
+        case VK_FORMAT_B8G8R8A8_UNORM:
+        case VK_FORMAT_B8G8R8A8_SRGB:
+        case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+        case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+        case VK_FORMAT_E5B9G9R9_UFLOAT_PACK32:
+        case VK_FORMAT_R16G16_SFLOAT:
+        case VK_FORMAT_R32_SFLOAT:
+            blockBytes = 4;
+            return true;
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+        case VK_FORMAT_R32G32_SFLOAT:
+            blockBytes = 8;
+            return true;
+        case VK_FORMAT_R32G32B32A32_SFLOAT:
+            blockBytes = 16;
+            return true;
+        case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+        case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+        case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+        case VK_FORMAT_BC4_UNORM_BLOCK:
+        case VK_FORMAT_BC4_SNORM_BLOCK:
+            blockBytes = 8;
+            blockDim = 4;
+            return true;
+        case VK_FORMAT_BC2_UNORM_BLOCK:
+        case VK_FORMAT_BC2_SRGB_BLOCK:
+        case VK_FORMAT_BC3_UNORM_BLOCK:
+        case VK_FORMAT_BC3_SRGB_BLOCK:
+        case VK_FORMAT_BC5_UNORM_BLOCK:
+        case VK_FORMAT_BC5_SNORM_BLOCK:
+        case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+        case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+        case VK_FORMAT_BC7_UNORM_BLOCK:
+        case VK_FORMAT_BC7_SRGB_BLOCK:
+            blockBytes = 16;
+            blockDim = 4;
+            return true;
+        default:
+            return false;
+    }
+}
+
+static VkFormat formatFromDXGI( uint32_t dxgiFormat )
+{
+    switch( dxgiFormat )
+    {
+        case 2: return VK_FORMAT_R32G32B32A32_SFLOAT;
+        case 10: return VK_FORMAT_R16G16B16A16_SFLOAT;
+        case 24: return VK_FORMAT_A2B10G10R10_UNORM_PACK32;
+        case 26: return VK_FORMAT_B10G11R11_UFLOAT_PACK32;
+        case 28: return VK_FORMAT_R8G8B8A8_UNORM;
+        case 29: return VK_FORMAT_R8G8B8A8_SRGB;
+        case 34: return VK_FORMAT_R16G16_SFLOAT;
+        case 41: return VK_FORMAT_R32_SFLOAT;
+        case 49: return VK_FORMAT_R8G8_UNORM;
+        case 54: return VK_FORMAT_R16_SFLOAT;
+        case 61: return VK_FORMAT_R8_UNORM;
+        case 67: return VK_FORMAT_E5B9G9R9_UFLOAT_PACK32;
+        case 71: return VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+        case 72: return VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+        case 74: return VK_FORMAT_BC2_UNORM_BLOCK;
+        case 75: return VK_FORMAT_BC2_SRGB_BLOCK;
+        case 77: return VK_FORMAT_BC3_UNORM_BLOCK;
+        case 78: return VK_FORMAT_BC3_SRGB_BLOCK;
+        case 80: return VK_FORMAT_BC4_UNORM_BLOCK;
+        case 81: return VK_FORMAT_BC4_SNORM_BLOCK;
+        case 83: return VK_FORMAT_BC5_UNORM_BLOCK;
+        case 84: return VK_FORMAT_BC5_SNORM_BLOCK;
+        case 87: return VK_FORMAT_B8G8R8A8_UNORM;
+        case 91: return VK_FORMAT_B8G8R8A8_SRGB;
+        case 95: return VK_FORMAT_BC6H_UFLOAT_BLOCK;
+        case 96: return VK_FORMAT_BC6H_SFLOAT_BLOCK;
+        case 98: return VK_FORMAT_BC7_UNORM_BLOCK;
+        case 99: return VK_FORMAT_BC7_SRGB_BLOCK;
+        default: return VK_FORMAT_UNDEFINED;
+    }
+}
+
+std::shared_ptr<VksTextureContainer> VksTextureContainer::open( const char* filePath, uint32_t maxArrayLayers )
+{
+    std::shared_ptr<VksTextureContainer> container( new VksTextureContainer() );
+    container->m_file = VksMappedFile::open( filePath );
+    if( !container->m_file )
+        return nullptr;
+    container->m_data = container->m_file->getData();
+    container->m_size = container->m_file->getSize();
+
+    if( container->m_size >= sizeof( kKTX2Identifier ) && memcmp( container->m_data, kKTX2Identifier, sizeof( kKTX2Identifier ) ) == 0 )
+    {
+        container->__parseKTX2( maxArrayLayers );
+    }
+    else if( container->m_size >= 4 && readValue<uint32_t>( container->m_data, 0 ) == kDDSMagic )
+    {
+        container->__parseDDS( maxArrayLayers );
+    }
+    else
+    {
+        return nullptr;
+    }
+
+    for( auto& region : container->m_regions )
+    {
+        if( region.offset > container->m_size || region.size > container->m_size - region.offset )
+        {
+            throw std::runtime_error("texture container is truncated");
+        }
+    }
+    return container;
+}
+
+VksTextureContainer::VksTextureContainer()
+{
+}
+
+VksTextureContainer::~VksTextureContainer()
+{
+}
+
+void VksTextureContainer::__parseKTX2( uint32_t maxArrayLayers )
+{
+    // identifier, nine header words, the dfd / kvd / sgd index
+    const size_t levelIndexOffset = 12 + 9 * 4 + 4 * 4 + 2 * 8;
+    if( m_size < levelIndexOffset )
+    {
+        throw std::runtime_error("texture container is truncated");
+    }
+
+    m_format = static_cast<VkFormat>( readValue<uint32_t>( m_data, 12 ) );
+    m_width = readValue<uint32_t>( m_data, 20 );
+    m_height = std::max( readValue<uint32_t>( m_data, 24 ), 1u );
+    uint32_t depth = readValue<uint32_t>( m_data, 28 );
+    uint32_t layers = std::max( readValue<uint32_t>( m_data, 32 ), 1u );
+    uint32_t faces = readValue<uint32_t>( m_data, 36 );
+    m_mipLevels = std::max( readValue<uint32_t>( m_data, 40 ), 1u );
+    uint32_t supercompression = readValue<uint32_t>( m_data, 44 );
+
+    if( m_format == VK_FORMAT_UNDEFINED || supercompression != 0 )
+    {
+        throw std::runtime_error("supercompressed KTX2 files are not supported");
+    }
+    if( depth > 1 || m_width == 0 || ( faces != 1 && faces != 6 ) )
+    {
+        throw std::runtime_error("only 2D, 2D array and cube KTX2 textures are supported");
+    }
+    __checkLimits( layers, faces, maxArrayLayers );
+    m_cube = faces == 6;
+    m_layerCount = layers * faces;
+
+    if( m_size < levelIndexOffset + m_mipLevels * 3 * sizeof( uint64_t ) )
+    {
+        throw std::runtime_error("texture container is truncated");
+    }
+    for( uint32_t level = 0; level < m_mipLevels; level++ )
+    {
+        size_t entry = levelIndexOffset + level * 3 * sizeof( uint64_t );
+        uint64_t byteOffset = readValue<uint64_t>( m_data, entry );
+        uint64_t byteLength = readValue<uint64_t>( m_data, entry + sizeof( uint64_t ) );
+        // a format formatBlock does not know has no size to check byteLength against
+        size_t imageSize = __imageSize( level );
+        if( imageSize == 0 )
+        {
+            throw std::runtime_error("KTX2 format is not supported");
+        }
+        if( byteLength != imageSize * m_layerCount )
+        {
+            throw std::runtime_error("KTX2 level size does not match its format");
+        }
+        // a level holds every layer and face, in the order of the image's array layers
+        m_regions.push_back( { level, 0, m_layerCount, static_cast<size_t>( byteOffset ), static_cast<size_t>( byteLength ) } );
+    }
+}
+
+void VksTextureContainer::__parseDDS( uint32_t maxArrayLayers )
+{
+    // magic, DDS_HEADER, optional DDS_HEADER_DXT10
+    const size_t headerSize = 4 + 124;
+    if( m_size < headerSize )
+    {
+        throw std::runtime_error("texture container is truncated");
+    }
+
+    m_height = readValue<uint32_t>( m_data, 4 + 8 );
+    m_width = readValue<uint32_t>( m_data, 4 + 12 );
+    m_mipLevels = std::max( readValue<uint32_t>( m_data, 4 + 24 ), 1u );
+    uint32_t pixelFlags = readValue<uint32_t>( m_data, 4 + 76 );
+    uint32_t fourCC = readValue<uint32_t>( m_data, 4 + 80 );
+    uint32_t bitCount = readValue<uint32_t>( m_data, 4 + 84 );
+    uint32_t masks[4];
+    for( uint32_t i = 0; i < 4; i++ )
+    {
+        masks[i] = readValue<uint32_t>( m_data, 4 + 88 + i * 4 );
+    }
+    uint32_t caps2 = readValue<uint32_t>( m_data, 4 + 108 );
+
+    const uint32_t DDPF_ALPHAPIXELS = 0x1, DDPF_FOURCC = 0x4, DDPF_RGB = 0x40, DDPF_LUMINANCE = 0x20000;
+    const uint32_t DDSCAPS2_CUBEMAP = 0x200, DDSCAPS2_CUBEMAP_ALLFACES = 0xFC00, DDSCAPS2_VOLUME = 0x200000;
+
+    size_t dataOffset = headerSize;
+    uint32_t layers = 1;
+    uint32_t faces = 1;
+    if( ( pixelFlags & DDPF_FOURCC ) && fourCC == makeFourCC( 'D', 'X', '1', '0' ) )
+    {
+        if( m_size < headerSize + 20 )
+        {
+            throw std::runtime_error("texture container is truncated");
+        }
+        m_format = formatFromDXGI( readValue<uint32_t>( m_data, headerSize ) );
+        uint32_t dimension = readValue<uint32_t>( m_data, headerSize + 4 );
+        uint32_t miscFlag = readValue<uint32_t>( m_data, headerSize + 8 );
+        layers = std::max( readValue<uint32_t>( m_data, headerSize + 12 ), 1u );
+        if( dimension != 3 )
+        {
+            throw std::runtime_error("only 2D, 2D array and cube DDS textures are supported");
+        }
+        faces = ( miscFlag & 0x4 ) ? 6 : 1;
+        dataOffset += 20;
+    }
+    else
+    {
+        if( caps2 & DDSCAPS2_VOLUME )
+        {
+            throw std::runtime_error("only 2D, 2D array and cube DDS textures are supported");
+        }
+        if( caps2 & DDSCAPS2_CUBEMAP )
+        {
+            if( ( caps2 & DDSCAPS2_CUBEMAP_ALLFACES ) != DDSCAPS2_CUBEMAP_ALLFACES )
+            {
+                throw std::runtime_error("DDS cube maps need all six faces");
+            }
+            faces = 6;
+        }
+
+        if( pixelFlags & DDPF_FOURCC )
+        {
+            if( fourCC == makeFourCC( 'D', 'X', 'T', '1' ) ) m_format = VK_FORMAT_BC1_RGBA_UNORM_BLOCK;
+            else if( fourCC == makeFourCC( 'D', 'X', 'T', '2' ) || fourCC == makeFourCC( 'D', 'X', 'T', '3' ) ) m_format = VK_FORMAT_BC2_UNORM_BLOCK;
+            else if( fourCC == makeFourCC( 'D', 'X', 'T', '4' ) || fourCC == makeFourCC( 'D', 'X', 'T', '5' ) ) m_format = VK_FORMAT_BC3_UNORM_BLOCK;
+            else if( fourCC == makeFourCC( 'A', 'T', 'I', '1' ) || fourCC == makeFourCC( 'B', 'C', '4', 'U' ) ) m_format = VK_FORMAT_BC4_UNORM_BLOCK;
+            else if( fourCC == makeFourCC( 'B', 'C', '4', 'S' ) ) m_format = VK_FORMAT_BC4_SNORM_BLOCK;
+            else if( fourCC == makeFourCC( 'A', 'T', 'I', '2' ) || fourCC == makeFourCC( 'B', 'C', '5', 'U' ) ) m_format = VK_FORMAT_BC5_UNORM_BLOCK;
+            else if( fourCC == makeFourCC( 'B', 'C', '5', 'S' ) ) m_format = VK_FORMAT_BC5_SNORM_BLOCK;
+            // D3DFMT_A16B16G16R16F and D3DFMT_A32B32G32R32F
+            else if( fourCC == 113 ) m_format = VK_FORMAT_R16G16B16A16_SFLOAT;
+            else if( fourCC == 116 ) m_format = VK_FORMAT_R32G32B32A32_SFLOAT;
+        }
+        else if( ( pixelFlags & DDPF_RGB ) && ( pixelFlags & DDPF_ALPHAPIXELS ) && bitCount == 32 )
+        {
+            if( masks[0] == 0xff && masks[1] == 0xff00 && masks[2] == 0xff0000 && masks[3] == 0xff000000 )
+                m_format = VK_FORMAT_R8G8B8A8_UNORM;
+            else if( masks[0] == 0xff0000 && masks[1] == 0xff00 && masks[2] == 0xff && masks[3] == 0xff000000 )
+                m_format = VK_FORMAT_B8G8R8A8_UNORM;
+        }
+        else if( ( pixelFlags & DDPF_LUMINANCE ) && bitCount == 8 )
+        {
+            m_format = VK_FORMAT_R8_UNORM;
+        }
+    }
+
+    if( m_format == VK_FORMAT_UNDEFINED || m_width == 0 || m_height == 0 )
+    {
+        throw std::runtime_error("DDS pixel format is not supported");
+    }
+    __checkLimits( layers, faces, maxArrayLayers );
+    m_cube = faces == 6;
+    m_layerCount = layers * faces;
+
+    // every layer ( face ) stores its whole mip chain before the next one starts
+    size_t offset = dataOffset;
+    for( uint32_t layer = 0; layer < m_layerCount; layer++ )
+    {
+        for( uint32_t level = 0; level < m_mipLevels; level++ )
+        {
+            size_t imageSize = __imageSize( level );
+            if( imageSize > m_size - std::min( offset, m_size ) )
+            {
+                throw std::runtime_error("texture container is truncated");
+            }
+            m_regions.push_back( { level, layer, 1, offset, imageSize } );
+            offset += imageSize;
+        }
+    }
+}
+
+void VksTextureContainer::__checkLimits( uint32_t layers, uint32_t faces, uint32_t maxArrayLayers )
+{
+    if( static_cast<uint64_t>( layers ) * faces > maxArrayLayers )
+    {
+        throw std::runtime_error("texture container has more array layers than the device supports");
+    }
+    uint32_t fullChain = 1;
+    for( uint32_t size = std::max( m_width, m_height ); size > 1; size >>= 1 )
+    {
+        fullChain++;
+    }
+    if( m_mipLevels > fullChain )
+    {
+        throw std::runtime_error("texture container has more mip levels than its size allows");
+    }
+}
+
+size_t VksTextureContainer::__imageSize( uint32_t mipLevel ) const
+{
+    uint32_t blockBytes = 0, blockDim = 1;
+    if( !formatBlock( m_format, blockBytes, blockDim ) )
+        return 0;
+    uint32_t width = std::max( m_width >> mipLevel, 1u );
+    uint32_t height = std::max( m_height >> mipLevel, 1u );
+    return static_cast<size_t>( ( width + blockDim - 1 ) / blockDim ) * ( ( height + blockDim - 1 ) / blockDim ) * blockBytes;
+}
+
+std::vector<VkBufferImageCopy> VksTextureContainer::stage( void* dst, size_t& size ) const
+{
+    std::vector<VkBufferImageCopy> copies;
+    copies.reserve( m_regions.size() );
+    size = 0;
+    for( auto& region : m_regions )
+    {
+        // a multiple of every texel block size and of the 4 bytes vkCmdCopyBufferToImage needs
+        size = ( size + 15 ) & ~static_cast<size_t>( 15 );
+
+        VkBufferImageCopy copy = {};
+        copy.bufferOffset = size;
+        copy.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        copy.imageSubresource.mipLevel = region.mipLevel;
+        copy.imageSubresource.baseArrayLayer = region.baseLayer;
+        copy.imageSubresource.layerCount = region.layerCount;
+        copy.imageExtent = { std::max( m_width >> region.mipLevel, 1u ), std::max( m_height >> region.mipLevel, 1u ), 1 };
+        copies.push_back( copy );
+
+        if( dst )
+        {
+            memcpy( static_cast<uint8_t*>( dst ) + size, m_data + region.offset, region.size );
+        }
+        size += region.size;
+    }
+    return copies;
+}
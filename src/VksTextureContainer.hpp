@@ -0,0 +1,98 @@
+//
+//  VksTextureContainer.hpp
+//  Vulkan
+//
+//
+
+#ifndef VksTextureContainer_hpp
+#define VksTextureContainer_hpp
+
+#include <vulkan/vulkan.h>
+#include <memory>
+#include <vector>
+
+// A memory mapped KTX2 or DDS file holding ready to upload texel data: mip chains, array
+// layers, cube faces and block compressed formats. Only the headers are parsed; the
+// payload is read straight from the mapping when it is staged.
+class VksMappedFile;
+class VksTextureContainer
+{
+public:
+    // One copy region: a mip level of layerCount consecutive layers, tightly packed
+    struct Region
+    {
+        uint32_t mipLevel;
+        uint32_t baseLayer;
+        uint32_t layerCount;
+        size_t offset;
+        size_t size;
+    };
+
+    // nullptr when the file is neither KTX2 nor DDS; throws when it is one but can not be
+    // loaded ( truncated, supercompressed, 3D, a format without a Vulkan equivalent, more
+    // layers than maxArrayLayers or more levels than a full mip chain )
+    static std::shared_ptr<VksTextureContainer> open( const char* filePath, uint32_t maxArrayLayers );
+
+    ~VksTextureContainer();
+
+    VkFormat getFormat() const {
+        return m_format;
+    }
+
+    uint32_t getWidth() const {
+        return m_width;
+    }
+
+    uint32_t getHeight() const {
+        return m_height;
+    }
+
+    uint32_t getMipLevels() const {
+        return m_mipLevels;
+    }
+
+    // array layers times faces, the arrayLayers of the image
+    uint32_t getLayerCount() const {
+        return m_layerCount;
+    }
+
+    bool isCube() const {
+        return m_cube;
+    }
+
+    const std::vector<Region>& getRegions() const {
+        return m_regions;
+    }
+
+    const uint8_t* getData() const {
+        return m_data;
+    }
+
+    // Copies every region into dst back to back, each start aligned to 16 bytes, and
+    // returns the copy regions for that layout. Without dst only the size is computed.
+    std::vector<VkBufferImageCopy> stage( void* dst, size_t& size ) const;
+
+private:
+    VksTextureContainer();
+
+    std::shared_ptr<VksMappedFile> m_file;
+    const uint8_t* m_data = nullptr;
+    size_t m_size = 0;
+
+    VkFormat m_format = VK_FORMAT_UNDEFINED;
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+    uint32_t m_mipLevels = 1;
+    uint32_t m_layerCount = 1;
+    bool m_cube = false;
+    std::vector<Region> m_regions;
+
+    void __parseKTX2( uint32_t maxArrayLayers );
+    void __parseDDS( uint32_t maxArrayLayers );
+    // rejects header values vkCreateImage would, before anything is sized from them
+    void __checkLimits( uint32_t layers, uint32_t faces, uint32_t maxArrayLayers );
+    // bytes of one layer of a level, 0 for formats the loader does not know the size of
+    size_t __imageSize( uint32_t mipLevel ) const;
+};
+
+#endif /* VksTextureContainer_hpp */
@@ -0,0 +1,167 @@
+//
+//  VksTextureLoader.cpp
+//  Vulkan
+//
+//
+
+#include "VksTextureLoader.hpp"
+#include "VksTexture.hpp"
+#include "VksUploadContext.hpp"
+#include "VksTrace.hpp"
+
+VksTextureLoader::Request::Request( const std::string& path, const std::shared_ptr<VksUploadContext>& uploadContext )
+    :m_path( path ), m_uploadContext( uploadContext )
+{
+}
+
+bool VksTextureLoader::Request::isReady()
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    if( !m_done ) return false;
+    return m_texture == nullptr || m_uploadContext->isComplete( m_uploadValue );
+}
+
+std::shared_ptr<VksTexture> VksTextureLoader::Request::wait()
+{
+    VKS_TRACE_ZONE( "VksTextureLoader::Request::wait" );
+    std::unique_lock<std::mutex> lock( m_mutex );
+    m_recorded.wait( lock, [this] { return m_done; } );
+    if( m_texture == nullptr )
+    {
+        throw std::runtime_error( m_error );
+    }
+    uint64_t value = m_uploadValue;
+    lock.unlock();
+
+    // the loader submits when its queue drains; flush in case other loads keep it busy
+    if( !m_uploadContext->isComplete( value ) )
+    {
+        m_uploadContext->flush();
+        m_uploadContext->wait( value );
+    }
+    return m_texture;
+}
+
+std::shared_ptr<VksTextureLoader> VksTextureLoader::createTextureLoader( const std::shared_ptr<VksUploadContext>& uploadContext,
+                                                                         uint32_t threadCount )
+{
+    return std::shared_ptr<VksTextureLoader>( new VksTextureLoader( uploadContext, threadCount ) );
+}
+
+VksTextureLoader::VksTextureLoader( const std::shared_ptr<VksUploadContext>& uploadContext, uint32_t threadCount )
+    :m_uploadContext( uploadContext )
+{
+    if( m_uploadContext == nullptr )
+    {
+        m_uploadContext = VksUploadContext::createUploadContext();
+    }
+    if( threadCount == 0 )
+    {
+        uint32_t hardwareThreads = std::thread::hardware_concurrency();
+        threadCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+    }
+
+    for( uint32_t i = 0; i < threadCount; i++ )
+    {
+        m_threads.emplace_back( &VksTextureLoader::__worker, this );
+    }
+}
+
+VksTextureLoader::~VksTextureLoader()
+{
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_stop = true;
+    }
+    m_jobReady.notify_all();
+    for( auto& thread : m_threads )
+    {
+        thread.join();
+    }
+    m_uploadContext->flush();
+}
+
+std::shared_ptr<VksTextureLoader::Request> VksTextureLoader::load( const std::string& path, VkImageUsageFlags usageFlags,
+                                                                   VkImageLayout imageLayout, bool mipmaps, VkFormat format,
+                                                                   const VksSamplerOptions& samplerOptions )
+{
+    std::shared_ptr<Request> request( new Request( path, m_uploadContext ) );
+    {
+        std::lock_guard<std::mutex> lock( m_mutex );
+        m_jobs.push_back( [=] {
+            __decode( request, usageFlags, imageLayout, mipmaps, format, samplerOptions );
+        });
+        m_pending++;
+    }
+    m_jobReady.notify_one();
+    return request;
+}
+
+void VksTextureLoader::waitIdle()
+{
+    VKS_TRACE_ZONE( "VksTextureLoader::waitIdle" );
+    {
+        std::unique_lock<std::mutex> lock( m_mutex );
+        m_idle.wait( lock, [this] { return m_pending == 0; } );
+    }
+    m_uploadContext->wait( m_uploadContext->flush() );
+}
+
+void VksTextureLoader::__worker()
+{
+    while( true )
+    {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock( m_mutex );
+            m_jobReady.wait( lock, [this] { return m_stop || !m_jobs.empty(); } );
+            // queued loads still finish on shutdown, so no Request waits forever
+            if( m_jobs.empty() ) return;
+            job = std::move( m_jobs.front() );
+            m_jobs.pop_front();
+        }
+
+        job();
+
+        bool drained = false;
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            drained = --m_pending == 0;
+        }
+        if( drained )
+        {
+            // the burst is recorded, submit it as one batch
+            m_uploadContext->flush();
+            m_idle.notify_all();
+        }
+    }
+}
+
+void VksTextureLoader::__decode( const std::shared_ptr<Request>& request, VkImageUsageFlags usageFlags, VkImageLayout imageLayout, bool mipmaps,
+                                 VkFormat format, const VksSamplerOptions& samplerOptions )
+{
+    VKS_TRACE_ZONE( "VksTextureLoader::__decode" );
+    std::shared_ptr<VksTexture> texture;
+    std::string error;
+    uint64_t uploadValue = 0;
+
+    try
+    {
+        texture = VksTexture::__createFromFile( request->m_path.c_str(), usageFlags, imageLayout, m_uploadContext.get(), mipmaps, format,
+                                                samplerOptions, &uploadValue );
+    }
+    catch( const std::exception& e )
+    {
+        error = request->m_path + ": " + e.what();
+        texture = nullptr;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock( request->m_mutex );
+        request->m_texture = texture;
+        request->m_error = error;
+        request->m_uploadValue = uploadValue;
+        request->m_done = true;
+    }
+    request->m_recorded.notify_all();
+}
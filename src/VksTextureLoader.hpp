@@ -0,0 +1,97 @@
+//
+//  VksTextureLoader.hpp
+//  Vulkan
+//
+//
+
+#ifndef VksTextureLoader_hpp
+#define VksTextureLoader_hpp
+
+#include "VkEngine.hpp"
+#include "VksSamplerCache.hpp"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+class VksTexture;
+class VksUploadContext;
+
+// Decodes image files on a pool of worker threads and uploads them through one
+// VksUploadContext. Every load returns a Request right away; the decode into staging
+// memory and the recording of the upload run on a worker, and the upload batch is
+// submitted as soon as the queue of pending loads drains, so a burst of loads ends
+// up in a single transfer submission.
+class VksTextureLoader
+{
+public:
+    class Request
+    {
+    public:
+        // Decoded, recorded and the upload batch completed on the GPU; never blocks
+        bool isReady();
+        // Blocks until the texture is usable, throws when the file could not be decoded
+        std::shared_ptr<VksTexture> wait();
+
+        const std::string& getPath() const {
+            return m_path;
+        }
+    private:
+        friend class VksTextureLoader;
+
+        Request( const std::string& path, const std::shared_ptr<VksUploadContext>& uploadContext );
+
+        std::string m_path;
+        std::shared_ptr<VksUploadContext> m_uploadContext;
+        std::mutex m_mutex;
+        std::condition_variable m_recorded;
+        bool m_done = false;
+        std::shared_ptr<VksTexture> m_texture;
+        std::string m_error;
+        uint64_t m_uploadValue = 0;
+    };
+
+    // threadCount 0 uses one thread less than the hardware has, at least one. Without an
+    // upload context the loader creates its own.
+    static std::shared_ptr<VksTextureLoader> createTextureLoader( const std::shared_ptr<VksUploadContext>& uploadContext = nullptr,
+                                                                  uint32_t threadCount = 0 );
+
+    // Finishes the loads already queued
+    ~VksTextureLoader();
+
+    // format takes the same values as VksTexture::createFromFile; BC formats are encoded on
+    // the worker as well, KTX2 and DDS payloads are copied from their mapping there
+    std::shared_ptr<Request> load( const std::string& path, VkImageUsageFlags usageFlags,
+                                   VkImageLayout imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, bool mipmaps = false,
+                                   VkFormat format = VK_FORMAT_R8G8B8A8_UNORM, const VksSamplerOptions& samplerOptions = VksSamplerOptions() );
+
+    // Blocks until every queued load is decoded and its upload has completed
+    void waitIdle();
+
+    uint32_t getThreadCount() const {
+        return static_cast<uint32_t>( m_threads.size() );
+    }
+
+    const std::shared_ptr<VksUploadContext>& getUploadContext() const {
+        return m_uploadContext;
+    }
+private:
+    VksTextureLoader( const std::shared_ptr<VksUploadContext>& uploadContext, uint32_t threadCount );
+
+    std::shared_ptr<VksUploadContext> m_uploadContext;
+    std::vector<std::thread> m_threads;
+    std::deque<std::function<void()>> m_jobs;
+    std::mutex m_mutex;
+    std::condition_variable m_jobReady;
+    std::condition_variable m_idle;
+    // queued plus running jobs
+    uint32_t m_pending = 0;
+    bool m_stop = false;
+
+    void __worker();
+    void __decode( const std::shared_ptr<Request>& request, VkImageUsageFlags usageFlags, VkImageLayout imageLayout, bool mipmaps,
+                   VkFormat format, const VksSamplerOptions& samplerOptions );
+};
+
+#endif /* VksTextureLoader_hpp */
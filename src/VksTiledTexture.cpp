@@ -0,0 +1,469 @@
+//
+//  VksTiledTexture.cpp
+//  Vulkan
+//
+//
+
+#include "VksTiledTexture.hpp"
+#include "VksTexture.hpp"
+#include "VksBuffer.hpp"
+#include "VksMappedFile.hpp"
+#include "VksStagingPool.hpp"
+#include "VksSyncPool.hpp"
+#include "VksTrace.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <unordered_set>
+
+static const char kTiledMagic[8] = { 'V', 'K', 'S', 'T', 'I', 'L', 'E', '1' };
+// magic, width, height, tileSize, format, padded so the tiles start 32 byte aligned
+static const size_t kTiledHeaderSize = 32;
+static const VkFormat kTiledFormat = VK_FORMAT_R8G8B8A8_UNORM;
+
+VksTiledTexture::VksTiledTexture()
+{
+}
+
+VksTiledTexture::~VksTiledTexture()
+{
+    // the view and sampler of the sparse image go first
+    m_texture.reset();
+    if( m_sparseImage != VK_NULL_HANDLE )
+    {
+        vkDestroyImage(m_logicDevice, m_sparseImage, nullptr);
+        m_allocator->freeMemory( m_tileMemory );
+    }
+}
+
+void VksTiledTexture::writeTiledFile(const char *filePath, const uint8_t *rgba, uint32_t width, uint32_t height, uint32_t tileSize)
+{
+    if( width == 0 || height == 0 || tileSize == 0 )
+    {
+        throw std::runtime_error("tiled file needs a non empty image and tile size");
+    }
+    std::ofstream file( filePath, std::ios::binary | std::ios::trunc );
+    if( !file.is_open() )
+    {
+        throw std::runtime_error("fail to open tiled file for writing");
+    }
+
+    uint8_t header[kTiledHeaderSize] = {};
+    uint32_t fields[4] = { width, height, tileSize, static_cast<uint32_t>( kTiledFormat ) };
+    memcpy( header, kTiledMagic, sizeof( kTiledMagic ) );
+    memcpy( header + sizeof( kTiledMagic ), fields, sizeof( fields ) );
+    file.write( reinterpret_cast<const char*>( header ), sizeof( header ) );
+
+    uint32_t tilesX = ( width + tileSize - 1 ) / tileSize;
+    uint32_t tilesY = ( height + tileSize - 1 ) / tileSize;
+    std::vector<uint8_t> row( (size_t)tileSize * 4 );
+    for( uint32_t tileY = 0; tileY < tilesY; tileY++ )
+    {
+        for( uint32_t tileX = 0; tileX < tilesX; tileX++ )
+        {
+            for( uint32_t y = 0; y < tileSize; y++ )
+            {
+                uint32_t sourceY = std::min( tileY * tileSize + y, height - 1 );
+                for( uint32_t x = 0; x < tileSize; x++ )
+                {
+                    uint32_t sourceX = std::min( tileX * tileSize + x, width - 1 );
+                    memcpy( &row[(size_t)x * 4], rgba + ( (size_t)sourceY * width + sourceX ) * 4, 4 );
+                }
+                file.write( reinterpret_cast<const char*>( row.data() ), row.size() );
+            }
+        }
+    }
+    if( !file )
+    {
+        throw std::runtime_error("fail to write tiled file");
+    }
+}
+
+std::shared_ptr<VksTiledTexture> VksTiledTexture::createTiledTexture(const char *filePath, uint32_t cacheTiles, bool allowSparse)
+{
+    VKS_TRACE_ZONE( "VksTiledTexture::createTiledTexture" );
+    std::shared_ptr<VksTiledTexture> texture( new VksTiledTexture() );
+    texture->m_file = VksMappedFile::open( filePath );
+    if( !texture->m_file || texture->m_file->getSize() < kTiledHeaderSize
+        || memcmp( texture->m_file->getData(), kTiledMagic, sizeof( kTiledMagic ) ) != 0 )
+    {
+        throw std::runtime_error("fail to open tiled texture file");
+    }
+
+    uint32_t fields[4];
+    memcpy( fields, texture->m_file->getData() + sizeof( kTiledMagic ), sizeof( fields ) );
+    texture->m_width = fields[0];
+    texture->m_height = fields[1];
+    texture->m_tileSize = fields[2];
+    if( texture->m_width == 0 || texture->m_height == 0 || texture->m_tileSize == 0 || fields[3] != static_cast<uint32_t>( kTiledFormat ) )
+    {
+        throw std::runtime_error("tiled texture file header is not supported");
+    }
+    texture->m_tilesX = ( texture->m_width + texture->m_tileSize - 1 ) / texture->m_tileSize;
+    texture->m_tilesY = ( texture->m_height + texture->m_tileSize - 1 ) / texture->m_tileSize;
+    size_t tileBytes = (size_t)texture->m_tileSize * texture->m_tileSize * 4;
+    if( texture->m_file->getSize() < kTiledHeaderSize + tileBytes * texture->m_tilesX * texture->m_tilesY )
+    {
+        throw std::runtime_error("tiled texture file is truncated");
+    }
+
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(m_physicalDevice, &deviceProperties);
+    if( texture->m_tilesX > deviceProperties.limits.maxImageDimension2D || texture->m_tilesY > deviceProperties.limits.maxImageDimension2D )
+    {
+        throw std::runtime_error("tiled texture has more tiles than the indirection texture can hold");
+    }
+
+    cacheTiles = std::max( cacheTiles, 1u );
+    if( !allowSparse || !texture->__createSparse( cacheTiles ) )
+    {
+        texture->__createAtlas( cacheTiles );
+    }
+    texture->m_freeSlots.resize( texture->m_capacity );
+    for( uint32_t slot = 0; slot < texture->m_capacity; slot++ )
+    {
+        // handed out from the back, slot 0 first
+        texture->m_freeSlots[slot] = texture->m_capacity - 1 - slot;
+    }
+
+    texture->m_indirectionTexture = VksTexture::createEmptyTexture( texture->m_tilesX, texture->m_tilesY, VK_FORMAT_R8G8B8A8_UNORM,
+                                                                    VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                                                    VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT );
+    texture->m_indirection.assign( (size_t)texture->m_tilesX * texture->m_tilesY * 4, 0 );
+    texture->__uploadIndirection( nullptr );
+    return texture;
+}
+
+bool VksTiledTexture::__createSparse(uint32_t cacheTiles)
+{
+    if( !m_enabledFeatures.sparseBinding || !m_enabledFeatures.sparseResidencyImage2D )
+        return false;
+
+    uint32_t queueFamilyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(m_physicalDevice, &queueFamilyCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilies( queueFamilyCount );
+    vkGetPhysicalDeviceQueueFamilyProperties(m_physicalDevice, &queueFamilyCount, queueFamilies.data());
+    if( !( queueFamilies[ m_familyIndices.graphicsFamily.value() ].queueFlags & VK_QUEUE_SPARSE_BINDING_BIT ) )
+        return false;
+
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(m_physicalDevice, &deviceProperties);
+    if( m_width > deviceProperties.limits.maxImageDimension2D || m_height > deviceProperties.limits.maxImageDimension2D )
+        return false;
+
+    VkImageUsageFlags usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    uint32_t propertyCount = 0;
+    vkGetPhysicalDeviceSparseImageFormatProperties(m_physicalDevice, kTiledFormat, VK_IMAGE_TYPE_2D, VK_SAMPLE_COUNT_1_BIT, usage,
+                                                   VK_IMAGE_TILING_OPTIMAL, &propertyCount, nullptr);
+    std::vector<VkSparseImageFormatProperties> formatProperties( propertyCount );
+    vkGetPhysicalDeviceSparseImageFormatProperties(m_physicalDevice, kTiledFormat, VK_IMAGE_TYPE_2D, VK_SAMPLE_COUNT_1_BIT, usage,
+                                                   VK_IMAGE_TILING_OPTIMAL, &propertyCount, formatProperties.data());
+    auto colorProperties = std::find_if( formatProperties.begin(), formatProperties.end(), []( const VkSparseImageFormatProperties& properties ) {
+        return ( properties.aspectMask & VK_IMAGE_ASPECT_COLOR_BIT ) != 0;
+    });
+    if( colorProperties == formatProperties.end() || m_tileSize % colorProperties->imageGranularity.width != 0
+        || m_tileSize % colorProperties->imageGranularity.height != 0 )
+        return false;
+
+    VkImageCreateInfo imageInfo = {};
+    imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageInfo.flags = VK_IMAGE_CREATE_SPARSE_BINDING_BIT | VK_IMAGE_CREATE_SPARSE_RESIDENCY_BIT;
+    imageInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageInfo.format = kTiledFormat;
+    imageInfo.extent = { m_width, m_height, 1 };
+    imageInfo.mipLevels = 1;
+    imageInfo.arrayLayers = 1;
+    imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageInfo.usage = usage;
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VK_CHECK( vkCreateImage(m_logicDevice, &imageInfo, nullptr, &m_sparseImage) )
+
+    uint32_t requirementCount = 0;
+    vkGetImageSparseMemoryRequirements(m_logicDevice, m_sparseImage, &requirementCount, nullptr);
+    std::vector<VkSparseImageMemoryRequirements> requirements( requirementCount );
+    vkGetImageSparseMemoryRequirements(m_logicDevice, m_sparseImage, &requirementCount, requirements.data());
+    bool usable = !requirements.empty();
+    for( auto& requirement : requirements )
+    {
+        // metadata would need binding of its own, a mip tail at level 0 means the image is
+        // too small to tile
+        if( ( requirement.formatProperties.aspectMask & VK_IMAGE_ASPECT_METADATA_BIT ) || requirement.imageMipTailFirstLod == 0 )
+        {
+            usable = false;
+        }
+    }
+    if( !usable )
+    {
+        vkDestroyImage(m_logicDevice, m_sparseImage, nullptr);
+        m_sparseImage = VK_NULL_HANDLE;
+        return false;
+    }
+
+    VkMemoryRequirements memReq;
+    vkGetImageMemoryRequirements(m_logicDevice, m_sparseImage, &memReq);
+    VkDeviceSize tileBytes = (VkDeviceSize)m_tileSize * m_tileSize * 4;
+    m_tileMemorySize = ( tileBytes + memReq.alignment - 1 ) / memReq.alignment * memReq.alignment;
+    // never more tiles than the image has
+    m_capacity = std::min( cacheTiles, m_tilesX * m_tilesY );
+    memReq.size = m_tileMemorySize * m_capacity;
+    m_tileMemory = m_allocator->allocate( memReq, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, false );
+    m_sparse = true;
+
+    m_texture = VksTexture::createFromVkImage( m_sparseImage, m_width, m_height, kTiledFormat, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL );
+    // unbound regions can change layout; later uploads then keep the texels already there
+    m_texture->requireState( VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_ACCESS_SHADER_READ_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT );
+    return true;
+}
+
+void VksTiledTexture::__createAtlas(uint32_t cacheTiles)
+{
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(m_physicalDevice, &deviceProperties);
+    // slot coordinates go through 8 bit indirection channels
+    uint32_t maxSlots = std::min( deviceProperties.limits.maxImageDimension2D / getSlotSize(), 256u );
+    if( maxSlots == 0 )
+    {
+        throw std::runtime_error("tile size is larger than the largest atlas");
+    }
+
+    cacheTiles = std::min( cacheTiles, m_tilesX * m_tilesY );
+    m_slotColumns = std::min( static_cast<uint32_t>( std::ceil( std::sqrt( static_cast<double>( cacheTiles ) ) ) ), maxSlots );
+    uint32_t slotRows = std::min( ( cacheTiles + m_slotColumns - 1 ) / m_slotColumns, maxSlots );
+    m_capacity = std::min( cacheTiles, m_slotColumns * slotRows );
+
+    m_texture = VksTexture::createEmptyTexture( m_slotColumns * getSlotSize(), slotRows * getSlotSize(), kTiledFormat,
+                                                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                                VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT );
+}
+
+std::vector<VksTiledTexture::TileCoord> VksTiledTexture::tilesInRect(VkRect2D rect) const
+{
+    std::vector<TileCoord> tiles;
+    int64_t left = std::max<int64_t>( rect.offset.x, 0 );
+    int64_t top = std::max<int64_t>( rect.offset.y, 0 );
+    int64_t right = std::min<int64_t>( (int64_t)rect.offset.x + rect.extent.width, m_width );
+    int64_t bottom = std::min<int64_t>( (int64_t)rect.offset.y + rect.extent.height, m_height );
+    if( left >= right || top >= bottom )
+        return tiles;
+
+    for( uint32_t tileY = static_cast<uint32_t>( top / m_tileSize ); tileY <= ( bottom - 1 ) / m_tileSize; tileY++ )
+    {
+        for( uint32_t tileX = static_cast<uint32_t>( left / m_tileSize ); tileX <= ( right - 1 ) / m_tileSize; tileX++ )
+        {
+            tiles.push_back( { tileX, tileY } );
+        }
+    }
+    return tiles;
+}
+
+bool VksTiledTexture::isResident(TileCoord tile) const
+{
+    if( tile.x >= m_tilesX || tile.y >= m_tilesY )
+        return false;
+    return m_resident.count( tile.y * m_tilesX + tile.x ) != 0;
+}
+
+uint32_t VksTiledTexture::requestTiles(const std::vector<TileCoord> &tiles, VksUploadContext* uploadContext)
+{
+    VKS_TRACE_ZONE( "VksTiledTexture::requestTiles" );
+    std::vector<uint32_t> missing;
+    std::unordered_set<uint32_t> requested;
+    uint32_t touched = 0;
+    for( auto& tile : tiles )
+    {
+        if( tile.x >= m_tilesX || tile.y >= m_tilesY )
+            continue;
+        uint32_t tileIndex = tile.y * m_tilesX + tile.x;
+        if( !requested.insert( tileIndex ).second )
+            continue;
+
+        m_statistics.requests++;
+        auto resident = m_resident.find( tileIndex );
+        if( resident != m_resident.end() )
+        {
+            m_lru.splice( m_lru.begin(), m_lru, resident->second.lru );
+            m_statistics.hits++;
+            touched++;
+        }
+        else
+        {
+            missing.push_back( tileIndex );
+        }
+    }
+
+    // tiles already touched by this request must not be evicted for the rest of it
+    size_t room = m_capacity - touched;
+    if( missing.size() > room )
+    {
+        m_statistics.dropped += missing.size() - room;
+        missing.resize( room );
+    }
+    if( missing.empty() )
+        return 0;
+
+    VkDeviceSize stageBytes = m_sparse ? (VkDeviceSize)m_tileSize * m_tileSize * 4 : (VkDeviceSize)getSlotSize() * getSlotSize() * 4;
+    auto stagingBuffer = m_stagingPool->acquire( stageBytes * missing.size() );
+    uint8_t* stagingData = static_cast<uint8_t*>( stagingBuffer->getMappedData() );
+
+    std::vector<VkBufferImageCopy> regions( missing.size() );
+    std::vector<VkSparseImageMemoryBind> binds;
+    bool rebinding = false;
+    VkDeviceSize bufferOffset = 0;
+    for( size_t i = 0; i < missing.size(); i++ )
+    {
+        uint32_t slot;
+        if( !m_freeSlots.empty() )
+        {
+            slot = m_freeSlots.back();
+            m_freeSlots.pop_back();
+        }
+        else
+        {
+            uint32_t evicted = m_lru.back();
+            m_lru.pop_back();
+            slot = m_resident[evicted].slot;
+            m_resident.erase( evicted );
+            __setIndirection( evicted, slot, false );
+            if( m_sparse )
+            {
+                binds.push_back( __sparseBind( evicted, slot, false ) );
+                rebinding = true;
+            }
+            m_statistics.evictions++;
+        }
+
+        m_lru.push_front( missing[i] );
+        m_resident[ missing[i] ] = { slot, m_lru.begin() };
+        __setIndirection( missing[i], slot, true );
+        if( m_sparse )
+        {
+            binds.push_back( __sparseBind( missing[i], slot, true ) );
+        }
+        bufferOffset += __stageTile( missing[i], slot, stagingData, bufferOffset, regions[i] );
+    }
+    stagingBuffer->flushMemory( 0, bufferOffset );
+    m_statistics.uploads += missing.size();
+    m_statistics.bytesUploaded += bufferOffset;
+
+    if( m_sparse )
+    {
+        __bindSparse( binds, rebinding );
+    }
+    m_texture->updateTexture( stagingBuffer, regions, uploadContext );
+    __uploadIndirection( uploadContext );
+    return static_cast<uint32_t>( missing.size() );
+}
+
+const uint8_t* VksTiledTexture::__texel(uint32_t x, uint32_t y) const
+{
+    uint32_t tileX = x / m_tileSize, tileY = y / m_tileSize;
+    size_t tile = (size_t)tileY * m_tilesX + tileX;
+    size_t texel = tile * m_tileSize * m_tileSize + (size_t)( y % m_tileSize ) * m_tileSize + ( x % m_tileSize );
+    return m_file->getData() + kTiledHeaderSize + texel * 4;
+}
+
+VkDeviceSize VksTiledTexture::__stageTile(uint32_t tileIndex, uint32_t slot, uint8_t *dst, VkDeviceSize bufferOffset, VkBufferImageCopy &region) const
+{
+    uint32_t tileX = tileIndex % m_tilesX, tileY = tileIndex / m_tilesX;
+    uint32_t originX = tileX * m_tileSize, originY = tileY * m_tileSize;
+    region = {};
+    region.bufferOffset = bufferOffset;
+    region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+
+    if( m_sparse )
+    {
+        // the stored tile as is; its padding past the image edge is skipped by the row pitch
+        size_t tileBytes = (size_t)m_tileSize * m_tileSize * 4;
+        memcpy( dst + bufferOffset, __texel( originX, originY ), tileBytes );
+        region.bufferRowLength = m_tileSize;
+        region.bufferImageHeight = m_tileSize;
+        region.imageOffset = { static_cast<int32_t>( originX ), static_cast<int32_t>( originY ), 0 };
+        region.imageExtent = { std::min( m_tileSize, m_width - originX ), std::min( m_tileSize, m_height - originY ), 1 };
+        return tileBytes;
+    }
+
+    // the tile with a border from its neighbours, clamped at the image edges
+    uint32_t slotSize = getSlotSize();
+    uint8_t* slotData = dst + bufferOffset;
+    for( uint32_t row = 0; row < slotSize; row++ )
+    {
+        int64_t y = std::min<int64_t>( std::max<int64_t>( (int64_t)originY + row - BORDER, 0 ), m_height - 1 );
+        uint8_t* slotRow = slotData + (size_t)row * slotSize * 4;
+        for( uint32_t border = 0; border < BORDER; border++ )
+        {
+            int64_t left = std::max<int64_t>( (int64_t)originX - BORDER + border, 0 );
+            int64_t right = std::min<int64_t>( (int64_t)originX + m_tileSize + border, m_width - 1 );
+            memcpy( slotRow + border * 4, __texel( static_cast<uint32_t>( left ), static_cast<uint32_t>( y ) ), 4 );
+            memcpy( slotRow + ( BORDER + m_tileSize + border ) * 4, __texel( static_cast<uint32_t>( right ), static_cast<uint32_t>( y ) ), 4 );
+        }
+        // a tile row is contiguous in the file and its padding repeats the image edge, so
+        // this also covers the rows taken from the tiles above and below
+        memcpy( slotRow + BORDER * 4, __texel( originX, static_cast<uint32_t>( y ) ), (size_t)m_tileSize * 4 );
+    }
+    region.imageOffset = { static_cast<int32_t>( slot % m_slotColumns * slotSize ), static_cast<int32_t>( slot / m_slotColumns * slotSize ), 0 };
+    region.imageExtent = { slotSize, slotSize, 1 };
+    return (VkDeviceSize)slotSize * slotSize * 4;
+}
+
+VkSparseImageMemoryBind VksTiledTexture::__sparseBind(uint32_t tileIndex, uint32_t slot, bool bind) const
+{
+    uint32_t originX = tileIndex % m_tilesX * m_tileSize, originY = tileIndex / m_tilesX * m_tileSize;
+    VkSparseImageMemoryBind memoryBind = {};
+    memoryBind.subresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0 };
+    memoryBind.offset = { static_cast<int32_t>( originX ), static_cast<int32_t>( originY ), 0 };
+    // edge tiles may end at the image edge instead of a block boundary
+    memoryBind.extent = { std::min( m_tileSize, m_width - originX ), std::min( m_tileSize, m_height - originY ), 1 };
+    memoryBind.memory = bind ? m_tileMemory.memory : VK_NULL_HANDLE;
+    memoryBind.memoryOffset = bind ? m_tileMemory.offset + slot * m_tileMemorySize : 0;
+    return memoryBind;
+}
+
+void VksTiledTexture::__bindSparse(const std::vector<VkSparseImageMemoryBind> &binds, bool rebinding)
+{
+    VKS_TRACE_ZONE( "VksTiledTexture::__bindSparse" );
+    std::lock_guard<std::mutex> lock( _queueMutex( m_graphicsQueue ) );
+    if( rebinding )
+    {
+        vkQueueWaitIdle( m_graphicsQueue );
+    }
+
+    VkSparseImageMemoryBindInfo imageBindInfo = {};
+    imageBindInfo.image = m_sparseImage;
+    imageBindInfo.bindCount = static_cast<uint32_t>( binds.size() );
+    imageBindInfo.pBinds = binds.data();
+
+    VkBindSparseInfo bindInfo = {};
+    bindInfo.sType = VK_STRUCTURE_TYPE_BIND_SPARSE_INFO;
+    bindInfo.imageBindCount = 1;
+    bindInfo.pImageBinds = &imageBindInfo;
+
+    // the copies into the new tiles are submitted after the binding completes
+    VkFence fence = m_syncPool->acquireFence();
+    VK_CHECK( vkQueueBindSparse(m_graphicsQueue, 1, &bindInfo, fence) )
+    VK_CHECK( vkWaitForFences(m_logicDevice, 1, &fence, VK_TRUE, UINT64_MAX) )
+    m_syncPool->releaseFence( fence );
+}
+
+void VksTiledTexture::__setIndirection(uint32_t tileIndex, uint32_t slot, bool resident)
+{
+    uint8_t* entry = &m_indirection[(size_t)tileIndex * 4];
+    entry[0] = resident && !m_sparse ? static_cast<uint8_t>( slot % m_slotColumns ) : 0;
+    entry[1] = resident && !m_sparse ? static_cast<uint8_t>( slot / m_slotColumns ) : 0;
+    entry[2] = 0;
+    entry[3] = resident ? 255 : 0;
+}
+
+void VksTiledTexture::__uploadIndirection(VksUploadContext* uploadContext)
+{
+    // a few bytes per tile, cheaper to send whole than to track dirty texels
+    auto stagingBuffer = m_stagingPool->acquire( m_indirection.size() );
+    stagingBuffer->copyHostDataToBuffer( m_indirection.data(), m_indirection.size() );
+
+    VkBufferImageCopy region = {};
+    region.imageSubresource = { VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 };
+    region.imageExtent = { m_tilesX, m_tilesY, 1 };
+    m_indirectionTexture->updateTexture( stagingBuffer, { region }, uploadContext );
+}
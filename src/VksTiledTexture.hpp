@@ -0,0 +1,162 @@
+//
+//  VksTiledTexture.hpp
+//  Vulkan
+//
+//
+
+#ifndef VksTiledTexture_hpp
+#define VksTiledTexture_hpp
+
+#include "VkEngine.hpp"
+#include "VksAllocator.hpp"
+#include <list>
+#include <unordered_map>
+
+class VksTexture;
+class VksMappedFile;
+class VksUploadContext;
+
+// Streams an RGBA8 image of any size from a memory mapped tiled file ( see writeTiledFile )
+// through a fixed number of VRAM tiles, evicting the least recently requested ones.
+//
+// With sparse residency the tiles are bound into one virtual image of the full size, so the
+// image must fit maxImageDimension2D and the tile size must be a multiple of the sparse
+// block shape. Otherwise tiles live in the slots of an atlas, each with a one texel border
+// copied from its neighbours so bilinear filtering does not bleed between slots.
+//
+// Both modes keep an indirection texture with one RGBA8 texel per tile: rg is the atlas
+// slot column and row ( times 1/255 ), a is 1 when the tile is resident. A shader samples
+// tile t = floor( uv * getTileCount() ); in atlas mode the texel is at
+// ( slot * getSlotSize() + getBorder() + fract( uv * getTileCount() ) * getTileSize() ).
+//
+// Not thread safe; requestTiles submits to the graphics queue.
+class VksTiledTexture : protected VkEngine
+{
+public:
+    static constexpr uint32_t BORDER = 1;
+
+    struct TileCoord
+    {
+        uint32_t x;
+        uint32_t y;
+    };
+
+    struct Statistics
+    {
+        uint64_t requests = 0;
+        uint64_t hits = 0;
+        uint64_t uploads = 0;
+        uint64_t evictions = 0;
+        // misses beyond the cache size in a single request
+        uint64_t dropped = 0;
+        uint64_t bytesUploaded = 0;
+    };
+
+    ~VksTiledTexture();
+
+    // cacheTiles is the VRAM budget in tiles, clamped to what one atlas can hold;
+    // allowSparse false forces the atlas even when sparse residency is available
+    static std::shared_ptr<VksTiledTexture> createTiledTexture( const char* filePath, uint32_t cacheTiles, bool allowSparse = true );
+
+    // Writes rgba ( tightly packed RGBA8 ) in the tiled layout: a 32 byte header, then the
+    // tiles row by row, each tileSize x tileSize texels, edge tiles padded by repeating the
+    // last column / row
+    static void writeTiledFile( const char* filePath, const uint8_t* rgba, uint32_t width, uint32_t height, uint32_t tileSize );
+
+    // Makes the tiles resident and marks them most recently used; tiles outside the image
+    // are ignored. Missing tiles are copied in one batch, on the graphics queue of
+    // uploadContext when one is given, blocking otherwise. Returns the number uploaded.
+    uint32_t requestTiles( const std::vector<TileCoord>& tiles, VksUploadContext* uploadContext = nullptr );
+    // tiles covering the texel rectangle
+    std::vector<TileCoord> tilesInRect( VkRect2D rect ) const;
+    bool isResident( TileCoord tile ) const;
+
+    bool isSparse() const {
+        return m_sparse;
+    }
+
+    // the virtual image when sparse, the atlas otherwise
+    const std::shared_ptr<VksTexture>& getTexture() const {
+        return m_texture;
+    }
+
+    const std::shared_ptr<VksTexture>& getIndirectionTexture() const {
+        return m_indirectionTexture;
+    }
+
+    uint32_t getWidth() const {
+        return m_width;
+    }
+
+    uint32_t getHeight() const {
+        return m_height;
+    }
+
+    uint32_t getTileSize() const {
+        return m_tileSize;
+    }
+
+    VkExtent2D getTileCount() const {
+        return { m_tilesX, m_tilesY };
+    }
+
+    // tile plus border, the pitch of atlas slots
+    uint32_t getSlotSize() const {
+        return m_tileSize + 2 * BORDER;
+    }
+
+    uint32_t getCapacity() const {
+        return m_capacity;
+    }
+
+    Statistics getStatistics() const {
+        return m_statistics;
+    }
+
+private:
+    VksTiledTexture();
+
+    struct Resident
+    {
+        uint32_t slot;
+        std::list<uint32_t>::iterator lru;
+    };
+
+    std::shared_ptr<VksMappedFile> m_file;
+    uint32_t m_width = 0;
+    uint32_t m_height = 0;
+    uint32_t m_tileSize = 0;
+    uint32_t m_tilesX = 0;
+    uint32_t m_tilesY = 0;
+    uint32_t m_capacity = 0;
+    // atlas slots per row
+    uint32_t m_slotColumns = 0;
+
+    bool m_sparse = false;
+    VkImage m_sparseImage = VK_NULL_HANDLE;
+    VksAllocator::Allocation m_tileMemory;
+    VkDeviceSize m_tileMemorySize = 0;
+
+    std::shared_ptr<VksTexture> m_texture;
+    std::shared_ptr<VksTexture> m_indirectionTexture;
+    std::vector<uint8_t> m_indirection;
+
+    // tile indices, most recently requested first
+    std::list<uint32_t> m_lru;
+    std::unordered_map<uint32_t, Resident> m_resident;
+    std::vector<uint32_t> m_freeSlots;
+    Statistics m_statistics;
+
+    bool __createSparse( uint32_t cacheTiles );
+    void __createAtlas( uint32_t cacheTiles );
+    const uint8_t* __texel( uint32_t x, uint32_t y ) const;
+    // the tile in its upload layout: the bare tile when sparse, slot with border otherwise
+    VkDeviceSize __stageTile( uint32_t tileIndex, uint32_t slot, uint8_t* dst, VkDeviceSize bufferOffset, VkBufferImageCopy& region ) const;
+    VkSparseImageMemoryBind __sparseBind( uint32_t tileIndex, uint32_t slot, bool bind ) const;
+    // evicted tiles may still be sampled by submitted work, so rebinding waits for the queue
+    void __bindSparse( const std::vector<VkSparseImageMemoryBind>& binds, bool rebinding );
+    void __setIndirection( uint32_t tileIndex, uint32_t slot, bool resident );
+    void __uploadIndirection( VksUploadContext* uploadContext );
+};
+
+#endif /* VksTiledTexture_hpp */
@@ -0,0 +1,217 @@
+//
+//  VksTimeline.cpp
+//  Vulkan
+//
+//
+
+#include "VksTimeline.hpp"
+#include "VksTrace.hpp"
+
+// the engine targets Vulkan 1.0, so the KHR entry points come from the device
+static PFN_vkWaitSemaphoresKHR s_waitSemaphores = nullptr;
+static PFN_vkGetSemaphoreCounterValueKHR s_getSemaphoreCounterValue = nullptr;
+static PFN_vkQueueSubmit2KHR s_queueSubmit2 = nullptr;
+
+std::shared_ptr<VksTimeline> VksTimeline::createTimeline( VkQueue queue, uint32_t queueFamily )
+{
+    return std::shared_ptr<VksTimeline>( new VksTimeline( queue, queueFamily ) );
+}
+
+VksTimeline::VksTimeline( VkQueue queue, uint32_t queueFamily )
+    :m_semaphore( VK_NULL_HANDLE ), m_queue( queue ), m_queueFamily( queueFamily ), m_submittedValue( 0 )
+{
+    if( !hasTimelineSemaphore() )
+    {
+        throw std::runtime_error("VK_KHR_timeline_semaphore is not enabled");
+    }
+
+    s_waitSemaphores = (PFN_vkWaitSemaphoresKHR) vkGetDeviceProcAddr( m_logicDevice, "vkWaitSemaphoresKHR" );
+    s_getSemaphoreCounterValue = (PFN_vkGetSemaphoreCounterValueKHR) vkGetDeviceProcAddr( m_logicDevice, "vkGetSemaphoreCounterValueKHR" );
+    if( hasSynchronization2() )
+    {
+        s_queueSubmit2 = (PFN_vkQueueSubmit2KHR) vkGetDeviceProcAddr( m_logicDevice, "vkQueueSubmit2KHR" );
+    }
+    if( s_waitSemaphores == nullptr || s_getSemaphoreCounterValue == nullptr )
+    {
+        throw std::runtime_error("failed to load the timeline semaphore functions");
+    }
+
+    VkSemaphoreTypeCreateInfoKHR typeInfo = {};
+    typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR;
+    typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR;
+    typeInfo.initialValue = 0;
+
+    VkSemaphoreCreateInfo createInfo = {};
+    createInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    createInfo.pNext = &typeInfo;
+    VK_CHECK( vkCreateSemaphore( m_logicDevice, &createInfo, nullptr, &m_semaphore ) )
+}
+
+VksTimeline::~VksTimeline()
+{
+    if( m_semaphore != VK_NULL_HANDLE )
+    {
+        vkDestroySemaphore( m_logicDevice, m_semaphore, nullptr );
+    }
+}
+
+uint64_t VksTimeline::submit( const VkCommandBuffer* commandBuffers, uint32_t commandBufferCount,
+                              const SemaphoreValue* waits, uint32_t waitCount,
+                              const VkSemaphore* binarySignals, uint32_t binarySignalCount )
+{
+    if( waitCount > MAX_SUBMIT_SEMAPHORES || binarySignalCount + 1 > MAX_SUBMIT_SEMAPHORES
+        || commandBufferCount > MAX_SUBMIT_COMMAND_BUFFERS )
+    {
+        throw std::runtime_error("too many semaphores or command buffers for one timeline submit");
+    }
+
+    std::lock_guard<std::mutex> lock( m_mutex );
+    uint64_t signalValue = m_submittedValue + 1;
+
+    if( s_queueSubmit2 != nullptr )
+    {
+        VkSemaphoreSubmitInfoKHR waitInfos[ MAX_SUBMIT_SEMAPHORES ];
+        VkSemaphoreSubmitInfoKHR signalInfos[ MAX_SUBMIT_SEMAPHORES ];
+        VkCommandBufferSubmitInfoKHR commandBufferInfos[ MAX_SUBMIT_COMMAND_BUFFERS ];
+
+        for( uint32_t i = 0; i < waitCount; i++ )
+        {
+            waitInfos[i] = {};
+            waitInfos[i].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO_KHR;
+            waitInfos[i].semaphore = waits[i].semaphore;
+            waitInfos[i].value = waits[i].value;
+            // the legacy stage bits keep their values in VkPipelineStageFlags2
+            waitInfos[i].stageMask = waits[i].stage;
+        }
+        for( uint32_t i = 0; i < binarySignalCount; i++ )
+        {
+            signalInfos[i] = {};
+            signalInfos[i].sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO_KHR;
+            signalInfos[i].semaphore = binarySignals[i];
+            signalInfos[i].stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR;
+        }
+        VkSemaphoreSubmitInfoKHR& timelineSignal = signalInfos[ binarySignalCount ];
+        timelineSignal = {};
+        timelineSignal.sType = VK_STRUCTURE_TYPE_SEMAPHORE_SUBMIT_INFO_KHR;
+        timelineSignal.semaphore = m_semaphore;
+        timelineSignal.value = signalValue;
+        timelineSignal.stageMask = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT_KHR;
+
+        for( uint32_t i = 0; i < commandBufferCount; i++ )
+        {
+            commandBufferInfos[i] = {};
+            commandBufferInfos[i].sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO_KHR;
+            commandBufferInfos[i].commandBuffer = commandBuffers[i];
+        }
+
+        VkSubmitInfo2KHR submitInfo = {};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO_2_KHR;
+        submitInfo.waitSemaphoreInfoCount = waitCount;
+        submitInfo.pWaitSemaphoreInfos = waitInfos;
+        submitInfo.commandBufferInfoCount = commandBufferCount;
+        submitInfo.pCommandBufferInfos = commandBufferInfos;
+        submitInfo.signalSemaphoreInfoCount = binarySignalCount + 1;
+        submitInfo.pSignalSemaphoreInfos = signalInfos;
+        std::lock_guard<std::mutex> queueLock( _queueMutex( m_queue ) );
+        VK_CHECK( s_queueSubmit2( m_queue, 1, &submitInfo, VK_NULL_HANDLE ) )
+    }
+    else
+    {
+        VkSemaphore waitSemaphores[ MAX_SUBMIT_SEMAPHORES ];
+        uint64_t waitValues[ MAX_SUBMIT_SEMAPHORES ];
+        VkPipelineStageFlags waitStages[ MAX_SUBMIT_SEMAPHORES ];
+        VkSemaphore signalSemaphores[ MAX_SUBMIT_SEMAPHORES ];
+        // binary semaphores still need an ( ignored ) entry in the value arrays
+        uint64_t signalValues[ MAX_SUBMIT_SEMAPHORES ] = {};
+
+        for( uint32_t i = 0; i < waitCount; i++ )
+        {
+            waitSemaphores[i] = waits[i].semaphore;
+            waitValues[i] = waits[i].value;
+            waitStages[i] = waits[i].stage;
+        }
+        for( uint32_t i = 0; i < binarySignalCount; i++ )
+        {
+            signalSemaphores[i] = binarySignals[i];
+        }
+        signalSemaphores[ binarySignalCount ] = m_semaphore;
+        signalValues[ binarySignalCount ] = signalValue;
+
+        VkTimelineSemaphoreSubmitInfoKHR timelineInfo = {};
+        timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR;
+        timelineInfo.waitSemaphoreValueCount = waitCount;
+        timelineInfo.pWaitSemaphoreValues = waitValues;
+        timelineInfo.signalSemaphoreValueCount = binarySignalCount + 1;
+        timelineInfo.pSignalSemaphoreValues = signalValues;
+
+        VkSubmitInfo submitInfo = {};
+        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        submitInfo.pNext = &timelineInfo;
+        submitInfo.waitSemaphoreCount = waitCount;
+        submitInfo.pWaitSemaphores = waitSemaphores;
+        submitInfo.pWaitDstStageMask = waitStages;
+        submitInfo.commandBufferCount = commandBufferCount;
+        submitInfo.pCommandBuffers = commandBuffers;
+        submitInfo.signalSemaphoreCount = binarySignalCount + 1;
+        submitInfo.pSignalSemaphores = signalSemaphores;
+        std::lock_guard<std::mutex> queueLock( _queueMutex( m_queue ) );
+        VK_CHECK( vkQueueSubmit( m_queue, 1, &submitInfo, VK_NULL_HANDLE ) )
+    }
+
+    m_submittedValue = signalValue;
+    return signalValue;
+}
+
+VksTimeline::SemaphoreValue VksTimeline::waitValue( uint64_t value, VkPipelineStageFlags stage )
+{
+    return { m_semaphore, value, stage };
+}
+
+bool VksTimeline::wait( uint64_t value, uint64_t timeout )
+{
+    if( value == 0 ) return true;
+
+    VKS_TRACE_ZONE( "VksTimeline::wait" );
+    VkSemaphoreWaitInfoKHR waitInfo = {};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &m_semaphore;
+    waitInfo.pValues = &value;
+    VkResult result = s_waitSemaphores( m_logicDevice, &waitInfo, timeout );
+    if( result == VK_TIMEOUT ) return false;
+    VK_CHECK( result )
+    return true;
+}
+
+bool VksTimeline::isComplete( uint64_t value )
+{
+    return getCompletedValue() >= value;
+}
+
+uint64_t VksTimeline::getCompletedValue()
+{
+    uint64_t value = 0;
+    VK_CHECK( s_getSemaphoreCounterValue( m_logicDevice, m_semaphore, &value ) )
+    return value;
+}
+
+uint64_t VksTimeline::getSubmittedValue()
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    return m_submittedValue;
+}
+
+VkSemaphore VksTimeline::getSemaphore()
+{
+    return m_semaphore;
+}
+
+VkQueue VksTimeline::getQueue()
+{
+    return m_queue;
+}
+
+uint32_t VksTimeline::getQueueFamily()
+{
+    return m_queueFamily;
+}
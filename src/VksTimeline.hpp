@@ -0,0 +1,68 @@
+//
+//  VksTimeline.hpp
+//  Vulkan
+//
+//
+
+#ifndef VksTimeline_hpp
+#define VksTimeline_hpp
+
+#include "VkEngine.hpp"
+#include <mutex>
+
+// One timeline semaphore per queue. Every submit signals the next value of the
+// queue, so "this work is done" is a single uint64_t instead of a fence per object,
+// and the CPU waits with vkWaitSemaphores on exactly the value it needs. Submits go
+// through vkQueueSubmit2 when VK_KHR_synchronization2 is enabled, otherwise through
+// vkQueueSubmit with VkTimelineSemaphoreSubmitInfo; neither allocates.
+// The engine creates one per queue when VkEngine::hasTimelineSemaphore() is true.
+class VksTimeline : protected VkEngine
+{
+public:
+    static const uint32_t MAX_SUBMIT_SEMAPHORES = 8;
+    static const uint32_t MAX_SUBMIT_COMMAND_BUFFERS = 8;
+
+    // value is ignored for binary semaphores
+    struct SemaphoreValue
+    {
+        VkSemaphore semaphore;
+        uint64_t value;
+        VkPipelineStageFlags stage;
+    };
+
+    static std::shared_ptr<VksTimeline> createTimeline( VkQueue queue, uint32_t queueFamily );
+
+    ~VksTimeline();
+
+    // Submits the command buffers ( none is fine ) after waits and signals the next value
+    // of this queue together with binarySignals, e.g. a semaphore vkQueuePresentKHR waits on.
+    // Returns the signaled value.
+    uint64_t submit( const VkCommandBuffer* commandBuffers, uint32_t commandBufferCount,
+                     const SemaphoreValue* waits, uint32_t waitCount,
+                     const VkSemaphore* binarySignals = nullptr, uint32_t binarySignalCount = 0 );
+
+    // Wait entry for a submit on another queue that consumes the work up to value
+    SemaphoreValue waitValue( uint64_t value, VkPipelineStageFlags stage );
+
+    // Returns false on timeout
+    bool wait( uint64_t value, uint64_t timeout = UINT64_MAX );
+    bool isComplete( uint64_t value );
+    uint64_t getCompletedValue();
+    // value of the last submit, 0 before the first one
+    uint64_t getSubmittedValue();
+
+    VkSemaphore getSemaphore();
+    VkQueue getQueue();
+    uint32_t getQueueFamily();
+private:
+    VksTimeline( VkQueue queue, uint32_t queueFamily );
+
+    VkSemaphore m_semaphore;
+    VkQueue m_queue;
+    uint32_t m_queueFamily;
+    uint64_t m_submittedValue;
+    // keeps values in submission order when several threads submit to the queue
+    std::mutex m_mutex;
+};
+
+#endif /* VksTimeline_hpp */
@@ -0,0 +1,198 @@
+//
+//  VksTrace.cpp
+//  Vulkan
+//
+//
+
+#include "VksTrace.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <stdio.h>
+
+static const uint32_t kRingSize = 4096;
+
+struct TraceEvent
+{
+    const char* name;
+    uint64_t beginNs;
+    uint64_t endNs;
+};
+
+// single producer ( the owning thread ), single consumer ( flush under s_mutex )
+struct ThreadRing
+{
+    TraceEvent events[ kRingSize ];
+    std::atomic<uint32_t> head{ 0 };
+    std::atomic<uint32_t> tail{ 0 };
+    uint32_t threadId = 0;
+};
+
+struct RecordedEvent
+{
+    std::string name;
+    uint64_t beginNs;
+    uint64_t endNs;
+    uint32_t threadId;
+    bool gpu;
+};
+
+static std::atomic<bool> s_enabled( false );
+static std::atomic<uint64_t> s_dropped( 0 );
+static std::mutex s_mutex;
+// rings outlive their threads, so zones recorded just before a thread exits are kept
+static std::vector<std::shared_ptr<ThreadRing>> s_rings;
+static std::vector<RecordedEvent> s_events;
+
+static ThreadRing* threadRing()
+{
+    thread_local std::shared_ptr<ThreadRing> ring;
+    if( !ring )
+    {
+        ring = std::make_shared<ThreadRing>();
+        std::lock_guard<std::mutex> lock( s_mutex );
+        ring->threadId = static_cast<uint32_t>( s_rings.size() );
+        s_rings.push_back( ring );
+    }
+    return ring.get();
+}
+
+VksTrace::Zone::Zone( const char* name )
+    :m_name( name ), m_begin( 0 )
+{
+    if( s_enabled.load( std::memory_order_relaxed ) )
+    {
+        m_begin = now();
+    }
+}
+
+VksTrace::Zone::~Zone()
+{
+    if( m_begin != 0 )
+    {
+        addCpuEvent( m_name, m_begin, now() );
+    }
+}
+
+void VksTrace::setEnabled( bool enabled )
+{
+    s_enabled.store( enabled );
+}
+
+bool VksTrace::isEnabled()
+{
+    return s_enabled.load( std::memory_order_relaxed );
+}
+
+uint64_t VksTrace::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+void VksTrace::addCpuEvent( const char* name, uint64_t beginNs, uint64_t endNs )
+{
+    ThreadRing* ring = threadRing();
+    uint32_t head = ring->head.load( std::memory_order_relaxed );
+    if( head - ring->tail.load( std::memory_order_acquire ) >= kRingSize )
+    {
+        s_dropped++;
+        return;
+    }
+    ring->events[ head % kRingSize ] = { name, beginNs, endNs };
+    ring->head.store( head + 1, std::memory_order_release );
+}
+
+void VksTrace::addGpuEvent( const std::string& name, uint64_t beginNs, uint64_t endNs, uint32_t queueFamily )
+{
+    // GPU events arrive in batches from VksProfiler::collect, not from hot paths
+    std::lock_guard<std::mutex> lock( s_mutex );
+    s_events.push_back( { name, beginNs, endNs, queueFamily, true } );
+}
+
+void VksTrace::flush()
+{
+    std::lock_guard<std::mutex> lock( s_mutex );
+    for( auto& ring : s_rings )
+    {
+        uint32_t tail = ring->tail.load( std::memory_order_relaxed );
+        uint32_t head = ring->head.load( std::memory_order_acquire );
+        for( ; tail != head; tail++ )
+        {
+            const TraceEvent& event = ring->events[ tail % kRingSize ];
+            s_events.push_back( { event.name, event.beginNs, event.endNs, ring->threadId, false } );
+        }
+        ring->tail.store( tail, std::memory_order_release );
+    }
+}
+
+static void writeJsonString( FILE* file, const std::string& value )
+{
+    fputc( '"', file );
+    for( char c : value )
+    {
+        if( c == '"' || c == '\\' )
+        {
+            fputc( '\\', file );
+            fputc( c, file );
+        }
+        else if( (unsigned char)c < 0x20 )
+        {
+            fprintf( file, "\\u%04x", c );
+        }
+        else
+        {
+            fputc( c, file );
+        }
+    }
+    fputc( '"', file );
+}
+
+bool VksTrace::writeChromeTrace( const std::string& path )
+{
+    flush();
+
+    FILE* file = fopen( path.c_str(), "wb" );
+    if( file == nullptr ) return false;
+
+    std::lock_guard<std::mutex> lock( s_mutex );
+    uint64_t origin = UINT64_MAX;
+    for( auto& event : s_events )
+    {
+        origin = std::min( origin, event.beginNs );
+    }
+
+    fprintf( file, "{\"traceEvents\":[\n" );
+    fprintf( file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"CPU\"}},\n" );
+    fprintf( file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"GPU\"}}" );
+    for( auto& event : s_events )
+    {
+        // complete events, timestamps in microseconds; tid is the queue family for GPU events
+        fprintf( file, ",\n{\"name\":" );
+        writeJsonString( file, event.name );
+        fprintf( file, ",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+                 event.gpu ? 1 : 0, event.threadId,
+                 ( event.beginNs - origin ) / 1000.0,
+                 ( event.endNs > event.beginNs ? event.endNs - event.beginNs : 0 ) / 1000.0 );
+    }
+    fprintf( file, "\n]}\n" );
+
+    bool written = ferror( file ) == 0;
+    fclose( file );
+    return written;
+}
+
+void VksTrace::clear()
+{
+    flush();
+    std::lock_guard<std::mutex> lock( s_mutex );
+    s_events.clear();
+    s_dropped = 0;
+}
+
+uint64_t VksTrace::getDroppedCount()
+{
+    return s_dropped.load();
+}
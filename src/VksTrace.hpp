@@ -0,0 +1,56 @@
+//
+//  VksTrace.hpp
+//  Vulkan
+//
+//
+
+#ifndef VksTrace_hpp
+#define VksTrace_hpp
+
+#include <stdint.h>
+#include <string>
+
+#define VKS_TRACE_CONCAT_( a, b ) a##b
+#define VKS_TRACE_CONCAT( a, b ) VKS_TRACE_CONCAT_( a, b )
+// Times the rest of the enclosing scope; name must be a string literal
+#define VKS_TRACE_ZONE( name ) VksTrace::Zone VKS_TRACE_CONCAT( __vksTraceZone, __LINE__ )( name )
+
+// CPU zones and GPU timestamps on one timeline, written as a Chrome trace event file
+// (chrome://tracing, Perfetto). Every thread records into its own fixed-size ring
+// without locking; flush() drains the rings and zones that do not fit before the
+// next flush are dropped and counted. GPU zones come from VksProfiler, which maps
+// its timestamps onto the CPU clock.
+class VksTrace
+{
+public:
+    class Zone
+    {
+    public:
+        explicit Zone( const char* name );
+        ~Zone();
+    private:
+        const char* m_name;
+        uint64_t m_begin;
+    };
+
+    // Disabled by default, a disabled zone costs one atomic load.
+    static void setEnabled( bool enabled );
+    static bool isEnabled();
+
+    // Nanoseconds of the steady clock all events are measured in
+    static uint64_t now();
+
+    static void addCpuEvent( const char* name, uint64_t beginNs, uint64_t endNs );
+    // GPU events get their own track per queue family
+    static void addGpuEvent( const std::string& name, uint64_t beginNs, uint64_t endNs, uint32_t queueFamily );
+
+    static void flush();
+    // Flushes, then writes every event since the last clear(). Returns false when the
+    // file can not be written.
+    static bool writeChromeTrace( const std::string& path );
+    static void clear();
+
+    static uint64_t getDroppedCount();
+};
+
+#endif /* VksTrace_hpp */
@@ -0,0 +1,267 @@
+//
+//  VksUploadContext.cpp
+//  Vulkan
+//
+//
+
+#include "VksUploadContext.hpp"
+#include "VksCommand.hpp"
+#include "VksBuffer.hpp"
+#include "VksBarrier.hpp"
+#include "VksTrace.hpp"
+#include "VksSyncPool.hpp"
+
+std::shared_ptr<VksUploadContext> VksUploadContext::createUploadContext()
+{
+    return std::shared_ptr<VksUploadContext>( new VksUploadContext() );
+}
+
+VksUploadContext::VksUploadContext()
+{
+    // private pools, so recording never races with the engine's command pools
+    uint32_t graphicsFamily = m_familyIndices.graphicsFamily.value();
+    m_dedicated = m_familyIndices.transferFamily.has_value();
+    m_queueFamily = m_dedicated ? m_familyIndices.transferFamily.value() : graphicsFamily;
+    m_queue = m_dedicated ? m_transferQueue : m_graphicsQueue;
+    
+    m_command = VksCommand::createCommandPool( m_queueFamily );
+    m_graphicsCommand = m_dedicated ? VksCommand::createCommandPool( graphicsFamily ) : m_command;
+}
+
+VksUploadContext::~VksUploadContext()
+{
+    flush();
+    waitIdle();
+
+    m_graphicsCommand.reset();
+    m_command.reset();
+}
+
+void VksUploadContext::__beginCommandBuffer( VkCommandBuffer commandBuffer )
+{
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VK_CHECK( vkBeginCommandBuffer( commandBuffer, &beginInfo ) )
+}
+
+void VksUploadContext::__beginBatch()
+{
+    if( m_recording.commandBuffer != VK_NULL_HANDLE )
+        return;
+
+    m_recording.commandBuffer = m_command->createPrimaryBuffer();
+    m_recording.value = m_nextValue;
+    __beginCommandBuffer( m_recording.commandBuffer );
+    
+    if( !m_dedicated )
+    {
+        m_recording.graphicsCommandBuffer = m_recording.commandBuffer;
+    }
+}
+
+void VksUploadContext::__beginGraphics()
+{
+    __beginBatch();
+    if( m_recording.graphicsCommandBuffer != VK_NULL_HANDLE )
+        return;
+    
+    m_recording.graphicsCommandBuffer = m_graphicsCommand->createPrimaryBuffer();
+    __beginCommandBuffer( m_recording.graphicsCommandBuffer );
+}
+
+uint64_t VksUploadContext::record( const std::function<void( VkCommandBuffer )>& recorder )
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    __beginBatch();
+    recorder( m_recording.commandBuffer );
+    return m_recording.value;
+}
+
+uint64_t VksUploadContext::recordGraphics( const std::function<void( VkCommandBuffer )>& recorder )
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    __beginGraphics();
+    recorder( m_recording.graphicsCommandBuffer );
+    return m_recording.value;
+}
+
+uint64_t VksUploadContext::transferImageOwnership( VkImage image, const VkImageSubresourceRange& range, VkImageLayout newLayout,
+                                                   VkAccessFlags dstAccessMask, VkPipelineStageFlags dstStage )
+{
+    auto barrier = VksBarrier::createQueueTransferBarrier( m_queueFamily, m_familyIndices.graphicsFamily.value(),
+                                                           VK_PIPELINE_STAGE_TRANSFER_BIT, dstStage );
+    barrier->addImageTransfer( image, range, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, newLayout,
+                               VK_ACCESS_TRANSFER_WRITE_BIT, dstAccessMask );
+    
+    std::lock_guard<std::mutex> lock( m_mutex );
+    __beginGraphics();
+    barrier->setReleaseBarrier( m_recording.commandBuffer );
+    barrier->setAcquireBarrier( m_recording.graphicsCommandBuffer );
+    return m_recording.value;
+}
+
+void VksUploadContext::keepAlive( const std::shared_ptr<void>& resource )
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    __beginBatch();
+    m_recording.resources.push_back( resource );
+}
+
+uint64_t VksUploadContext::copyBuffer( const std::shared_ptr<VksBuffer>& srcBuffer, const std::shared_ptr<VksBuffer>& dstBuffer,
+                                       VkDeviceSize srcOffset, VkDeviceSize dstOffset, VkDeviceSize size )
+{
+    if( size == VK_WHOLE_SIZE )
+    {
+        size = srcBuffer->getVkBufferSize() - srcOffset;
+    }
+
+    std::lock_guard<std::mutex> lock( m_mutex );
+    __beginBatch();
+
+    VkBufferCopy copyRegion = {};
+    copyRegion.srcOffset = srcOffset;
+    copyRegion.dstOffset = dstOffset;
+    copyRegion.size = size;
+    vkCmdCopyBuffer( m_recording.commandBuffer, srcBuffer->getVkBuffer(), dstBuffer->getVkBuffer(), 1, &copyRegion );
+
+    m_recording.resources.push_back( srcBuffer );
+    m_recording.resources.push_back( dstBuffer );
+    return m_recording.value;
+}
+
+uint64_t VksUploadContext::copyBufferToImage( const std::shared_ptr<VksBuffer>& srcBuffer, VkImage dstImage, const VkBufferImageCopy& region )
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    __beginBatch();
+
+    vkCmdCopyBufferToImage( m_recording.commandBuffer, srcBuffer->getVkBuffer(), dstImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region );
+
+    m_recording.resources.push_back( srcBuffer );
+    return m_recording.value;
+}
+
+uint64_t VksUploadContext::flush()
+{
+    VKS_TRACE_ZONE( "VksUploadContext::flush" );
+    std::lock_guard<std::mutex> lock( m_mutex );
+    if( m_recording.commandBuffer == VK_NULL_HANDLE )
+    {
+        return m_nextValue - 1;
+    }
+
+    VK_CHECK( vkEndCommandBuffer( m_recording.commandBuffer ) )
+    bool split = m_recording.graphicsCommandBuffer != VK_NULL_HANDLE && m_recording.graphicsCommandBuffer != m_recording.commandBuffer;
+    if( split )
+    {
+        VK_CHECK( vkEndCommandBuffer( m_recording.graphicsCommandBuffer ) )
+    }
+
+    m_recording.fence = m_syncPool->acquireFence();
+
+    VkSubmitInfo submit = {};
+    submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit.commandBufferCount = 1;
+    submit.pCommandBuffers = &m_recording.commandBuffer;
+    
+    // the queue is shared with the render thread and other contexts, so every submit
+    // holds the engine's lock for it
+    if( !split )
+    {
+        std::lock_guard<std::mutex> queueLock( _queueMutex( m_queue ) );
+        VK_CHECK( vkQueueSubmit( m_queue, 1, &submit, m_recording.fence ) )
+    }
+    else
+    {
+        m_recording.semaphore = m_syncPool->acquireSemaphore();
+        
+        submit.signalSemaphoreCount = 1;
+        submit.pSignalSemaphores = &m_recording.semaphore;
+        {
+            std::lock_guard<std::mutex> queueLock( _queueMutex( m_queue ) );
+            VK_CHECK( vkQueueSubmit( m_queue, 1, &submit, VK_NULL_HANDLE ) )
+        }
+        
+        // the graphics part finishes last, so its fence retires the whole batch
+        VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+        VkSubmitInfo graphicsSubmit = {};
+        graphicsSubmit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+        graphicsSubmit.waitSemaphoreCount = 1;
+        graphicsSubmit.pWaitSemaphores = &m_recording.semaphore;
+        graphicsSubmit.pWaitDstStageMask = &waitStage;
+        graphicsSubmit.commandBufferCount = 1;
+        graphicsSubmit.pCommandBuffers = &m_recording.graphicsCommandBuffer;
+        std::lock_guard<std::mutex> queueLock( _queueMutex( m_graphicsQueue ) );
+        VK_CHECK( vkQueueSubmit( m_graphicsQueue, 1, &graphicsSubmit, m_recording.fence ) )
+    }
+
+    uint64_t value = m_recording.value;
+    m_inFlight.push_back( std::move( m_recording ) );
+    m_recording = Batch();
+    m_nextValue++;
+
+    return value;
+}
+
+void VksUploadContext::__retireBatches( bool block, uint64_t value )
+{
+    VKS_TRACE_ZONE( "VksUploadContext::retireBatches" );
+    while( !m_inFlight.empty() )
+    {
+        Batch& batch = m_inFlight.front();
+        if( block && batch.value <= value )
+        {
+            VK_CHECK( vkWaitForFences( m_logicDevice, 1, &batch.fence, VK_TRUE, UINT64_MAX ) )
+        }
+        else if( vkGetFenceStatus( m_logicDevice, batch.fence ) != VK_SUCCESS )
+        {
+            break;
+        }
+
+        m_syncPool->releaseFence( batch.fence );
+        vkFreeCommandBuffers( m_logicDevice, m_command->getCommandPool(), 1, &batch.commandBuffer );
+        if( batch.graphicsCommandBuffer != VK_NULL_HANDLE && batch.graphicsCommandBuffer != batch.commandBuffer )
+        {
+            vkFreeCommandBuffers( m_logicDevice, m_graphicsCommand->getCommandPool(), 1, &batch.graphicsCommandBuffer );
+        }
+        // the graphics submit that waited on it is done as well
+        m_syncPool->releaseSemaphore( batch.semaphore );
+        m_completedValue = batch.value;
+        m_inFlight.pop_front();
+    }
+}
+
+bool VksUploadContext::isComplete( uint64_t value )
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    __retireBatches( false, value );
+    return value <= m_completedValue;
+}
+
+void VksUploadContext::wait( uint64_t value )
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    if( m_recording.commandBuffer != VK_NULL_HANDLE && value >= m_recording.value )
+    {
+        throw std::runtime_error("waiting on an upload batch that was never flushed");
+    }
+    __retireBatches( true, value );
+}
+
+void VksUploadContext::waitIdle()
+{
+    wait( getFlushedValue() );
+}
+
+uint64_t VksUploadContext::getFlushedValue()
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    return m_nextValue - 1;
+}
+
+uint64_t VksUploadContext::getCompletedValue()
+{
+    std::lock_guard<std::mutex> lock( m_mutex );
+    __retireBatches( false, 0 );
+    return m_completedValue;
+}
@@ -0,0 +1,99 @@
+//
+//  VksUploadContext.hpp
+//  Vulkan
+//
+//
+
+#ifndef VksUploadContext_hpp
+#define VksUploadContext_hpp
+
+#include "VkEngine.hpp"
+#include <functional>
+#include <mutex>
+#include <deque>
+
+class VksCommand;
+class VksBuffer;
+
+// Records staging copies and layout transitions from any number of callers into one
+// command buffer and submits them as a single batch. Every recorded piece of work
+// belongs to a batch value; flush() submits the batch and returns its value without
+// waiting, isComplete()/wait() tell when the GPU is done with it.
+//
+// On devices with a dedicated transfer family, record() goes to the transfer queue and
+// recordGraphics() to a graphics command buffer that waits on it, so uploads overlap
+// with rendering. Images written by record() are handed over with transferImageOwnership().
+//
+// Thread safe; flush() may run on any thread, its submits hold the engine's queue lock.
+class VksUploadContext : protected VkEngine
+{
+public:
+    static std::shared_ptr<VksUploadContext> createUploadContext();
+
+    ~VksUploadContext();
+
+    // Runs recorder on the command buffer of the batch being recorded and returns the
+    // value that batch will complete with. Only transfer commands are allowed here.
+    uint64_t record( const std::function<void( VkCommandBuffer )>& recorder );
+    // Same, but for work that needs the graphics queue; it runs after the batch's transfers.
+    uint64_t recordGraphics( const std::function<void( VkCommandBuffer )>& recorder );
+
+    // Moves an image left in TRANSFER_DST_OPTIMAL by record() to newLayout on the graphics
+    // queue, releasing and acquiring queue family ownership when needed.
+    uint64_t transferImageOwnership( VkImage image, const VkImageSubresourceRange& range, VkImageLayout newLayout,
+                                     VkAccessFlags dstAccessMask, VkPipelineStageFlags dstStage );
+
+    uint32_t getQueueFamily() const {
+        return m_queueFamily;
+    }
+
+    // Holds a resource (typically a staging buffer) until the current batch completes.
+    void keepAlive( const std::shared_ptr<void>& resource );
+
+    uint64_t copyBuffer( const std::shared_ptr<VksBuffer>& srcBuffer, const std::shared_ptr<VksBuffer>& dstBuffer,
+                         VkDeviceSize srcOffset = 0, VkDeviceSize dstOffset = 0, VkDeviceSize size = VK_WHOLE_SIZE );
+    uint64_t copyBufferToImage( const std::shared_ptr<VksBuffer>& srcBuffer, VkImage dstImage, const VkBufferImageCopy& region );
+
+    // Submits the recorded batch. Returns the value of the last submitted batch when
+    // nothing was recorded since the previous flush.
+    uint64_t flush();
+
+    bool isComplete( uint64_t value );
+    void wait( uint64_t value );
+    void waitIdle();
+
+    uint64_t getCompletedValue();
+    // Value of the last submitted batch; anything recorded later waits for the next flush()
+    uint64_t getFlushedValue();
+
+private:
+    struct Batch
+    {
+        VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+        VkCommandBuffer graphicsCommandBuffer = VK_NULL_HANDLE;
+        VkSemaphore semaphore = VK_NULL_HANDLE;
+        VkFence fence = VK_NULL_HANDLE;
+        uint64_t value = 0;
+        std::vector<std::shared_ptr<void>> resources;
+    };
+
+    VksUploadContext();
+
+    std::shared_ptr<VksCommand> m_command;
+    std::shared_ptr<VksCommand> m_graphicsCommand;
+    VkQueue m_queue;
+    uint32_t m_queueFamily;
+    bool m_dedicated;
+    std::mutex m_mutex;
+    Batch m_recording;
+    std::deque<Batch> m_inFlight;
+    uint64_t m_nextValue = 1;
+    uint64_t m_completedValue = 0;
+
+    void __beginBatch();
+    void __beginGraphics();
+    void __beginCommandBuffer( VkCommandBuffer commandBuffer );
+    void __retireBatches( bool block, uint64_t value );
+};
+
+#endif /* VksUploadContext_hpp */
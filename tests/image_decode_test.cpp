@@ -0,0 +1,239 @@
+//
+//  image_decode_test.cpp
+//  Vulkan
+//
+//  Encodes synthetic PNGs in every 8 bit color type with lodepng, decodes them with
+//  VksImageDecode into padded rows and compares against stb_image. Formats the row path
+//  does not take, the photo and corrupt files must go through stb_image or throw. Needs
+//  no device.
+//
+
+#include "VksImageDecode.hpp"
+#include "lodepng.h"
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+static bool s_passed = true;
+
+static void expect( bool condition, const std::string& what )
+{
+    printf( "%s %s\n", condition ? "ok  " : "FAIL", what.c_str() );
+    s_passed &= condition;
+}
+
+struct Decoded
+{
+    bool inPlace = false;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    size_t rowPitch = 0;
+    std::vector<uint8_t> rows;
+};
+
+static Decoded decode( const std::vector<uint8_t>& file, size_t rowAlignment )
+{
+    Decoded decoded;
+    decoded.inPlace = VksImageDecode::decode( file.data(), file.size(), rowAlignment, [&]( uint32_t width, uint32_t height, size_t rowPitch ) {
+        decoded.width = width;
+        decoded.height = height;
+        decoded.rowPitch = rowPitch;
+        // garbage, so padding that is not written shows up
+        decoded.rows.assign( rowPitch * height, 0xcd );
+        return decoded.rows.data();
+    });
+    return decoded;
+}
+
+// the decoded rows hold what stb_image makes of the file, and zeroed padding
+static bool matchesSTB( const std::vector<uint8_t>& file, const Decoded& decoded )
+{
+    int width = 0, height = 0, channels = 0;
+    stbi_uc* pixels = stbi_load_from_memory( file.data(), static_cast<int>( file.size() ), &width, &height, &channels, STBI_rgb_alpha );
+    if( pixels == nullptr ) return false;
+    bool same = decoded.width == uint32_t( width ) && decoded.height == uint32_t( height ) && decoded.rowPitch % 4 == 0
+        && decoded.rowPitch >= size_t( width ) * 4;
+    for( int y = 0; same && y < height; y++ )
+    {
+        const uint8_t* row = decoded.rows.data() + y * decoded.rowPitch;
+        same = memcmp( row, pixels + size_t( y ) * width * 4, size_t( width ) * 4 ) == 0;
+        for( size_t x = size_t( width ) * 4; same && x < decoded.rowPitch; x++ )
+        {
+            same = row[x] == 0;
+        }
+    }
+    stbi_image_free( pixels );
+    return same;
+}
+
+// samples in the PNG's own layout, with every filter type showing up in the encoder's choice
+static std::vector<uint8_t> syntheticSamples( uint32_t width, uint32_t height, uint32_t channels, uint32_t bytesPerSample )
+{
+    std::vector<uint8_t> samples( size_t( width ) * height * channels * bytesPerSample );
+    uint32_t seed = 777;
+    for( size_t i = 0; i < samples.size(); i++ )
+    {
+        size_t texel = i / ( channels * bytesPerSample );
+        uint32_t x = static_cast<uint32_t>( texel % width ), y = static_cast<uint32_t>( texel / width );
+        seed = seed * 1664525u + 1013904223u;
+        // smooth areas and noisy ones
+        samples[i] = static_cast<uint8_t>( y < height / 2 ? x * 3 + y * 5 + i % channels * 40 : seed >> 24 );
+    }
+    return samples;
+}
+
+static std::vector<uint8_t> encode( const std::vector<uint8_t>& samples, uint32_t width, uint32_t height, LodePNGColorType colorType,
+                                    uint32_t bitDepth, bool interlaced, bool colorKey, uint32_t paletteSize = 0 )
+{
+    LodePNGState state;
+    lodepng_state_init( &state );
+    state.encoder.auto_convert = 0;
+    state.info_raw.colortype = colorType;
+    state.info_raw.bitdepth = bitDepth;
+    state.info_png.color.colortype = colorType;
+    state.info_png.color.bitdepth = bitDepth;
+    state.info_png.interlace_method = interlaced ? 1 : 0;
+    for( uint32_t i = 0; i < paletteSize; i++ )
+    {
+        unsigned char alpha = static_cast<unsigned char>( i % 3 == 0 ? 255 : i * 7 );
+        lodepng_palette_add( &state.info_raw, i * 5, 255 - i, i * 11, alpha );
+        lodepng_palette_add( &state.info_png.color, i * 5, 255 - i, i * 11, alpha );
+    }
+    if( colorKey )
+    {
+        // the first sample of the image, so some texels turn transparent
+        state.info_png.color.key_defined = 1;
+        state.info_png.color.key_r = samples[0];
+        state.info_png.color.key_g = colorType == LCT_RGB ? samples[1] : samples[0];
+        state.info_png.color.key_b = colorType == LCT_RGB ? samples[2] : samples[0];
+        state.info_raw.key_defined = state.info_png.color.key_defined;
+        state.info_raw.key_r = state.info_png.color.key_r;
+        state.info_raw.key_g = state.info_png.color.key_g;
+        state.info_raw.key_b = state.info_png.color.key_b;
+    }
+
+    unsigned char* png = nullptr;
+    size_t pngSize = 0;
+    unsigned error = lodepng_encode( &png, &pngSize, samples.data(), width, height, &state );
+    lodepng_state_cleanup( &state );
+    if( error )
+    {
+        throw std::runtime_error( lodepng_error_text( error ) );
+    }
+    std::vector<uint8_t> file( png, png + pngSize );
+    free( png );
+    return file;
+}
+
+struct PNGCase
+{
+    const char* name;
+    LodePNGColorType colorType;
+    uint32_t channels;
+    uint32_t bitDepth;
+    bool interlaced;
+    bool colorKey;
+    // decoded into the rows rather than copied from stb_image
+    bool inPlace;
+};
+
+static const PNGCase pngCases[] = {
+    { "gray", LCT_GREY, 1, 8, false, false, true },
+    { "gray keyed", LCT_GREY, 1, 8, false, true, true },
+    { "rgb", LCT_RGB, 3, 8, false, false, true },
+    { "rgb keyed", LCT_RGB, 3, 8, false, true, true },
+    { "palette", LCT_PALETTE, 1, 8, false, false, true },
+    { "gray alpha", LCT_GREY_ALPHA, 2, 8, false, false, true },
+    { "rgba", LCT_RGBA, 4, 8, false, false, true },
+    { "rgba 16 bit", LCT_RGBA, 4, 16, false, false, false },
+    { "rgba interlaced", LCT_RGBA, 4, 8, true, false, false },
+};
+
+static std::vector<uint8_t> readFile( const char* path )
+{
+    std::ifstream file( path, std::ios::binary | std::ios::ate );
+    if( !file ) return {};
+    std::vector<uint8_t> data( static_cast<size_t>( file.tellg() ) );
+    file.seekg( 0 );
+    file.read( reinterpret_cast<char*>( data.data() ), data.size() );
+    return data;
+}
+
+static bool throws( const std::vector<uint8_t>& file )
+{
+    try
+    {
+        decode( file, 1 );
+    }
+    catch( const std::exception& )
+    {
+        return true;
+    }
+    return false;
+}
+
+int main( int argc, char** argv )
+{
+    if( argc < 2 )
+    {
+        printf( "usage: %s <image>\n", argv[0] );
+        return 1;
+    }
+
+    static const uint32_t sizes[][2] = { { 1, 1 }, { 3, 5 }, { 257, 130 } };
+    static const size_t alignments[] = { 1, 256 };
+
+    for( const PNGCase& pngCase : pngCases )
+    {
+        for( auto& size : sizes )
+        {
+            uint32_t paletteSize = pngCase.colorType == LCT_PALETTE ? 200 : 0;
+            auto samples = syntheticSamples( size[0], size[1], pngCase.channels, pngCase.bitDepth / 8 );
+            if( paletteSize )
+            {
+                for( auto& sample : samples ) sample %= paletteSize;
+            }
+            auto file = encode( samples, size[0], size[1], pngCase.colorType, pngCase.bitDepth, pngCase.interlaced, pngCase.colorKey,
+                                paletteSize );
+            for( size_t alignment : alignments )
+            {
+                Decoded decoded = decode( file, alignment );
+                std::string what = std::string( pngCase.name ) + " " + std::to_string( size[0] ) + "x" + std::to_string( size[1] )
+                    + " pitch " + std::to_string( decoded.rowPitch );
+                expect( decoded.inPlace == pngCase.inPlace, what + ( pngCase.inPlace ? " decodes in place" : " goes through stb_image" ) );
+                expect( matchesSTB( file, decoded ), what + " matches stb_image" );
+            }
+        }
+    }
+
+    auto photo = readFile( argv[1] );
+    expect( !photo.empty(), std::string( "read " ) + argv[1] );
+    if( !photo.empty() )
+    {
+        Decoded decoded = decode( photo, 256 );
+        expect( !decoded.inPlace && matchesSTB( photo, decoded ), "photo goes through stb_image with padded rows" );
+    }
+
+    auto rgba = encode( syntheticSamples( 16, 16, 4, 1 ), 16, 16, LCT_RGBA, 8, false, false );
+    // a chunk length past the end of the file
+    auto badLength = rgba;
+    badLength[ 33 + 3 ] = 0xff;
+    badLength[ 33 ] = 0x7f;
+    expect( throws( badLength ), "chunk running past the end throws" );
+    // cut inside the image data
+    auto truncated = std::vector<uint8_t>( rgba.begin(), rgba.begin() + 33 + 12 + 20 );
+    expect( throws( truncated ), "truncated image data throws" );
+    // the header alone
+    auto header = std::vector<uint8_t>( rgba.begin(), rgba.begin() + 33 );
+    expect( throws( header ), "PNG without image data throws" );
+    std::vector<uint8_t> notAnImage( 64, 0x42 );
+    expect( throws( notAnImage ), "random bytes throw" );
+
+    return s_passed ? 0 : 1;
+}
@@ -0,0 +1,121 @@
+//
+//  spirv_reflect_test.cpp
+//  Vulkan
+//
+//  Reflects the checked-in shaders with VksSpirvReflect and checks their descriptor
+//  layouts and compute local sizes, then feeds it corrupt modules. Needs no device.
+//
+
+#include "VksSpirvReflect.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+static bool s_passed = true;
+
+static void expect( bool condition, const std::string& what )
+{
+    printf( "%s %s\n", condition ? "ok  " : "FAIL", what.c_str() );
+    s_passed &= condition;
+}
+
+static std::vector<char> readFile( const std::string& path )
+{
+    std::ifstream file( path, std::ios::binary | std::ios::ate );
+    if( !file ) return {};
+    std::vector<char> code( static_cast<size_t>( file.tellg() ) );
+    file.seekg( 0 );
+    file.read( code.data(), code.size() );
+    return code;
+}
+
+static VksSpirvReflect reflectFile( const std::string& directory, const char* name )
+{
+    VksSpirvReflect reflection;
+    reflection.reflect( readFile( directory + "/" + name ) );
+    expect( reflection.isValid(), std::string( name ) + " reflects " + reflection.getError() );
+    return reflection;
+}
+
+static void expectBinding( const VksSpirvReflect& reflection, const char* name, size_t index, uint32_t set, uint32_t binding,
+                           VkDescriptorType type, VkShaderStageFlags stageFlags )
+{
+    const std::vector<VksSpirvReflect::Binding>& bindings = reflection.getBindings();
+    bool found = index < bindings.size() && bindings[index].set == set && bindings[index].binding == binding &&
+                 bindings[index].type == type && bindings[index].count == 1 && bindings[index].stageFlags == stageFlags;
+    expect( found, std::string( name ) + " binding " + std::to_string( set ) + "." + std::to_string( binding ) );
+}
+
+static void checkCompute( const std::string& directory, const char* name, uint32_t localX, uint32_t localY )
+{
+    VksSpirvReflect reflection = reflectFile( directory, name );
+    expect( reflection.getStageFlags() == VK_SHADER_STAGE_COMPUTE_BIT, std::string( name ) + " is a compute stage" );
+    expect( reflection.getBindings().size() == 2 && reflection.getSetCount() == 1, std::string( name ) + " has two bindings in one set" );
+    expectBinding( reflection, name, 0, 0, 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT );
+    expectBinding( reflection, name, 1, 0, 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_SHADER_STAGE_COMPUTE_BIT );
+    const std::array<uint32_t, 3>& localSize = reflection.getLocalSize();
+    expect( localSize[0] == localX && localSize[1] == localY && localSize[2] == 1, std::string( name ) + " local size" );
+}
+
+// a uniform buffer at binding 0 in the vertex stage, a sampler at binding 1 in the fragment stage
+static void checkGraphics( const std::string& directory, const char* vertexName, const char* fragmentName )
+{
+    VksSpirvReflect vertex = reflectFile( directory, vertexName );
+    VksSpirvReflect fragment = reflectFile( directory, fragmentName );
+    expect( vertex.getStageFlags() == VK_SHADER_STAGE_VERTEX_BIT, std::string( vertexName ) + " is a vertex stage" );
+    expect( fragment.getStageFlags() == VK_SHADER_STAGE_FRAGMENT_BIT, std::string( fragmentName ) + " is a fragment stage" );
+    expect( vertex.getLocalSize()[0] == 0, std::string( vertexName ) + " has no local size" );
+
+    expect( vertex.merge( fragment ), std::string( vertexName ) + " merges with " + fragmentName );
+    expect( vertex.getBindings().size() == 2, "merged stages have two bindings" );
+    expectBinding( vertex, vertexName, 0, 0, 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, VK_SHADER_STAGE_VERTEX_BIT );
+    expectBinding( vertex, fragmentName, 1, 0, 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_SHADER_STAGE_FRAGMENT_BIT );
+}
+
+static void checkCorrupt( const std::string& directory )
+{
+    std::vector<char> code = readFile( directory + "/edgedetect.comp.spv" );
+    std::vector<uint32_t> words( code.size() / 4 );
+    memcpy( words.data(), code.data(), words.size() * 4 );
+
+    VksSpirvReflect reflection;
+    std::vector<uint32_t> corrupt = words;
+    corrupt[3] = 0xffffffffu;
+    expect( !reflection.reflect( corrupt.data(), corrupt.size() ), "huge id bound is rejected" );
+
+    corrupt = words;
+    corrupt[0] = 0;
+    expect( !reflection.reflect( corrupt.data(), corrupt.size() ), "bad magic is rejected" );
+
+    // cut inside the first instruction longer than two words
+    size_t cut = 5;
+    while( cut < words.size() && ( words[cut] >> 16 ) > 0 && ( words[cut] >> 16 ) < 3 )
+    {
+        cut += words[cut] >> 16;
+    }
+    expect( !reflection.reflect( words.data(), cut + 2 ), "module ending inside an instruction is rejected" );
+    expect( !reflection.reflect( words.data(), 3 ), "header only module is rejected" );
+}
+
+int main( int argc, char** argv )
+{
+    if( argc < 2 )
+    {
+        printf( "usage: %s <shader directory>\n", argv[0] );
+        return 1;
+    }
+    std::string directory = argv[1];
+
+    checkCompute( directory, "edgedetect.comp.spv", 16, 16 );
+    checkCompute( directory, "mipdownsample.comp.spv", 8, 8 );
+    checkGraphics( directory, "textureVert.spv", "textureFrag.spv" );
+    checkGraphics( directory, "offscreenVert.spv", "offscreenFrag.spv" );
+
+    VksSpirvReflect simple = reflectFile( directory, "simpleFrag.spv" );
+    expect( simple.getBindings().empty() && simple.getSetCount() == 0, "simpleFrag.spv has no bindings" );
+
+    checkCorrupt( directory );
+    return s_passed ? 0 : 1;
+}